@@ -32,6 +32,7 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 	// Init any globals not in "struct g" that need it:
 	g_hInstance = hInstance;
 	InitializeCriticalSection(&g_CriticalRegExCache); // v1.0.45.04: Must be done early so that it's unconditional, so that DeleteCriticalSection() in the script destructor can also be unconditional (deleting when never initialized can crash, at least on Win 9x).
+	WindowSnapshot::Init(); // Must be done before any hotkey criterion can be checked.
 
 	if (!GetCurrentDirectory(sizeof(g_WorkingDir), g_WorkingDir)) // Needed for the FileSelectFile() workaround.
 		*g_WorkingDir = '\0';
@@ -244,6 +245,7 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 	// to return early due to an error have passed, above.
 	if (g_script.CreateWindows() != OK)
 		return CRITICAL_ERROR;
+	WindowSnapshot::StartWatching(); // Done here because it must be done by the main thread, whose message loop receives the events.
 
 	// At this point, it is nearly certain that the script will be executed.
 
@@ -58,6 +58,7 @@ int WINAPI OldWinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmd
 	g_hInstance = hInstance;
 	// MsgBox((UINT)g_hInstance);
 	InitializeCriticalSection(&g_CriticalRegExCache); // v1.0.45.04: Must be done early so that it's unconditional, so that DeleteCriticalSection() in the script destructor can also be unconditional (deleting when never initialized can crash, at least on Win 9x).
+	WindowSnapshot::Init(); // Must be done before any hotkey criterion can be checked.
 
 	if (!GetCurrentDirectory(sizeof(g_WorkingDir), g_WorkingDir)) // Needed for the FileSelectFile() workaround.
 		*g_WorkingDir = '\0';
@@ -242,6 +243,7 @@ param = nameHinstanceP.argv ; // Naveen: v6.1 Script options in nameHinstanceP.n
 	// to return early due to an error have passed, above.
 	if (g_script.CreateWindows() != OK)
 		return CRITICAL_ERROR;
+	WindowSnapshot::StartWatching(); // Done here because it must be done by the main thread, whose message loop receives the events.
 
 	// At this point, it is nearly certain that the script will be executed.
 
@@ -335,6 +337,9 @@ unsigned __stdcall runScript( void* pArguments )
 }
 
 // Naveen: v1. ahkdll() - load AutoHotkey script into dll
+// Unlike the fragments loaded by addFile(), the script run by ahkdll() has no SimpleHeap arena of its own:
+// it uses SimpleHeap::sMain, which is never freed, since there is only one g_script per loaded copy of the
+// DLL and nothing resets it (ExitApp ends the process; see Script::TerminateApp).
 // Naveen: v3. ahkdll(script, single command line option, script parameters)
 // options such as /Debug are supported, see Lexikos' Debugger
 EXPORT int ahkdll(char *fileName, char *argv, char *args)
@@ -19,12 +19,54 @@ GNU General Public License for more details.
 #include "globaldata.h" // for g_script, so that errors can be centrally reported here.
 
 // Static member data:
-SimpleHeap *SimpleHeap::sFirst = NULL;
-SimpleHeap *SimpleHeap::sLast  = NULL;
-char *SimpleHeap::sMostRecentlyAllocated = NULL;
-UINT SimpleHeap::sBlockCount = 0;
+SimpleHeap *SimpleHeap::sFirstArena = NULL;
+SimpleHeap *SimpleHeap::sLastArena = NULL;
+volatile LONG SimpleHeap::sArenaListLock = 0;
+DWORD SimpleHeap::sTlsIndex = TLS_OUT_OF_INDEXES; // Allocated upon first use of SetCurrent().
+SimpleHeap SimpleHeap::sMain; // Must be defined after the above so that it's constructed after they are initialized.
 
-char *SimpleHeap::Malloc(char *aBuf, size_t aLength)
+
+
+SimpleHeap::SimpleHeap()
+	: mFirst(NULL), mLast(NULL), mBlockCount(0), mNextArena(NULL)
+// Blocks are created only upon first use because some arenas (such as that of a script fragment
+// consisting only of hotkeys that are later removed) might never be used.
+{
+	LockArenaList();
+	if (sLastArena)
+		sLastArena->mNextArena = this;
+	else
+		sFirstArena = this;
+	sLastArena = this;
+	UnlockArenaList();
+}
+
+
+
+SimpleHeap::~SimpleHeap()
+// Frees all of the arena's memory.  Caller must ensure that nothing still refers to it and that no
+// other thread is using the arena.  sMain is never destroyed until the program exits, at which time
+// the OS would reclaim its memory anyway.
+{
+	LockArenaList();
+	SimpleHeap *prev = NULL, *arena;
+	for (arena = sFirstArena; arena && arena != this; prev = arena, arena = arena->mNextArena);
+	if (arena) // Should always be true.
+	{
+		if (prev)
+			prev->mNextArena = mNextArena;
+		else
+			sFirstArena = mNextArena;
+		if (sLastArena == this)
+			sLastArena = prev;
+	}
+	UnlockArenaList();
+	DestroyBlocks(mFirst);
+}
+
+
+
+char *SimpleHeap::Alloc(char *aBuf, size_t aLength)
 // v1.0.44.14: Added aLength to improve performance in cases where callers already know the length.
 // If aLength is at its default of -1, the length will be calculated here.
 // Caller must ensture that aBuf isn't NULL.
@@ -34,7 +76,7 @@ char *SimpleHeap::Malloc(char *aBuf, size_t aLength)
 	if (aLength == -1) // Caller wanted us to calculate it.  Compare directly to -1 since aLength is unsigned.
 		aLength = strlen(aBuf);
 	char *new_buf;
-	if (   !(new_buf = SimpleHeap::Malloc(aLength + 1))   ) // +1 for the zero terminator.
+	if (   !(new_buf = Alloc(aLength + 1))   ) // +1 for the zero terminator.
 	{
 		g_script.ScriptError(ERR_OUTOFMEM, aBuf);
 		return NULL; // Callers may rely on NULL vs. "" being returned in the event of failure.
@@ -45,7 +87,7 @@ char *SimpleHeap::Malloc(char *aBuf, size_t aLength)
 
 
 
-char *SimpleHeap::Malloc(size_t aSize)
+char *SimpleHeap::Alloc(size_t aSize)
 // Seems okay to return char* for convenience, since that's the type most often used.
 // This could be made more memory efficient by searching old blocks for sufficient
 // free space to handle <size> prior to creating a new block.  But the whole point
@@ -55,16 +97,12 @@ char *SimpleHeap::Malloc(size_t aSize)
 // seems like a bad trade-off compared to the performance impact of traversing a
 // potentially large linked list or maintaining and traversing an array of
 // "under-utilized" blocks.
+// This is lock-free: each step below either claims space with a single compare-and-swap or
+// retries because another thread got there first.  Since the retry can only happen because
+// some other thread made progress, no thread can be held up indefinitely by one that is suspended.
 {
 	if (aSize < 1 || aSize > BLOCK_SIZE)
 		return NULL;
-	if (!sFirst) // We need at least one block to do anything, so create it.
-		if (   !(sFirst = CreateBlock())   )
-			return NULL;
-	if (aSize > sLast->mSpaceAvailable)
-		if (   !(sLast->mNextBlock = CreateBlock())   )
-			return NULL;
-	sMostRecentlyAllocated = sLast->mFreeMarker; // THIS IS NOW THE NEWLY ALLOCATED BLOCK FOR THE CALLER, which is 32-bit aligned because the previous call to this function (i.e. the logic below) set it up that way.
 	// v1.0.40.04: Set up the NEXT chunk to be aligned on a 32-bit boundary (the first chunk in each block
 	// should always be aligned since the block's address came from malloc()).  On average, this change
 	// "wastes" only 1.5 bytes per chunk. In a 200 KB script of typical contents, this change requires less
@@ -74,91 +112,185 @@ char *SimpleHeap::Malloc(size_t aSize)
 	// 2) May solve other obscure issues (past and future), which improves sanity due to not chasing bugs
 	//    for hours on end that were caused solely by non-alignment.
 	// 3) May slightly improve performance since aligned data is easier for the CPU to access and cache.
-	size_t remainder = aSize % 4;
-	size_t size_consumed = remainder ? aSize + (4 - remainder) : aSize;
-	// v1.0.45: The following can't happen when BLOCK_SIZE is a multiple of 4, so it's commented out:
-	//if (size_consumed > sLast->mSpaceAvailable) // For maintainability, don't allow mFreeMarker to go out of bounds or
-	//	size_consumed = sLast->mSpaceAvailable; // mSpaceAvailable to go negative (which it can't due to be unsigned).
-	sLast->mFreeMarker += size_consumed;
-	sLast->mSpaceAvailable -= size_consumed;
-	return sMostRecentlyAllocated;
+	// Space is now tracked in 4-byte units, which achieves the same thing.
+	LONG units = (LONG)((aSize + 3) / 4);
+	SimpleHeapBlock *block, *next;
+	LONG state, used;
+	for (;;)
+	{
+		if (   !(block = mLast)   ) // We need at least one block to do anything, so create it.
+		{
+			if (   !(block = CreateBlock())   )
+				return NULL;
+			if (InterlockedCompareExchangePointer((PVOID volatile *)&mFirst, block, NULL) == NULL)
+				InterlockedIncrement((LPLONG)&mBlockCount);
+			else // Another thread created the first block first.
+				DestroyBlocks(block);
+			InterlockedCompareExchangePointer((PVOID volatile *)&mLast, mFirst, NULL);
+			continue;
+		}
+		state = block->mState;
+		used = LOWORD(state);
+		if (units <= SH_UNIT_COUNT - used) // There's enough room in the last block.
+		{
+			if (InterlockedCompareExchange((LPLONG)&block->mState, SH_STATE(used, used + units), state) == state)
+				return block->mBlock + used * 4; // THIS IS NOW THE NEWLY ALLOCATED BLOCK FOR THE CALLER.
+			continue; // Another thread allocated from this block (or freed) first, so try again.
+		}
+		// Otherwise, this block is full (for this size), so move on to the next one, creating it if needed.
+		// Whichever thread succeeds in linking a new block also counts it; others discard theirs.
+		if (   !(next = block->mNextBlock)   )
+		{
+			if (   !(next = CreateBlock())   )
+				return NULL;
+			if (InterlockedCompareExchangePointer((PVOID volatile *)&block->mNextBlock, next, NULL) == NULL)
+				InterlockedIncrement((LPLONG)&mBlockCount);
+			else
+			{
+				DestroyBlocks(next);
+				next = block->mNextBlock;
+			}
+		}
+		InterlockedCompareExchangePointer((PVOID volatile *)&mLast, next, block); // Fails harmlessly if another thread already advanced it.
+	}
 }
 
 
 
-void SimpleHeap::Delete(void *aPtr)
-// If aPtr is the most recently allocated area of memory by SimpleHeap, this will reclaim that
+void SimpleHeap::Free(void *aPtr)
+// If aPtr is the most recently allocated area of memory in this arena, this will reclaim that
 // memory.  Otherwise, the caller should realize that the memory cannot be reclaimed (i.e. potential
 // memory leak unless caller handles things right).
 {
-	if (aPtr != sMostRecentlyAllocated || !sMostRecentlyAllocated)
+	SimpleHeapBlock *block = mLast;
+	if (!block || (char *)aPtr < block->mBlock || (char *)aPtr >= block->mBlock + BLOCK_SIZE)
 		return;
-	size_t sMostRecentlyAllocated_size = sLast->mFreeMarker - sMostRecentlyAllocated;
-	sLast->mFreeMarker -= sMostRecentlyAllocated_size;
-	sLast->mSpaceAvailable += sMostRecentlyAllocated_size;
-	sMostRecentlyAllocated = NULL; // i.e. no support for anything other than a one-time delete of an item just added.
+	LONG recent = (LONG)(((char *)aPtr - block->mBlock) / 4);
+	LONG state = block->mState;
+	if (HIWORD(state) != recent)
+		return; // It's not the most recent (e.g. another thread has allocated since), or it was already freed.
+	// There's no support for anything other than a one-time delete of an item just added, so the
+	// most-recent unit is set to "none".  If the CAS fails, another thread has allocated in the interim,
+	// in which case the memory can't be reclaimed.
+	InterlockedCompareExchange((LPLONG)&block->mState, SH_STATE(SH_NO_RECENT, recent), state);
+}
+
+
+
+void SimpleHeap::Reset()
+// Frees all of the arena's memory except the first block, which is kept for reuse since an arena
+// that has been used once is likely to be used again.  Caller must ensure that nothing still refers
+// to the arena's memory and that no other thread is using the arena.
+{
+	SimpleHeapBlock *first = mFirst;
+	if (!first)
+		return;
+	DestroyBlocks(first->mNextBlock);
+	first->mNextBlock = NULL;
+	first->mState = SH_STATE(SH_NO_RECENT, 0);
+	mLast = first;
+	mBlockCount = 1;
+}
+
+
+
+size_t SimpleHeap::GetBytesUsed()
+// Returns the number of bytes handed out by the arena (including the padding that keeps each
+// allocation aligned on a 32-bit boundary).  Other threads might allocate during the count, in which
+// case the result is approximate.
+{
+	size_t bytes = 0;
+	for (SimpleHeapBlock *block = mFirst; block; block = block->mNextBlock)
+		bytes += LOWORD(block->mState) * 4;
+	return bytes;
 }
 
 
 
-// Commented out because not currently used:
-//void SimpleHeap::DeleteAll()
-//// See Hotkey::AllDestructAndExit for comments about why this isn't actually called.
-//{
-//	SimpleHeap *next, *curr;
-//	for (curr = sFirst; curr != NULL;)
-//	{
-//		next = curr->mNextBlock;  // Save this member's value prior to deleting the object.
-//		delete curr;
-//		curr = next;
-//	}
-//}
+size_t SimpleHeap::GetBytesWasted()
+// Returns the number of bytes left over at the end of each block prior to the last, which can never
+// be used because allocation only proceeds from the last block.
+{
+	size_t bytes = 0;
+	for (SimpleHeapBlock *block = mFirst; block && block->mNextBlock; block = block->mNextBlock)
+		bytes += BLOCK_SIZE - LOWORD(block->mState) * 4;
+	return bytes;
+}
+
+
+
+SimpleHeap *SimpleHeap::SetCurrent(SimpleHeap *aHeap)
+// Makes aHeap the arena used by the calling thread's calls to the static methods (NULL means sMain).
+// Returns the thread's previous arena so that the caller can restore it.
+{
+	if (sTlsIndex == TLS_OUT_OF_INDEXES)
+	{
+		DWORD tls_index = TlsAlloc();
+		if (tls_index == TLS_OUT_OF_INDEXES)
+			return &sMain; // Realistically should never happen.  Everything will continue to use sMain.
+		// Check whether another thread allocated one in the meantime:
+		if (InterlockedCompareExchange((LPLONG)&sTlsIndex, (LONG)tls_index, (LONG)TLS_OUT_OF_INDEXES) != (LONG)TLS_OUT_OF_INDEXES)
+			TlsFree(tls_index);
+	}
+	SimpleHeap *prev = Current();
+	TlsSetValue(sTlsIndex, aHeap == &sMain ? NULL : aHeap);
+	return prev;
+}
+
 
 
+SimpleHeap *SimpleHeap::GetArena(int aIndex)
+// Returns the arena at the zero-based aIndex in order of creation (0 is sMain), or NULL if there is none.
+{
+	LockArenaList();
+	SimpleHeap *arena;
+	for (arena = sFirstArena; arena && aIndex > 0; arena = arena->mNextArena, --aIndex);
+	UnlockArenaList();
+	return aIndex < 0 ? NULL : arena;
+}
+
 
-SimpleHeap *SimpleHeap::CreateBlock()
+
+void SimpleHeap::LockArenaList()
+// The list is changed only when an arena is created or destroyed, which is far too rare for the lock
+// to be contended often, so a simple spin lock suffices.
+{
+	while (InterlockedExchange((LPLONG)&sArenaListLock, 1))
+		Sleep(0);
+}
+
+
+
+SimpleHeapBlock *SimpleHeap::CreateBlock()
 // Added for v1.0.40.04 to try to solve the fact that some functions such as GetRawInputDeviceList()
 // will sometimes fail if passed memory from SimpleHeap. Although this change didn't actually solve
 // the issue (it turned out to be a 32-bit alignment issue), using malloc() appears to save memory
 // (compared to using "new" on a class that contains a large buffer such as "char mBlock[BLOCK_SIZE]").
 // In a 200 KB script, it saves 8 KB of VM Size as shown by Task Manager.
 {
-	SimpleHeap *block;
-	if (   !(block = new SimpleHeap)   )
+	SimpleHeapBlock *block;
+	if (   !(block = (SimpleHeapBlock *)malloc(sizeof(SimpleHeapBlock)))   )
 		return NULL;
-	// The new block's mFreeMarker starts off pointing to the first byte in the new block:
-	if (   !(block->mBlock = block->mFreeMarker = (char *)malloc(BLOCK_SIZE))   )
+	if (   !(block->mBlock = (char *)malloc(BLOCK_SIZE))   )
 	{
-		delete block;
+		free(block);
 		return NULL;
 	}
-	// Since above didn't return, block was successfully created:
-	block->mSpaceAvailable = BLOCK_SIZE;
-	sLast = block;  // Constructing a new block always results in it becoming the current block.
-	++sBlockCount;
+	block->mState = SH_STATE(SH_NO_RECENT, 0);
+	block->mNextBlock = NULL;
 	return block;
 }
 
 
 
-SimpleHeap::SimpleHeap()  // Construct a new block.  Caller is responsible for initializing other members.
-	: mNextBlock(NULL)
+void SimpleHeap::DestroyBlocks(SimpleHeapBlock *aBlock)
+// Frees aBlock and all blocks after it.
 {
-}
-
-
-SimpleHeap::~SimpleHeap()
-// This destructor is currently never called because all instances of the object are created
-// with "new", yet none are ever destroyed with "delete".  As an alternative to this behavior
-// the delete method should recursively delete mNextBlock, if it's non-NULL, prior to
-// returning.  It seems unnecessary to do this, however, since the whole idea behind this
-// class is that it's a simple implementation of one-time, persistent memory allocation.
-// It's not intended to permit deallocation and subsequent reclamation of freed fragments
-// within the collection of blocks.  When the program exits, all memory dynamically
-// allocated by the constructor and any other methods that call "new" will be reclaimed
-// by the OS.  UPDATE: This is now called by static method DeleteAll().
-{
-	if (mBlock) // v1.0.40.04
-		free(mBlock);
-	return;
+	SimpleHeapBlock *next;
+	for (; aBlock; aBlock = next)
+	{
+		next = aBlock->mNextBlock; // Save this member's value prior to freeing the block.
+		free(aBlock->mBlock);
+		free(aBlock);
+	}
 }
@@ -37,26 +37,68 @@ GNU General Public License for more details.
 // Update: reduced it from 64K to 32K since many scripts tend to be small.
 #define BLOCK_SIZE (32 * 1024) // Relied upon by Malloc() to be a multiple of 4.
 
+// Each SimpleHeap object is an arena: a linked list of blocks from which memory is handed out
+// sequentially and which is freed only as a whole (see Reset() and the destructor).  Most memory
+// lasts as long as the script, so it comes from sMain.  Other arenas may be created for memory
+// whose lifetime ends sooner, such as a script fragment that the DLL's host may later discard
+// (see addFile()).  Alloc() is lock-free so that more than one thread may allocate from the same
+// arena at once.
+// To achieve that, each block keeps its state in a single LONG that can be updated atomically:
+// the low word is the number of 4-byte units in use and the high word is the unit at which the
+// most recent allocation begins (for Free()), or SH_NO_RECENT if none.  So BLOCK_SIZE/4 must fit
+// in a word, which leaves plenty of room.
+#define SH_UNIT_COUNT (BLOCK_SIZE / 4)
+#define SH_NO_RECENT 0xFFFF
+#define SH_STATE(recent, used) (((LONG)(recent) << 16) | (LONG)(used))
+
+struct SimpleHeapBlock
+{
+	char *mBlock; // This block's memory.
+	volatile LONG mState; // See above.
+	SimpleHeapBlock * volatile mNextBlock; // The block after this one in the linked list; NULL if none.
+};
+
 class SimpleHeap
 {
 private:
-	char *mBlock; // This object's memory block.  Although private, its contents are public.
-	char *mFreeMarker;  // Address inside the above block of the first unused byte.
-	size_t mSpaceAvailable;
-	static UINT sBlockCount;
-	static SimpleHeap *sFirst, *sLast;  // The first and last objects in the linked list.
-	static char *sMostRecentlyAllocated; // For use with Delete().
-	SimpleHeap *mNextBlock;  // The object after this one in the linked list; NULL if none.
-
-	static SimpleHeap *CreateBlock();
-	SimpleHeap();  // Private constructor, since we want only the static methods to be able to create new objects.
-	~SimpleHeap();
+	SimpleHeapBlock * volatile mFirst, * volatile mLast; // The first and last blocks in the linked list.
+	volatile LONG mBlockCount;
+	SimpleHeap *mNextArena; // The arena created after this one (see sFirstArena); NULL if none.
+
+	static SimpleHeap *sFirstArena, *sLastArena; // All existing arenas in order of creation, for GetArena().
+	static volatile LONG sArenaListLock;
+	static DWORD sTlsIndex; // The TLS slot that holds each thread's current arena.
+
+	static SimpleHeapBlock *CreateBlock();
+	static void DestroyBlocks(SimpleHeapBlock *aBlock);
+	static void LockArenaList();
+	static void UnlockArenaList() {InterlockedExchange((LPLONG)&sArenaListLock, 0);}
 public:
-	static UINT GetBlockCount() {return sBlockCount;}
-	static char *Malloc(char *aBuf, size_t aLength = -1); // Return a block of memory to the caller and copy aBuf into it.
-	static char *Malloc(size_t aSize); // Return a block of memory to the caller.
-	static void Delete(void *aPtr);
-	//static void DeleteAll();
+	static SimpleHeap sMain; // The arena for memory that lasts as long as the script.
+
+	SimpleHeap();
+	~SimpleHeap(); // Frees all of the arena's blocks.
+	char *Alloc(char *aBuf, size_t aLength = -1); // Return a block of memory to the caller and copy aBuf into it.
+	char *Alloc(size_t aSize); // Return a block of memory to the caller.
+	void Free(void *aPtr);
+	void Reset();
+	UINT GetBlockCount() {return (UINT)mBlockCount;}
+	size_t GetBytesUsed();
+	size_t GetBytesWasted();
+
+	// The static methods below operate on the calling thread's current arena, which is sMain unless
+	// the thread has called SetCurrent().  Callers use them when the memory belongs to whatever is
+	// being loaded (lines, labels, functions, etc.) rather than to the script as a whole.
+	static SimpleHeap *Current()
+	{
+		SimpleHeap *heap;
+		return (sTlsIndex != TLS_OUT_OF_INDEXES && (heap = (SimpleHeap *)TlsGetValue(sTlsIndex))) ? heap : &sMain;
+	}
+	static SimpleHeap *SetCurrent(SimpleHeap *aHeap);
+	static SimpleHeap *GetArena(int aIndex);
+	static char *Malloc(char *aBuf, size_t aLength = -1) {return Current()->Alloc(aBuf, aLength);}
+	static char *Malloc(size_t aSize) {return Current()->Alloc(aSize);}
+	static void Delete(void *aPtr) {Current()->Free(aPtr);}
 };
 
 #endif
@@ -244,6 +244,7 @@ bool MsgSleep(int aSleepDuration, MessageMode aMode)
 			// (if they're installed).  Otherwise, there's greater risk of keyboard/mouse lag.
 			// PeekMessage(), depending on how, and how often it's called, will also do this, but
 			// I'm not as confident in it.
+			IniFlushAll(); // The script is about to go idle, so write any changes it has made to INI files.
 			if (GetMessage(&msg, NULL, 0, MSG_FILTER_MAX) == -1) // -1 is an error, 0 means WM_QUIT
 				continue; // Error probably happens only when bad parameters were passed to GetMessage().
 			//else let any WM_QUIT be handled below.
@@ -759,7 +760,7 @@ bool MsgSleep(int aSleepDuration, MessageMode aMode)
 				if (hs->mHotCriterion)
 				{
 					// For details, see comments in the hotkey section of this switch().
-					if (   !(criterion_found_hwnd = HotCriterionAllowsFiring(hs->mHotCriterion, hs->mHotWinTitle, hs->mHotWinText))   )
+					if (   !(criterion_found_hwnd = HotCriterionAllowsFiring(hs->mHotCriterion, hs->mHotWinCriterion))   )
 						// Hotstring is no longer eligible to fire even though it was when the hook sent us
 						// the message.  Abort the firing even though the hook may have already started
 						// executing the hotstring by suppressing the final end-character or other actions.
@@ -1564,28 +1565,67 @@ bool CheckScriptTimers()
 	// g_nPausedThreads).  However, g_nPausedThreads must still be checked in case the uppermost thread
 	// isn't paused but some other thread isn't (as documented, timers don't run when any thread is paused).
 	if (!INTERRUPTIBLE || g_nPausedThreads > 0 || g_IdleIsPaused || !g.AllowTimers || g_nThreads >= g_MaxThreadsTotal)
-		return false; // Above: To be safe (prevent stack faults) don't allow max threads to be exceeded.
+	{
+		// Above: To be safe (prevent stack faults) don't allow max threads to be exceeded.
+		// Since the timers can't run right now, go back to polling at the standard interval in case the
+		// main timer was stretched to a due time that has now arrived (otherwise, a timer that's overdue
+		// but blocked would next be checked only after another full stretched interval):
+		if (g_MainTimerLong)
+			SET_MAIN_TIMER
+		return false;
+	}
+
+	// The enabled timers are kept in a min-heap ordered by due time, so if the first one isn't due,
+	// none are.  This is by far the most common case since we're called by every MsgSleep():
+	__int64 now = GetTickCount64Ext();
+	if (!g_script.mTimerHeapCount || g_script.mTimerHeap[0]->mDue > now)
+	{
+		SetMainTimerForScriptTimers();
+		return false;
+	}
 
-	ScriptTimer *ptimer;
-	UINT launched_threads;
+	ScriptTimer **heap = g_script.mTimerHeap;
+	UINT launched_threads, due_count, i, j, child, child_end;
 	DWORD tick_start;
 	global_struct global_saved;
 	char ErrorLevel_saved[ERRORLEVEL_SAVED_SIZE];
 
-	// Note: It seems inconsequential if a subroutine that the below loop executes causes a
-	// new timer to be added to the linked list while the loop is still enumerating the timers.
+	// Make a snapshot of every timer that's currently due.  Since a parent in the heap is never due
+	// later than its children, the due timers form a subtree at the top of the heap, which is found by
+	// descending only into the children of due timers (the snapshot array doubles as the queue for this
+	// breadth-first walk).  A snapshot is needed because launching a timer's subroutine below reorders
+	// the heap.  It seems inconsequential if a subroutine launched below causes a new timer to be
+	// created or enabled; that timer will be noticed on the next call.
+	ScriptTimer **due = (ScriptTimer **)_alloca(g_script.mTimerHeapCount * sizeof(ScriptTimer *));
+	due[0] = heap[0];
+	for (due_count = 1, i = 0; i < due_count; ++i)
+		for (child = 2 * due[i]->mHeapIndex + 1, child_end = child + 2; child < child_end && child < g_script.mTimerHeapCount; ++child)
+			if (heap[child]->mDue <= now)
+				due[due_count++] = heap[child];
+	// Run them in order of due time (then priority).  There are usually only a few, so an insertion
+	// sort is best:
+	for (i = 1; i < due_count; ++i)
+	{
+		ScriptTimer *timer = due[i];
+		for (j = i; j > 0 && TIMER_BEFORE(timer, due[j - 1]); --j)
+			due[j] = due[j - 1];
+		due[j] = timer;
+	}
 
-	for (launched_threads = 0, ptimer = g_script.mFirstTimer; ptimer != NULL; ptimer = ptimer->mNextTimer)
+	for (launched_threads = 0, i = 0; i < due_count; ++i)
 	{
-		// Call GetTickCount() every time in case a previous iteration of the loop took a long
-		// time to execute.  Also, as of v1.0.36.03, the following subtracts two DWORDs to support
-		// intervals of 49.7 vs. 24.8 days.  This should work as long as the distance between the
-		// values being compared isn't greater than 49.7 days. This is because 1 minus 2 in unsigned
-		// math yields 0xFFFFFFFF milliseconds (49.7 days).
-		ScriptTimer &timer = *ptimer; // For performance and convenience.
+		// Check everything again (including the tick count) because a previous iteration of the loop
+		// may have run a subroutine that took a long time, disabled or reset this timer, or called us
+		// recursively (which might have run this timer already).  mPriority and mExistingThreads are
+		// respected exactly as before: a timer whose subroutine is already running, or whose priority
+		// is lower than the current thread's, is skipped and stays at the top of the heap, so it will
+		// be launched by a later call once it becomes eligible.  Also, mDue is 64-bit, which supports
+		// periods as long as 49.7 days without the wraparound concerns of the old DWORD comparison.
+		ScriptTimer &timer = *due[i]; // For performance and convenience.
 		if (timer.mEnabled && timer.mExistingThreads < 1 && timer.mPriority >= g.Priority // thread priorities
-			&& (tick_start = GetTickCount()) - timer.mTimeLastRun >= (DWORD)timer.mPeriod)
+			&& (now = GetTickCount64Ext()) >= timer.mDue)
 		{
+			tick_start = (DWORD)now;
 			if (!launched_threads)
 			{
 				// Since this is the first subroutine that will be launched during this call to
@@ -1611,6 +1651,18 @@ bool CheckScriptTimers()
 				// in other places that would need to start up the timer again because we stopped it, etc.
 			}
 
+			// Update the statistics reported by EngineStats("Timer").  Lateness is how long after its due time the
+			// subroutine is being launched.  Jitter is how much that lateness changed since the prior run,
+			// which reflects how irregular the intervals between runs are:
+			DWORD lateness = (DWORD)(now - timer.mDue);
+			if (timer.mRunCount)
+				timer.mTotalJitter += lateness > timer.mLastLateness ? lateness - timer.mLastLateness : timer.mLastLateness - lateness;
+			++timer.mRunCount;
+			timer.mLastLateness = lateness;
+			timer.mTotalLateness += lateness;
+			if (timer.mMaxLateness < lateness)
+				timer.mMaxLateness = lateness;
+
 			// Fix for v1.0.31: mTimeLastRun is now given its new value *before* the thread is launched
 			// rather than after.  This allows a timer to be reset by its own thread -- by means of
 			// "SetTimer, TimerName", which is otherwise impossible because the reset was being
@@ -1625,6 +1677,11 @@ bool CheckScriptTimers()
 			timer.mTimeLastRun = tick_start;
 			if (timer.mRunOnlyOnce)
 				timer.Disable();  // This is done prior to launching the thread for reasons similar to above.
+			else
+			{
+				timer.mDue = now + timer.mPeriod;
+				g_script.TimerHeapUpdate(&timer);
+			}
 			++launched_threads;
 
 			if (g_nFileDialogs) // See MsgSleep() for comments on this.
@@ -1656,8 +1713,9 @@ bool CheckScriptTimers()
 
 			KILL_UNINTERRUPTIBLE_TIMER
 		} // if timer is due to launch.
-	} // for() each timer.
+	} // for() each due timer.
 
+	SetMainTimerForScriptTimers(); // Must be done after the loop since the heap was reordered by it.
 	if (launched_threads) // Since at least one subroutine was run above, restore various values for our caller.
 	{
 		ResumeUnderlyingThread(&global_saved, ErrorLevel_saved, false); // Last param "false" because KILL_UNINTERRUPTIBLE_TIMER was already done above.
@@ -1668,6 +1726,43 @@ bool CheckScriptTimers()
 
 
 
+void SetMainTimerForScriptTimers()
+// Ensures the main timer exists whenever there's at least one enabled script timer.  When nothing else
+// needs the main timer (no MsgSleep() layer is waiting on it and there are no joystick hotkeys to poll),
+// its interval is stretched to the time remaining until the earliest script timer is due.  This allows
+// an idle script to sit in GetMessage() until there's actually something to do rather than waking up
+// every SLEEP_INTERVAL to find that nothing is due.  Anyone else who needs the timer uses SET_MAIN_TIMER,
+// which puts it back to the standard interval.
+{
+	if (!g_script.mTimerHeapCount)
+		return; // ScriptTimer::Disable() has already killed the main timer if appropriate.
+	if (g_nLayersNeedingTimer || Hotkey::sJoyHotkeyCount)
+	{
+		SET_MAIN_TIMER
+		return;
+	}
+	__int64 due = g_script.mTimerHeap[0]->mDue;
+	__int64 delay = due - GetTickCount64Ext();
+	if (delay <= SLEEP_INTERVAL) // Due soon or overdue (e.g. because it's blocked by priority or still running).
+	{
+		SET_MAIN_TIMER
+		return;
+	}
+	if (g_MainTimerExists && g_MainTimerLong && g_MainTimerDue == due)
+		return; // Already set for this due time, so avoid the overhead of resetting it.
+	if (delay > 0x7FFFFFFF) // SetTimer()'s behavior for larger values varies by OS, so cap it (the timer will simply be rearmed when it fires).
+		delay = 0x7FFFFFFF;
+	if (g_MainTimerExists = SetTimer(g_hWnd, TIMER_ID_MAIN, (UINT)delay, (TIMERPROC)NULL))
+	{
+		g_MainTimerLong = true;
+		g_MainTimerDue = due;
+	}
+	else
+		g_MainTimerLong = false;
+}
+
+
+
 void PollJoysticks()
 // It's best to call this function only directly from MsgSleep() or when there is an instance of
 // MsgSleep() closer on the call stack than the nearest dialog's message pump (e.g. MsgBox).
@@ -1716,6 +1811,48 @@ void PollJoysticks()
 
 
 
+// Open-addressed hash table that maps a message number to its index in g_MsgMonitor.  Each slot holds
+// the index plus one so that zero (the initial state of the static array) means "empty".  The size is
+// a power of two more than twice MAX_MSG_MONITORS, which keeps the table at most half full and thus
+// keeps probe sequences short -- which matters because every message the main window receives is
+// looked up here whenever the script monitors any message at all.
+#define MSG_MONITOR_HASH_SIZE 1024
+#define MSG_MONITOR_HASH(aMsg) (((aMsg) * 2654435761U) >> 22) // Fibonacci hashing: the top 10 bits of the product.
+static short sMsgMonitorHash[MSG_MONITOR_HASH_SIZE];
+
+int FindMsgMonitor(UINT aMsg)
+// Returns the index in g_MsgMonitor of aMsg's monitor, or -1 if it isn't being monitored.
+{
+	for (UINT h = MSG_MONITOR_HASH(aMsg); sMsgMonitorHash[h]; h = (h + 1) & (MSG_MONITOR_HASH_SIZE - 1))
+		if (g_MsgMonitor[sMsgMonitorHash[h] - 1].msg == aMsg)
+			return sMsgMonitorHash[h] - 1;
+	return -1;
+}
+
+
+
+void AddMsgMonitorToHash(int aIndex)
+// Caller must have already stored the new monitor's message number in g_MsgMonitor[aIndex] and
+// ensured that the message isn't already in the table.
+{
+	UINT h;
+	for (h = MSG_MONITOR_HASH(g_MsgMonitor[aIndex].msg); sMsgMonitorHash[h]; h = (h + 1) & (MSG_MONITOR_HASH_SIZE - 1));
+	sMsgMonitorHash[h] = (short)(aIndex + 1);
+}
+
+
+
+void RebuildMsgMonitorHash()
+// Must be called whenever items in g_MsgMonitor are removed or moved, since that changes their indices.
+// Rebuilding from scratch is simpler than deleting from an open-addressed table, and it's rare.
+{
+	ZeroMemory(sMsgMonitorHash, sizeof(sMsgMonitorHash));
+	for (int i = 0; i < g_MsgMonitorCount; ++i)
+		AddMsgMonitorToHash(i);
+}
+
+
+
 bool MsgMonitor(HWND aWnd, UINT aMsg, WPARAM awParam, LPARAM alParam, MSG *apMsg, LRESULT &aMsgReply)
 // Returns false if the message is not being monitored, or it is but the called function indicated
 // that the message should be given its normal processing.  Returns true when the caller should
@@ -1743,18 +1880,23 @@ bool MsgMonitor(HWND aWnd, UINT aMsg, WPARAM awParam, LPARAM alParam, MSG *apMsg
 	// ResumeUnderlyingThread() sets g.AllowThreadToBeInterrupted to false for us in case the
 	// timer "TIMER_ID_UNINTERRUPTIBLE" fired for the new thread rather than for the old one (this
 	// prevents the interrupted thread from becoming permanently uninterruptible).
+	// The lookup is done before the interruptibility check below so that the counters reported by
+	// EngineStats("MsgMonitor") reflect every message we were asked about.  The hash table makes the common
+	// case, a message nobody monitors (such as the flood of WM_MOUSEMOVE and WM_PAINT in a GUI script),
+	// cost a single probe rather than a scan of the entire array.
+	int msg_index = FindMsgMonitor(aMsg);
+	if (msg_index < 0) // The script isn't monitoring this message.
+	{
+		++g_MsgMonitorMisses;
+		return false; // Tell the caller to give this message any additional/default processing.
+	}
+	// Otherwise, the script is monitoring this message, so continue on.
+	++g_MsgMonitorHits;
+
 	if (!INTERRUPTIBLE_IN_EMERGENCY)
 		return false;
 
-	// Linear search vs. binary search should perform better on average because the vast majority
-	// of message monitoring scripts are expected to monitor only a few message numbers.
-	int msg_index, msg_count_orig;
-	for (msg_count_orig = g_MsgMonitorCount, msg_index = 0; msg_index < g_MsgMonitorCount; ++msg_index)
-		if (g_MsgMonitor[msg_index].msg == aMsg)
-			break;
-	if (msg_index == g_MsgMonitorCount) // No match found, so the script isn't monitoring this message.
-		return false; // Tell the caller to give this message any additional/default processing.
-	// Otherwise, the script is monitoring this message, so continue on.
+	int msg_count_orig = g_MsgMonitorCount;
 
 	MsgMonitorStruct &monitor = g_MsgMonitor[msg_index]; // For performance and convenience.
 	Func &func = *monitor.func;                          // Above, but also in case monitor item gets deleted while the function is running (e.g. by the function itself).
@@ -1887,13 +2029,9 @@ bool MsgMonitor(HWND aWnd, UINT aMsg, WPARAM awParam, LPARAM alParam, MSG *apMsg
 		// deletes a message monitor, monitor.instance_count wouldn't get decremented (but only if the
 		// message(s) that were deleted lay to the left of it in the array).  So check if the monitor is
 		// somewhere else in the array and if found (i.e. it didn't delete itself), update it.
-		for (msg_index = 0; msg_index < g_MsgMonitorCount; ++msg_index)
-			if (g_MsgMonitor[msg_index].msg == aMsg)
-			{
-				if (g_MsgMonitor[msg_index].instance_count) // Avoid going negative, which might otherwise be possible in weird circumstances described in other comments.
-					--g_MsgMonitor[msg_index].instance_count;
-				break;
-			}
+		if ((msg_index = FindMsgMonitor(aMsg)) > -1
+			&& g_MsgMonitor[msg_index].instance_count) // Avoid going negative, which might otherwise be possible in weird circumstances described in other comments.
+			--g_MsgMonitor[msg_index].instance_count;
 	}
 
 	return block_further_processing; // If false, the caller will ignore aMsgReply and process this message normally. If true, aMsgReply contains the reply the caller should immediately send for this message.
@@ -1927,6 +2065,7 @@ void InitNewThread(int aPriority, bool aSkipUninterruptible, bool aIncrementThre
 	CopyMemory(&g, &g_default, sizeof(global_struct));
 	g.UnderlyingThreadIsPaused = underlying_thread_is_paused;
 	g.Priority = aPriority;
+	g.ProfileToken = Line::sProfiling ? Line::ProfileEnter(NULL) : 0; // Lets the profiler keep this thread's time separate from the one it interrupted.
 
 	if (aSkipUninterruptible)
 		return;
@@ -1988,6 +2127,10 @@ void ResumeUnderlyingThread(global_struct *pSavedStruct, char *aSavedErrorLevel,
 	if (aKillInterruptibleTimer)
 		KILL_UNINTERRUPTIBLE_TIMER // g.AllowThreadToBeInterrupted is set later below, after the g struct has been restored.
 
+	if (g.ProfileToken)
+		Line::ProfileLeave(g.ProfileToken);
+	if (g.RegExScans) // The thread abandoned a RegExMatchNext() scan outside of any function.
+		RegExScanFree(g.RegExScans);
 	bool underlying_thread_is_paused = g.UnderlyingThreadIsPaused; // Done this way for performance (to avoid multiple indirections).
 	CopyMemory(&g, pSavedStruct, sizeof(global_struct));
 	g_ErrorLevel->Assign(aSavedErrorLevel);
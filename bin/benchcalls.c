@@ -0,0 +1,75 @@
+/* Measures calls/sec into a script running in AutoHotkey.dll when several host threads call it at once,
+   which a script can't do since it has only one thread (see benchcalls.ahk for a single producer).
+   Each thread makes the same number of ahkFunction() calls; a call rejected because the queue is full is
+   retried rather than counted.  Afterward, the script's total is checked against the number of calls.
+   Build: winegcc -mwindows -o benchcalls.exe benchcalls.c  (or gcc -o benchcalls.exe benchcalls.c under MinGW)
+   Run from this directory: benchcalls [threads [calls_per_thread]]
+*/
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int (*ahkdll_type)(char *, char *, char *);
+typedef int (*ahkFunction_type)(char *, char *, char *, char *, char *);
+typedef int (*ahkFunctionSync_type)(char *, char *, char *, char *, char *, char *, int);
+
+static ahkFunction_type ahkFunction;
+static int calls_per_thread;
+static volatile LONG rejected = 0;
+
+static DWORD WINAPI Producer(LPVOID param)
+{
+	int i;
+	for (i = 0; i < calls_per_thread; )
+	{
+		if (ahkFunction("Bump", "1", NULL, NULL, NULL) < 0)
+		{
+			InterlockedIncrement(&rejected);
+			Sleep(0); /* The queue is full, so let the script's thread catch up. */
+		}
+		else
+			++i;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 4, i;
+	HANDLE *handle;
+	HMODULE dll;
+	ahkFunctionSync_type ahkFunctionSync;
+	char result[64];
+	DWORD start, elapsed;
+	long expected;
+	calls_per_thread = argc > 2 ? atoi(argv[2]) : 20000;
+	if (threads < 1 || calls_per_thread < 1
+		|| !(dll = LoadLibrary("AutoHotkey.dll"))
+		|| !(ahkFunction = (ahkFunction_type)GetProcAddress(dll, "ahkFunction"))
+		|| !(ahkFunctionSync = (ahkFunctionSync_type)GetProcAddress(dll, "ahkFunctionSync"))
+		|| !(handle = (HANDLE *)malloc(threads * sizeof(HANDLE))))
+	{
+		fprintf(stderr, "Couldn't load AutoHotkey.dll.\n");
+		return 2;
+	}
+	((ahkdll_type)GetProcAddress(dll, "ahkdll"))("benchcallee.ahk", "", "");
+	Sleep(1000); /* Let the script finish its auto-execute section. */
+
+	start = GetTickCount();
+	for (i = 0; i < threads; ++i)
+		handle[i] = CreateThread(NULL, 0, Producer, NULL, 0, NULL);
+	WaitForMultipleObjects(threads, handle, TRUE, INFINITE);
+	/* Calls are executed in the order they were queued, so this one waits for all of the above: */
+	ahkFunctionSync("Bump", "0", NULL, NULL, NULL, result, sizeof(result));
+	elapsed = GetTickCount() - start;
+
+	expected = (long)threads * calls_per_thread;
+	printf("%d threads: %ld calls in %lu ms = %.0f calls/sec (%ld rejected while the queue was full)\n"
+		, threads, expected, elapsed, elapsed ? expected * 1000.0 / elapsed : 0.0, (long)rejected);
+	if (atol(result) != expected)
+	{
+		printf("FAILED: the script counted %s calls.\n", result);
+		return 1;
+	}
+	return 0;
+}
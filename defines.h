@@ -431,6 +431,7 @@ typedef UCHAR HookType;
 			MsgSleep(-1);\
 		tick_now = GetTickCount();\
 		g_script.mLastPeekTime = tick_now;\
+		IniFlushIfDue(tick_now);\
 	}\
 }
 
@@ -524,7 +525,8 @@ struct global_struct
 	WIN32_FIND_DATA *mLoopFile;  // The file of the current file-loop, if applicable.
 	RegItemStruct *mLoopRegItem; // The registry subkey or value of the current registry enumeration loop.
 	LoopReadFileStruct *mLoopReadFile;  // The file whose contents are currently being read by a File-Read Loop.
-	char *mLoopField;  // The field of the current string-parsing loop.
+	char *mLoopField;  // The field of the current string-parsing loop.  Not terminated (see mLoopFieldLength).
+	size_t mLoopFieldLength;
 	// v1.0.44.14: The above mLoop attributes were moved into this structure from the script class
 	// because they're more approriate as thread-attributes rather than being global to the entire script.
 
@@ -552,6 +554,8 @@ struct global_struct
 	char FormatFloat[32];
 	Func *CurrentFunc; // v1.0.46.16: The function whose body is currently being processed at load-time, or being run at runtime (if any).
 	Label *CurrentLabel; // The label that is currently awaiting its matching "return" (if any).
+	__int64 ProfileToken; // The profiler's frame for this thread (see Line::ProfileEnter), or 0 if none.
+	struct RegExScan *RegExScans; // RegExMatchNext()'s scans in progress in the current function call or thread (see BIF_RegEx).
 	HWND hWndLastUsed;  // In many cases, it's better to use GetValidLastUsedWindow() when referring to this.
 	//HWND hWndToRestore;
 	int MsgBoxResult;  // Which button was pressed in the most recent MsgBox.
@@ -574,6 +578,8 @@ struct global_struct
 	bool StoreCapslockMode;
 	bool AutoTrim;
 	bool FormatIntAsHex;
+	bool FormatFloatFast; // SetFormat FloatFast: Vars keep assigned floats at full precision and format them only when their text is needed.
+	bool FormatIntegerFast; // SetFormat IntegerFast: Vars format their integers (even in hex) only when their text is needed.
 	bool MsgBoxTimedOut; // Doesn't require initialization.
 	bool IsPaused, UnderlyingThreadIsPaused; // The latter supports better toggling via "Pause" or "Pause Toggle".
 };
@@ -585,6 +591,8 @@ inline void global_clear_state(global_struct &g)
 {
 	g.CurrentFunc = NULL;
 	g.CurrentLabel = NULL;
+	g.ProfileToken = 0;
+	g.RegExScans = NULL; // Not freed since g_default might be a copy of the auto-execute thread, which still owns them.
 	g.hWndLastUsed = NULL;
 	//g.hWndToRestore = NULL;
 	g.MsgBoxResult = 0;
@@ -603,6 +611,7 @@ inline void global_clear_state(global_struct &g)
 	g.mLoopRegItem = NULL;
 	g.mLoopReadFile = NULL;
 	g.mLoopField = NULL;
+	g.mLoopFieldLength = 0;
 }
 
 inline void global_init(global_struct &g)
@@ -657,6 +666,8 @@ inline void global_init(global_struct &g)
 	g.AutoTrim = true;  // AutoIt2's default, and overall the best default in most cases.
 	strcpy(g.FormatFloat, "%0.6f");
 	g.FormatIntAsHex = false;
+	g.FormatFloatFast = false;
+	g.FormatIntegerFast = false;
 	// For FormatFloat:
 	// I considered storing more than 6 digits to the right of the decimal point (which is the default
 	// for most Unices and MSVC++ it seems).  But going beyond that makes things a little weird for many
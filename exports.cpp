@@ -3,21 +3,6 @@
 #include "application.h" // for MsgSleep()
 #include "exports.h"
 #include "script.h"
-// Naveen: v1. ahkgetvar()
-EXPORT VarSizeType ahkgetvar(char *name, char *output)
-{
-	Var *ahkvar = g_script.FindOrAddVar(name);
-	return ahkvar->Get(output);  // var.getText() added in V1.
-}
-EXPORT int ahkassign(char *name, char *value) // ahkwine 0.1
-{
-	Var *var;
-if (   !(var = g_script.FindOrAddVar(name, strlen(name)))   )
-				return -1;  // Realistically should never happen.
-			var->Assign(value);
-			return 0; // success
-}
-
 EXPORT int ximportfunc(ahkx_int_str func1, ahkx_int_str func2, ahkx_int_str_str func3) // Naveen ahkx N11
 {
     g_script.xifwinactive = func1 ;
@@ -26,11 +11,6 @@ EXPORT int ximportfunc(ahkx_int_str func1, ahkx_int_str func2, ahkx_int_str_str
     return 0;
 }
 
-EXPORT unsigned int ahkFindFunc(char *funcname)
-{
-return (unsigned int)g_script.FindFunc(funcname);
-}
-
 void BIF_FindFunc(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount) // Added in Nv8.
 {
 	// Set default return value in case of early return.
@@ -43,17 +23,6 @@ void BIF_FindFunc(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 	aResultToken.value_int64 = (__int64)ahkFindFunc(funcname);
 	return;
 }
-EXPORT int ahkLabel(char *aLabelName)
-{
-	Label *aLabel = g_script.FindLabel(aLabelName) ;
-	if (aLabel)
-	{
-		PostMessage(g_hWnd, AHK_EXECUTE_LABEL, (LPARAM)aLabel, (LPARAM)aLabel);
-		return 0;
-	}
-	else
-		return -1;
-}
 
 EXPORT int ahkKey(char *keys) // N11 sendahk
 {
@@ -81,28 +50,125 @@ void BIF_sendahk(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 	return;
 }
 
+// Each call to addFile() loads its file into an arena of its own (see SimpleHeap) so that the memory of a
+// fragment can be freed once a later reset has discarded it, rather than being leaked for as long as the
+// script runs.  Each fragment's lines are contiguous because every call appends them to the end of the script.
+struct FragmentHeap
+{
+	SimpleHeap *heap;
+	Line *first_line, *last_line; // The fragment's lines, or NULL if it has none.
+	bool is_freeable; // False if the fragment registered something that would outlive a reset (see FreeFragments).
+	FragmentHeap *next;
+};
+static FragmentHeap *sFirstFragment = NULL, *sLastFragment = NULL;
+
+
+
+static void FreeFragments()
+// Called by addFile() when it resets all functions and labels.  Since no function or label can be found by
+// name any more, the lines of the fragments loaded so far are removed from the script and their arenas freed.
+// Fragments that registered hotkeys, hotstrings, #IfWin criteria or window groups are kept (i.e. leaked as
+// before) because those are global lists that refer back into the fragment.  So is every fragment prior to
+// the last such one, since a fragment's lines can refer to the functions, labels and local variables of the
+// fragments loaded before it (e.g. a function call is resolved when its line is loaded).  Beyond that, the
+// host must not reset while a fragment still has a running thread, timer, OnMessage function, menu item or
+// GUI label, since those also refer into the fragment.
+{
+	FragmentHeap *frag, *next, *last_kept = NULL;
+	Line *line, *prev_line;
+	for (frag = sFirstFragment; frag; frag = frag->next)
+		if (!frag->is_freeable)
+			last_kept = frag;
+	bool keep = last_kept != NULL; // Keep fragments up to and including last_kept.
+	for (frag = sFirstFragment; frag; frag = next)
+	{
+		next = frag->next;
+		if (!keep)
+		{
+			if (frag->first_line) // Unlink its lines from the script.
+			{
+				prev_line = frag->first_line->mPrevLine; // Never NULL because the main script comes first.
+				prev_line->mNextLine = frag->last_line->mNextLine;
+				if (frag->last_line->mNextLine)
+					frag->last_line->mNextLine->mPrevLine = prev_line;
+				else
+					g_script.mLastLine = prev_line;
+				for (line = frag->first_line; ; line = line->mNextLine)
+				{
+					if (g_script.mCurrLine == line)
+						g_script.mCurrLine = prev_line;
+					if (line == frag->last_line)
+						break;
+				}
+			}
+			delete frag->heap;
+		}
+		else if (frag == last_kept)
+			keep = false;
+		delete frag;
+	}
+	sFirstFragment = sLastFragment = NULL;
+	// Caches keyed by the address of a line's deref would otherwise mistake a deref of a fragment loaded
+	// later (which might be given the same address) for one they already know:
+	DllCallSiteReset();
+	RegExSiteReset();
+	// Rather than searching the ListLines log for lines that no longer exist, simply start it over:
+	ZeroMemory(Line::sLog, sizeof(Line::sLog));
+	Line::sLogNext = 0;
+	Line::ProfileReset(); // Likewise for the profiler, whose statistics refer to lines and functions by address.
+}
+
+
+
 // Naveen: v6 addFile()
 // Todo: support for #Directives, and proper treatment of mIsReadytoExecute
 EXPORT unsigned int addFile(char *fileName, bool aAllowDuplicateInclude, int aIgnoreLoadFailure)
 {   // dynamically include a file into a script !!
 	// labels, hotkeys, functions.
 
-	Line *oldLastLine = g_script.mLastLine;
-
 	if (aIgnoreLoadFailure > 1)  // if third param is > 1, reset all functions, labels, remove hotkeys
 	{
 		g_script.mFirstFunc = NULL;   // Naveen
 		g_script.mFirstLabel = NULL ;
 		g_script.mLastLabel = NULL ;
 		g_script.mLastFunc = NULL ;
-		g_script.LoadIncludedFile(fileName, aAllowDuplicateInclude, aIgnoreLoadFailure);
+		g_script.mLabelIndex.RemoveAll(); // Keep the indexes in sync with the now-empty lists above.
+		g_script.mFuncIndex.RemoveAll();
+		FreeFragments(); // Must be done prior to the below since it can change mLastLine.
 	}
+
+#ifndef AUTOHOTKEYSC
+	FuncLibraryIndexReset(); // The fragment might call a function whose library file was created after startup.
+#endif
+	Line *oldLastLine = g_script.mLastLine;
+	FragmentHeap *frag = new FragmentHeap;
+	frag->heap = new SimpleHeap;
+	frag->next = NULL;
+	HotkeyIDType hotkey_count = Hotkey::sHotkeyCount;
+	HotstringIDType hotstring_count = Hotstring::sHotstringCount;
+	HotkeyCriterion *last_criterion = g_LastHotCriterion;
+	WinGroup *last_group = g_script.mLastGroup;
+
+	SimpleHeap *prev_heap = SimpleHeap::SetCurrent(frag->heap); // Everything below that isn't global comes from the fragment's arena.
+	if (aIgnoreLoadFailure > 1)
+		g_script.LoadIncludedFile(fileName, aAllowDuplicateInclude, aIgnoreLoadFailure);
 	else
 	{
 	g_script.LoadIncludedFile(fileName, aAllowDuplicateInclude, (bool) aIgnoreLoadFailure);
 	}
 
 	g_script.PreparseBlocks(oldLastLine->mNextLine); //
+	SimpleHeap::SetCurrent(prev_heap);
+
+	frag->first_line = oldLastLine->mNextLine;
+	frag->last_line = frag->first_line ? g_script.mLastLine : NULL;
+	frag->is_freeable = hotkey_count == Hotkey::sHotkeyCount && hotstring_count == Hotstring::sHotstringCount
+		&& last_criterion == g_LastHotCriterion && last_group == g_script.mLastGroup;
+	if (sLastFragment)
+		sLastFragment->next = frag;
+	else
+		sFirstFragment = frag;
+	sLastFragment = frag;
 	return (unsigned int) oldLastLine->mNextLine;  //
 }
 
@@ -138,96 +204,426 @@ void BIF_Import(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParam
 	return;
 }
 
+// Calls made into the script by the host (ahkFunction, ahkLabel, ahkassign) are put into the following
+// queue, which is drained by the script's thread whenever it receives AHK_EXECUTE_FUNCTION.  This replaces
+// a single global slot for the target function, which was overwritten whenever a second call arrived before
+// the first had been executed.  Any number of host threads may add to the queue at the same time without locking:
+// it's a bounded ring buffer in which each slot has a sequence number that tells producers whether the slot
+// is free and tells the (single) consumer whether the slot has been filled.
+// Only one AHK_EXECUTE_FUNCTION message is posted per batch of calls (see sCallQueuePosted), which avoids
+// a window-message round trip for every call when the host makes many calls in quick succession.
+// Functions, labels and variables are queued by name and looked up only by the script's thread, since the
+// host's threads must not search the script's indexes while the script's thread might be adding to them
+// (e.g. FindFunc() adds built-in functions upon first use, and a hash table that grows frees its old table).
+// For the same reason, even lookups such as ahkgetvar() and ahkFindFunc() are made through the queue.
+// A host thread that waits for a call never waits forever: if the script's window goes away before the
+// call has been started, the call is cancelled (see CancelCall()).
+#define CALL_QUEUE_SIZE 256 // Must be a power of two.
+#define CALL_MAX_PARAMS 4
+
+enum CallType {CALL_FUNCTION, CALL_LABEL, CALL_ASSIGN, CALL_GETVAR, CALL_FINDFUNC};
+
+struct CallResult // Used only by synchronous calls.  It lives on the waiting host thread's stack.
+{
+	HANDLE done;     // Signaled by the script's thread once the call has been executed (or dropped).
+	char *buf;       // Caller's buffer for the function's return value (may be NULL).  For CALL_GETVAR, it must be large enough for the whole value.
+	int buf_size;
+	int length;      // Length of the full return value, or -1 if the call couldn't be executed.
+	void *item;      // For CALL_FINDFUNC, the function that was found (NULL if none).
+};
+
+struct CallQueueEntry
+{
+	volatile LONG sequence; // See EnqueueCall() and DrainCallQueue().
+	// The position of this call in the queue while it's waiting to be executed.  The script's thread changes it
+	// to position+1 when it takes the call, and CancelCall() changes it to position+2 instead.  Neither value can
+	// be mistaken for the position of a later call in the same slot, since those differ by CALL_QUEUE_SIZE.
+	volatile LONG claim;
+	CallType type;
+	char *name; // Name of the function, label or variable, depending on type.
+	char *param[CALL_MAX_PARAMS]; // Copies of the caller's strings (NULL for omitted params).  They and name are all in one block, which param_block points to.
+	char *param_block;
+	CallResult *result; // NULL if the caller isn't waiting for the call to finish.
+};
+
+static CallQueueEntry sCallQueue[CALL_QUEUE_SIZE];
+static volatile LONG sCallQueueHead = 0; // Position at which the next call will be added (by any thread).
+static LONG sCallQueueTail = 0;          // Position of the next call to be executed (by the script's thread only).
+static volatile LONG sCallQueuePosted = 0; // Nonzero if an AHK_EXECUTE_FUNCTION message is already pending.
+
+static struct CallQueueInit
+{
+	// Runs when the DLL is loaded, which is before any of the exported functions can be called.
+	CallQueueInit()
+	{
+		for (LONG i = 0; i < CALL_QUEUE_SIZE; ++i)
+			sCallQueue[i].sequence = i; // Slot i is free for the producer whose position is i.
+	}
+} sCallQueueInit;
+
+
+
+static bool IsScriptThread()
+// Calls made by the script's own thread (e.g. via DllCall) are executed immediately rather than queued,
+// which also prevents a synchronous call from waiting forever on a queue that only it could drain.
+{
+	return GetWindowThreadProcessId(g_hWnd, NULL) == GetCurrentThreadId();
+}
+
+
+
+static bool PostCallQueue()
+// Notifies the script's thread that there are calls in the queue, unless it has already been notified of a
+// batch that it hasn't yet started draining.  Returns false if the message couldn't be posted (e.g. the
+// script's message queue is full or its window doesn't exist yet), in which case the next call to this
+// function tries again.
+{
+	if (InterlockedExchange((LPLONG)&sCallQueuePosted, 1))
+		return true;
+	if (PostMessage(g_hWnd, AHK_EXECUTE_FUNCTION, 0, 0))
+		return true;
+	InterlockedExchange((LPLONG)&sCallQueuePosted, 0); // Otherwise no later call would ever post again.
+	return false;
+}
+
+
+
+static bool CancelCall(LONG aPos)
+// Cancels the call at queue position aPos so that the script's thread discards it rather than executing it.
+// Returns false if that's too late because the script's thread has already taken the call.
+{
+	CallQueueEntry &entry = sCallQueue[aPos & (CALL_QUEUE_SIZE - 1)];
+	return InterlockedCompareExchange((LPLONG)&entry.claim, aPos + 2, aPos) == aPos;
+}
+
+
+
+static bool EnqueueCall(CallType aType, char *aName, char *aParam[], int aParamCount, CallResult *aResult, LONG &aPos)
+// Returns true if the call was queued, or false if the queue is full, there's insufficient memory, or the
+// script's thread couldn't be notified.  aPos is set to the call's position in the queue.
+{
+	// Copy the strings because an asynchronous caller is free to reuse them as soon as we return.
+	int i;
+	size_t length[CALL_MAX_PARAMS], name_length = strlen(aName) + 1, space_needed = name_length;
+	for (i = 0; i < aParamCount; ++i)
+		space_needed += (length[i] = aParam[i] ? strlen(aParam[i]) + 1 : 0);
+	char *param_block, *cp;
+	if (   !(param_block = (char *)malloc(space_needed))   )
+		return false;
+
+	LONG pos = sCallQueueHead;
+	CallQueueEntry *entry;
+	for (;;)
+	{
+		entry = sCallQueue + (pos & (CALL_QUEUE_SIZE - 1));
+		LONG dif = entry->sequence - pos;
+		if (!dif) // This slot is free, so try to claim it.
+		{
+			if (InterlockedCompareExchange((LPLONG)&sCallQueueHead, pos + 1, pos) == pos)
+				break; // The slot is now ours.
+			// Otherwise, another producer claimed it first.
+		}
+		else if (dif < 0) // The consumer hasn't yet freed this slot, so the queue is full.
+		{
+			free(param_block);
+			return false;
+		}
+		pos = sCallQueueHead; // Try again at the most recent position.
+	}
+
+	entry->type = aType;
+	entry->name = (char *)memcpy(param_block, aName, name_length);
+	entry->param_block = param_block;
+	for (cp = param_block + name_length, i = 0; i < CALL_MAX_PARAMS; ++i)
+	{
+		if (i < aParamCount && aParam[i])
+		{
+			entry->param[i] = (char *)memcpy(cp, aParam[i], length[i]);
+			cp += length[i];
+		}
+		else
+			entry->param[i] = NULL;
+	}
+	entry->result = aResult;
+	entry->claim = pos;
+	InterlockedExchange((LPLONG)&entry->sequence, pos + 1); // Publish the slot to the consumer.  Must be done last.
+	aPos = pos;
+
+	// This must be done after publishing the slot above (see DrainCallQueue()).  If the script's thread can't
+	// be notified, the call is withdrawn rather than left for a message that might never come; but if the
+	// script's thread has taken it in the meantime (due to an earlier message), it's as good as done.
+	return PostCallQueue() || !CancelCall(pos);
+}
+
+
+
+static void SetCallResult(CallResult *aResult, char *aValue)
+// aValue is NULL if the call couldn't be executed.
+{
+	if (!aResult)
+		return;
+	if (aValue)
+	{
+		aResult->length = (int)strlen(aValue);
+		if (aResult->buf && aResult->buf_size > 0)
+			strlcpy(aResult->buf, aValue, aResult->buf_size);
+	}
+	else
+		aResult->length = -1;
+}
+
+
+
+static bool CallFunc(Func &aFunc, char *aParam[], CallResult *aResult)
+// Launches a new thread that calls aFunc, passing it up to CALL_MAX_PARAMS params.  Its other params
+// get their default values.  Must be called only by the script's thread.  Returns false if the call
+// couldn't be made.
+{
+	Func &func = aFunc;
+	if (!INTERRUPTIBLE_IN_EMERGENCY)
+		return false;
+
+	if (g_nThreads >= g_MaxThreadsTotal)
+		// Below: Only a subset of ACT_IS_ALWAYS_ALLOWED is done here because:
+		// 1) The omitted action types seem too obscure to grant always-run permission for msg-monitor events.
+		// 2) Reduction in code size.
+		if (func.mJumpToLine->mActionType != ACT_EXITAPP && func.mJumpToLine->mActionType != ACT_RELOAD)
+			return false;
+
+	// Need to check if backup is needed in case script explicitly called the function rather than using
+	// it solely as a callback.  UPDATE: And now that max_instances is supported, also need it for that.
+	// See ExpandExpression() for detailed comments about the following section.
+	VarBkp *var_backup = NULL;   // If needed, it will hold an array of VarBkp objects.
+	int var_backup_count; // The number of items in the above array.
+	if (func.mInstances > 0) // Backup is needed.
+		if (!Var::BackupFunctionVars(func, var_backup, var_backup_count)) // Out of memory.
+			return false;
+			// Since we're in the middle of processing messages, and since out-of-memory is so rare,
+			// it seems justifiable not to have any error reporting and instead just avoid launching
+			// the new thread.
+
+	// Since above didn't return, the launch of the new thread is now considered unavoidable.
+
+	// See MsgSleep() for comments about the following section.
+	char ErrorLevel_saved[ERRORLEVEL_SAVED_SIZE];
+	strlcpy(ErrorLevel_saved, g_ErrorLevel->Contents(), sizeof(ErrorLevel_saved));
+
+	global_struct global_saved;
+	CopyMemory(&global_saved, &g, sizeof(global_struct));
+
+	InitNewThread(0, false, true, func.mJumpToLine->mActionType);
+
+	// Copy the caller's params into the function's formal parameters.  An omitted (NULL) param is given
+	// its default value, if it has one.  See ExpandExpression() for details.
+	for (int i = 0; i < func.mParamCount; ++i)
+	{
+		FuncParam &this_formal_param = func.mParam[i];
+		if (this_formal_param.is_byref) // There's no caller's variable to be an alias for.
+			this_formal_param.var->ConvertToNonAliasIfNecessary();
+		if (i < CALL_MAX_PARAMS && aParam[i])
+			this_formal_param.var->Assign(aParam[i]);
+		else switch(this_formal_param.default_type)
+		{
+		case PARAM_DEFAULT_INT:   this_formal_param.var->Assign(this_formal_param.default_int64);  break;
+		case PARAM_DEFAULT_FLOAT: this_formal_param.var->Assign(this_formal_param.default_double); break;
+		case PARAM_DEFAULT_STR:   this_formal_param.var->Assign(this_formal_param.default_str);    break;
+		default:                  this_formal_param.var->Assign(); // Make it blank.
+		}
+	}
+
+	// v1.0.38.04: Below was added to maximize responsiveness to incoming messages.  The reasoning
+	// is similar to why the same thing is done in MsgSleep() prior to its launch of a thread, so see
+	// MsgSleep for more comments:
+	g_script.mLastScriptRest = g_script.mLastPeekTime = GetTickCount();
+
+	char *return_value;
+	func.Call(return_value); // Call the UDF.
+
+	// Fix for v1.0.47: Must handle return_value BEFORE calling FreeAndRestoreFunctionVars() because return_value
+	// might be the contents of one of the function's local variables (which are about to be free'd).
+	SetCallResult(aResult, return_value);
+
+	Var::FreeAndRestoreFunctionVars(func, var_backup, var_backup_count);
+	ResumeUnderlyingThread(&global_saved, ErrorLevel_saved, true);
+	return true;
+}
+
+
+
+static bool ExecuteCall(CallType aType, char *aName, char *aParam[], CallResult *aResult)
+// Must be called only by the script's thread.  Returns false if the call couldn't be executed (e.g.
+// there's no such function), in which case that has also been reported via aResult.
+{
+	Func *func;
+	Label *label;
+	Var *var;
+	switch (aType)
+	{
+	case CALL_FUNCTION:
+		if (   !(func = g_script.FindFunc(aName)) || func->mIsBuiltIn // Built-in functions can't be launched as a new thread.
+			|| !CallFunc(*func, aParam, aResult)   )
+			break;
+		return true;
+	case CALL_LABEL:
+		if (   !(label = g_script.FindLabel(aName))   )
+			break;
+		label->Execute();
+		SetCallResult(aResult, "");
+		return true;
+	case CALL_ASSIGN: // aParam[0] is the variable's new value.
+		if (   !(var = g_script.FindOrAddVar(aName))   )
+			break;
+		var->Assign(aParam[0]); // A NULL value makes it blank.
+		SetCallResult(aResult, "");
+		return true;
+	case CALL_GETVAR: // Always synchronous.  The caller's buffer is written directly, as Var::Get() would.
+		if (   !(var = g_script.FindOrAddVar(aName))   )
+			break;
+		aResult->length = (int)var->Get(aResult->buf);
+		return true;
+	case CALL_FINDFUNC: // Always synchronous.
+		aResult->item = g_script.FindFunc(aName);
+		aResult->length = 0;
+		return true;
+	}
+	SetCallResult(aResult, NULL);
+	return false;
+}
+
+
+
+void DrainCallQueue()
+// Called by the script's thread upon receipt of AHK_EXECUTE_FUNCTION.  Executes every call in the queue.
+{
+	// Reset this first so that any call queued from now on posts a new message.  A call that's published
+	// before this point will be seen by the loop below; one published after it will post its own message.
+	InterlockedExchange((LPLONG)&sCallQueuePosted, 0);
+	CallQueueEntry *entry;
+	CallType type;
+	char *name, *param[CALL_MAX_PARAMS], *param_block;
+	CallResult *result;
+	for (;;)
+	{
+		entry = sCallQueue + (sCallQueueTail & (CALL_QUEUE_SIZE - 1));
+		if (entry->sequence - (sCallQueueTail + 1) < 0) // The queue is empty (or the producer of the next slot hasn't finished filling it, in which case it will post another message).
+			return;
+		type = entry->type;
+		name = entry->name;
+		memcpy(param, entry->param, sizeof(param));
+		param_block = entry->param_block;
+		result = entry->result;
+		// Take the call unless its producer has cancelled it (see CancelCall()), in which case a waiting
+		// producer has already returned, so result must not be used.
+		bool cancelled = InterlockedCompareExchange((LPLONG)&entry->claim, sCallQueueTail + 1, sCallQueueTail) != sCallQueueTail;
+		// Free the slot and advance before executing the call, since the call may cause this function to be
+		// called recursively (e.g. if the called function sleeps) and producers may reuse the slot:
+		InterlockedExchange((LPLONG)&entry->sequence, sCallQueueTail + CALL_QUEUE_SIZE);
+		++sCallQueueTail;
+		if (!cancelled)
+			ExecuteCall(type, name, param, result);
+		free(param_block);
+		if (result && !cancelled)
+			SetEvent(result->done); // Must be done last because the waiting thread then discards the result struct.
+	}
+}
+
+
+
+static int QueueCall(CallType aType, char *aName, char *aParam[], int aParamCount, char *aResultBuf, int aResultBufSize, bool aWait
+	, void **aItem = NULL)
+// Returns -1 on failure.  Otherwise, returns 0 for asynchronous calls or the length of the return
+// value for synchronous ones (the return value is truncated if aResultBuf is too small).  If aItem
+// isn't NULL, it receives the item found by a CALL_FINDFUNC.
+// Since aName isn't looked up until the script's thread gets to the call, an asynchronous call from a
+// host thread can't report that there's no such function or label; the call is simply discarded.
+{
+	if (aItem)
+		*aItem = NULL;
+	if (!aName)
+		return -1;
+	char *param[CALL_MAX_PARAMS] = {NULL};
+	memcpy(param, aParam, aParamCount * sizeof(char *));
+	CallResult result = {NULL, aResultBuf, aResultBufSize, -1, NULL};
+	LONG pos;
+	if (IsScriptThread())
+	{
+		if (!ExecuteCall(aType, aName, param, aWait ? &result : NULL))
+			return -1;
+		if (aItem)
+			*aItem = result.item;
+		return aWait ? result.length : 0;
+	}
+	if (!aWait)
+		return EnqueueCall(aType, aName, param, aParamCount, NULL, pos) ? 0 : -1;
+	if (   !(result.done = CreateEvent(NULL, FALSE, FALSE, NULL))   )
+		return -1;
+	if (EnqueueCall(aType, aName, param, aParamCount, &result, pos))
+	{
+		// Rather than waiting forever, check periodically whether the script's thread still needs to be
+		// notified (in case a post failed after this call was queued) or has gone away.  Once the script's
+		// thread has taken the call, it's waited for even if it takes a long time (e.g. a function that
+		// sleeps), since the script's thread will write into result when it's done.
+		while (WaitForSingleObject(result.done, 100) == WAIT_TIMEOUT)
+		{
+			if (!IsWindow(g_hWnd) && CancelCall(pos))
+				break; // result.length is still -1.
+			PostCallQueue();
+		}
+		if (aItem)
+			*aItem = result.item;
+	}
+	CloseHandle(result.done);
+	return result.length;
+}
+
+
+
 EXPORT int ahkFunction(char *func, char *param1, char *param2, char *param3, char *param4)
+// Queues a call to the script's function <func> and returns without waiting for it.
+// Returns 0 on success or -1 if the queue is full.  A host thread's call to a function that doesn't
+// exist is discarded later (see QueueCall()).
 {
-	Func *aFunc = g_script.FindFunc(func) ;
-if (aFunc)
-{
-	g_script.mTempFunc = aFunc ;
-	PostMessage(g_hWnd, AHK_EXECUTE_FUNCTION, (WPARAM)param1, (LPARAM)param2);
-	return 0;
-}
-else
-	return -1;
+	char *param[CALL_MAX_PARAMS] = {param1, param2, param3, param4};
+	return QueueCall(CALL_FUNCTION, func, param, CALL_MAX_PARAMS, NULL, 0, false);
 }
 
-bool callFunc(WPARAM awParam, LPARAM alParam)
+EXPORT int ahkFunctionSync(char *func, char *param1, char *param2, char *param3, char *param4, char *result, int result_size)
+// Same as ahkFunction() except that it waits for the function to return and copies its return value
+// into <result>, truncating it if necessary to fit into <result_size> bytes.  <result> may be NULL.
+// Returns the length of the entire return value, or -1 if the function couldn't be called (e.g. there's
+// no such function).
 {
-	Func &func = *(Func *)g_script.mTempFunc ;
-	if (!INTERRUPTIBLE_IN_EMERGENCY)
-		return false;
-
-	if (g_nThreads >= g_MaxThreadsTotal)
-		// Below: Only a subset of ACT_IS_ALWAYS_ALLOWED is done here because:
-		// 1) The omitted action types seem too obscure to grant always-run permission for msg-monitor events.
-		// 2) Reduction in code size.
-		if (func.mJumpToLine->mActionType != ACT_EXITAPP && func.mJumpToLine->mActionType != ACT_RELOAD)
-			return false;
-
-	// Need to check if backup is needed in case script explicitly called the function rather than using
-	// it solely as a callback.  UPDATE: And now that max_instances is supported, also need it for that.
-	// See ExpandExpression() for detailed comments about the following section.
-	VarBkp *var_backup = NULL;   // If needed, it will hold an array of VarBkp objects.
-	int var_backup_count; // The number of items in the above array.
-	if (func.mInstances > 0) // Backup is needed.
-		if (!Var::BackupFunctionVars(func, var_backup, var_backup_count)) // Out of memory.
-			return false;
-			// Since we're in the middle of processing messages, and since out-of-memory is so rare,
-			// it seems justifiable not to have any error reporting and instead just avoid launching
-			// the new thread.
-
-	// Since above didn't return, the launch of the new thread is now considered unavoidable.
-
-	// See MsgSleep() for comments about the following section.
-	char ErrorLevel_saved[ERRORLEVEL_SAVED_SIZE];
-	strlcpy(ErrorLevel_saved, g_ErrorLevel->Contents(), sizeof(ErrorLevel_saved));
-
-	global_struct global_saved;
-	CopyMemory(&global_saved, &g, sizeof(global_struct));
-
-	InitNewThread(0, false, true, func.mJumpToLine->mActionType);
-
-
-	// See ExpandExpression() for detailed comments about the following section.
-	if (func.mParamCount > 0)
-	{
-		// Copy the appropriate values into each of the function's formal parameters.
-		func.mParam[0].var->Assign((char *)awParam); // Assign parameter #1: wParam
-		if (func.mParamCount > 1) // Assign parameter #2: lParam
-		{
-			// v1.0.38.01: LPARAM is now written out as a DWORD because the majority of system messages
-			// use LPARAM as a pointer or other unsigned value.  This shouldn't affect most scripts because
-			// of the way ATOI64() and ATOU() wrap a negative number back into the unsigned domain for
-			// commands such as PostMessage/SendMessage.
-			func.mParam[1].var->Assign((char *)alParam);
-		}
-	}
-
-	// v1.0.38.04: Below was added to maximize responsiveness to incoming messages.  The reasoning
-	// is similar to why the same thing is done in MsgSleep() prior to its launch of a thread, so see
-	// MsgSleep for more comments:
-	g_script.mLastScriptRest = g_script.mLastPeekTime = GetTickCount();
-
-
-	char *return_value;
-	func.Call(return_value); // Call the UDF.
-
-
-	// Fix for v1.0.47: Must handle return_value BEFORE calling FreeAndRestoreFunctionVars() because return_value
-	// might be the contents of one of the function's local variables (which are about to be free'd).
-/*	bool block_further_processing = *return_value; // No need to check the following because they're implied for *return_value!=0: result != EARLY_EXIT && result != FAIL;
-	if (block_further_processing)
-		aMsgReply = (LPARAM)ATOI64(return_value); // Use 64-bit in case it's an unsigned number greater than 0x7FFFFFFF, in which case this allows it to wrap around to a negative.
-	//else leave aMsgReply uninitialized because we'll be returning false later below, which tells our caller
-	// to ignore aMsgReply.
-*/
-	Var::FreeAndRestoreFunctionVars(func, var_backup, var_backup_count);
-	ResumeUnderlyingThread(&global_saved, ErrorLevel_saved, true);
-
-	return 0 ; // block_further_processing; // If false, the caller will ignore aMsgReply and process this message normally. If true, aMsgReply contains the reply the caller should immediately send for this message.
+	char *param[CALL_MAX_PARAMS] = {param1, param2, param3, param4};
+	return QueueCall(CALL_FUNCTION, func, param, CALL_MAX_PARAMS, result, result_size, true);
 }
 
+EXPORT int ahkLabel(char *aLabelName)
+// Queues a launch of the label <aLabelName>.  As with ahkFunction(), a host thread's launch of a label
+// that doesn't exist is discarded later.
+{
+	return QueueCall(CALL_LABEL, aLabelName, NULL, 0, NULL, 0, false);
+}
 
+EXPORT int ahkassign(char *name, char *value) // ahkwine 0.1
+// Waits until the script's thread has done the assignment so that the new value is visible to
+// anything the host does next (such as ahkgetvar()).
+{
+	return QueueCall(CALL_ASSIGN, name, &value, 1, NULL, 0, true) < 0 ? -1 : 0;
+}
 
+// Naveen: v1. ahkgetvar()
+EXPORT VarSizeType ahkgetvar(char *name, char *output)
+// Copies the contents of the script's variable <name> (creating it if necessary) into <output>, which must be
+// large enough.  If <output> is NULL, only the length is returned.  Returns -1 if the script's thread
+// couldn't be reached.
+{
+	return (VarSizeType)QueueCall(CALL_GETVAR, name, NULL, 0, output, 0, true);
+}
 
-
+EXPORT unsigned int ahkFindFunc(char *funcname)
+// Returns the address of the script's function <funcname>, or 0 if there's no such function.
+{
+	void *func;
+	QueueCall(CALL_FINDFUNC, funcname, NULL, 0, NULL, 0, true, &func);
+	return (unsigned int)func;
+}
@@ -15,7 +15,11 @@ BIF(BIF_GetTokenValue) ;
 
 EXPORT int ahkLabel(char *aLabelName);
 EXPORT int ahkFunction(char *func, char *param1, char *param2, char *param3, char *param4);
-bool callFunc(WPARAM awParam, LPARAM alParam);
-// do not export callFunc, it must be called within script thread
+EXPORT int ahkFunctionSync(char *func, char *param1, char *param2, char *param3, char *param4, char *result, int result_size);
+EXPORT int ahkassign(char *name, char *value);
+EXPORT VarSizeType ahkgetvar(char *name, char *output);
+EXPORT unsigned int ahkFindFunc(char *funcname);
+void DrainCallQueue();
+// do not export DrainCallQueue, it must be called within script thread
 void BIF_Import(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
 void BIF_FindFunc(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
@@ -77,6 +77,8 @@ bool g_NoTrayIcon = false;
 #endif
 bool g_AllowSameLineComments = true;
 bool g_MainTimerExists = false;
+bool g_MainTimerLong = false; // True when the main timer has been stretched to the next script timer's due time rather than SLEEP_INTERVAL.
+__int64 g_MainTimerDue = 0;   // The due time (see GetTickCount64Ext) the main timer was stretched to.  Valid only when g_MainTimerLong is true.
 bool g_UninterruptibleTimerExists = false;
 bool g_AutoExecTimerExists = false;
 bool g_InputTimerExists = false;
@@ -95,6 +97,9 @@ int g_MaxHistoryKeys = 40;
 // as the maximum memory size of a variable, including the string's zero terminator.
 // The chosen default seems big enough to be flexible, yet small enough to not be a problem on 99% of systems:
 VarSizeType g_MaxVarCapacity = 64 * 1024 * 1024;
+// The number of compiled RegEx's to keep (see #RegExCacheSize).  The default is enough for the vast majority
+// of scripts; only those that rotate through more unique patterns than this need to raise it.
+int g_RegExCacheSize = PCRE_CACHE_SIZE;
 UCHAR g_MaxThreadsPerHotkey = 1;
 int g_MaxThreadsTotal = 10;
 // On my system, the repeat-rate (which is probably set to XP's default) is such that between 20
@@ -108,6 +113,10 @@ bool g_MaxThreadsBuffer = false;  // This feature usually does more harm than go
 HotCriterionType g_HotCriterion = HOT_NO_CRITERION;
 char *g_HotWinTitle = ""; // In spite of the above being the primary indicator,
 char *g_HotWinText = "";  // these are initialized for maintainability.
+HotkeyCriterion *g_HotWinCriterion = NULL; // The record that holds the above two, or NULL if there are no criteria.
+// Reported by EngineStats("HotCriterion", ...).  They're updated by both the hook thread and the main thread:
+volatile LONG g_HotCriterionCalls = 0, g_HotCriterionEvaluations = 0; // How many times #IfWin criteria were checked, and how many of those had to search (see HotCriterionAllowsFiring).
+volatile LONG g_HotCriterionTime = 0; // Total microseconds spent checking them.
 HotkeyCriterion *g_FirstHotCriterion = NULL, *g_LastHotCriterion = NULL;
 
 MenuTypeType g_MenuIsVisible = MENU_TYPE_NONE;
@@ -122,13 +131,8 @@ GuiType *g_gui[MAX_GUI_WINDOWS] = {NULL};
 HWND g_hWndToolTip[MAX_TOOLTIPS] = {NULL};
 MsgMonitorStruct *g_MsgMonitor = NULL; // An array to be allocated upon first use (if any).
 int g_MsgMonitorCount = 0;
-
-// Init not needed for these:
-UCHAR g_SortCaseSensitive;
-bool g_SortNumeric;
-bool g_SortReverse;
-int g_SortColumnOffset;
-Func *g_SortFunc;
+__int64 g_MsgMonitorHits = 0;   // Number of messages MsgMonitor() found to be monitored by the script.
+__int64 g_MsgMonitorMisses = 0; // Number of messages MsgMonitor() found not to be monitored.
 
 char g_delimiter = ',';
 char g_DerefChar = '%';
@@ -191,6 +195,7 @@ char g_WorkingDir[MAX_PATH] = "";
 char *g_WorkingDirOrig = NULL;  // Assigned a value in WinMain().
 
 bool g_ContinuationLTrim = false;
+bool g_LoopReadChunked = true; // See #LoopReadChunked.
 bool g_ForceKeybdHook = false;
 ToggleValueType g_ForceNumLock = NEUTRAL;
 ToggleValueType g_ForceCapsLock = NEUTRAL;
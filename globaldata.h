@@ -74,6 +74,8 @@ extern bool g_AllowSameLineComments;
 extern bool g_AllowInterruption;
 extern bool g_DeferMessagesForUnderlyingPump;
 extern bool g_MainTimerExists;
+extern bool g_MainTimerLong;
+extern __int64 g_MainTimerDue;
 extern bool g_UninterruptibleTimerExists;
 extern bool g_AutoExecTimerExists;
 extern bool g_InputTimerExists;
@@ -87,6 +89,9 @@ extern bool g_IdleIsPaused;
 extern int g_MaxHistoryKeys;
 
 extern VarSizeType g_MaxVarCapacity;
+#define PCRE_CACHE_SIZE 100 // Default for #RegExCacheSize.
+#define PCRE_CACHE_SIZE_MAX 100000 // Limit for #RegExCacheSize, to keep a typo from reserving a huge amount of memory.
+extern int g_RegExCacheSize;
 // This value is the absolute limit:
 #define MAX_THREADS_LIMIT 20
 #define MAX_THREADS_DEFAULT 10
@@ -98,6 +103,8 @@ extern bool g_MaxThreadsBuffer;
 extern HotCriterionType g_HotCriterion;
 extern char *g_HotWinTitle;
 extern char *g_HotWinText;
+extern HotkeyCriterion *g_HotWinCriterion;
+extern volatile LONG g_HotCriterionCalls, g_HotCriterionEvaluations, g_HotCriterionTime;
 extern HotkeyCriterion *g_FirstHotCriterion, *g_LastHotCriterion;
 
 extern MenuTypeType g_MenuIsVisible;
@@ -112,12 +119,7 @@ EXTERN_GUI;
 extern HWND g_hWndToolTip[MAX_TOOLTIPS];
 extern MsgMonitorStruct *g_MsgMonitor; // An array to be allocated upon first use (if any).
 extern int g_MsgMonitorCount;
-
-extern UCHAR g_SortCaseSensitive;
-extern bool g_SortNumeric;
-extern bool g_SortReverse;
-extern int g_SortColumnOffset;
-extern Func *g_SortFunc;
+extern __int64 g_MsgMonitorHits, g_MsgMonitorMisses;
 
 extern char g_delimiter;
 extern char g_DerefChar;
@@ -162,6 +164,7 @@ extern char g_WorkingDir[MAX_PATH];  // Explicit size needed here in .h file for
 extern char *g_WorkingDirOrig;
 
 extern bool g_ContinuationLTrim;
+extern bool g_LoopReadChunked;
 extern bool g_ForceKeybdHook;
 extern ToggleValueType g_ForceNumLock;
 extern ToggleValueType g_ForceCapsLock;
@@ -229,9 +232,16 @@ enum OurTimers {TIMER_ID_MAIN = MAX_MSGBOXES + 2, TIMER_ID_UNINTERRUPTIBLE, TIME
 // function properly without it, at least when there are suspended subroutines.
 // MSDN docs for SetTimer(): "Windows 2000/XP: If uElapse is less than 10,
 // the timeout is set to 10."
+// When the only reason for the main timer to exist is the script's timers, SetMainTimerForScriptTimers()
+// may stretch its interval to the time remaining until the earliest one is due, so that an idle script
+// doesn't wake up every SLEEP_INTERVAL for nothing.  Anyone else who needs the timer uses this macro,
+// which therefore also puts a stretched timer back to the standard short interval:
 #define SET_MAIN_TIMER \
-if (!g_MainTimerExists)\
-	g_MainTimerExists = SetTimer(g_hWnd, TIMER_ID_MAIN, SLEEP_INTERVAL, (TIMERPROC)NULL);
+if (!g_MainTimerExists || g_MainTimerLong)\
+{\
+	g_MainTimerExists = SetTimer(g_hWnd, TIMER_ID_MAIN, SLEEP_INTERVAL, (TIMERPROC)NULL);\
+	g_MainTimerLong = false;\
+}
 // v1.0.39 for above: Apparently, one of the few times SetTimer fails is after the thread has done
 // PostQuitMessage. That particular failure was causing an unwanted recursive call to ExitApp(),
 // which is why the above no longer calls ExitApp on failure.  Here's the sequence:
@@ -286,10 +296,14 @@ if (!g_InputTimerExists)\
 // reset it as though it were killed and recreated.  Note also that g_hWnd is used vs. NULL so that
 // the timer will fire even when a msg pump other than our own is running, such as that of a MsgBox.
 #define LARGE_DEREF_BUF_SIZE (4*1024*1024)
+#define DEREF_BUF_IDLE_TIME 10000 // How long (in ms) a large or pooled deref buffer must go unused before it's freed.
 
 #define KILL_MAIN_TIMER \
 if (g_MainTimerExists && KillTimer(g_hWnd, TIMER_ID_MAIN))\
-	g_MainTimerExists = false;
+{\
+	g_MainTimerExists = false;\
+	g_MainTimerLong = false;\
+}
 
 // Although the caller doesn't always need g.AllowThreadToBeInterrupted reset to true,
 // it's much more maintainable and nicer to do it unconditionally due to the complexity of
@@ -318,5 +332,6 @@ if (g_InputTimerExists && KillTimer(g_hWnd, TIMER_ID_INPUT))\
 #define KILL_DEREF_TIMER \
 if (g_DerefTimerExists && KillTimer(g_hWnd, TIMER_ID_DEREF))\
 	g_DerefTimerExists = false;
+#define SET_DEREF_TIMER(aTimeoutValue) g_DerefTimerExists = SetTimer(g_hWnd, TIMER_ID_DEREF, aTimeoutValue, DerefTimeout);
 
 #endif
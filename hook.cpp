@@ -2709,59 +2709,21 @@ bool CollectInput(KBDLLHOOKSTRUCT &aEvent, const vk_type aVK, const sc_type aSC,
 
 		if (g_HSBufLength)
 		{
-			char *cphs, *cpbuf, *cpcase_start, *cpcase_end;
+			char *cpcase_start, *cpcase_end;
 			int case_capable_characters;
 			bool first_char_with_case_is_upper, first_char_with_case_has_gone_by;
 			CaseConformModes case_conform_mode;
 
 			// Searching through the hot strings in the original, physical order is the documented
 			// way in which precedence is determined, i.e. the first match is the only one that will
-			// be triggered.
-			for (HotstringIDType u = 0; u < Hotstring::sHotstringCount; ++u)
+			// be triggered.  FindMatch() does this via a trie of the abbreviations, so the work done
+			// here doesn't grow with the number of hotstrings.  v1.0.41: A perfect match whose window
+			// isn't active or doesn't exist is skipped in favor of others, in case the script contains
+			// hotstrings that would trigger simultaneously were it not for the "only one" rule.
+			HotstringIDType u = Hotstring::FindMatch(g_HSBuf, g_HSBufLength);
+			if (u != HOTSTRING_INDEX_INVALID)
 			{
 				Hotstring &hs = *shs[u];  // For performance and convenience.
-				if (hs.mSuspended)
-					continue;
-				if (hs.mEndCharRequired)
-				{
-					if (g_HSBufLength <= hs.mStringLength) // Ensure the string is long enough for loop below.
-						continue;
-					if (!strchr(g_EndChars, g_HSBuf[g_HSBufLength - 1])) // It's not an end-char, so no match.
-						continue;
-					cpbuf = g_HSBuf + g_HSBufLength - 2; // Init once for both loops. -2 to omit end-char.
-				}
-				else // No ending char required.
-				{
-					if (g_HSBufLength < hs.mStringLength) // Ensure the string is long enough for loop below.
-						continue;
-					cpbuf = g_HSBuf + g_HSBufLength - 1; // Init once for both loops.
-				}
-				cphs = hs.mString + hs.mStringLength - 1; // Init once for both loops.
-				// Check if this item is a match:
-				if (hs.mCaseSensitive)
-				{
-					for (; cphs >= hs.mString; --cpbuf, --cphs)
-						if (*cpbuf != *cphs)
-							break;
-				}
-				else // case insensitive
-					// v1.0.43.03: Using CharLower vs. tolower seems the best default behavior (even though slower)
-					// so that languages in which the higher ANSI characters are common will see "" == "", etc.
-					for (; cphs >= hs.mString; --cpbuf, --cphs)
-						if (ltolower(*cpbuf) != ltolower(*cphs)) // v1.0.43.04: Fixed crash by properly casting to UCHAR (via macro).
-							break;
-
-				// Check if one of the loops above found a matching hotstring (relies heavily on
-				// short-circuit boolean order):
-				if (   cphs >= hs.mString // One of the loops above stopped early due discovering "no match"...
-					// ... or it did but the "?" option is not present to protect from the fact that
-					// what lies to the left of this hotstring abbreviation is an alphanumberic character:
-					|| !hs.mDetectWhenInsideWord && cpbuf >= g_HSBuf && IsCharAlphaNumeric(*cpbuf)
-					// ... v1.0.41: Or it's a perfect match but the right window isn't active or doesn't exist.
-					// In that case, continue searching for other matches in case the script contains
-					// hotstrings that would trigger simultaneously were it not for the "only one" rule.
-					|| !HotCriterionAllowsFiring(hs.mHotCriterion, hs.mHotWinTitle, hs.mHotWinText)   )
-					continue; // No match or not eligible to fire.
 					// v1.0.42: The following scenario defeats the ability to give criterion hotstrings
 					// precedence over non-criterion:
 					// A global/non-criterion hotstring is higher up in the file than some criterion hotstring,
@@ -2774,7 +2736,7 @@ bool CollectInput(KBDLLHOOKSTRUCT &aEvent, const vk_type aVK, const sc_type aSC,
 					// more flexible not to do it; instead, to let the script determine (even by resorting to
 					// #IfWinNOTActive) what precedence hotstrings have with respect to each other.
 
-				// MATCHING HOTSTRING WAS FOUND (since above didn't continue).
+				// MATCHING HOTSTRING WAS FOUND.
 				// Since default KeyDelay is 0, and since that is expected to be typical, it seems
 				// best to unconditionally post a message rather than trying to handle the backspacing
 				// and replacing here.  This is because a KeyDelay of 0 might be fairly slow at
@@ -2946,8 +2908,7 @@ bool CollectInput(KBDLLHOOKSTRUCT &aEvent, const vk_type aVK, const sc_type aSC,
 				// In case the above changed the value of g_HSBufLength, terminate the buffer at that position:
 				g_HSBuf[g_HSBufLength] = '\0';
 
-				break; // Somewhere above would have done "continue" if a match wasn't found.
-			} // for()
+			} // A match was found.
 		} // if buf not empty
 	} // Yes, collect hotstring input.
 
@@ -3019,11 +2980,21 @@ bool CollectInput(KBDLLHOOKSTRUCT &aEvent, const vk_type aVK, const sc_type aSC,
 	// in progress (which we know is the case otherwise other opportunities to return above would
 	// have done so).  Hotstrings (if any) have already been fully handled by the above.
 
+	// Each char's state in the match automaton is recorded as it's added (which also lets Backspace
+	// undo it by simply shortening the buffer).  For the "*" option, a match can end at either char:
+	bool input_matched = false;
 	#define ADD_INPUT_CHAR(ch) \
 		if (g_input.BufferLength < g_input.BufferLengthMax)\
 		{\
 			g_input.buffer[g_input.BufferLength++] = ch;\
 			g_input.buffer[g_input.BufferLength] = '\0';\
+			if (g_input.MatchCount)\
+			{\
+				int *state_at = g_input.Matcher.mStateAt + g_input.BufferLength;\
+				*state_at = g_input.Matcher.Next(state_at[-1], ch);\
+				if (g_input.FindAnywhere && g_input.Matcher.IsMatch(*state_at))\
+					input_matched = true;\
+			}\
 		}
 	ADD_INPUT_CHAR(ch[0])
 	if (byte_count > 1)
@@ -3039,69 +3010,118 @@ bool CollectInput(KBDLLHOOKSTRUCT &aEvent, const vk_type aVK, const sc_type aSC,
 	// else even if BufferLengthMax has been reached, check if there's a match because a match should take
 	// precedence over the length limit.
 
-	// Otherwise, check if the buffer now matches any of the key phrases:
-	if (g_input.FindAnywhere)
+	// Otherwise, check if the buffer now matches any of the key phrases.  The automaton has already
+	// done all the work (see InputMatcher), so this takes the same time regardless of how many phrases
+	// there are.  For an exact match, only the state after the whole buffer matters:
+	if (input_matched || !g_input.FindAnywhere && g_input.Matcher.IsMatch(g_input.Matcher.mStateAt[g_input.BufferLength]))
 	{
-		if (g_input.CaseSensitive)
-		{
-			for (UINT i = 0; i < g_input.MatchCount; ++i)
-			{
-				if (strstr(g_input.buffer, g_input.match[i]))
-				{
-					g_input.status = INPUT_TERMINATED_BY_MATCH;
-					return treat_as_visible;
-				}
-			}
-		}
-		else // Not case sensitive.
+		g_input.status = INPUT_TERMINATED_BY_MATCH;
+		return treat_as_visible;
+	}
+
+	// Otherwise, no match found.
+	if (g_input.BufferLength >= g_input.BufferLengthMax)
+		g_input.status = INPUT_LIMIT_REACHED;
+	return treat_as_visible;
+#undef shs  // To avoid naming conflicts
+*/
+}
+
+
+
+bool InputMatcher::BuildFrom(char **aMatch, UINT aMatchCount, bool aCaseSensitive, bool aFindAnywhere)
+// Called by the Input command before it puts the input in progress (the hook doesn't look at the
+// automaton until then).  Returns false if out of memory.
+{
+	UCHAR fold[256], folded_class[256], *cp;
+	UINT i, c, state, state_count_max;
+	int *next;
+
+	// Give each distinct (folded) char in the phrases its own class.  All other chars share class 0,
+	// which keeps the table small even though a state has a transition for every possible char:
+	for (c = 0; c < 256; ++c)
+		fold[c] = aCaseSensitive ? (UCHAR)c : (UCHAR)(size_t)ltolower(c); // Same folding as lstrcasestr().
+	ZeroMemory(folded_class, sizeof(folded_class));
+	mClassCount = 1;
+	for (state_count_max = 1, i = 0; i < aMatchCount; ++i) // Also count the chars, which bounds the number of states.
+		for (cp = (UCHAR *)aMatch[i]; *cp; ++cp, ++state_count_max)
+			if (!folded_class[fold[*cp]])
+				folded_class[fold[*cp]] = (UCHAR)mClassCount++;
+	for (c = 0; c < 256; ++c)
+		mClass[c] = folded_class[fold[c]];
+
+	free(mNext); // Free the automaton of any prior Input.
+	free(mIsMatch);
+	mNext = (int *)calloc(state_count_max * mClassCount, sizeof(int));
+	mIsMatch = (bool *)calloc(state_count_max, sizeof(bool));
+	if (!mStateAt)
+		mStateAt = (int *)malloc(INPUT_BUFFER_SIZE * sizeof(int));
+	if (!mNext || !mIsMatch || !mStateAt)
+		goto out_of_memory;
+
+	// Build the trie.  While doing so, zero means "no transition" since nothing leads back to the root (state 0):
+	for (mStateCount = 1, i = 0; i < aMatchCount; ++i)
+	{
+		for (state = 0, cp = (UCHAR *)aMatch[i]; *cp; ++cp)
 		{
-			for (UINT i = 0; i < g_input.MatchCount; ++i)
-			{
-				// v1.0.43.03: Changed lstrcasestr to strcasestr because it seems unlikely to break any existing
-				// scripts and is also more useful given that that Input with match-list is pretty rarely used,
-				// and even when it is used, match lists are usually short (so performance isn't impacted much
-				// by this change).
-				if (lstrcasestr(g_input.buffer, g_input.match[i]))
-				{
-					g_input.status = INPUT_TERMINATED_BY_MATCH;
-					return treat_as_visible;
-				}
-			}
+			next = mNext + state * mClassCount + mClass[*cp];
+			if (!*next)
+				*next = mStateCount++;
+			state = *next;
 		}
+		mIsMatch[state] = true;
 	}
-	else // Exact match is required
+
+	if (aFindAnywhere)
 	{
-		if (g_input.CaseSensitive)
-		{
-			for (UINT i = 0; i < g_input.MatchCount; ++i)
+		// Visit the states breadth-first so that each one's failure state (the state for its longest proper
+		// suffix) is already complete.  Each missing transition is copied from the failure state, which turns
+		// the trie into a DFA in which every char is a single lookup.  A state is also a match if its failure
+		// state is, since that means a shorter phrase ends there.
+		int *fail, *queue, *row, *fail_row;
+		UINT head, tail;
+		if (   !(fail = (int *)malloc(mStateCount * 2 * sizeof(int)))   )
+			goto out_of_memory;
+		queue = fail + mStateCount;
+		for (head = tail = 0, c = 0; c < mClassCount; ++c) // The root's missing transitions stay at zero (the root).
+			if (state = mNext[c])
 			{
-				if (!strcmp(g_input.buffer, g_input.match[i]))
-				{
-					g_input.status = INPUT_TERMINATED_BY_MATCH;
-					return treat_as_visible;
-				}
+				fail[state] = 0;
+				queue[tail++] = state;
 			}
-		}
-		else // Not case sensitive.
+		while (head < tail)
 		{
-			for (UINT i = 0; i < g_input.MatchCount; ++i)
+			row = mNext + queue[head] * mClassCount;
+			fail_row = mNext + fail[queue[head++]] * mClassCount;
+			for (c = 0; c < mClassCount; ++c)
 			{
-				// v1.0.43.03: Changed to locale-insensitive search.  See similar v1.0.43.03 comment above for more details.
-				if (!lstrcmpi(g_input.buffer, g_input.match[i]))
+				if (state = row[c]) // A real transition, since each row is filled in only when it's visited.
 				{
-					g_input.status = INPUT_TERMINATED_BY_MATCH;
-					return treat_as_visible;
+					fail[state] = fail_row[c];
+					if (mIsMatch[fail[state]])
+						mIsMatch[state] = true;
+					queue[tail++] = state;
 				}
+				else
+					row[c] = fail_row[c];
 			}
 		}
+		free(fail);
 	}
+	else // Exact match: Any char that isn't on the trie means the buffer can't match anymore.
+		for (i = 0; i < mStateCount * mClassCount; ++i) // As above, every zero (even in the root's row) is a missing transition.
+			if (!mNext[i])
+				mNext[i] = INPUT_MATCH_DEAD;
+	mStateAt[0] = 0; // The state for an empty buffer.
+	return true;
 
-	// Otherwise, no match found.
-	if (g_input.BufferLength >= g_input.BufferLengthMax)
-		g_input.status = INPUT_LIMIT_REACHED;
-	return treat_as_visible;
-#undef shs  // To avoid naming conflicts
-*/
+out_of_memory:
+	free(mNext);
+	free(mIsMatch);
+	mNext = NULL;
+	mIsMatch = NULL;
+	mStateCount = 0;
+	return false;
 }
 
 
@@ -183,6 +183,30 @@ enum InputStatusType {INPUT_OFF, INPUT_IN_PROGRESS, INPUT_TIMED_OUT, INPUT_TERMI
 #define END_KEY_WITH_SHIFT 0x02
 #define END_KEY_WITHOUT_SHIFT 0x04
 
+struct InputMatcher
+// The Input command's match list compiled into an automaton so that the hook can check each keystroke in
+// constant time regardless of how many phrases there are or how long the buffer is.  For the "*" option
+// (find anywhere), it's an Aho-Corasick automaton: a state is the longest suffix of the buffer that is a
+// prefix of some phrase, and it is a match state if any phrase is a suffix of the buffer.  Otherwise, it's
+// a trie of the phrases in which falling off the trie leads to INPUT_MATCH_DEAD.  For case insensitivity,
+// chars are folded (per the locale, like lstrcasestr) before being looked up.
+{
+	#define INPUT_MATCH_DEAD -1
+	int *mNext;         // mNext[state * mClassCount + char class] is the state after a char of that class.
+	bool *mIsMatch;     // mIsMatch[state] is true if reaching that state completes a phrase.
+	int *mStateAt;      // mStateAt[i] is the state after the first i chars of the buffer (so that Backspace can undo).
+	UINT mStateCount;
+	UINT mClassCount;   // The number of distinct (folded) chars in the phrases, plus class 0 for all others.
+	UCHAR mClass[256];  // Maps a char to its class.
+	bool BuildFrom(char **aMatch, UINT aMatchCount, bool aCaseSensitive, bool aFindAnywhere);
+	int Next(int aState, char aChar)
+	{
+		return aState == INPUT_MATCH_DEAD ? INPUT_MATCH_DEAD : mNext[aState * mClassCount + mClass[(UCHAR)aChar]];
+	}
+	bool IsMatch(int aState) {return aState != INPUT_MATCH_DEAD && mIsMatch[aState];}
+	InputMatcher() : mNext(NULL), mIsMatch(NULL), mStateAt(NULL), mStateCount(0), mClassCount(0) {}
+};
+
 struct input_type
 {
 	InputStatusType status;
@@ -198,6 +222,7 @@ struct input_type
 	#define INPUT_ARRAY_BLOCK_SIZE 1024  // The increment by which the above array expands.
 	char *MatchBuf; // The is the buffer whose contents are pointed to by the match array.
 	UINT MatchBufSize; // The capacity of the above above buffer.
+	InputMatcher Matcher; // The above phrases compiled for the hook.  Its memory is reused by each Input.
 	bool BackspaceIsUndo;
 	bool CaseSensitive;
 	bool IgnoreAHKInput; // Whether input from any AHK script is ignored for the purpose of finding a match.
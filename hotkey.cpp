@@ -33,27 +33,62 @@ DWORD Hotkey::sJoyHotkeyCount = 0;
 
 
 
-HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, char *aWinTitle, char *aWinText)
+HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, HotkeyCriterion *aCriterion)
 // This is a global function because it's used by both hotkeys and hotstrings.
 // In addition to being called by the hook thread, this can now be called by the main thread.
 // That happens when a WM_HOTKEY message arrives that is non-hook (such as for Win9x).
 // Returns a non-NULL HWND if firing is allowed.  However, if it's a global criterion or
 // a "not-criterion" such as #IfWinNotActive, (HWND)1 is returned rather than a genuine HWND.
+// A single keystroke can evaluate the same criterion for many variants (and for the hotkey's
+// prefix check), so each criterion's outcome is cached until the current WindowSnapshot is replaced.
 {
-	HWND found_hwnd;
+	int i;
 	switch(aHotCriterion)
 	{
 	case HOT_IF_ACTIVE:
 	case HOT_IF_NOT_ACTIVE:
-		found_hwnd = WinActive(g_default, aWinTitle, aWinText, "", "", false); // Thread-safe.
+		i = 0;
 		break;
 	case HOT_IF_EXIST:
 	case HOT_IF_NOT_EXIST:
-		found_hwnd = WinExist(g_default, aWinTitle, aWinText, "", "", false, false); // Thread-safe.
+		i = 1;
 		break;
 	default: // HOT_NO_CRITERION (listed last because most callers avoids calling here by checking this value first).
 		return (HWND)1; // Always allow hotkey to fire.
 	}
+	LARGE_INTEGER start, finish, frequency;
+	QueryPerformanceCounter(&start);
+	InterlockedIncrement((LPLONG)&g_HotCriterionCalls);
+
+	HWND found_hwnd;
+	DWORD snapshot_id;
+	if (aCriterion->mWindowCriteria->mNeedsSearch) // The snapshot can't answer it, but its ID still limits how long the answer is cached.
+	{
+		snapshot_id = WindowSnapshot::GetID(false, i == 0);
+		if (aCriterion->mSnapshotID[i] == snapshot_id)
+			found_hwnd = aCriterion->mFoundHwnd[i];
+		else
+		{
+			found_hwnd = i ? WinExist(g_default, aCriterion->mHotWinTitle, aCriterion->mHotWinText, "", "", false, false) // Thread-safe.
+				: WinActive(g_default, aCriterion->mHotWinTitle, aCriterion->mHotWinText, "", "", false); // Thread-safe.
+			aCriterion->mFoundHwnd[i] = found_hwnd; // Must be stored prior to the ID (see HotkeyCriterion).
+			aCriterion->mSnapshotID[i] = snapshot_id;
+			InterlockedIncrement((LPLONG)&g_HotCriterionEvaluations);
+		}
+	}
+	else if (aCriterion->mSnapshotID[i] == WindowSnapshot::GetID(i == 1, i == 0))
+		found_hwnd = aCriterion->mFoundHwnd[i];
+	else
+	{
+		found_hwnd = WindowSnapshot::FindMatch(*aCriterion->mWindowCriteria, i == 0, g_default, snapshot_id);
+		aCriterion->mFoundHwnd[i] = found_hwnd; // Must be stored prior to the ID (see HotkeyCriterion).
+		aCriterion->mSnapshotID[i] = snapshot_id;
+		InterlockedIncrement((LPLONG)&g_HotCriterionEvaluations);
+	}
+
+	QueryPerformanceCounter(&finish);
+	if (QueryPerformanceFrequency(&frequency) && frequency.QuadPart)
+		InterlockedExchangeAdd((LPLONG)&g_HotCriterionTime, (LONG)((finish.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart));
 	return (aHotCriterion == HOT_IF_ACTIVE || aHotCriterion == HOT_IF_EXIST) ? found_hwnd : (HWND)!found_hwnd;
 }
 
@@ -70,6 +105,7 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText)
 		g_HotCriterion = HOT_NO_CRITERION; // Don't allow blank title+text to avoid having it interpreted as the last-found-window.
 		g_HotWinTitle = ""; // Helps maintainability and some things might rely on it.
 		g_HotWinText = "";  //
+		g_HotWinCriterion = NULL; //
 		return OK;
 	}
 
@@ -83,6 +119,7 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText)
 			// Match found, so point to the existing memory.
 			g_HotWinTitle = cp->mHotWinTitle;
 			g_HotWinText = cp->mHotWinText;
+			g_HotWinCriterion = cp;
 			return OK;
 		}
 
@@ -105,9 +142,15 @@ ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText)
 	}
 	else
 		cp->mHotWinText = "";
+	// Parse the criteria now rather than each time they're evaluated, which can be many times per keystroke:
+	if (   !(cp->mWindowCriteria = (WindowCriteria *)SimpleHeap::Malloc(sizeof(WindowCriteria)))
+		|| !ParseWindowCriteria(*cp->mWindowCriteria, cp->mHotWinTitle, cp->mHotWinText)   )
+		return FAIL;
+	cp->mSnapshotID[0] = cp->mSnapshotID[1] = 0; // 0 is never the ID of a snapshot, so nothing is cached yet.
 
 	g_HotWinTitle = cp->mHotWinTitle;
 	g_HotWinText = cp->mHotWinText;
+	g_HotWinCriterion = cp;
 
 	// Update the linked list:
 	if (!g_FirstHotCriterion)
@@ -147,6 +190,8 @@ void Hotkey::ManifestAllHotkeysHotstringsHooks()
 	// a hotkey processed earlier in the second pass might have been registered when in fact it
 	// should have become a hook hotkey due to something learned only later in the second pass.
 	// Doing these types of things in the first pass resolves such situations.
+	Hotstring::BuildTrie(); // Lets the hook find any hotstrings added since the last call.
+
 	bool vk_is_prefix[VK_ARRAY_COUNT] = {false};
 	bool hk_is_inactive[MAX_HOTKEYS]; // No init needed.
 	bool is_win9x = g_os.IsWin9x(); // Might help performance a little by avoiding calls in loops.
@@ -516,8 +561,7 @@ bool Hotkey::PrefixHasNoEnabledSuffixes(int aVKorSC, bool aIsSC)
 			// whether the hotkey was enabled (above), which isn't enough):
 			if (   vp->mEnabled // This particular variant within its parent hotkey is enabled.
 				&& (!g_IsSuspended || vp->mJumpToLabel->IsExemptFromSuspend()) // This variant isn't suspended...
-				&& (!vp->mHotCriterion || HotCriterionAllowsFiring(vp->mHotCriterion
-					, vp->mHotWinTitle, vp->mHotWinText))   ) // ... and its critieria allow it to fire.
+				&& (!vp->mHotCriterion || HotCriterionAllowsFiring(vp->mHotCriterion, vp->mHotWinCriterion))   ) // ... and its critieria allow it to fire.
 				return false; // At least one of this prefix's suffixes is eligible for firing.
 	}
 	// Since above didn't return, no hotkeys were found for this prefix that are capable of firing.
@@ -559,8 +603,7 @@ HotkeyVariant *Hotkey::CriterionAllowsFiring(HWND *aFoundHWND)
 		// impact performance since the vast majority of hotkeys have either one or just a few variants.
 		if (   vp->mEnabled // This particular variant within its parent hotkey is enabled.
 			&& (!g_IsSuspended || vp->mJumpToLabel->IsExemptFromSuspend()) // This variant isn't suspended...
-			&& (!vp->mHotCriterion || (found_hwnd = HotCriterionAllowsFiring(vp->mHotCriterion
-				, vp->mHotWinTitle, vp->mHotWinText)))   ) // ... and its critieria allow it to fire.
+			&& (!vp->mHotCriterion || (found_hwnd = HotCriterionAllowsFiring(vp->mHotCriterion, vp->mHotWinCriterion)))   ) // ... and its critieria allow it to fire.
 		{
 			if (vp->mHotCriterion) // Since this is the first criteria hotkey, it takes precedence.
 				return vp;
@@ -1503,6 +1546,7 @@ HotkeyVariant *Hotkey::AddVariant(Label *aJumpToLabel, bool aSuffixHasTilde)
 	v.mHotCriterion = g_HotCriterion; // If this hotkey is an alt-tab one (mHookAction), this is stored but ignored until/unless the Hotkey command converts it into a non-alt-tab hotkey.
 	v.mHotWinTitle = g_HotWinTitle;
 	v.mHotWinText = g_HotWinText;  // The value of this and other globals used above can vary during load-time.
+	v.mHotWinCriterion = g_HotWinCriterion;
 	v.mEnabled = true;
 	if (aSuffixHasTilde)
 	{
@@ -2184,6 +2228,8 @@ Hotstring **Hotstring::shs = NULL;
 HotstringIDType Hotstring::sHotstringCount = 0;
 HotstringIDType Hotstring::sHotstringCountMax = 0;
 bool Hotstring::mAtLeastOneEnabled = false;
+HotstringTrie *Hotstring::sTrie = NULL;
+HotstringTrie *Hotstring::sOldTrie = NULL;
 
 
 void Hotstring::SuspendAll(bool aSuspend)
@@ -2219,6 +2265,208 @@ void Hotstring::SuspendAll(bool aSuspend)
 
 
 
+static void FreeHotstringTrie(HotstringTrie *aTrie)
+{
+	if (!aTrie)
+		return;
+	for (int k = 0; k < 2; ++k)
+	{
+		free(aTrie->mNode[k]);
+		free(aTrie->mMatch[k]);
+	}
+	free(aTrie);
+}
+
+
+
+void Hotstring::BuildTrie()
+// Called by ManifestAllHotkeysHotstringsHooks() so that hotstrings added since the last call become
+// part of the trie.  The hook thread might be searching sTrie at this very moment, so a new trie is
+// built and then put into effect by replacing the pointer.  The one it replaced is freed only upon the
+// next rebuild, by which time the hook has long since finished with it.  If memory can't be allocated,
+// the old trie stays in effect and FindMatch() checks the hotstrings it lacks one by one.
+{
+	if (!sHotstringCount || sTrie && sTrie->mHotstringCount == sHotstringCount)
+		return;
+
+	HotstringTrie *trie;
+	UINT *node_of; // The node at which each hotstring's abbreviation ends.
+	UINT node_count[2] = {1, 1}, match_count[2] = {0, 0}; // The root is node 0.
+	HotstringIDType u;
+	UINT n, child;
+	char *cp;
+	int k;
+	if (   !(trie = (HotstringTrie *)calloc(1, sizeof(HotstringTrie)))
+		|| !(node_of = (UINT *)malloc(sHotstringCount * sizeof(UINT)))   )
+	{
+		free(trie);
+		return;
+	}
+	// Each character of an abbreviation adds at most one node, so the following is enough:
+	for (u = 0; u < sHotstringCount; ++u)
+	{
+		k = shs[u]->mEndCharRequired;
+		node_count[k] += shs[u]->mStringLength;
+		++match_count[k];
+	}
+	for (k = 0; k < 2; ++k)
+	{
+		if (   !(trie->mNode[k] = (HotstringTrieNode *)calloc(node_count[k], sizeof(HotstringTrieNode)))
+			|| !(trie->mMatch[k] = (HotstringIDType *)malloc((match_count[k] + 1) * sizeof(HotstringIDType)))   ) // +1 to avoid malloc(0).
+		{
+			FreeHotstringTrie(trie);
+			free(node_of);
+			return;
+		}
+		node_count[k] = 1; // Reset for use below.
+	}
+
+	for (u = 0; u < sHotstringCount; ++u)
+	{
+		Hotstring &hs = *shs[u];
+		k = hs.mEndCharRequired;
+		HotstringTrieNode *node = trie->mNode[k];
+		for (n = 0, cp = hs.mString + hs.mStringLength - 1; cp >= hs.mString; --cp, n = child)
+		{
+			UCHAR ch = (UCHAR)(size_t)ltolower(*cp);
+			if (n)
+				for (child = node[n].mFirstChild; child && node[child].mChar != ch; child = node[child].mNextSibling);
+			else
+				child = trie->mRootChild[k][ch];
+			if (!child)
+			{
+				child = node_count[k]++;
+				node[child].mChar = ch;
+				if (n)
+				{
+					node[child].mNextSibling = node[n].mFirstChild;
+					node[n].mFirstChild = child;
+				}
+				else
+					trie->mRootChild[k][ch] = child;
+			}
+		}
+		node_of[u] = n; // Never the root because abbreviations can't be blank.
+		++node[n].mMatchCount;
+	}
+	// Give each node its range within mMatch, then fill the ranges in order of precedence so that
+	// FindMatch() can merge them:
+	for (k = 0; k < 2; ++k)
+		for (match_count[k] = 0, n = 1; n < node_count[k]; ++n)
+		{
+			trie->mNode[k][n].mFirstMatch = match_count[k];
+			match_count[k] += trie->mNode[k][n].mMatchCount;
+			trie->mNode[k][n].mMatchCount = 0;
+		}
+	for (u = 0; u < sHotstringCount; ++u)
+	{
+		k = shs[u]->mEndCharRequired;
+		HotstringTrieNode &node = trie->mNode[k][node_of[u]];
+		trie->mMatch[k][node.mFirstMatch + node.mMatchCount++] = u;
+	}
+	free(node_of);
+	trie->mHotstringCount = sHotstringCount;
+
+	FreeHotstringTrie(sOldTrie);
+	sOldTrie = sTrie;
+	sTrie = trie;
+}
+
+
+
+HotstringIDType Hotstring::FindMatch(char *aBuf, int aBufLength)
+// Returns the index of the first hotstring (in order of precedence, i.e. the order in which they
+// appear in the script) that matches the end of aBuf and is eligible to fire, or HOTSTRING_INDEX_INVALID
+// if none.  Caller has ensured aBufLength > 0.  This is called by the hook for each character typed,
+// so the trie is used to limit the work to the length of the longest abbreviation that matches, no
+// matter how many hotstrings there are.
+{
+	struct match_list_type
+	{
+		HotstringIDType *match, *match_end;
+		int start; // Where in aBuf the abbreviations of these hotstrings begin.
+	} list[2 * MAX_HOTSTRING_LENGTH];
+	int list_count = 0, best, start, end, i, k;
+	HotstringTrie *trie = sTrie; // Local copy in case the main thread replaces it (see BuildTrie).
+	HotstringIDType u, trie_hotstring_count = trie ? trie->mHotstringCount : 0;
+	UINT n;
+	bool ends_with_end_char = strchr(g_EndChars, aBuf[aBufLength - 1]);
+
+	if (trie)
+	{
+		for (k = 0; k < 2; ++k)
+		{
+			if (k && !ends_with_end_char)
+				break;
+			HotstringTrieNode *node = trie->mNode[k];
+			// Walk backward from the last character (or the one prior to the end-char), collecting the
+			// hotstrings of each node along the way:
+			for (n = 0, i = aBufLength - 1 - k; i >= 0; --i)
+			{
+				UCHAR ch = (UCHAR)(size_t)ltolower(aBuf[i]);
+				if (n)
+					for (n = node[n].mFirstChild; n && node[n].mChar != ch; n = node[n].mNextSibling);
+				else
+					n = trie->mRootChild[k][ch];
+				if (!n)
+					break;
+				if (node[n].mMatchCount)
+				{
+					list[list_count].match = trie->mMatch[k] + node[n].mFirstMatch;
+					list[list_count].match_end = list[list_count].match + node[n].mMatchCount;
+					list[list_count++].start = i;
+				}
+			}
+		}
+		// Each list is in ascending order, so visit their hotstrings in order of precedence by
+		// repeatedly taking the lowest index among them until one is found that can fire:
+		for (;;)
+		{
+			for (best = -1, i = 0; i < list_count; ++i)
+				if (list[i].match < list[i].match_end && (best < 0 || *list[i].match < *list[best].match))
+					best = i;
+			if (best < 0)
+				break;
+			u = *list[best].match++;
+			if (shs[u]->AllowsFiring(aBuf, list[best].start))
+				return u;
+		}
+	}
+
+	// Check any hotstrings that aren't yet in the trie (see BuildTrie):
+	for (u = trie_hotstring_count; u < sHotstringCount; ++u)
+	{
+		Hotstring &hs = *shs[u];
+		if (hs.mEndCharRequired && !ends_with_end_char)
+			continue;
+		end = aBufLength - hs.mEndCharRequired; // Omit the end-char, if any.
+		if (   (start = end - hs.mStringLength) < 0   ) // The buffer is too short.
+			continue;
+		// v1.0.43.03: Using CharLower vs. tolower seems the best default behavior (even though slower)
+		// so that languages in which the higher ANSI characters are common will see them as equal.
+		for (i = 0; i < hs.mStringLength && ltolower(aBuf[start + i]) == ltolower(hs.mString[i]); ++i);
+		if (i == hs.mStringLength && hs.AllowsFiring(aBuf, start))
+			return u;
+	}
+	return HOTSTRING_INDEX_INVALID;
+}
+
+
+
+bool Hotstring::AllowsFiring(char *aBuf, int aStart)
+// Caller has ensured that this hotstring's abbreviation matches aBuf+aStart when case is ignored.
+{
+	return !mSuspended
+		&& (!mCaseSensitive || !strncmp(aBuf + aStart, mString, mStringLength))
+		// The "?" option is required if what lies to the left of the abbreviation is alphanumeric:
+		&& (mDetectWhenInsideWord || !aStart || !IsCharAlphaNumeric(aBuf[aStart - 1]))
+		// v1.0.41: And the right window must be active or exist.  Criterion hotstrings aren't
+		// given precedence over global ones that appear higher up in the script (see CollectInput).
+		&& HotCriterionAllowsFiring(mHotCriterion, mHotWinCriterion);
+}
+
+
+
 ResultType Hotstring::Perform()
 // Returns OK or FAIL.  Caller has already ensured that the backspacing (if specified by mDoBackspace)
 // has been done.
@@ -2381,7 +2629,7 @@ Hotstring::Hotstring(Label *aJumpToLabel, char *aOptions, char *aHotstring, char
 	, mOmitEndChar(g_HSOmitEndChar), mSendRaw(aHasContinuationSection ? true : g_HSSendRaw)
 	, mEndCharRequired(g_HSEndCharRequired), mDetectWhenInsideWord(g_HSDetectWhenInsideWord), mDoReset(g_HSDoReset)
 	, mHotCriterion(g_HotCriterion)
-	, mHotWinTitle(g_HotWinTitle), mHotWinText(g_HotWinText)
+	, mHotWinTitle(g_HotWinTitle), mHotWinText(g_HotWinText), mHotWinCriterion(g_HotWinCriterion)
 	, mConstructedOK(false)
 {
 	// Insist on certain qualities so that they never need to be checked other than here:
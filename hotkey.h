@@ -59,14 +59,26 @@ enum HotkeyTypeEnum {HK_NORMAL, HK_KEYBD_HOOK, HK_MOUSE_HOOK, HK_BOTH_HOOKS, HK_
 
 typedef UCHAR HotCriterionType;
 enum HotCriterionEnum {HOT_NO_CRITERION, HOT_IF_ACTIVE, HOT_IF_NOT_ACTIVE, HOT_IF_EXIST, HOT_IF_NOT_EXIST}; // HOT_NO_CRITERION must be zero.
-HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, char *aWinTitle, char *aWinText); // Used by hotkeys and hotstrings.
+struct HotkeyCriterion;
+HWND HotCriterionAllowsFiring(HotCriterionType aHotCriterion, HotkeyCriterion *aCriterion); // Used by hotkeys and hotstrings.
 ResultType SetGlobalHotTitleText(char *aWinTitle, char *aWinText);
 
 
 
+struct WindowCriteria; // See window.h.
+
 struct HotkeyCriterion
 {
 	char *mHotWinTitle, *mHotWinText;
+	WindowCriteria *mWindowCriteria; // The above, parsed in advance for use with WindowSnapshot::FindMatch().
+	// The outcome of the most recent #IfWin[Not]Active ([0]) and #IfWin[Not]Exist ([1]) evaluation, which
+	// stays valid for as long as the WindowSnapshot whose ID was stored with it.  Since this is shared by
+	// every variant that has this criterion, each criterion is evaluated at most once per snapshot.
+	// mFoundHwnd is always stored before mSnapshotID (see HotCriterionAllowsFiring), so the only effect of
+	// the hook thread and main thread racing to update them is that the result of a slightly newer
+	// snapshot might be used.
+	HWND mFoundHwnd[2];
+	DWORD mSnapshotID[2];
 	HotkeyCriterion *mNextCriterion;
 };
 
@@ -77,6 +89,7 @@ struct HotkeyVariant
 	Label *mJumpToLabel;
 	DWORD mRunAgainTime;
 	char *mHotWinTitle, *mHotWinText;
+	HotkeyCriterion *mHotWinCriterion; // The criterion record that holds the above, or NULL if mHotCriterion is HOT_NO_CRITERION.
 	HotkeyVariant *mNextVariant;
 	int mPriority;
 	// Keep members that are less than 32-bit adjacent to each other to conserve memory in with the default
@@ -321,6 +334,26 @@ typedef UINT HotstringIDType;
 
 enum CaseConformModes {CASE_CONFORM_NONE, CASE_CONFORM_ALL_CAPS, CASE_CONFORM_FIRST_CAP};
 
+struct HotstringTrieNode
+{
+	UINT mFirstChild, mNextSibling; // Node indices, where 0 means "none" since the root (node 0) is nobody's child.
+	UINT mFirstMatch, mMatchCount;  // The hotstrings whose abbreviation ends at this node (see HotstringTrie::mMatch).
+	UCHAR mChar; // Always lowercase (see HotstringTrie).
+};
+
+struct HotstringTrie
+// The abbreviations of all hotstrings, each stored in reverse so that the hook can walk backward from the
+// end of g_HSBuf and visit only those hotstrings that could possibly match, rather than comparing every
+// hotstring against the buffer on each keystroke.  Characters are stored lowercase so that one trie serves
+// both case-sensitive and case-insensitive hotstrings (the former are verified upon reaching them).
+// Element [0] of each array is for hotstrings that don't require an ending character, [1] for those that do.
+{
+	HotstringTrieNode *mNode[2];
+	HotstringIDType *mMatch[2];   // Indices into Hotstring::shs, grouped by node and in ascending order within each node.
+	UINT mRootChild[2][256];      // The root's children, indexed by character for performance.
+	HotstringIDType mHotstringCount; // shs[0..mHotstringCount-1] are in the trie; any others must be searched the old way.
+};
+
 
 class Hotstring
 {
@@ -329,9 +362,11 @@ public:
 	static HotstringIDType sHotstringCount;
 	static HotstringIDType sHotstringCountMax;
 	static bool mAtLeastOneEnabled; // v1.0.44.08: For performance, such as avoiding calling ToAsciiEx() in the hook.
+	static HotstringTrie *sTrie, *sOldTrie; // See BuildTrie().
 
 	Label *mJumpToLabel;
 	char *mString, *mReplacement, *mHotWinTitle, *mHotWinText;
+	HotkeyCriterion *mHotWinCriterion; // See HotkeyVariant.
 	int mPriority, mKeyDelay;
 
 	// Keep members that are smaller than 32-bit adjacent with each other to conserve memory (due to 4-byte alignment).
@@ -344,6 +379,9 @@ public:
 		, mDetectWhenInsideWord, mDoReset, mConstructedOK;
 
 	static void SuspendAll(bool aSuspend);
+	static void BuildTrie();
+	static HotstringIDType FindMatch(char *aBuf, int aBufLength);
+	bool AllowsFiring(char *aBuf, int aStart);
 	ResultType Perform();
 	void DoReplace(LPARAM alParam);
 	static ResultType AddHotstring(Label *aJumpToLabel, char *aOptions, char *aHotstring, char *aReplacement
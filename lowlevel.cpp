@@ -3,7 +3,6 @@
 #include "application.h" // for MsgSleep()
 #include "exports.h"
 #include "script.h"
-// #define BETA
 #define BIF(fun) void fun(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount)
 
 
@@ -58,20 +57,22 @@ BIF(BIF_GetTokenValue)
 
     if (token->symbol == SYM_VAR)
     {
-		Var &var = *token->var;
+		Var &var = *token->var->ResolveAlias();
 
-#ifdef BETA
-		VarAttribType cache_attrib = var.mAttrib & (VAR_ATTRIB_HAS_VALID_INT64 | VAR_ATTRIB_HAS_VALID_DOUBLE);
-		if (cache_attrib)
+		if (var.mAttrib & VAR_ATTRIB_HAS_VALID_INT64)
 		{
-			aResultToken.symbol = (SymbolType) (cache_attrib >> 4);
+			aResultToken.symbol = SYM_INTEGER;
 			aResultToken.value_int64 = var.mContentsInt64;
 		}
+		else if (var.mAttrib & VAR_ATTRIB_HAS_VALID_DOUBLE)
+		{
+			aResultToken.symbol = SYM_FLOAT;
+			aResultToken.value_double = var.mContentsDouble;
+		}
 		else
-#endif
 		{
 			aResultToken.symbol = SYM_OPERAND;
-			aResultToken.marker = var.mContents;
+			aResultToken.marker = var.Contents();
 		}
     }
     else
@@ -82,6 +83,9 @@ BIF(BIF_GetTokenValue)
 }
 
 BIF(BIF_CacheEnable)
+// Lets a var whose address was taken cache its number again (see VAR_ATTRIB_CACHE_DISABLED), for scripts
+// that know nothing will write to that address anymore.
 {
-// to implement
+	if (aParam[0]->symbol == SYM_VAR)
+		aParam[0]->var->ResolveAlias()->mAttrib &= ~VAR_ATTRIB_CACHE_DISABLED;
 }
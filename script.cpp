@@ -22,6 +22,7 @@ GNU General Public License for more details.
 #include "window.h" // for a lot of things
 #include "application.h" // for MsgSleep()
 #include "exports.h" // Naveen v8
+#include <io.h> // for _get_osfhandle() used by Loop Read.
 // Globals that are for only this module:
 #define MAX_COMMENT_FLAG_LENGTH 15
 static char g_CommentFlag[MAX_COMMENT_FLAG_LENGTH + 1] = ";"; // Adjust the below for any changes.
@@ -45,8 +46,9 @@ Script::Script()
 	, mFirstLabel(NULL), mLastLabel(NULL)
 	, mFirstFunc(NULL), mLastFunc(NULL)
 	, mFirstTimer(NULL), mLastTimer(NULL), mTimerEnabledCount(0), mTimerCount(0)
+	, mTimerHeap(NULL), mTimerHeapCount(0), mTimerHeapSize(0)
 	, mFirstMenu(NULL), mLastMenu(NULL), mMenuCount(0)
-	, mVar(NULL), mVarCount(0), mVarCountMax(0), mLazyVar(NULL), mLazyVarCount(0)
+	, mVar(NULL), mVarCount(0), mVarCountMax(0), mVarIsSorted(true)
 	, mOpenBlockCount(0), mNextLineIsFunctionBody(false)
 	, mFuncExceptionVar(NULL), mFuncExceptionVarCount(0)
 	, mCurrFileIndex(0), mCombinedLineNumber(0), mNoHotkeyLabels(true), mMenuUseErrorLevel(false)
@@ -58,6 +60,7 @@ Script::Script()
 #else
 	, mIncludeLibraryFunctionsThenExit(NULL)
 #endif
+	, mImage(NULL)
 	, mLinesExecutedThisCycle(0), mUninterruptedLineCountMax(1000), mUninterruptibleTime(15)
 	, mRunAsUser(NULL), mRunAsPass(NULL), mRunAsDomain(NULL)
 	, mCustomIcon(NULL) // Normally NULL unless there's a custom tray icon loaded dynamically.
@@ -119,6 +122,7 @@ Script::~Script() // Destructor.
 	// MSDN: "Before terminating, an application must call the UnhookWindowsHookEx function to free
 	// system resources associated with the hook."
 	AddRemoveHooks(0); // Remove all hooks.
+	WindowSnapshot::StopWatching();
 	if (mNIC.hWnd) // Tray icon is installed.
 		Shell_NotifyIcon(NIM_DELETE, &mNIC); // Remove it.
 	// Destroy any Progress/SplashImage windows that haven't already been destroyed.  This is necessary
@@ -815,6 +819,7 @@ void Script::TerminateApp(int aExitCode)
 // Note that g_script's destructor takes care of most other cleanup work, such as destroying
 // tray icons, menus, and unowned windows such as ToolTip.
 {
+	IniFlushAll(); // Write any changes the script has made to INI files before they're lost.
 	// We call DestroyWindow() because MainWindowProc() has left that up to us.
 	// DestroyWindow() will cause MainWindowProc() to immediately receive and process the
 	// WM_DESTROY msg, which should in turn result in any child windows being destroyed
@@ -923,13 +928,34 @@ LineNumberType Script::LoadFromFile(bool aScriptWasNotspecified)
 	if (   !(mPlaceholderLabel = new Label(""))   ) // Not added to linked list since it's never looked up.
 		return LOADING_FAILED;
 
+#ifndef AUTOHOTKEYSC
+	// If the script has an up-to-date image, the lines are replayed from it rather than read from the
+	// script's files.  Otherwise, the load is recorded if the script has #ScriptImage (see ScriptImage).
+	// Compiled scripts don't need this because they're already loaded from memory.
+	if (!mIncludeLibraryFunctionsThenExit && (mImage = new ScriptImage) && !mImage->Begin(mFileSpec))
+	{
+		delete mImage; // The script neither has an image nor wants one, so there's nothing to do.
+		mImage = NULL;
+	}
+#endif
+
 	// Load the main script file.  This will also load any files it includes with #Include.
+	// An image consists of two phases: the lines of the script's own files (including its #Includes),
+	// and then the lines of any library files that PreparseBlocks() auto-included the first time.
+	// When replaying, the second LoadIncludedFile() below supplies the library lines prior to
+	// PreparseBlocks(), which therefore finds those functions already defined.
 	if (   LoadIncludedFile(mFileSpec, false, false) != OK
 		|| !AddLine(ACT_EXIT) // Fix for v1.0.47.04: Add an Exit because otherwise, a script that ends in an IF-statement will crash in PreparseBlocks() because PreparseBlocks() expects every IF-statements mNextLine to be non-NULL (helps loading performance too).
+		|| mImage && mImage->mReplaying && LoadIncludedFile(mFileSpec, false, false) != OK
 		|| !PreparseBlocks(mFirstLine)   ) // Must preparse the blocks before preparsing the If/Else's further below because If/Else may rely on blocks.
+	{
+		FreeImage();
 		return LOADING_FAILED; // Error was already displayed by the above calls.
+	}
 	// ABOVE: In v1.0.47, the above may have auto-included additional files from the userlib/stdlib.
 	// That's why the above is done prior to adding the EXIT lines and other things below.
+	if (mImage)
+		mImage->EndPhase(mCurrFileIndex, mCombinedLineNumber); // End of the library phase.
 
 #ifndef AUTOHOTKEYSC
 	if (mIncludeLibraryFunctionsThenExit)
@@ -964,11 +990,23 @@ LineNumberType Script::LoadFromFile(bool aScriptWasNotspecified)
 	// Not done since it's number doesn't much matter: ++mCombinedLineNumber;
 	++mCombinedLineNumber;  // So that the EXITs will both show up in ListLines as the line # after the last physical one in the script.
 	if (!(AddLine(ACT_EXIT) && AddLine(ACT_EXIT))) // Second exit guaranties non-NULL mRelatedLine(s).
+	{
+		FreeImage();
 		return LOADING_FAILED;
+	}
 	mPlaceholderLabel->mJumpToLine = mLastLine; // To follow the rule "all labels should have a non-NULL line before the script starts running".
 
 	if (!PreparseIfElse(mFirstLine))
+	{
+		FreeImage();
 		return LOADING_FAILED; // Error was already displayed by the above calls.
+	}
+
+	if (mImage) // Now that the script is known to have loaded successfully, write its image if appropriate.
+	{
+		mImage->Finish(mFileSpec);
+		FreeImage();
+	}
 
 	// Use FindOrAdd, not Add, because the user may already have added it simply by
 	// referring to it in the script:
@@ -1054,6 +1092,18 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	if (!aFileSpec || !*aFileSpec) return FAIL;
 
 #ifndef AUTOHOTKEYSC
+	// When the script's image is being replayed, the outermost call supplies every line of the current
+	// phase (including those of included files) directly from the image, so any #Include encountered
+	// along the way has nothing left to do.  Line::sSourceFile was already set up by ScriptImage::Open().
+	bool replay_image = false;
+	if (mImage && mImage->mReplaying)
+	{
+		if (mImage->mReplayInProgress)
+			return OK;
+		replay_image = mImage->mReplayInProgress = true;
+	}
+	UINT image_record;
+
 	if (Line::sSourceFileCount >= Line::sMaxSourceFiles)
 	{
 		if (Line::sSourceFileCount >= ABSOLUTE_MAX_SOURCE_FILES)
@@ -1076,7 +1126,7 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 		Line::sMaxSourceFiles = new_max;
 	}
 
-	char full_path[MAX_PATH];
+	char full_path[MAX_PATH], include_key[MAX_PATH], *include_key_copy;
 #endif
 
 	// Keep this var on the stack due to recursion, which allows newly created lines to be given the
@@ -1095,11 +1145,15 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 		char *filename_marker;
 		GetFullPathName(aFileSpec, sizeof(full_path), full_path, &filename_marker);
 		// Check if this file was already included.  If so, it's not an error because we want
-		// to support automatic "include once" behavior.  So just ignore repeats:
-		if (!aAllowDuplicateInclude)
-			for (int f = 0; f < source_file_index; ++f) // Here, source_file_index==Line::sSourceFileCount
-				if (!lstrcmpi(Line::sSourceFile[f], full_path)) // Case insensitive like the file system (testing shows that "" == "" in the NTFS, which is hopefully how lstrcmpi works regardless of locale).
-					return OK;
+		// to support automatic "include once" behavior.  So just ignore repeats.
+		// The path is looked up in mIncludeIndex rather than compared to every file included so far,
+		// which matters for scripts with hundreds of includes.  The index is keyed by the lowercase
+		// path because CharLower() folds non-ASCII letters like the file system does (testing shows
+		// that "" == "" in the NTFS), whereas NameHashTable by itself folds only A-Z:
+		strcpy(include_key, full_path);
+		CharLower(include_key);
+		if (!aAllowDuplicateInclude && !replay_image && mIncludeIndex.Find(include_key))
+			return OK;
 		// The file is added to the list further below, after the file has been opened, in case the
 		// opening fails and aIgnoreLoadFailure==true.
 	}
@@ -1116,11 +1170,15 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 
 #ifndef AUTOHOTKEYSC
 	// Future: might be best to put a stat() or GetFileAttributes() in here for better handling.
-	FILE *fp = fopen(aFileSpec, "r");
-	if (!fp)
+	FILE *fp = replay_image ? NULL : fopen(aFileSpec, "r");
+	if (!fp && !replay_image)
 	{
 		if (aIgnoreLoadFailure)
+		{
+			if (mImage && mImage->mRecording) // The image must become stale if this file is created later.
+				mImage->AddFile(full_path, true);
 			return OK;
+		}
 		snprintf(msg_text, sizeof(msg_text), "%s file \"%s\" cannot be opened."
 			, Line::sSourceFileCount > 0 ? "#Include" : "Script", aFileSpec);
 		MsgBox(msg_text);
@@ -1133,7 +1191,7 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	// NOTE: To save code size, any UTF-8 BOM bytes at the beginning of a compiled script have already been
 	// stripped out by the script compiler.  Thus, there is no need to check for them in the AUTOHOTKEYSC
 	// section further below.
-	if (fgets(buf, 4, fp)) // Success (the fourth character is the terminator).
+	if (fp && fgets(buf, 4, fp)) // Success (the fourth character is the terminator).
 	{
 		if (strcmp(buf, "﻿"))  // UTF-8 BOM marker is NOT present.
 			rewind(fp);  // Go back to the beginning so that the first three bytes aren't omitted during loading.
@@ -1142,9 +1200,22 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	//else file read error or EOF, let a later section handle it.
 
 	// This is done only after the file has been successfully opened in case aIgnoreLoadFailure==true:
-	if (source_file_index > 0)
-		Line::sSourceFile[source_file_index] = SimpleHeap::Malloc(full_path);
-	//else the first file was already taken care of by another means.
+	if (!replay_image)
+	{
+		if (source_file_index > 0)
+			Line::sSourceFile[source_file_index] = SimpleHeap::sMain.Alloc(full_path);
+		else // The first file was already taken care of by another means, but its key is still needed.
+		{
+			strlcpy(include_key, mFileSpec, sizeof(include_key));
+			CharLower(include_key);
+		}
+		if (   !(include_key_copy = SimpleHeap::sMain.Alloc(include_key))
+			|| !mIncludeIndex.Add(include_key_copy, include_key_copy)   )
+			return CloseAndReturn(fp, script_buf, ScriptError(ERR_OUTOFMEM));
+		if (mImage && mImage->mRecording)
+			mImage->AddFile(Line::sSourceFile[source_file_index]);
+		++Line::sSourceFileCount;
+	}
 
 #else // Stand-alone mode (there are no include files in this mode since all of them were merged into the main script at the time of compiling).
 	HS_EXEArc_Read oRead;
@@ -1179,9 +1250,9 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	// this means that instead of a newline character, there may also be carridge
 	// returns 0x0d 0x0a (\r\n)
 	HS_EXEArc_Read *fp = &oRead;  // To help consolidate the code below.
-#endif
 
 	++Line::sSourceFileCount;
+#endif
 
 	// File is now open, read lines from it.
 
@@ -1228,7 +1299,13 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 	buf_length = GetLine(buf, max_chars_to_read, 0, script_buf_marker);
 #else
 	LineNumberType phys_line_number = 0;
-	buf_length = GetLine(buf, LINE_SIZE - 1, 0, fp);
+	if (replay_image) // The loop below gets each line from the image instead.
+	{
+		*buf = '\0';
+		buf_length = 0;
+	}
+	else
+		buf_length = GetLine(buf, LINE_SIZE - 1, 0, fp);
 #endif
 
 	if (in_comment_section = !strncmp(buf, "/*", 2))
@@ -1243,6 +1320,38 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 		// For each whole line (a line with continuation section is counted as only a single line
 		// for the purpose of this outer loop).
 
+#ifndef AUTOHOTKEYSC
+		if (replay_image)
+		{
+			// Each record is a complete line, already stripped of comments and combined with any
+			// continuation lines/sections, so go straight to the processing of it.  The record also
+			// supplies the file index and line number the line originally had.
+			image_record = mImage->NextLine(buf, mCurrFileIndex, mCombinedLineNumber);
+			if (image_record == SCRIPT_IMAGE_END_OF_PHASE)
+				break;
+			mCurrLine = NULL;
+			next_buf_length = 0; // Nothing is read ahead while replaying (see continue_main_loop).
+			if (image_record != SCRIPT_IMAGE_END_OF_FILE)
+			{
+				buf_length = image_record;
+				goto image_line_ready;
+			}
+			// Otherwise, an included file has ended.  A function call on its last line must be resolved
+			// now because the LoadIncludedFile() that originally loaded that file did so at the bottom of
+			// this function, before the lines of the including file resumed.
+			if (*pending_function)
+			{
+				saved_line_number = mCombinedLineNumber;
+				mCombinedLineNumber = pending_function_line_number;
+				if (!ParseAndAddLine(pending_function, ACT_EXPRESSION))
+					return CloseAndReturn(fp, script_buf, FAIL);
+				mCombinedLineNumber = saved_line_number;
+				*pending_function = '\0';
+			}
+			continue;
+		}
+#endif
+
 		// Keep track of this line's *physical* line number within its file for A_LineNumber and
 		// error reporting purposes.  This must be done only in the outer loop so that it tracks
 		// the topmost line of any set of lines merged due to continuation section/line(s)..
@@ -1676,6 +1785,11 @@ ResultType Script::LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude
 		// buf_length can't be -1 (though next_buf_length can) because outer loop's condition prevents it:
 		if (!buf_length) // Done only after the line number increments above so that the physical line number is properly tracked.
 			goto continue_main_loop; // In lieu of "continue", for performance.
+#ifndef AUTOHOTKEYSC
+		if (mImage && mImage->mRecording)
+			mImage->AddLine(mCurrFileIndex, mCombinedLineNumber, buf, (UINT)buf_length);
+image_line_ready:
+#endif
 
 		// Since neither of the above executed, or they did but didn't "continue",
 		// buf now contains a non-commented line, either by itself or built from
@@ -2324,7 +2438,18 @@ continue_main_loop: // This method is used in lieu of "continue" for performance
 	free(script_buf); // AutoIt3: Close the archive and free the file in memory.
 	oRead.Close();    //
 #else
-	fclose(fp);
+	if (replay_image)
+		mImage->mReplayInProgress = false;
+	else
+	{
+		fclose(fp);
+		if (mImage && mImage->mRecording)
+		{
+			mImage->EndFile(mCurrFileIndex, mCombinedLineNumber);
+			if (!source_file_index) // The main script file has ended, and with it the first phase (see LoadFromFile).
+				mImage->EndPhase(mCurrFileIndex, mCombinedLineNumber);
+		}
+	}
 #endif
 	return OK;
 }
@@ -2343,13 +2468,354 @@ inline ResultType Script::CloseAndReturn(HS_EXEArc_Read *fp, UCHAR *aBuf, Result
 inline ResultType Script::CloseAndReturn(FILE *fp, UCHAR *aBuf, ResultType aReturnValue)
 {
 	// aBuf is unused in this case.
-	fclose(fp);
+	if (fp) // NULL when the lines were being replayed from the script's image.
+		fclose(fp);
 	return aReturnValue;
 }
 #endif
 
 
 
+void ScriptImage::BuildPath(char *aBuf, char *aScriptFileSpec)
+// Caller must ensure aBuf is at least MAX_PATH in size.
+{
+	snprintf(aBuf, MAX_PATH, "%s%s", aScriptFileSpec, SCRIPT_IMAGE_EXT);
+}
+
+
+
+bool ScriptImage::HashFile(char *aFileSpec, DWORD &aSize, unsigned __int64 &aHash)
+// Sets aSize and aHash to the size and FNV-1a hash of the file's contents.  The file is mapped rather
+// than read so that hashing a large include costs no more than the OS's paging of it.
+// Returns false if the file can't be opened or read.
+{
+	HANDLE file = CreateFile(aFileSpec, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	aHash = 14695981039346656037ULL; // FNV offset basis, which is also the hash of an empty file.
+	aSize = GetFileSize(file, NULL);
+	bool success = (aSize != INVALID_FILE_SIZE);
+	if (success && aSize) // CreateFileMapping() can't map an empty file.
+	{
+		HANDLE mapping;
+		UCHAR *view = NULL;
+		if (mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL))
+		{
+			if (view = (UCHAR *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))
+			{
+				for (UCHAR *cp = view, *end = view + aSize; cp < end; ++cp)
+					aHash = (aHash ^ *cp) * 1099511628211ULL; // FNV prime.
+				UnmapViewOfFile(view);
+			}
+			CloseHandle(mapping);
+		}
+		success = (view != NULL);
+	}
+	CloseHandle(file);
+	return success;
+}
+
+
+
+bool ScriptImage::HasDirective(char *aScriptFileSpec)
+// Returns true if some line of the script's main file starts with #ScriptImage, so that scripts without
+// the directive aren't recorded at all.  A false match (e.g. inside a comment block) merely wastes a
+// recording, since only the directive itself sets mWanted.
+{
+	FILE *fp = fopen(aScriptFileSpec, "r");
+	if (!fp)
+		return false;
+	char buf[LINE_SIZE];
+	bool found = false;
+	while (!found && fgets(buf, sizeof(buf), fp))
+		found = !strnicmp(omit_leading_whitespace(buf), "#ScriptImage", 12);
+	fclose(fp);
+	return found;
+}
+
+
+
+bool ScriptImage::MayReplace(char *aImagePath)
+// Returns true if aImagePath doesn't exist or is an image (perhaps a stale one), so that some other
+// file that merely happens to have the same name is never overwritten.
+{
+	HANDLE file = CreateFile(aImagePath, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	char magic[sizeof(SCRIPT_IMAGE_MAGIC)];
+	DWORD bytes_read;
+	bool is_image = ReadFile(file, magic, sizeof(magic), &bytes_read, NULL) && bytes_read == sizeof(magic)
+		&& !memcmp(magic, SCRIPT_IMAGE_MAGIC, sizeof(magic));
+	CloseHandle(file);
+	return is_image;
+}
+
+
+
+bool ScriptImage::Append(char *&aBuf, UINT &aSize, UINT &aCapacity, void *aData, UINT aDataSize, UINT aPadTo)
+// Appends aDataSize bytes to aBuf (growing it as needed), followed by enough zero bytes to make the
+// size of the appended data a multiple of aPadTo.  Upon out-of-memory, recording is abandoned since
+// an image is only an optimization.
+{
+	UINT padded_size = (aDataSize + aPadTo - 1) / aPadTo * aPadTo;
+	if (aSize + padded_size > aCapacity)
+	{
+		UINT new_capacity = aCapacity ? aCapacity * 2 : 64 * 1024;
+		while (new_capacity < aSize + padded_size)
+			new_capacity *= 2;
+		char *new_buf = (char *)realloc(aBuf, new_capacity);
+		if (!new_buf)
+			return mRecording = false;
+		aBuf = new_buf;
+		aCapacity = new_capacity;
+	}
+	memcpy(aBuf + aSize, aData, aDataSize);
+	memset(aBuf + aSize + aDataSize, 0, padded_size - aDataSize);
+	aSize += padded_size;
+	return true;
+}
+
+
+
+bool ScriptImage::Open(char *aScriptFileSpec)
+// Maps the script's image and validates it in full, so that replaying it never needs to check anything.
+// Returns false if there is no usable image, in which case nothing has been changed.
+{
+	char image_path[MAX_PATH];
+	BuildPath(image_path, aScriptFileSpec);
+	HANDLE file = CreateFile(image_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD image_size = GetFileSize(file, NULL);
+	HANDLE mapping = NULL;
+	if (image_size != INVALID_FILE_SIZE && image_size >= sizeof(ScriptImageHeader))
+		if (mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL))
+		{
+			mView = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping); // The view keeps the mapping alive.
+		}
+	CloseHandle(file);
+	if (!mView)
+		return false;
+
+	ScriptImageHeader &header = *(ScriptImageHeader *)mView;
+	char *files = mView + sizeof(ScriptImageHeader), *lines = files + header.files_size;
+	if (   memcmp(header.magic, SCRIPT_IMAGE_MAGIC, sizeof(SCRIPT_IMAGE_MAGIC))
+		|| strncmp(header.version, NAME_VERSION, sizeof(header.version))
+		|| !header.file_count || header.file_count > ABSOLUTE_MAX_SOURCE_FILES
+		|| header.files_size > image_size || header.lines_size > image_size // Checked individually so that the sum can't overflow.
+		|| sizeof(ScriptImageHeader) + header.files_size + header.lines_size != image_size   )
+		return false;
+
+	// Check that every file is still exactly as it was when the image was recorded (or still absent).
+	UINT i, present_count = 0;
+	char *cp, *end;
+	ScriptImageFile *image_file;
+	DWORD size;
+	unsigned __int64 hash;
+	for (i = 0, cp = files, end = lines; i < header.file_count; ++i)
+	{
+		image_file = (ScriptImageFile *)cp;
+		if (   end - cp < (int)sizeof(ScriptImageFile)
+			|| image_file->path_length >= MAX_PATH || end - cp < (int)(sizeof(ScriptImageFile) + image_file->path_length + 1)   )
+			return false;
+		cp += sizeof(ScriptImageFile);
+		if (cp[image_file->path_length])
+			return false;
+		if (image_file->size == SCRIPT_IMAGE_FILE_ABSENT)
+		{
+			if (!i || GetFileAttributes(cp) != 0xFFFFFFFF)
+				return false;
+		}
+		else
+		{
+			if (!i && lstrcmpi(cp, aScriptFileSpec)) // The image belongs to some other script (e.g. it was copied).
+				return false;
+			if (!HashFile(cp, size, hash) || size != image_file->size || hash != image_file->hash)
+				return false;
+			++present_count;
+		}
+		cp += (image_file->path_length + 1 + 3) & ~3;
+	}
+	if (cp != end)
+		return false;
+
+	// Check the line records so that NextLine() can trust them.
+	ScriptImageLine *image_line;
+	int phase_count = 0;
+	for (cp = lines, end = lines + header.lines_size; cp < end;)
+	{
+		image_line = (ScriptImageLine *)cp;
+		if (end - cp < (int)sizeof(ScriptImageLine)
+			|| image_line->file_index < 0 || (UINT)image_line->file_index >= present_count)
+			return false;
+		cp += sizeof(ScriptImageLine);
+		if (image_line->length == SCRIPT_IMAGE_END_OF_PHASE)
+			++phase_count;
+		else if (image_line->length != SCRIPT_IMAGE_END_OF_FILE)
+		{
+			if (   !image_line->length || image_line->length >= LINE_SIZE
+				|| end - cp < (int)(image_line->length + 1) || cp[image_line->length]   )
+				return false;
+			cp += (image_line->length + 1 + 3) & ~3;
+		}
+	}
+	if (cp != end || phase_count != 2)
+		return false;
+
+	// The image is valid, so register its files the same way LoadIncludedFile() would have, including
+	// their keys in mIncludeIndex so that a later #Include of one of them (e.g. by addFile()) is still
+	// seen as a duplicate.  This is done all at once because the image's lines refer to the files by
+	// index.  Absent files have no index, just as they have none in Line::sSourceFile when loading normally.
+	UINT max_files = present_count < 100 ? 100 : present_count;
+	char **realloc_temp = (char **)realloc(Line::sSourceFile, max_files * sizeof(char *));
+	if (!realloc_temp)
+		return false;
+	Line::sSourceFile = realloc_temp;
+	Line::sMaxSourceFiles = max_files;
+	int source_file_index = 0;
+	char include_key[MAX_PATH], *include_key_copy;
+	for (i = 0, cp = files; i < header.file_count; ++i)
+	{
+		image_file = (ScriptImageFile *)cp;
+		cp += sizeof(ScriptImageFile);
+		if (image_file->size != SCRIPT_IMAGE_FILE_ABSENT)
+		{
+			if (   !(Line::sSourceFile[source_file_index] = source_file_index ? SimpleHeap::sMain.Alloc(cp, image_file->path_length) : aScriptFileSpec)   )
+				return false;
+			strcpy(include_key, cp); // Its length was checked above.
+			CharLower(include_key);
+			if (   !(include_key_copy = SimpleHeap::sMain.Alloc(include_key))
+				|| !g_script.mIncludeIndex.Add(include_key_copy, include_key_copy)   )
+				return false;
+			++source_file_index;
+		}
+		cp += (image_file->path_length + 1 + 3) & ~3;
+	}
+	Line::sSourceFileCount = source_file_index;
+	mNextLine = lines;
+	return true;
+}
+
+
+
+bool ScriptImage::Begin(char *aScriptFileSpec)
+// Returns false if the script has neither a usable image nor the #ScriptImage directive, in which case
+// the caller should delete this object.
+{
+	if (Open(aScriptFileSpec))
+		return mReplaying = true;
+	if (mView)
+	{
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+	return mRecording = HasDirective(aScriptFileSpec);
+}
+
+
+
+UINT ScriptImage::NextLine(char *aBuf, int &aFileIndex, LineNumberType &aLineNumber)
+// Copies the next line into aBuf (which must be at least LINE_SIZE in size) and sets aFileIndex and
+// aLineNumber to where the line came from.  Returns the line's length, or SCRIPT_IMAGE_END_OF_FILE or
+// SCRIPT_IMAGE_END_OF_PHASE for the records that mark those points.
+{
+	ScriptImageLine &image_line = *(ScriptImageLine *)mNextLine;
+	mNextLine += sizeof(ScriptImageLine);
+	aFileIndex = image_line.file_index;
+	aLineNumber = image_line.line_number;
+	if (image_line.length != SCRIPT_IMAGE_END_OF_FILE && image_line.length != SCRIPT_IMAGE_END_OF_PHASE)
+	{
+		memcpy(aBuf, mNextLine, image_line.length + 1); // Include the terminator.
+		mNextLine += (image_line.length + 1 + 3) & ~3;
+	}
+	return image_line.length;
+}
+
+
+
+void ScriptImage::AddFile(char *aFileSpec, bool aIsAbsent)
+// Caller must call this for each file in the same order it adds them to Line::sSourceFile, since their
+// position among the present files is their index.  An absent file may be added anywhere.  The hash of
+// a file is taken now, while it's being loaded, so that a change made during the load makes the image stale.
+{
+	if (!mRecording)
+		return;
+	ScriptImageFile image_file;
+	image_file.hash = 0;
+	image_file.path_length = (UINT)strlen(aFileSpec);
+	if (aIsAbsent)
+		image_file.size = SCRIPT_IMAGE_FILE_ABSENT;
+	else if (!HashFile(aFileSpec, image_file.size, image_file.hash))
+	{
+		mRecording = false;
+		return;
+	}
+	if (Append(mFiles, mFilesSize, mFilesCapacity, &image_file, sizeof(image_file))
+		&& Append(mFiles, mFilesSize, mFilesCapacity, aFileSpec, image_file.path_length + 1, 4))
+		++mFileCount;
+}
+
+
+
+void ScriptImage::AddLine(int aFileIndex, LineNumberType aLineNumber, char *aText, UINT aLength)
+// aLength may instead be SCRIPT_IMAGE_END_OF_FILE or SCRIPT_IMAGE_END_OF_PHASE, in which case aText is ignored.
+{
+	if (!mRecording)
+		return;
+	ScriptImageLine image_line;
+	image_line.file_index = aFileIndex;
+	image_line.line_number = aLineNumber;
+	image_line.length = aLength;
+	if (Append(mLines, mLinesSize, mLinesCapacity, &image_line, sizeof(image_line))
+		&& aLength != SCRIPT_IMAGE_END_OF_FILE && aLength != SCRIPT_IMAGE_END_OF_PHASE)
+		Append(mLines, mLinesSize, mLinesCapacity, aText, aLength + 1, 4);
+}
+
+
+
+void ScriptImage::Finish(char *aScriptFileSpec)
+// Called once the script has loaded successfully.  Writes the image if the script wants one and it was
+// recorded.  A stale image left behind by a script that no longer has #ScriptImage is left alone, since
+// Open() rejects it anyway.  Failure to write is silently ignored because the image is only an optimization.
+{
+	if (!mRecording || !mWanted)
+		return; // The image was replayed (and thus is still valid), recording was abandoned, or the directive was only a false match (see HasDirective).
+	char image_path[MAX_PATH];
+	BuildPath(image_path, aScriptFileSpec);
+	if (!MayReplace(image_path))
+		return;
+	ScriptImageHeader header;
+	ZeroMemory(&header, sizeof(header));
+	memcpy(header.magic, SCRIPT_IMAGE_MAGIC, sizeof(SCRIPT_IMAGE_MAGIC));
+	strlcpy(header.version, NAME_VERSION, sizeof(header.version));
+	header.file_count = mFileCount;
+	header.files_size = mFilesSize;
+	header.lines_size = mLinesSize;
+	HANDLE file = CreateFile(image_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	DWORD bytes_written;
+	bool success = WriteFile(file, &header, sizeof(header), &bytes_written, NULL)
+		&& WriteFile(file, mFiles, mFilesSize, &bytes_written, NULL)
+		&& WriteFile(file, mLines, mLinesSize, &bytes_written, NULL);
+	CloseHandle(file);
+	if (!success) // Don't leave a partial image behind, though Open() would reject it anyway.  It's known to be ours since it was just created.
+		DeleteFile(image_path);
+}
+
+
+
+ScriptImage::~ScriptImage()
+{
+	if (mView)
+		UnmapViewOfFile(mView);
+	free(mFiles);
+	free(mLines);
+}
+
+
+
 #ifdef AUTOHOTKEYSC
 size_t Script::GetLine(char *aBuf, int aMaxCharsToRead, int aInContinuationSection, UCHAR *&aMemFile) // last param = reference to pointer
 #else
@@ -2620,6 +3086,15 @@ inline ResultType Script::IsDirective(char *aBuf)
 		g_persistent = true;
 		return CONDITION_TRUE;
 	}
+	if (IS_DIRECTIVE_MATCH("#ScriptImage"))
+	{
+		// Cache the script's lines so that they can be loaded faster next time (see ScriptImage).
+		// mImage is NULL for compiled scripts, when only gathering library functions, and when the
+		// directive isn't in the main script file (see ScriptImage::HasDirective).
+		if (mImage)
+			mImage->mWanted = true;
+		return CONDITION_TRUE;
+	}
 	if (IS_DIRECTIVE_MATCH("#SingleInstance"))
 	{
 		g_AllowOnlyOneInstance = SINGLE_INSTANCE_PROMPT; // Set default.
@@ -2672,6 +3147,7 @@ inline ResultType Script::IsDirective(char *aBuf)
 			g_HotCriterion = HOT_NO_CRITERION; // Indicate that no criteria are in effect for subsequent hotkeys.
 			g_HotWinTitle = ""; // Helps maintainability and some things might rely on it.
 			g_HotWinText = "";  //
+			g_HotWinCriterion = NULL; //
 			return CONDITION_TRUE;
 		}
 		char *hot_win_title = parameter, *hot_win_text; // Set default for title; text is determined later.
@@ -2828,6 +3304,12 @@ inline ResultType Script::IsDirective(char *aBuf)
 		return CONDITION_TRUE;
 	}
 
+	if (IS_DIRECTIVE_MATCH("#LoopReadChunked")) // "Off" reverts Loop Read to fgets(), which limits lines to READ_FILE_LINE_SIZE.
+	{
+		g_LoopReadChunked = !parameter || Line::ConvertOnOff(parameter) != TOGGLED_OFF;
+		return CONDITION_TRUE;
+	}
+
 	if (IS_DIRECTIVE_MATCH("#WinActivateForce"))
 	{
 		g_WinActivateForce = true;
@@ -2856,6 +3338,19 @@ inline ResultType Script::IsDirective(char *aBuf)
 		}
 		return CONDITION_TRUE;
 	}
+	if (IS_DIRECTIVE_MATCH("#RegExCacheSize"))
+	{
+		if (parameter)
+		{
+			value = ATOI(parameter);  // parameter was set to the right position by the above macro
+			if (value > PCRE_CACHE_SIZE_MAX)
+				value = PCRE_CACHE_SIZE_MAX;
+			else if (value < 1)
+				value = 1;
+			g_RegExCacheSize = value; // Takes effect because the cache isn't allocated until a RegEx is first used, which is after all directives have been processed.
+		}
+		return CONDITION_TRUE;
+	}
 	if (IS_DIRECTIVE_MATCH("#KeyHistory"))
 	{
 		if (parameter)
@@ -2956,6 +3451,7 @@ void ScriptTimer::Disable()
 {
 	mEnabled = false;
 	--g_script.mTimerEnabledCount;
+	g_script.TimerHeapRemove(this);
 	if (!g_script.mTimerEnabledCount && !g_nLayersNeedingTimer && !Hotkey::sJoyHotkeyCount)
 		KILL_MAIN_TIMER
 	// Above: If there are now no enabled timed subroutines, kill the main timer since there's no other
@@ -3009,7 +3505,9 @@ ResultType Script::UpdateOrCreateTimer(Label *aLabel, char *aPeriod, char *aPrio
 		{
 			timer->mEnabled = true;
 			++mTimerEnabledCount;
-			SET_MAIN_TIMER  // Ensure the API timer is always running when there is at least one enabled timed subroutine.
+			// The timer is added to the heap further below, once its due time is known.  The main timer
+			// is set there too, which ensures that the API timer is always running when there is at least
+			// one enabled timed subroutine.
 		}
 		//else do nothing, leave it disabled.
 	}
@@ -3041,6 +3539,23 @@ ResultType Script::UpdateOrCreateTimer(Label *aLabel, char *aPeriod, char *aPrio
 		// Instead, we want it to occur only when the full 5 seconds have elapsed:
 		timer->mTimeLastRun = GetTickCount();
 
+	if (timer->mEnabled) // Schedule it (or reschedule it if its period or priority may have changed).
+	{
+		timer->UpdateDue(GetTickCount64Ext());
+		if (timer->mHeapIndex < 0)
+		{
+			if (!TimerHeapInsert(timer))
+			{
+				timer->mEnabled = false;
+				--mTimerEnabledCount;
+				return ScriptError(ERR_OUTOFMEM);
+			}
+		}
+		else
+			TimerHeapUpdate(timer);
+		SetMainTimerForScriptTimers();
+	}
+
     // Below is obsolete, see above for why:
 	// We don't have to kill or set the main timer because the only way this function is called
 	// is directly from the execution of a script line inside ExecUntil(), in which case:
@@ -3052,6 +3567,93 @@ ResultType Script::UpdateOrCreateTimer(Label *aLabel, char *aPeriod, char *aPrio
 
 
 
+ResultType Script::TimerHeapInsert(ScriptTimer *aTimer)
+// Caller must ensure aTimer isn't already in the heap and that its mDue is up-to-date.
+{
+	if (mTimerHeapCount == mTimerHeapSize)
+	{
+		UINT new_size = mTimerHeapSize ? mTimerHeapSize * 2 : 16;
+		ScriptTimer **new_heap = (ScriptTimer **)realloc(mTimerHeap, new_size * sizeof(ScriptTimer *));
+		if (!new_heap)
+			return FAIL;
+		mTimerHeap = new_heap;
+		mTimerHeapSize = new_size;
+	}
+	aTimer->mHeapIndex = mTimerHeapCount;
+	mTimerHeap[mTimerHeapCount++] = aTimer;
+	TimerHeapSiftUp(aTimer->mHeapIndex);
+	return OK;
+}
+
+
+
+void Script::TimerHeapRemove(ScriptTimer *aTimer)
+// Does nothing if aTimer isn't in the heap.
+{
+	int index = aTimer->mHeapIndex;
+	if (index < 0)
+		return;
+	aTimer->mHeapIndex = -1;
+	if (index == --mTimerHeapCount) // It was the last item, so there's nothing to fill the hole with.
+		return;
+	// Move the last item into the hole, then restore the heap property in whichever direction it's violated:
+	mTimerHeap[index] = mTimerHeap[mTimerHeapCount];
+	mTimerHeap[index]->mHeapIndex = index;
+	TimerHeapUpdate(mTimerHeap[index]);
+}
+
+
+
+void Script::TimerHeapUpdate(ScriptTimer *aTimer)
+// Call this after changing the mDue or mPriority of a timer that's in the heap.
+{
+	int index = aTimer->mHeapIndex;
+	if (index > 0 && TIMER_BEFORE(aTimer, mTimerHeap[(index - 1) / 2]))
+		TimerHeapSiftUp(index);
+	else
+		TimerHeapSiftDown(index);
+}
+
+
+
+void Script::TimerHeapSiftUp(int aIndex)
+{
+	ScriptTimer *timer = mTimerHeap[aIndex];
+	for (int parent; aIndex > 0; aIndex = parent)
+	{
+		parent = (aIndex - 1) / 2;
+		if (!TIMER_BEFORE(timer, mTimerHeap[parent]))
+			break;
+		mTimerHeap[aIndex] = mTimerHeap[parent];
+		mTimerHeap[aIndex]->mHeapIndex = aIndex;
+	}
+	mTimerHeap[aIndex] = timer;
+	timer->mHeapIndex = aIndex;
+}
+
+
+
+void Script::TimerHeapSiftDown(int aIndex)
+{
+	ScriptTimer *timer = mTimerHeap[aIndex];
+	for (int child, count = (int)mTimerHeapCount;; aIndex = child)
+	{
+		child = 2 * aIndex + 1;
+		if (child >= count)
+			break;
+		if (child + 1 < count && TIMER_BEFORE(mTimerHeap[child + 1], mTimerHeap[child]))
+			++child; // Use the right child because it sorts before the left.
+		if (!TIMER_BEFORE(mTimerHeap[child], timer))
+			break;
+		mTimerHeap[aIndex] = mTimerHeap[child];
+		mTimerHeap[aIndex]->mHeapIndex = aIndex;
+	}
+	mTimerHeap[aIndex] = timer;
+	timer->mHeapIndex = aIndex;
+}
+
+
+
 Label *Script::FindLabel(char *aLabelName)
 // Returns the first label whose name matches aLabelName, or NULL if not found.
 // v1.0.42: Since duplicates labels are now possible (to support #IfWin variants of a particular
@@ -3060,10 +3662,10 @@ Label *Script::FindLabel(char *aLabelName)
 // a match is found.
 {
 	if (!aLabelName || !*aLabelName) return NULL;
-	for (Label *label = mFirstLabel; label != NULL; label = label->mNextLabel)
-		if (!stricmp(label->mName, aLabelName)) // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
-			return label; // Match found.
-	return NULL; // No match found.
+	// mLabelIndex keeps only the first label added under each name, so it yields the same label as
+	// searching the linked list from its beginning would.  Its comparisons are case-insensitive in the
+	// same way as stricmp().
+	return (Label *)mLabelIndex.Find(aLabelName);
 }
 
 
@@ -3084,7 +3686,7 @@ ResultType Script::AddLabel(char *aLabelName, bool aAllowDupe)
 	if (!new_name)
 		return FAIL;  // It already displayed the error for us.
 	Label *the_new_label = new Label(new_name); // Pass it the dynamic memory area we created.
-	if (the_new_label == NULL)
+	if (the_new_label == NULL || !mLabelIndex.Add(new_name, the_new_label)) // For dupes, Add() keeps the first label in the index.
 		return ScriptError(ERR_OUTOFMEM);
 	the_new_label->mPrevLabel = mLastLabel;  // Whether NULL or not.
 	if (mFirstLabel == NULL)
@@ -4600,6 +5202,7 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 			this_aArgMap = aArgMap ? aArgMap[i] : NULL; // Same.
 			ArgStruct &this_new_arg = new_arg[i];       // Same.
 			this_new_arg.is_expression = false;         // Set default early, for maintainability.
+			this_new_arg.postfix = NULL;                // Built upon first evaluation if this arg turns out to be an expression.
 
 			if (aActionType == ACT_TRANSFORM)
 			{
@@ -5709,7 +6312,7 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 	case ACT_SETFORMAT:
 		if (aArgc > 0 && !line.ArgHasDeref(1))
 		{
-            if (!stricmp(new_raw_arg1, "Float"))
+            if (!stricmp(new_raw_arg1, "Float") || !stricmp(new_raw_arg1, "FloatFast"))
 			{
 				if (aArgc > 1 && !line.ArgHasDeref(2))
 				{
@@ -5718,7 +6321,7 @@ ResultType Script::AddLine(ActionTypeType aActionType, char *aArg[], ArgCountTyp
 						return ScriptError(ERR_PARAM2_INVALID, new_raw_arg2);
 				}
 			}
-			else if (!stricmp(new_raw_arg1, "Integer"))
+			else if (!stricmp(new_raw_arg1, "Integer") || !stricmp(new_raw_arg1, "IntegerFast"))
 			{
 				if (aArgc > 1 && !line.ArgHasDeref(2) && toupper(*new_raw_arg2) != 'H' && toupper(*new_raw_arg2) != 'D')
 					return ScriptError(ERR_PARAM2_INVALID, new_raw_arg2);
@@ -6413,7 +7016,6 @@ ResultType Script::DefineFunc(char *aBuf, Var *aFuncExceptionVar[])
 			return FAIL; // It already displayed the error.
 
 	Func &func = *g.CurrentFunc; // For performance and convenience.
-	int insert_pos;
 	size_t param_length, value_length;
 	FuncParam param[MAX_FUNCTION_PARAMS];
 	int param_count = 0;
@@ -6448,9 +7050,9 @@ ResultType Script::DefineFunc(char *aBuf, Var *aFuncExceptionVar[])
 
 		// This will search for local variables, never globals, by virtue of the fact that this
 		// new function's mDefaultVarType is always VAR_ASSUME_NONE at this early stage of its creation:
-		if (this_param.var = FindVar(param_start, param_length, &insert_pos))  // Assign.
+		if (this_param.var = FindVar(param_start, param_length))  // Assign.
 			return ScriptError("Duplicate parameter.", param_start);
-		if (   !(this_param.var = AddVar(param_start, param_length, insert_pos, 2))   ) // Pass 2 as last parameter to mean "it's a local but more specifically a function's parameter".
+		if (   !(this_param.var = AddVar(param_start, param_length, 2))   ) // Pass 2 as last parameter to mean "it's a local but more specifically a function's parameter".
 			return FAIL; // It already displayed the error, including attempts to have reserved names as parameter names.
 
 		// v1.0.35: Check if a default value is specified for this parameter and set up for the next iteration.
@@ -6572,11 +7174,76 @@ ResultType Script::DefineFunc(char *aBuf, Var *aFuncExceptionVar[])
 
 
 #ifndef AUTOHOTKEYSC
+#define FUNC_LIB_EXT ".ahk"
+#define FUNC_LIB_EXT_LENGTH 4
+
 struct FuncLibrary
 {
 	char *path;
 	DWORD length;
+	NameHashTable files; // The lowercase name (minus extension) of each library file, built upon first use.
+	char *names; // The keys of the above, each followed by its terminator.  Malloc'd so that a rebuild can free them.
+	UINT names_size;
 };
+static bool sFuncLibraryIndexIsStale = true;
+
+void FuncLibraryIndexReset()
+// Called by addFile() so that a library file created since the index was built can be found.  The index
+// is rebuilt only when a function is next looked up in the library, so this costs nothing otherwise.
+{
+	sFuncLibraryIndexIsStale = true;
+}
+
+
+
+static void IndexFuncLibrary(FuncLibrary &aLib)
+// Lists the library's directory once so that FindFuncInLibrary() can check each candidate filename in
+// memory rather than calling GetFileAttributes() for it.  Since unresolved functions are typically far
+// more numerous than library files, this replaces many failed file system lookups with one directory
+// listing.  The names are lowercased by CharLower() for the reason described at mIncludeIndex.
+// Any previous index is discarded, and a library whose directory doesn't exist is given an empty index.
+// Caller must ensure aLib.path is enabled (non-empty) and has room to append "*.ahk".
+{
+	aLib.files.RemoveAll();
+	free(aLib.names);
+	aLib.names = NULL;
+	aLib.names_size = 0;
+	strcpy(aLib.path + aLib.length, "*" FUNC_LIB_EXT);
+	WIN32_FIND_DATA find_data;
+	HANDLE find_handle = FindFirstFile(aLib.path, &find_data);
+	aLib.path[aLib.length] = '\0';
+	if (find_handle == INVALID_HANDLE_VALUE)
+		return;
+	size_t name_length;
+	UINT names_capacity = 0;
+	char *name;
+	do
+	{
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		// Confirm the extension because the wildcard also matches the short (8.3) name of a file such
+		// as "Name.ahk2", and such files aren't found by the GetFileAttributes() method.
+		name_length = strlen(find_data.cFileName);
+		if (name_length <= FUNC_LIB_EXT_LENGTH || stricmp(find_data.cFileName + name_length - FUNC_LIB_EXT_LENGTH, FUNC_LIB_EXT))
+			continue;
+		name_length -= FUNC_LIB_EXT_LENGTH;
+		find_data.cFileName[name_length] = '\0';
+		CharLowerBuff(find_data.cFileName, (DWORD)name_length);
+		if (aLib.names_size + name_length + 1 > names_capacity)
+		{
+			names_capacity = names_capacity ? names_capacity * 2 : 4096; // Enough for the longest file name.
+			if (   !(name = (char *)realloc(aLib.names, names_capacity))   )
+				break; // Out of memory.  Just use a partial index.
+			aLib.names = name;
+		}
+		memcpy(aLib.names + aLib.names_size, find_data.cFileName, name_length + 1);
+		aLib.names_size += (UINT)name_length + 1;
+	} while (FindNextFile(find_handle, &find_data));
+	FindClose(find_handle);
+	// The names are added only now because the above might have moved them.
+	for (name = aLib.names; name < aLib.names + aLib.names_size; name += strlen(name) + 1)
+		aLib.files.Add(name, name);
+}
 
 Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &aErrorWasShown)
 // Caller must ensure that aFuncName doesn't already exist as a defined function.
@@ -6586,22 +7253,19 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 
 	int i;
 	char *char_after_last_backslash, *terminate_here;
-	DWORD attr;
 
-	#define FUNC_LIB_EXT ".ahk"
-	#define FUNC_LIB_EXT_LENGTH 4
 	#define FUNC_USER_LIB "\\AutoHotkey\\Lib\\" // Needs leading and trailing backslash.
 	#define FUNC_USER_LIB_LENGTH 16
 	#define FUNC_STD_LIB "Lib\\" // Needs trailing but not leading backslash.
 	#define FUNC_STD_LIB_LENGTH 4
 
 	#define FUNC_LIB_COUNT 2
-	static FuncLibrary sLib[FUNC_LIB_COUNT] = {0};
+	static FuncLibrary sLib[FUNC_LIB_COUNT]; // Static, so path is initially NULL.
 
 	if (!sLib[0].path) // Allocate & discover paths only upon first use because many scripts won't use anything from the library. This saves a bit of memory and performance.
 	{
 		for (i = 0; i < FUNC_LIB_COUNT; ++i)
-			if (   !(sLib[i].path = SimpleHeap::Malloc(MAX_PATH))   ) // Need MAX_PATH for to allow room for appending each candidate file/function name.
+			if (   !(sLib[i].path = SimpleHeap::sMain.Alloc(MAX_PATH))   ) // Need MAX_PATH for to allow room for appending each candidate file/function name.
 				return NULL; // Due to rarity, simply pass the failure back to caller.
 
 		// DETERMINE PATH TO "USER" LIBRARY:
@@ -6635,21 +7299,30 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 		}
 
 		for (i = 0; i < FUNC_LIB_COUNT; ++i)
-		{
-			attr = GetFileAttributes(sLib[i].path); // Seems to accept directories that have a trailing backslash, which is good because it simplifies the code.
-			if (attr == 0xFFFFFFFF || !(attr & FILE_ATTRIBUTE_DIRECTORY)) // Directory doesn't exist or it's a file vs. directory. Relies on short-circuit boolean order.
+			if (sLib[i].length >= MAX_PATH-FUNC_LIB_EXT_LENGTH-1) // No room for the "*.ahk" pattern.
 			{
 				*sLib[i].path = '\0'; // Mark this library as disabled.
 				sLib[i].length = 0;   //
 			}
-		}
 	}
 	// Above must ensure that all sLib[].path elements are non-NULL (but they can be "" to indicate "no library").
 
+	// The directories are listed upon first use and again after each addFile() (see FuncLibraryIndexReset()),
+	// since a fragment loaded at runtime might call a function whose library file was created after startup.
+	// A directory that doesn't exist (or is a file) simply gets an empty index, so that it's found if it's
+	// created later.
+	if (sFuncLibraryIndexIsStale)
+	{
+		sFuncLibraryIndexIsStale = false;
+		for (i = 0; i < FUNC_LIB_COUNT; ++i)
+			if (*sLib[i].path)
+				IndexFuncLibrary(sLib[i]);
+	}
+
 	if (!aFuncNameLength) // Caller didn't specify, so use the entire string.
 		aFuncNameLength = strlen(aFuncName);
 
-	char *dest, *first_underscore, class_name_buf[MAX_VAR_NAME_LENGTH + 1];
+	char *dest, *first_underscore, class_name_buf[MAX_VAR_NAME_LENGTH + 1], lowercase_name[MAX_PATH];
 	char *naked_filename = aFuncName;               // Set up for the first iteration.
 	size_t naked_filename_length = aFuncNameLength; //
 
@@ -6662,13 +7335,14 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 
 			if (sLib[i].length + naked_filename_length >= MAX_PATH-FUNC_LIB_EXT_LENGTH)
 				continue; // Path too long to match in this library, but try others.
+			// Consult the library's index rather than the file system (see IndexFuncLibrary()):
+			memcpy(lowercase_name, naked_filename, naked_filename_length); // Above has ensured it fits.
+			CharLowerBuff(lowercase_name, (DWORD)naked_filename_length);
+			if (!sLib[i].files.Find(lowercase_name, naked_filename_length))
+				continue;
 			dest = (char *)memcpy(sLib[i].path + sLib[i].length, naked_filename, naked_filename_length); // Append the filename to the library path.
 			strcpy(dest + naked_filename_length, FUNC_LIB_EXT); // Append the file extension.
 
-			attr = GetFileAttributes(sLib[i].path); // Testing confirms that GetFileAttributes() doesn't support wildcards; which is good because we want filenames containing question marks to be "not found" rather than being treated as a match-pattern.
-			if (attr == 0xFFFFFFFF || (attr & FILE_ATTRIBUTE_DIRECTORY)) // File doesn't exist or it's a directory. Relies on short-circuit boolean order.
-				continue;
-
 			// Since above didn't "continue", a file exists whose name matches that of the requested function.
 			// Before loading/including that file, set the working directory to its folder so that if it uses
 			// #Include, it will be able to use more convenient/intuitive relative paths.  This is similar to
@@ -6736,6 +7410,93 @@ Func *Script::FindFuncInLibrary(char *aFuncName, size_t aFuncNameLength, bool &a
 
 
 
+struct BuiltInFuncInfo
+{
+	char *name;
+	BuiltInFunctionType bif;
+	int min_params, max_params;
+};
+
+// The built-in functions recognized by FindFunc().  Several names can share the same BIF because some
+// BIFs examine the name of the function by which they were called.
+// Maint: max_params of 10000 is an arbitrarily high limit that will never realistically be reached.
+static BuiltInFuncInfo sBuiltInFunc[] =
+{
+	{"LV_GetNext", BIF_LV_GetNextOrCount, 0, 2}
+	, {"LV_GetCount", BIF_LV_GetNextOrCount, 0, 1}
+	, {"LV_GetText", BIF_LV_GetText, 2, 3}
+	, {"LV_Add", BIF_LV_AddInsertModify, 0, 10000} // 0 params means append a blank row.
+	, {"LV_Insert", BIF_LV_AddInsertModify, 1, 10000} // Passing only 1 param to it means "insert a blank row".
+	, {"LV_Modify", BIF_LV_AddInsertModify, 2, 10000} // Although it shares the same function with "Insert", it can still have its own min/max params.
+	, {"LV_Delete", BIF_LV_Delete, 0, 1}
+	, {"LV_InsertCol", BIF_LV_InsertModifyDeleteCol, 1, 3} // Min of 1 because inserting a blank column ahead of the first column does not seem useful enough to sacrifice the no-parameter mode, which might have potential future uses.
+	, {"LV_ModifyCol", BIF_LV_InsertModifyDeleteCol, 0, 3}
+	, {"LV_DeleteCol", BIF_LV_InsertModifyDeleteCol, 1, 1}
+	, {"LV_SetImageList", BIF_LV_SetImageList, 1, 2}
+	, {"TV_Add", BIF_TV_AddModifyDelete, 1, 3}
+	, {"TV_Modify", BIF_TV_AddModifyDelete, 1, 3} // One-parameter mode is "select specified item".
+	, {"TV_Delete", BIF_TV_AddModifyDelete, 0, 1}
+	, {"TV_GetParent", BIF_TV_GetRelatedItem, 1, 1}
+	, {"TV_GetChild", BIF_TV_GetRelatedItem, 1, 1}
+	, {"TV_GetPrev", BIF_TV_GetRelatedItem, 1, 1}
+	, {"TV_GetCount", BIF_TV_GetRelatedItem, 0, 0}
+	, {"TV_GetSelection", BIF_TV_GetRelatedItem, 0, 0}
+	, {"TV_GetNext", BIF_TV_GetRelatedItem, 0, 2} // Unlike "Prev", Next also supports 0 or 2 parameters.
+	, {"TV_Get", BIF_TV_Get, 2, 2}
+	, {"TV_GetText", BIF_TV_Get, 2, 2}
+	, {"IL_Create", BIF_IL_Create, 0, 3}
+	, {"IL_Destroy", BIF_IL_Destroy, 1, 1}
+	, {"IL_Add", BIF_IL_Add, 2, 4}
+	, {"SB_SetText", BIF_StatusBar, 1, 3}
+	, {"SB_SetParts", BIF_StatusBar, 0, 255} // 255 params alllows for up to 256 parts, which is SB's max.
+	, {"SB_SetIcon", BIF_StatusBar, 1, 3}
+	, {"StrLen", BIF_StrLen, 1, 1}
+	, {"SubStr", BIF_SubStr, 2, 3}
+	, {"sendahk", BIF_sendahk, 1, 1} // N11
+	, {"Import", BIF_Import, 1, 3} // addFile() Naveen v8.
+	, {"Static", BIF_Static, 1, 1} // lowlevel() Naveen v9.
+	, {"Alias", BIF_Alias, 1, 2} // lowlevel() Naveen v9.
+	, {"GetTokenValue", BIF_GetTokenValue, 1, 1} // lowlevel() Naveen v9.
+	, {"CacheEnable", BIF_CacheEnable, 1, 1} // lowlevel() Naveen v9.
+	, {"Getvar", BIF_Getvar, 1, 1} // lowlevel() Naveen v9.
+	, {"InStr", BIF_InStr, 2, 4}
+	, {"RegExMatch", BIF_RegEx, 2, 4}
+	, {"RegExMatchNext", BIF_RegEx, 2, 4}
+	, {"RegExReplace", BIF_RegEx, 2, 6}
+	, {"EngineStats", BIF_EngineStats, 2, 3}
+	, {"Profile", BIF_Profile, 1, 2}
+	, {"GetKeyState", BIF_GetKeyState, 1, 2}
+	, {"Asc", BIF_Asc, 1, 1}
+	, {"Chr", BIF_Chr, 1, 1}
+	, {"NumGet", BIF_NumGet, 1, 3}
+	, {"NumPut", BIF_NumPut, 2, 4}
+	, {"IsLabel", BIF_IsLabel, 1, 1}
+	, {"DllCall", BIF_DllCall, 1, 10000}
+	, {"VarSetCapacity", BIF_VarSetCapacity, 1, 3}
+	, {"FileExist", BIF_FileExist, 1, 1}
+	, {"WinExist", BIF_WinExistActive, 0, 4}
+	, {"WinActive", BIF_WinExistActive, 0, 4}
+	, {"Round", BIF_Round, 1, 2}
+	, {"Floor", BIF_FloorCeil, 1, 1}
+	, {"Ceil", BIF_FloorCeil, 1, 1}
+	, {"Mod", BIF_Mod, 2, 2}
+	, {"Abs", BIF_Abs, 1, 1}
+	, {"Sin", BIF_Sin, 1, 1}
+	, {"Cos", BIF_Cos, 1, 1}
+	, {"Tan", BIF_Tan, 1, 1}
+	, {"ASin", BIF_ASinACos, 1, 1}
+	, {"ACos", BIF_ASinACos, 1, 1}
+	, {"ATan", BIF_ATan, 1, 1}
+	, {"Exp", BIF_Exp, 1, 1}
+	, {"Sqrt", BIF_SqrtLogLn, 1, 1}
+	, {"Log", BIF_SqrtLogLn, 1, 1}
+	, {"Ln", BIF_SqrtLogLn, 1, 1}
+	, {"OnMessage", BIF_OnMessage, 1, 3} // See FindFunc() for how this one also makes the script persistent.
+	, {"RegisterCallback", BIF_RegisterCallback, 1, 4}
+};
+
+
+
 Func *Script::FindFunc(char *aFuncName, size_t aFuncNameLength)
 // Returns the Function whose name matches aFuncName (which caller has ensured isn't NULL).
 // If it doesn't exist, NULL is returned.
@@ -6749,340 +7510,44 @@ Func *Script::FindFunc(char *aFuncName, size_t aFuncNameLength)
 	if (aFuncNameLength > MAX_VAR_NAME_LENGTH)
 		return NULL;
 
-	// The following copy is made because it allows the name searching to use stricmp() instead of
-	// strlicmp(), which close to doubles the performance.  The copy includes only the first aVarNameLength
-	// characters from aVarName:
-	char func_name[MAX_VAR_NAME_LENGTH + 1];
-	strlcpy(func_name, aFuncName, aFuncNameLength + 1);  // +1 to convert length to size.
-
+	// The hash index compares only the first aFuncNameLength characters of aFuncName, so unlike the
+	// old linear search, no terminated copy of the name is needed here.
 	Func *pfunc;
-	for (pfunc = mFirstFunc; pfunc; pfunc = pfunc->mNextFunc)
-		if (!stricmp(func_name, pfunc->mName)) // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
-			return pfunc; // Match found.
+	if (pfunc = (Func *)mFuncIndex.Find(aFuncName, aFuncNameLength))
+		return pfunc; // Match found.
 
 	// Since above didn't return, there is no match.  See if it's a built-in function that hasn't yet
-	// been added to the function list.
-
-	// Set defaults to be possibly overridden below:
-	int min_params = 1;
-	int max_params = 1;
-	BuiltInFunctionType bif;
-	char *suffix = func_name + 3;
+	// been added to the function list.  The table of built-in functions is indexed upon first use
+	// by a hash table of its own, which avoids comparing the name to every entry.
+	static NameHashTable sBuiltInFuncIndex;
+	if (!sBuiltInFuncIndex.Count())
+		for (int i = 0; i < sizeof(sBuiltInFunc) / sizeof(BuiltInFuncInfo); ++i)
+			if (!sBuiltInFuncIndex.Add(sBuiltInFunc[i].name, sBuiltInFunc + i))
+			{
+				sBuiltInFuncIndex.RemoveAll(); // So that it will be retried next time rather than being left incomplete.
+				ScriptError(ERR_OUTOFMEM);
+				return NULL;
+			}
+	BuiltInFuncInfo *bif_info;
+	if (   !(bif_info = (BuiltInFuncInfo *)sBuiltInFuncIndex.Find(aFuncName, aFuncNameLength))   )
+		return NULL;
 
-	if (!strnicmp(func_name, "LV_", 3)) // It's a ListView function.
-	{
-		suffix = func_name + 3;
-		if (!stricmp(suffix, "GetNext"))
-		{
-			bif = BIF_LV_GetNextOrCount;
-			min_params = 0;
-			max_params = 2;
-		}
-		else if (!stricmp(suffix, "GetCount"))
-		{
-			bif = BIF_LV_GetNextOrCount;
-			min_params = 0; // But leave max at its default of 1.
-		}
-		else if (!stricmp(suffix, "GetText"))
-		{
-			bif = BIF_LV_GetText;
-			min_params = 2;
-			max_params = 3;
-		}
-		else if (!stricmp(suffix, "Add"))
-		{
-			bif = BIF_LV_AddInsertModify;
-			min_params = 0; // 0 params means append a blank row.
-			max_params = 10000; // An arbitrarily high limit that will never realistically be reached.
-		}
-		else if (!stricmp(suffix, "Insert"))
-		{
-			bif = BIF_LV_AddInsertModify;
-			// Leave min_params at 1.  Passing only 1 param to it means "insert a blank row".
-			max_params = 10000; // An arbitrarily high limit that will never realistically be reached.
-		}
-		else if (!stricmp(suffix, "Modify"))
-		{
-			bif = BIF_LV_AddInsertModify; // Although it shares the same function with "Insert", it can still have its own min/max params.
-			min_params = 2;
-			max_params = 10000; // An arbitrarily high limit that will never realistically be reached.
-		}
-		else if (!stricmp(suffix, "Delete"))
-		{
-			bif = BIF_LV_Delete;
-			min_params = 0; // Leave max at its default of 1.
-		}
-		else if (!stricmp(suffix, "InsertCol"))
-		{
-			bif = BIF_LV_InsertModifyDeleteCol;
-			// Leave min_params at 1 because inserting a blank column ahead of the first column
-			// does not seem useful enough to sacrifice the no-parameter mode, which might have
-			// potential future uses.
-			max_params = 3;
-		}
-		else if (!stricmp(suffix, "ModifyCol"))
-		{
-			bif = BIF_LV_InsertModifyDeleteCol;
-			min_params = 0;
-			max_params = 3;
-		}
-		else if (!stricmp(suffix, "DeleteCol"))
-			bif = BIF_LV_InsertModifyDeleteCol; // Leave min/max set to 1.
-		else if (!stricmp(suffix, "SetImageList"))
-		{
-			bif = BIF_LV_SetImageList;
-			max_params = 2; // Leave min at 1.
-		}
-		else
-			return NULL;
-	}
-	else if (!strnicmp(func_name, "TV_", 3)) // It's a TreeView function.
-	{
-		suffix = func_name + 3;
-		if (!stricmp(suffix, "Add"))
-		{
-			bif = BIF_TV_AddModifyDelete;
-			max_params = 3; // Leave min at its default of 1.
-		}
-		else if (!stricmp(suffix, "Modify"))
-		{
-			bif = BIF_TV_AddModifyDelete;
-			max_params = 3; // One-parameter mode is "select specified item".
-		}
-		else if (!stricmp(suffix, "Delete"))
-		{
-			bif = BIF_TV_AddModifyDelete;
-			min_params = 0;
-		}
-		else if (!stricmp(suffix, "GetParent") || !stricmp(suffix, "GetChild") || !stricmp(suffix, "GetPrev"))
-			bif = BIF_TV_GetRelatedItem;
-		else if (!stricmp(suffix, "GetCount") || !stricmp(suffix, "GetSelection"))
-		{
-			bif = BIF_TV_GetRelatedItem;
-			min_params = 0;
-			max_params = 0;
-		}
-		else if (!stricmp(suffix, "GetNext")) // Unlike "Prev", Next also supports 0 or 2 parameters.
-		{
-			bif = BIF_TV_GetRelatedItem;
-			min_params = 0;
-			max_params = 2;
-		}
-		else if (!stricmp(suffix, "Get") || !stricmp(suffix, "GetText"))
-		{
-			bif = BIF_TV_Get;
-			min_params = 2;
-			max_params = 2;
-		}
-		else
-			return NULL;
-	}
-	else if (!strnicmp(func_name, "IL_", 3)) // It's an ImageList function.
-	{
-		suffix = func_name + 3;
-		if (!stricmp(suffix, "Create"))
-		{
-			bif = BIF_IL_Create;
-			min_params = 0;
-			max_params = 3;
-		}
-		else if (!stricmp(suffix, "Destroy"))
-		{
-			bif = BIF_IL_Destroy; // Leave Min/Max set to 1.
-		}
-		else if (!stricmp(suffix, "Add"))
-		{
-			bif = BIF_IL_Add;
-			min_params = 2;
-			max_params = 4;
-		}
-		else
-			return NULL;
-	}
-	else if (!stricmp(func_name, "SB_SetText"))
-	{
-		bif = BIF_StatusBar;
-		max_params = 3; // Leave min_params at its default of 1.
-	}
-	else if (!stricmp(func_name, "SB_SetParts"))
-	{
-		bif = BIF_StatusBar;
-		min_params = 0;
-		max_params = 255; // 255 params alllows for up to 256 parts, which is SB's max.
-	}
-	else if (!stricmp(func_name, "SB_SetIcon"))
-	{
-		bif = BIF_StatusBar;
-		max_params = 3; // Leave min_params at its default of 1.
-	}
-	else if (!stricmp(func_name, "StrLen"))
-		bif = BIF_StrLen;
-	else if (!stricmp(func_name, "SubStr"))
-	{
-		bif = BIF_SubStr;
-		min_params = 2;
-		max_params = 3;
-	}
-
-	else if (!stricmp(func_name, "sendahk"))  // N11
-	{
-		bif = BIF_sendahk;
-		min_params = 1;
-		max_params = 1;
-	}
-
-			else if (!stricmp(func_name, "Import"))  // addFile() Naveen v8.
-	{
-		bif = BIF_Import;
-		min_params = 1;
-		max_params = 3;
-	}
-else if (!stricmp(func_name, "Static"))  // lowlevel() Naveen v9.
-	{
-		bif = BIF_Static;
-		min_params = 1;
-		max_params = 1;
-	}
-	else if (!stricmp(func_name, "Alias"))  // lowlevel() Naveen v9.
-	{
-		bif = BIF_Alias;
-		min_params = 1;
-		max_params = 2;
-	}
-else if (!stricmp(func_name, "GetTokenValue"))  // lowlevel() Naveen v9.
-	{
-		bif = BIF_GetTokenValue;
-		min_params = 1;
-		max_params = 1;
-	}
-
-else if (!stricmp(func_name, "CacheEnable"))  // lowlevel() Naveen v9.
-	{
-		bif = BIF_CacheEnable;
-		min_params = 1;
-		max_params = 1;
-	}
-
-	else if (!stricmp(func_name, "Getvar"))  // lowlevel() Naveen v9.
-	{
-		bif = BIF_Getvar;
-		min_params = 1;
-		max_params = 1;
-	}
-	else if (!stricmp(func_name, "InStr"))
-	{
-		bif = BIF_InStr;
-		min_params = 2;
-		max_params = 4;
-	}
-	else if (!stricmp(func_name, "RegExMatch"))
-	{
-		bif = BIF_RegEx;
-		min_params = 2;
-		max_params = 4;
-	}
-	else if (!stricmp(func_name, "RegExReplace"))
-	{
-		bif = BIF_RegEx;
-		min_params = 2;
-		max_params = 6;
-	}
-	else if (!stricmp(func_name, "GetKeyState"))
-	{
-		bif = BIF_GetKeyState;
-		max_params = 2;
-	}
-	else if (!stricmp(func_name, "Asc"))
-		bif = BIF_Asc;
-	else if (!stricmp(func_name, "Chr"))
-		bif = BIF_Chr;
-	else if (!stricmp(func_name, "NumGet"))
-	{
-		bif = BIF_NumGet;
-		max_params = 3;
-	}
-	else if (!stricmp(func_name, "NumPut"))
-	{
-		bif = BIF_NumPut;
-		min_params = 2;
-		max_params = 4;
-	}
-	else if (!stricmp(func_name, "IsLabel"))
-		bif = BIF_IsLabel;
-	else if (!stricmp(func_name, "DllCall"))
-	{
-		bif = BIF_DllCall;
-		max_params = 10000; // An arbitrarily high limit that will never realistically be reached.
-	}
-	else if (!stricmp(func_name, "VarSetCapacity"))
-	{
-		bif = BIF_VarSetCapacity;
-		max_params = 3;
-	}
-	else if (!stricmp(func_name, "FileExist"))
-		bif = BIF_FileExist;
-	else if (!stricmp(func_name, "WinExist") || !stricmp(func_name, "WinActive"))
-	{
-		bif = BIF_WinExistActive;
-		min_params = 0;
-		max_params = 4;
-	}
-	else if (!stricmp(func_name, "Round"))
-	{
-		bif = BIF_Round;
-		max_params = 2;
-	}
-	else if (!stricmp(func_name, "Floor") || !stricmp(func_name, "Ceil"))
-		bif = BIF_FloorCeil;
-	else if (!stricmp(func_name, "Mod"))
-	{
-		bif = BIF_Mod;
-		min_params = 2;
-		max_params = 2;
-	}
-	else if (!stricmp(func_name, "Abs"))
-		bif = BIF_Abs;
-	else if (!stricmp(func_name, "Sin"))
-		bif = BIF_Sin;
-	else if (!stricmp(func_name, "Cos"))
-		bif = BIF_Cos;
-	else if (!stricmp(func_name, "Tan"))
-		bif = BIF_Tan;
-	else if (!stricmp(func_name, "ASin") || !stricmp(func_name, "ACos"))
-		bif = BIF_ASinACos;
-	else if (!stricmp(func_name, "ATan"))
-		bif = BIF_ATan;
-	else if (!stricmp(func_name, "Exp"))
-		bif = BIF_Exp;
-	else if (!stricmp(func_name, "Sqrt") || !stricmp(func_name, "Log") || !stricmp(func_name, "Ln"))
-		bif = BIF_SqrtLogLn;
-	else if (!stricmp(func_name, "OnMessage"))
-	{
-		bif = BIF_OnMessage;
-		max_params = 3;  // Leave min at 1.
+	if (bif_info->bif == BIF_OnMessage)
 		// By design, scripts that use OnMessage are persistent by default.  Doing this here
 		// also allows WinMain() to later detect whether this script should become #SingleInstance.
 		// Note: Don't directly change g_AllowOnlyOneInstance here in case the remainder of the
 		// script-loading process comes across any explicit uses of #SingleInstance, which would
 		// override the default set here.
 		g_persistent = true;
-	}
-	else if (!stricmp(func_name, "RegisterCallback"))
-	{
-		bif = BIF_RegisterCallback;
-		max_params = 4; // Leave min_params at 1.
-	}
-	else
-		return NULL; // Maint: There may be other lines above that also return NULL.
 
 	// Since above didn't return, this is a built-in function that hasn't yet been added to the list.
 	// Add it now:
-	if (   !(pfunc = AddFunc(func_name, aFuncNameLength, true))   )
+	if (   !(pfunc = AddFunc(aFuncName, aFuncNameLength, true))   )
 		return NULL;
 
-	pfunc->mBIF = bif;
-	pfunc->mMinParams = min_params;
-	pfunc->mParamCount = max_params;
+	pfunc->mBIF = bif_info->bif;
+	pfunc->mMinParams = bif_info->min_params;
+	pfunc->mParamCount = bif_info->max_params;
 
 	return pfunc;
 }
@@ -7136,7 +7601,7 @@ Func *Script::AddFunc(char *aFuncName, size_t aFuncNameLength, bool aIsBuiltIn)
 		return NULL;
 
 	Func *the_new_func = new Func(new_name, aIsBuiltIn);
-	if (!the_new_func)
+	if (!the_new_func || !mFuncIndex.Add(new_name, the_new_func))
 	{
 		ScriptError(ERR_OUTOFMEM);
 		return NULL;
@@ -7315,7 +7780,7 @@ Var *Line::ResolveVarOfArg(int aArgIndex, bool aCreateIfNecessary)
 			return NULL; // Above already displayed error for us.
 		// The use of ALWAYS_PREFER_LOCAL below improves flexibility of assume-global functions
 		// by allowing this command to resolve to a local first if such a local exists:
-		if (found_var = g_script.FindVar(sVarName, var_name_length, NULL, ALWAYS_PREFER_LOCAL)) // Assign.
+		if (found_var = g_script.FindVar(sVarName, var_name_length, ALWAYS_PREFER_LOCAL)) // Assign.
 			return found_var;
 		// At this point, this is either a non-existent variable or a reserved/built-in variable
 		// that was never statically referenced in the script (only dynamically), e.g. A_IPAddress%A_Index%
@@ -7351,26 +7816,21 @@ Var *Script::FindOrAddVar(char *aVarName, size_t aVarNameLength, int aAlwaysUse,
 {
 	if (!*aVarName)
 		return NULL;
-	int insert_pos;
 	bool is_local; // Used to detect which type of var should be added in case the result of the below is NULL.
 	Var *var;
-	if (var = FindVar(aVarName, aVarNameLength, &insert_pos, aAlwaysUse, apIsException, &is_local))
+	if (var = FindVar(aVarName, aVarNameLength, aAlwaysUse, apIsException, &is_local))
 		return var;
 	// Otherwise, no match found, so create a new var.  This will return NULL if there was a problem,
 	// in which case AddVar() will already have displayed the error:
-	return AddVar(aVarName, aVarNameLength, insert_pos, is_local);
+	return AddVar(aVarName, aVarNameLength, is_local);
 }
 
 
 
-Var *Script::FindVar(char *aVarName, size_t aVarNameLength, int *apInsertPos, int aAlwaysUse
+Var *Script::FindVar(char *aVarName, size_t aVarNameLength, int aAlwaysUse
 	, bool *apIsException, bool *apIsLocal)
-// Caller has ensured that aVarName isn't NULL.  It must also ignore the contents of apInsertPos when
-// a match (non-NULL value) is returned.
+// Caller has ensured that aVarName isn't NULL.
 // Returns the Var whose name matches aVarName.  If it doesn't exist, NULL is returned.
-// If caller provided a non-NULL apInsertPos, it will be given a the array index that a newly
-// inserted item should have to keep the list in sorted order (which also allows the ListVars command
-// to display the variables in alphabetical order).
 {
 	if (!*aVarName)
 		return NULL;
@@ -7383,9 +7843,9 @@ Var *Script::FindVar(char *aVarName, size_t aVarNameLength, int *apInsertPos, in
 	if (aVarNameLength > MAX_VAR_NAME_LENGTH)
 		return NULL;
 
-	// The following copy is made because it allows the various searches below to use stricmp() instead of
-	// strlicmp(), which close to doubles their performance.  The copy includes only the first aVarNameLength
-	// characters from aVarName:
+	// The following copy is made because it allows the load-time searches of the exception list below to
+	// use stricmp() instead of strlicmp(), which close to doubles their performance.  The copy includes
+	// only the first aVarNameLength characters from aVarName:
 	char var_name[MAX_VAR_NAME_LENGTH + 1];
 	strlcpy(var_name, aVarName, aVarNameLength + 1);  // +1 to convert length to size.
 
@@ -7460,77 +7920,17 @@ Var *Script::FindVar(char *aVarName, size_t aVarNameLength, int *apInsertPos, in
 
 	if (apIsLocal) // Its purpose is to inform caller of type it would have been in case we don't find a match.
 		*apIsLocal = is_local; // And it stays this way even if globals will be searched because caller wants that.  In other words, a local var is created by default when there is not existing global or local.
-	if (apInsertPos) // Set default.  Caller should ignore the value when match is found.
-		*apInsertPos = -1;
 	if (apIsException)
 		*apIsException = (found_var != NULL);
 
 	if (found_var) // Match found (as an exception or load-time "is parameter" exception).
-		return found_var; // apInsertPos does not need to be set because caller doesn't need it when match is found.
-
-	// Init for binary search loop:
-	int left, right, mid, result;  // left/right must be ints to allow them to go negative and detect underflow.
-	Var **var;  // An array of pointers-to-var.
-	if (is_local)
-	{
-		var = g.CurrentFunc->mVar;
-		right = g.CurrentFunc->mVarCount - 1;
-	}
-	else
-	{
-		var = mVar;
-		right = mVarCount - 1;
-	}
-
-	// Binary search:
-	for (left = 0; left <= right;) // "right" was already initialized above.
-	{
-		mid = (left + right) / 2;
-		result = stricmp(var_name, var[mid]->mName); // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
-		if (result > 0)
-			left = mid + 1;
-		else if (result < 0)
-			right = mid - 1;
-		else // Match found.
-			return var[mid];
-	}
-
-	// Since above didn't return, no match was found in the main list, so search the lazy list if there
-	// is one.  If there's no lazy list, the value of "left" established above will be used as the
-	// insertion point further below:
-	if (is_local)
-	{
-		var = g.CurrentFunc->mLazyVar;
-		right = g.CurrentFunc->mLazyVarCount - 1;
-	}
-	else
-	{
-		var = mLazyVar;
-		right = mLazyVarCount - 1;
-	}
-
-	if (var) // There is a lazy list to search (and even if the list is empty, left must be reset to 0 below).
-	{
-		// Binary search:
-		for (left = 0; left <= right;)  // "right" was already initialized above.
-		{
-			mid = (left + right) / 2;
-			result = stricmp(var_name, var[mid]->mName); // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
-			if (result > 0)
-				left = mid + 1;
-			else if (result < 0)
-				right = mid - 1;
-			else // Match found.
-				return var[mid];
-		}
-	}
+		return found_var;
 
-	// Since above didn't return, no match was found and "left" always contains the position where aVarName
-	// should be inserted to keep the list sorted.  The item is always inserted into the lazy list unless
-	// there is no lazy list.
-	// Set the output parameter, if present:
-	if (apInsertPos) // Caller wants this value even if we'll be resorting to searching the global list below.
-		*apInsertPos = left; // This is the index a newly inserted item should have to keep alphabetical order.
+	// Look up the name in the hash index of the appropriate list.  This replaces the binary search of
+	// sorted arrays used by earlier versions, which made each new variable an O(n) insertion and was
+	// the main cost of creating large pseudo-arrays (e.g. StringSplit) and dynamic variables.
+	if (found_var = (Var *)(is_local ? g.CurrentFunc->mVarIndex : mVarIndex).Find(aVarName, aVarNameLength))
+		return found_var;
 
 	// Since no match was found, if this is a local fall back to searching the list of globals at runtime
 	// if the caller didn't insist on a particular type:
@@ -7541,15 +7941,15 @@ Var *Script::FindVar(char *aVarName, size_t aVarNameLength, int *apInsertPos, in
 			// In this case, callers want to fall back to globals when a local wasn't found.  However,
 			// they want the insertion (if our caller will be doing one) to insert according to the
 			// current assume-mode.  Therefore, if the mode is VAR_ASSUME_GLOBAL, pass the apIsLocal
-			// and apInsertPos variables to FindVar() so that it will update them to be global.
+			// variable to FindVar() so that it will update it to be global.
 			// Otherwise, do not pass them since they were already set correctly by us above.
 			if (g.CurrentFunc->mDefaultVarType == VAR_ASSUME_GLOBAL)
-				return FindVar(aVarName, aVarNameLength, apInsertPos, ALWAYS_USE_GLOBAL, NULL, apIsLocal);
+				return FindVar(aVarName, aVarNameLength, ALWAYS_USE_GLOBAL, NULL, apIsLocal);
 			else
-				return FindVar(aVarName, aVarNameLength, NULL, ALWAYS_USE_GLOBAL);
+				return FindVar(aVarName, aVarNameLength, ALWAYS_USE_GLOBAL);
 		}
 		if (aAlwaysUse == ALWAYS_USE_DEFAULT && mIsReadyToExecute) // In this case, fall back to globals only at runtime.
-			return FindVar(aVarName, aVarNameLength, NULL, ALWAYS_USE_GLOBAL);
+			return FindVar(aVarName, aVarNameLength, ALWAYS_USE_GLOBAL);
 	}
 	// Otherwise, since above didn't return:
 	return NULL; // No match.
@@ -7557,11 +7957,10 @@ Var *Script::FindVar(char *aVarName, size_t aVarNameLength, int *apInsertPos, in
 
 
 
-Var *Script::AddVar(char *aVarName, size_t aVarNameLength, int aInsertPos, int aIsLocal)
+Var *Script::AddVar(char *aVarName, size_t aVarNameLength, int aIsLocal)
 // Returns the address of the new variable or NULL on failure.
 // Caller must ensure that g.CurrentFunc!=NULL whenever aIsLocal==true.
 // Caller must ensure that aVarName isn't NULL and that this isn't a duplicate variable name.
-// In addition, it has provided aInsertPos, which is the insertion point so that the list stays sorted.
 // Finally, aIsLocal has been provided to indicate which list, global or local, should receive this
 // new variable.  aIsLocal is normally 0 or 1 (boolean), but it may be 2 to indicate "it's a local AND a
 // function's parameter".
@@ -7608,84 +8007,37 @@ Var *Script::AddVar(char *aVarName, size_t aVarNameLength, int aInsertPos, int a
 		}
 	}
 
-	// Allocate some dynamic memory to pass to the constructor:
-	char *new_name = SimpleHeap::Malloc(var_name, aVarNameLength);
+	// Allocate some dynamic memory to pass to the constructor.  Global variables come from the main
+	// arena even while a script fragment is being loaded into an arena of its own, because they outlive
+	// the fragment (see addFile()):
+	SimpleHeap *heap = aIsLocal ? SimpleHeap::Current() : &SimpleHeap::sMain;
+	char *new_name = heap->Alloc(var_name, aVarNameLength);
 	if (!new_name)
 		// It already displayed the error for us.  These mem errors are so unusual that we're not going
 		// to bother varying the error message to include ERR_ABORT if this occurs during runtime.
 		return NULL;
 
-	Var *the_new_var = new Var(new_name, var_type, aIsLocal != 0); // , aAttrib);
+	Var *the_new_var = new (heap) Var(new_name, var_type, aIsLocal != 0); // , aAttrib);
 	if (the_new_var == NULL)
 	{
 		ScriptError(ERR_OUTOFMEM);
 		return NULL;
 	}
 
-	// If there's a lazy var list, aInsertPos provided by the caller is for it, so this new variable
-	// always gets inserted into that list because there's always room for one more (because the
-	// previously added variable would have purged it if it had reached capacity).
-	Var **lazy_var = aIsLocal ? g.CurrentFunc->mLazyVar : mLazyVar;
-	int &lazy_var_count = aIsLocal ? g.CurrentFunc->mLazyVarCount : mLazyVarCount; // Used further below too.
-	if (lazy_var)
-	{
-		if (aInsertPos != lazy_var_count) // Need to make room at the indicated position for this variable.
-			memmove(lazy_var + aInsertPos + 1, lazy_var + aInsertPos, (lazy_var_count - aInsertPos) * sizeof(Var *));
-		//else both are zero or the item is being inserted at the end of the list, so it's easy.
-		lazy_var[aInsertPos] = the_new_var;
-		++lazy_var_count;
-		// In a testing creating between 200,000 and 400,000 variables, using a size of 1000 vs. 500 improves
-		// the speed by 17%, but when you substract out the binary search time (leaving only the insert time),
-		// the increase is more like 34%.  But there is a diminishing return after that: Going to 2000 only
-		// gains 20%, and to 4000 only gains an addition 10%.  Therefore, to conserve memory in functions that
-		// have so many variables that the lazy list is used, a good trade-off seems to be 2000 (8 KB of memory)
-		// per function that needs it.
-		#define MAX_LAZY_VARS 2000 // Don't make this larger than 90000 without altering the incremental increase of alloc_count further below.
-		if (lazy_var_count < MAX_LAZY_VARS) // The lazy list hasn't yet reached capacity, so no need to merge it into the main list.
-			return the_new_var;
-	}
-
-	// Since above didn't return, either there is no lazy list or the lazy list is full and needs to be
-	// merged into the main list.
-
 	// Create references to whichever variable list (local or global) is being acted upon.  These
 	// references simplify the code:
 	Var **&var = aIsLocal ? g.CurrentFunc->mVar : mVar; // This needs to be a ref. too in case it needs to be realloc'd.
 	int &var_count = aIsLocal ? g.CurrentFunc->mVarCount : mVarCount;
 	int &var_count_max = aIsLocal ? g.CurrentFunc->mVarCountMax : mVarCountMax;
-	int alloc_count;
-
-	// Since the above would have returned if the lazy list is present but not yet full, if the left side
-	// of the OR below is false, it also means that lazy_var is NULL.  Thus lazy_var==NULL is implicit for the
-	// right side of the OR:
-	if ((lazy_var && var_count + MAX_LAZY_VARS > var_count_max) || var_count == var_count_max)
-	{
-		// Increase by orders of magnitude each time because realloc() is probably an expensive operation
-		// in terms of hurting performance.  So here, a little bit of memory is sacrificed to improve
-		// the expected level of performance for scripts that use hundreds of thousands of variables.
-		if (!var_count_max)
-			alloc_count = aIsLocal ? 100 : 1000;  // 100 conserves memory since every function needs such a block, and most functions have much fewer than 100 local variables.
-		else if (var_count_max < 1000)
-			alloc_count = 1000;
-		else if (var_count_max < 9999) // Making this 9999 vs. 10000 allows an exact/whole number of lazy_var blocks to fit into main indices between 10000 and 99999
-			alloc_count = 9999;
-		else if (var_count_max < 100000)
-		{
-			alloc_count = 100000;
-			// This is also the threshold beyond which the lazy list is used to accelerate performance.
-			// Create the permanently lazy list:
-			Var **&lazy_var = aIsLocal ? g.CurrentFunc->mLazyVar : mLazyVar;
-			if (   !(lazy_var = (Var **)malloc(MAX_LAZY_VARS * sizeof(Var *)))   )
-			{
-				ScriptError(ERR_OUTOFMEM);
-				return NULL;
-			}
-		}
-		else if (var_count_max < 1000000)
-			alloc_count = 1000000;
-		else
-			alloc_count = var_count_max + 1000000;  // i.e. continue to increase by 4MB (1M*4) each time.
+	bool &var_is_sorted = aIsLocal ? g.CurrentFunc->mVarIsSorted : mVarIsSorted;
 
+	if (var_count == var_count_max)
+	{
+		// Since new variables are simply appended (the hash index takes care of lookups), doubling the
+		// capacity keeps the total cost of realloc() proportional to the number of variables even for
+		// scripts that create millions of them.
+		int alloc_count = var_count_max ? var_count_max * 2
+			: (aIsLocal ? 100 : 1000);  // 100 conserves memory since every function needs such a block, and most functions have much fewer than 100 local variables.
 		Var **temp = (Var **)realloc(var, alloc_count * sizeof(Var *)); // If passed NULL, realloc() will do a malloc().
 		if (!temp)
 		{
@@ -7696,85 +8048,16 @@ Var *Script::AddVar(char *aVarName, size_t aVarNameLength, int aInsertPos, int a
 		var_count_max = alloc_count;
 	}
 
-	if (!lazy_var)
-	{
-		if (aInsertPos != var_count) // Need to make room at the indicated position for this variable.
-			memmove(var + aInsertPos + 1, var + aInsertPos, (var_count - aInsertPos) * sizeof(Var *));
-		//else both are zero or the item is being inserted at the end of the list, so it's easy.
-		var[aInsertPos] = the_new_var;
-		++var_count;
-		return the_new_var;
-	}
-	//else the variable was already inserted into the lazy list, so the above is not done.
-
-	// Since above didn't return, the lazy list is not only present, but full because otherwise it
-	// would have returned higher above.
-
-	// Since the lazy list is now at its max capacity, merge it into the main list (if the
-	// main list was at capacity, this section relies upon the fact that the above already
-	// increased its capacity by an amount far larger than the number of items containined
-	// in the lazy list).
-
-	// LAZY LIST: Although it's not nearly as good as hashing (which might be implemented in the future,
-	// though it would be no small undertaking since it affects so many design aspects, both load-time
-	// and runtime for scripts), this method of accelerating inserts into a binary search array is
-	// enormously beneficial because it improves the scalability of binary-search by two orders
-	// of magnitude (from about 100,000 variables to at least 5M).  Credit for the idea goes to Lazlo.
-	// DETAILS:
-	// The fact that this merge operation is so much faster than total work required
-	// to insert each one into the main list is the whole reason for having the lazy
-	// list.  In other words, the large memmove() that would otherwise be required
-	// to insert each new variable into the main list is completely avoided.  Large memmove()s
-	// are far more costly than small ones because apparently they can't fit into the CPU
-	// cache, so the operation would take hundreds or even thousands of times longer
-	// depending on the speed difference between main memory and CPU cache.  But above and
-	// beyond the CPU cache issue, the lazy sorting method results in vastly less memory
-	// being moved than would have been required without it, so even if the CPU doesn't have
-	// a cache, the lazy list method vastly increases performance for scripts that have more
-	// than 100,000 variables, allowing at least 5 million variables to be created without a
-	// dramatic reduction in performance.
-
-	char *target_name;
-	Var **insert_pos, **insert_pos_prev;
-	int i, left, right, mid;
-
-	// Append any items from the lazy list to the main list that are alphabetically greater than
-	// the last item in the main list.  Above has already ensured that the main list is large enough
-	// to accept all items in the lazy list.
-	for (i = lazy_var_count - 1, target_name = var[var_count - 1]->mName
-		; i > -1 && stricmp(target_name, lazy_var[i]->mName) < 0
-		; --i);
-	// Above is a self-contained loop.
-	// Now do a separate loop to append (in the *correct* order) anything found above.
-	for (int j = i + 1; j < lazy_var_count; ++j) // Might have zero iterations.
-		var[var_count++] = lazy_var[j];
-	lazy_var_count = i + 1; // The number of items that remain after moving out those that qualified.
-
-	// This will have zero iterations if the above already moved them all:
-	for (insert_pos = var + var_count, i = lazy_var_count - 1; i > -1; --i)
-	{
-		// Modified binary search that relies on the fact that caller has ensured a match will never
-		// be found in the main list for each item in the lazy list:
-		for (target_name = lazy_var[i]->mName, left = 0, right = (int)(insert_pos - var - 1); left <= right;)
-		{
-			mid = (left + right) / 2;
-			if (stricmp(target_name, var[mid]->mName) > 0) // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
-				left = mid + 1;
-			else // it must be < 0 because caller has ensured it can't be equal (i.e. that there will be no match)
-				right = mid - 1;
-		}
-		// Now "left" contains the insertion point is is known to be less than var_count due to a previous
-		// set of loops above.  Make a gap there large enough to hold all items because that allows a
-		// smaller total amount of memory to be moved by shifting the gap to the left in the main list,
-		// gradually filling it as we go:
-		insert_pos_prev = insert_pos;  // "prev" is the now the position of the beginning of the gap, but the gap is about to be shifted left by moving memory right.
-		insert_pos = var + left; // This is where it *would* be inserted if we weren't doing the accelerated merge.
-		memmove(insert_pos + i + 1, insert_pos, (insert_pos_prev - insert_pos) * sizeof(Var *));
-		var[left + i] = lazy_var[i]; // Now insert this item at the far right side of the gap just created.
-	}
-	var_count += lazy_var_count;
-	lazy_var_count = 0;  // Indicate that the lazy var list is now empty.
-
+	if (!(aIsLocal ? g.CurrentFunc->mVarIndex : mVarIndex).Add(new_name, the_new_var))
+	{
+		ScriptError(ERR_OUTOFMEM);
+		return NULL;
+	}
+	// The list is kept in order of creation.  ListVars sorts it only when it's displayed, and only if
+	// a variable has been added out of alphabetical order since the last time it was sorted:
+	if (var_count && var_is_sorted && stricmp(new_name, var[var_count - 1]->mName) < 0) // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
+		var_is_sorted = false;
+	var[var_count++] = the_new_var;
 	return the_new_var;
 }
 
@@ -8668,6 +8951,17 @@ Line *Script::PreparseIfElse(Line *aStartingLine, ExecUntilMode aMode, Attribute
 Line *Line::sLog[] = {NULL};  // Initialize all the array elements.
 DWORD Line::sLogTick[]; // No initialization needed.
 int Line::sLogNext = 0;  // Start at the first element.
+DerefType *Line::sBIFCallSite = NULL;
+bool Line::sProfiling = false;
+__int64 Line::sProfileSession = 0;
+int Line::sProfileDepth = 0;
+__int64 Line::sProfileTick;
+ProfileFrame Line::sProfileFrame[PROFILE_MAX_DEPTH];
+ProfileItem *Line::sProfileLine = NULL;
+ProfileItem *Line::sProfileFunc = NULL;
+UINT Line::sProfileLineCount = 0, Line::sProfileLineSize = 0, Line::sProfileFuncCount = 0, Line::sProfileFuncSize = 0;
+ProfileNode *Line::sProfileNode = NULL;
+UINT Line::sProfileNodeCount = 0, Line::sProfileNodeSize = 0;
 
 #ifdef AUTOHOTKEYSC  // Reduces code size to omit things that are unused, and helps catch bugs at compile-time.
 	char *Line::sSourceFile[1]; // No init needed.
@@ -8684,24 +8978,173 @@ char *Line::sArgDeref[MAX_ARGS]; // No init needed.
 Var *Line::sArgVar[MAX_ARGS]; // Same.
 
 
+// Deref buffer pool: Lines that call functions (and threads that interrupt them) need deref buffers of their
+// own, which formerly meant a malloc() and free() for each such line, and more for each line whose size class
+// differed from the previous one's.  Instead, buffers are kept in free lists by size class and handed back
+// out, and only freed after going unused for DEREF_BUF_IDLE_TIME (see TrimDerefBufPool), so that a script
+// with a sustained workload of large strings stops reallocating.  An idle buffer's first bytes hold its
+// list entry.  Buffers remain plain malloc'd memory because a variable can take one over (AcceptNewMem).
+#define DEREF_POOL_CLASSES 10 // Classes 0-8 are 16 KB to 4 MB in powers of two; the last holds any larger size.
+#define DEREF_POOL_MAX_PER_CLASS 4 // More idle buffers than this in one class is rare enough not to be worth keeping.
+#define DEREF_POOL_HUGE_INCREMENT (1024*1024) // Sizes in the last class are rounded up to this.
+struct DerefPoolEntry
+{
+	DerefPoolEntry *mNext;
+	size_t mSize;
+	DWORD mIdleSince;
+};
+static DerefPoolEntry *sDerefPool[DEREF_POOL_CLASSES];
+static int sDerefPoolCount[DEREF_POOL_CLASSES];
+static size_t sDerefPoolBytes = 0;      // Total size of idle buffers in the pool.
+static size_t sDerefBufBytesInUse = 0;  // Total size of buffers that have been acquired and not yet released.
+static size_t sDerefBufPeakInUse = 0;   // High-water mark of the above.
+static size_t sDerefBufPeakTotal = 0;   // High-water mark of the above plus sDerefPoolBytes.
+static __int64 sDerefBufAcquires = 0, sDerefBufReuses = 0, sDerefBufFrees = 0;
+
+
+
+static size_t DerefBufClassSize(size_t aSize, int &aClass)
+// Returns the size of buffer to allocate for aSize bytes, and sets aClass to its index in sDerefPool.
+{
+	size_t class_size = DEREF_BUF_EXPAND_INCREMENT;
+	for (aClass = 0; aClass < DEREF_POOL_CLASSES - 1; ++aClass, class_size <<= 1)
+		if (aSize <= class_size)
+			return class_size;
+	return (aSize + DEREF_POOL_HUGE_INCREMENT - 1) / DEREF_POOL_HUGE_INCREMENT * DEREF_POOL_HUGE_INCREMENT;
+}
+
+
+
+char *Line::AcquireDerefBuf(size_t aSizeNeeded, size_t &aBufSize)
+// Returns a buffer of at least aSizeNeeded bytes and sets aBufSize to its actual size; or returns NULL
+// (leaving aBufSize unchanged) if out of memory.  The caller should eventually pass the buffer to
+// ReleaseDerefBuf() or, if something else has taken ownership of it, DisownDerefBuf().
+{
+	int size_class;
+	size_t buf_size = DerefBufClassSize(aSizeNeeded, size_class);
+	DerefPoolEntry **link, *entry;
+	char *buf;
+	++sDerefBufAcquires;
+	for (link = &sDerefPool[size_class]; entry = *link; link = &entry->mNext)
+		if (entry->mSize >= aSizeNeeded) // Always true except in the last class, whose sizes vary.
+		{
+			*link = entry->mNext;
+			--sDerefPoolCount[size_class];
+			sDerefPoolBytes -= entry->mSize;
+			buf_size = entry->mSize;
+			buf = (char *)entry;
+			++sDerefBufReuses;
+			goto found;
+		}
+	if (   !(buf = (char *)malloc(buf_size))   )
+		return NULL;
+	if (sDerefBufBytesInUse + buf_size + sDerefPoolBytes > sDerefBufPeakTotal)
+		sDerefBufPeakTotal = sDerefBufBytesInUse + buf_size + sDerefPoolBytes;
+found:
+	sDerefBufBytesInUse += buf_size;
+	if (sDerefBufBytesInUse > sDerefBufPeakInUse)
+		sDerefBufPeakInUse = sDerefBufBytesInUse;
+	if (buf_size > LARGE_DEREF_BUF_SIZE)
+		++sLargeDerefBufs;
+	aBufSize = buf_size;
+	return buf;
+}
+
+
+
+void Line::ReleaseDerefBuf(char *aBuf, size_t aBufSize, bool aKeepInPool)
+// Caller must ensure aBuf was returned by AcquireDerefBuf() and that aBufSize is the size it reported.
+{
+	DisownDerefBuf(aBufSize);
+	int size_class;
+	DerefBufClassSize(aBufSize, size_class);
+	if (!aKeepInPool || sDerefPoolCount[size_class] >= DEREF_POOL_MAX_PER_CLASS)
+	{
+		free(aBuf);
+		++sDerefBufFrees;
+		return;
+	}
+	DerefPoolEntry *entry = (DerefPoolEntry *)aBuf;
+	entry->mSize = aBufSize;
+	entry->mIdleSince = GetTickCount();
+	entry->mNext = sDerefPool[size_class]; // Newest first so that the one most likely to be in the CPU cache is reused first.
+	sDerefPool[size_class] = entry;
+	++sDerefPoolCount[size_class];
+	sDerefPoolBytes += aBufSize;
+	if (!g_DerefTimerExists) // Don't reset an existing timer since each entry keeps track of its own idle time.
+		SET_DEREF_TIMER(DEREF_BUF_IDLE_TIME)
+}
+
+
+
+void Line::DisownDerefBuf(size_t aBufSize)
+// Removes a buffer from the in-use accounting, such as when a variable takes it over.
+{
+	sDerefBufBytesInUse -= aBufSize;
+	if (aBufSize > LARGE_DEREF_BUF_SIZE)
+		--sLargeDerefBufs;
+}
+
+
+
+void Line::TrimDerefBufPool()
+// Frees the pooled buffers that have been idle for at least DEREF_BUF_IDLE_TIME.
+{
+	DWORD now = GetTickCount();
+	DerefPoolEntry **link, *entry;
+	for (int size_class = 0; size_class < DEREF_POOL_CLASSES; ++size_class)
+		for (link = &sDerefPool[size_class]; entry = *link;)
+		{
+			if (now - entry->mIdleSince < DEREF_BUF_IDLE_TIME)
+			{
+				link = &entry->mNext;
+				continue;
+			}
+			*link = entry->mNext;
+			--sDerefPoolCount[size_class];
+			sDerefPoolBytes -= entry->mSize;
+			free(entry);
+			++sDerefBufFrees;
+		}
+}
+
+
+
+__int64 Line::GetDerefBufStat(char *aItem, char *aWhich)
+// Reported by EngineStats("DerefBuf").  Returns -1 if aItem isn't recognized.
+{
+	if (!stricmp(aItem, "Acquires")) return sDerefBufAcquires;
+	if (!stricmp(aItem, "Reuses")) return sDerefBufReuses;       // Acquires satisfied from the pool.
+	if (!stricmp(aItem, "Frees")) return sDerefBufFrees;
+	if (!stricmp(aItem, "InUse")) return sDerefBufBytesInUse;    // Bytes.
+	if (!stricmp(aItem, "Pooled")) return sDerefPoolBytes;       // Bytes in idle buffers.
+	if (!stricmp(aItem, "PeakInUse")) return sDerefBufPeakInUse; // High-water mark of InUse.
+	if (!stricmp(aItem, "PeakTotal")) return sDerefBufPeakTotal; // High-water mark of InUse plus Pooled.
+	return -1;
+}
+
+
+
 void Line::FreeDerefBufIfLarge()
+// Called by the deref timer (see DEREF_BUF_IDLE_TIME).
 {
 	if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
 	{
 		// Freeing the buffer should be safe even if the script's current quasi-thread is in the middle
 		// of executing a command, since commands are all designed to make only temporary use of the
 		// deref buffer (they make copies of anything they need prior to calling MsgSleep() or anything
-		// else that might pump messages and thus result in a call to us here).
-		free(sDerefBuf); // The above size-check has ensured this is non-NULL.
+		// else that might pump messages and thus result in a call to us here).  It isn't put into the
+		// pool because the timer has already shown it to be idle.
+		ReleaseDerefBuf(sDerefBuf, sDerefBufSize, false); // The above size-check has ensured this is non-NULL.
 		SET_S_DEREF_BUF(NULL, 0);
-		--sLargeDerefBufs;
-		if (!sLargeDerefBufs)
-			KILL_DEREF_TIMER
 	}
-	//else leave the timer running because some other deref buffer in a recursed ExpandArgs() layer
-	// is still waiting to be freed (even if it isn't, it should be harmless to keep the timer running
-	// just in case, since each call to ExpandArgs() will reset/postpone the timer due to the script
-	// having demonstrated that it isn't idle).
+	TrimDerefBufPool();
+	if (!sLargeDerefBufs && !sDerefPoolBytes)
+		KILL_DEREF_TIMER
+	//else leave the timer running because some pooled buffer hasn't been idle long enough yet or some other
+	// deref buffer in a recursed ExpandArgs() layer is still waiting to be freed (even if it isn't, it should
+	// be harmless to keep the timer running just in case, since each call to ExpandArgs() will reset/postpone
+	// the timer due to the script having demonstrated that it isn't idle).
 }
 
 
@@ -8729,6 +9172,7 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 	RegItemStruct *loop_reg_item;
 	LoopReadFileStruct *loop_read_file;
 	char *loop_field;
+	size_t loop_field_length;
 
 	Line *jump_to_line; // Don't use *apJumpToLine because it might not exist.
 	Label *jump_to_label;  // For use with Gosub & Goto & GroupActivate.
@@ -8818,6 +9262,8 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 		sLogTick[sLogNext++] = GetTickCount();  // Incrementing here vs. separately benches a little faster.
 		if (sLogNext >= LINE_LOG_SIZE)
 			sLogNext = 0;
+		if (sProfiling)
+			ProfileLine(line);
 
 		// Do this only after the opportunity to Sleep (above) has passed, because during
 		// that sleep, a new subroutine might be launched which would likely overwrite the
@@ -9157,6 +9603,7 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 			loop_reg_item = g.mLoopRegItem;
 			loop_read_file = g.mLoopReadFile;
 			loop_field = g.mLoopField;
+			loop_field_length = g.mLoopFieldLength;
 
 			// INIT "A_INDEX" (one-based not zero-based). This is done here rather than in each PerformLoop()
 			// function because it reduces code size and also because registry loops and file-pattern loops
@@ -9198,6 +9645,7 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 				break;
 			case ATTR_LOOP_READ_FILE:
 				FILE *read_file;
+				IniFlushAll(); // See the file commands in Perform().
 				if (*ARG2 && (read_file = fopen(ARG2, "r"))) // v1.0.47: Added check for "" to avoid debug-assertion failure while in debug mode (maybe it's bad to to open file "" in release mode too).
 				{
 					result = line->PerformLoopReadFile(apReturnValue, continue_main_loop, jump_to_line, read_file, ARG3);
@@ -9270,6 +9718,7 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 			else if (((size_t)attr) == (size_t)ATTR_LOOP_READ_FILE)
 			{
 				FILE *read_file;
+				IniFlushAll(); // See the file commands in Perform().
 				if (*ARG2 && (read_file = fopen(ARG2, "r"))) // v1.0.47: Added check for "" to avoid debug-assertion failure while in debug mode (maybe it's bad to to open file "" in release mode too).
 				{
 					result = line->PerformLoopReadFile(apReturnValue, continue_main_loop, jump_to_line, read_file, ARG3);
@@ -9339,6 +9788,7 @@ ResultType Line::ExecUntil(ExecUntilMode aMode, char **apReturnValue, Line **apJ
 			g.mLoopRegItem = loop_reg_item;
 			g.mLoopReadFile = loop_read_file;
 			g.mLoopField = loop_field;
+			g.mLoopFieldLength = loop_field_length;
 			// Above is done unconditionally (regardless of the value of "result") for simplicity and maintainability.
 
 			if (result == FAIL || result == EARLY_RETURN || result == EARLY_EXIT)
@@ -10163,62 +10613,62 @@ ResultType Line::PerformLoopParse(char **apReturnValue, bool &aContinueMainLoop,
 	if (!*ARG2) // Since the input variable's contents are blank, the loop will execute zero times.
 		return OK;
 
-	// The following will be used to hold the parsed items.  It needs to have its own storage because
-	// even though ARG2 might always be a writable memory area, we can't rely upon it being
-	// persistent because it might reside in the deref buffer, in which case the other commands
-	// in the loop's body would probably overwrite it.  Even if the ARG2's contents aren't in
-	// the deref buffer, we still can't modify it (i.e. to temporarily terminate it and thus
-	// bypass the need for malloc() below) because that might modify the variable contents, and
-	// that variable may be referenced elsewhere in the body of the loop (which would result
-	// in unexpected side-effects).  So, rather than have a limit of 64K or something (which
-	// would limit this feature's usefulness for parsing a large list of filenames, for example),
-	// it seems best to dynamically allocate a temporary buffer large enough to hold the
-	// contents of ARG2 (the input variable).  Update: Since these loops tend to be enclosed
-	// by file-read loops, and thus may be called thousands of times in a short period,
-	// it should help average performance to use the stack for small vars rather than
-	// constantly doing malloc() and free(), which are much higher overhead and probably
-	// cause memory fragmentation (especially with thousands of calls):
-	size_t space_needed = ArgLength(2) + 1;  // +1 for the zero terminator.
-	char *stack_buf, *buf;
-	#define FREE_PARSE_MEMORY if (buf != stack_buf) free(buf)  // Also used by the CSV version of this function.
-	#define LOOP_PARSE_BUF_SIZE 40000                          //
-	if (space_needed <= LOOP_PARSE_BUF_SIZE)
-	{
-		stack_buf = (char *)_alloca(LOOP_PARSE_BUF_SIZE); // Helps performance.  See comments above.
-		buf = stack_buf;
-	}
+	// The fields are never terminated in place; instead, A_LoopField is a pointer and length into the text
+	// being parsed.  That text needs to stay unchanged for the life of the loop.  ARG2 can't be relied upon
+	// to do that if it resides in the deref buffer, in which case the other commands in the loop's body
+	// would probably overwrite it, so a copy is made.  But when ARG2 is the contents of the input variable
+	// itself (the usual case for a large list), the variable is "pinned" instead: the loop reads its memory
+	// directly, and if the loop's body (or a thread that interrupts it) changes the variable, the variable
+	// is given new memory while the loop keeps the old (see Var::DetachFromPins).  This avoids copying
+	// the entire string every time the loop starts, which matters when these loops are enclosed by
+	// file-read loops and thus called thousands of times in a short period.  For copies, the stack is used
+	// for small strings rather than malloc() and free(), which are much higher overhead and probably cause
+	// memory fragmentation (especially with thousands of calls):
+	VarPin pin;
+	Var *input_var = ARGVAR2;
+	char *stack_buf = NULL, *buf;
+	#define FREE_PARSE_MEMORY if (pin.mVar) Var::Unpin(pin); else if (buf != stack_buf) free(buf)  // Also used by the CSV version of this function.
+	#define LOOP_PARSE_BUF_SIZE 40000                                                               //
+	if (input_var && ARG2 == (input_var = input_var->ResolveAlias())->Contents() && input_var->Pin(pin))
+		buf = ARG2;
 	else
 	{
-		if (   !(buf = (char *)malloc(space_needed))   )
+		size_t space_needed = ArgLength(2) + 1;  // +1 for the zero terminator.
+		if (space_needed <= LOOP_PARSE_BUF_SIZE)
+			buf = stack_buf = (char *)_alloca(LOOP_PARSE_BUF_SIZE); // Helps performance.  See comments above.
+		else if (   !(buf = (char *)malloc(space_needed))   )
 			// Probably best to consider this a critical error, since on the rare times it does happen, the user
 			// would probably want to know about it immediately.
 			return LineError(ERR_OUTOFMEM, FAIL, ARG2);
-		stack_buf = NULL; // For comparison purposes later below.
+		strcpy(buf, ARG2); // Make the copy.
 	}
-	strcpy(buf, ARG2); // Make the copy.
 
-	// Make a copy of ARG3 and ARG4 in case either one's contents are in the deref buffer, which would
-	// probably be overwritten by the commands in the script loop's body:
-	char delimiters[512], omit_list[512];
-	strlcpy(delimiters, ARG3, sizeof(delimiters));
-	strlcpy(omit_list, ARG4, sizeof(omit_list));
+	// Build lookup tables from ARG3 and ARG4 now in case either one's contents are in the deref buffer,
+	// which would probably be overwritten by the commands in the script loop's body.  The tables also
+	// make each char's test a single lookup rather than a scan of the whole list.  A lone delimiter
+	// (by far the most common case, e.g. `n or a comma) is found with strchr() instead, which the CRT
+	// implements with a scan that's much faster than a char-by-char loop.
+	CharSet delimiter_set(ARG3), omit_set(ARG4);
+	char single_delimiter = (*ARG3 && !ARG3[1]) ? *ARG3 : '\0'; // Zero if there are no delimiters or more than one.
+	bool has_delimiters = *ARG3, has_omit_list = *ARG4;
 
 	ResultType result;
 	Line *jump_to_line;
-	char *field, *field_end, saved_char;
-	size_t field_length;
+	char *field, *field_end, *value_end;
 
 	for (field = buf;;)
 	{
-		if (*delimiters)
+		if (single_delimiter)
 		{
-			if (   !(field_end = StrChrAny(field, delimiters))   ) // No more delimiters found.
+			if (   !(field_end = strchr(field, single_delimiter))   ) // No more delimiters found.
 				field_end = field + strlen(field);  // Set it to the position of the zero terminator instead.
 		}
+		else if (has_delimiters)
+			for (field_end = field; *field_end && !delimiter_set.Has(*field_end); ++field_end);
 		else // Since no delimiters, every char in the input string is treated as a separate field.
 		{
 			// But exclude this char if it's in the omit_list:
-			if (*omit_list && strchr(omit_list, *field))
+			if (omit_set.Has(*field))
 			{
 				++field; // Move on to the next char.
 				if (!*field) // The end of the string has been reached.
@@ -10228,22 +10678,16 @@ ResultType Line::PerformLoopParse(char **apReturnValue, bool &aContinueMainLoop,
 			field_end = field + 1;
 		}
 
-		saved_char = *field_end;  // In case it's a non-delimited list of single chars.
-		*field_end = '\0';  // Temporarily terminate so that GetLoopField() will see the correct substring.
-
-		if (*omit_list && *field && *delimiters)  // If no delimiters, the omit_list has already been handled above.
+		value_end = field_end; // field_end itself is left as-is because it's needed to find the next field.
+		if (has_omit_list && has_delimiters)  // If no delimiters, the omit_list has already been handled above.
 		{
-			// Process the omit list.
-			field = omit_leading_any(field, omit_list, field_end - field);
-			if (*field) // i.e. the above didn't remove all the chars due to them all being in the omit-list.
-			{
-				field_length = omit_trailing_any(field, omit_list, field_end - 1);
-				field[field_length] = '\0';  // Terminate here, but don't update field_end, since saved_char needs it.
-			}
+			for (; field < value_end && omit_set.Has(*field); ++field);
+			for (; value_end > field && omit_set.Has(value_end[-1]); --value_end);
 		}
 
 		// See comments in PerformLoop() for details about this section.
 		g.mLoopField = field;
+		g.mLoopFieldLength = value_end - field;
 		result = mNextLine->ExecUntil(ONLY_ONE_LINE, apReturnValue, &jump_to_line);
 		++g.mLoopIteration;
 
@@ -10260,10 +10704,9 @@ ResultType Line::PerformLoopParse(char **apReturnValue, bool &aContinueMainLoop,
 				aJumpToLine = jump_to_line; // Signal our caller to handle this jump.
 			break;
 		}
-		if (!saved_char) // The last item in the list has just been processed, so the loop is done.
+		if (!*field_end) // The last item in the list has just been processed, so the loop is done.
 			break;
-		*field_end = saved_char;  // Undo the temporary termination, in case the list of delimiters is blank.
-		field = *delimiters ? field_end + 1 : field_end;  // Move on to the next field.
+		field = has_delimiters ? field_end + 1 : field_end;  // Move on to the next field.
 	}
 	FREE_PARSE_MEMORY;
 	return OK;
@@ -10280,29 +10723,34 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 		return OK;
 
 	// See comments in PerformLoopParse() for details.
-	size_t space_needed = ArgLength(2) + 1;  // +1 for the zero terminator.
-	char *stack_buf, *buf;
-	if (space_needed <= LOOP_PARSE_BUF_SIZE)
-	{
-		stack_buf = (char *)_alloca(LOOP_PARSE_BUF_SIZE); // Helps performance.  See comments above.
-		buf = stack_buf;
-	}
+	VarPin pin;
+	Var *input_var = ARGVAR2;
+	char *stack_buf = NULL, *buf;
+	if (input_var && ARG2 == (input_var = input_var->ResolveAlias())->Contents() && input_var->Pin(pin))
+		buf = ARG2;
 	else
 	{
-		if (   !(buf = (char *)malloc(space_needed))   )
+		size_t space_needed = ArgLength(2) + 1;  // +1 for the zero terminator.
+		if (space_needed <= LOOP_PARSE_BUF_SIZE)
+			buf = stack_buf = (char *)_alloca(LOOP_PARSE_BUF_SIZE); // Helps performance.  See comments above.
+		else if (   !(buf = (char *)malloc(space_needed))   )
 			return LineError(ERR_OUTOFMEM, FAIL, ARG2);
-		stack_buf = NULL; // For comparison purposes later below.
+		strcpy(buf, ARG2); // Make the copy.
 	}
-	strcpy(buf, ARG2); // Make the copy.
 
-	char omit_list[512];
-	strlcpy(omit_list, ARG4, sizeof(omit_list));
+	CharSet omit_set(ARG4);
+	bool has_omit_list = *ARG4;
+
+	// Since the text being parsed is never altered, a field containing escaped quotes ("") is unescaped
+	// into this separate buffer, which grows as needed and is reused by subsequent such fields:
+	char *unescaped = NULL;
+	size_t unescaped_size = 0;
 
 	ResultType result;
 	Line *jump_to_line;
-	char *field, *field_end, saved_char;
+	char *field, *field_end, *value, *value_end, *cp;
 	size_t field_length;
-	bool field_is_enclosed_in_quotes;
+	bool field_is_enclosed_in_quotes, field_has_escaped_quotes;
 
 	for (field = buf;;)
 	{
@@ -10319,53 +10767,67 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 		else
 			field_is_enclosed_in_quotes = false;
 
-		for (field_end = field;;)
+		field_has_escaped_quotes = false;
+		for (cp = field;; cp = field_end + 2) // +2 to skip over a pair of quotes (see below).
 		{
-			if (   !(field_end = strchr(field_end, field_is_enclosed_in_quotes ? '"' : ','))   )
+			if (   !(field_end = strchr(cp, field_is_enclosed_in_quotes ? '"' : ','))   )
 			{
 				// This is the last field in the string, so set field_end to the position of
 				// the zero terminator instead:
-				field_end = field + strlen(field);
+				field_end = cp + strlen(cp);
 				break;
 			}
-			if (field_is_enclosed_in_quotes)
+			// The quote discovered above marks the end of the string if it isn't followed by another
+			// quote.  But if it is a pair of quotes, it's a literal double-quote, so keep searching
+			// for the "real" ending quote:
+			if (field_is_enclosed_in_quotes && field_end[1] == '"')
 			{
-				// The quote discovered above marks the end of the string if it isn't followed
-				// by another quote.  But if it is a pair of quotes, replace it with a single
-				// literal double-quote and then keep searching for the real ending quote:
-				if (field_end[1] == '"')  // A pair of quotes was encountered.
-				{
-					memmove(field_end, field_end + 1, strlen(field_end + 1) + 1); // +1 to include terminator.
-					++field_end; // Skip over the literal double quote that we just produced.
-					continue; // Keep looking for the "real" ending quote.
-				}
-				// Otherwise, this quote marks the end of the field, so just fall through and break.
+				field_has_escaped_quotes = true;
+				continue;
 			}
-			// else field is not enclosed in quotes, so the comma discovered above must be a delimiter.
+			// Otherwise, this quote or comma marks the end of the field.
 			break;
 		}
 
-		saved_char = *field_end; // This can be the terminator, a comma, or a double-quote.
-		*field_end = '\0';  // Terminate here so that GetLoopField() will see the correct substring.
-
-		if (*omit_list && *field)
+		if (field_has_escaped_quotes) // Replace each pair of quotes with a single literal double-quote.
 		{
-			// Process the omit list.
-			field = omit_leading_any(field, omit_list, field_end - field);
-			if (*field) // i.e. the above didn't remove all the chars due to them all being in the omit-list.
+			field_length = field_end - field; // The unescaped field is shorter than this.
+			if (field_length >= unescaped_size)
 			{
-				field_length = omit_trailing_any(field, omit_list, field_end - 1);
-				field[field_length] = '\0';  // Terminate here, but don't update field_end, since we need its pos.
+				free(unescaped);
+				unescaped_size = field_length < 4096 ? 4096 : field_length + 1;
+				if (   !(unescaped = (char *)malloc(unescaped_size))   )
+				{
+					FREE_PARSE_MEMORY;
+					return LineError(ERR_OUTOFMEM, FAIL, ARG2);
+				}
 			}
+			for (value_end = unescaped, cp = field; cp < field_end; ++cp)
+				if ((*value_end++ = *cp) == '"') // Since all quotes within the field are paired, skip the second.
+					++cp;
+			value = unescaped;
+		}
+		else
+		{
+			value = field;
+			value_end = field_end;
+		}
+
+		if (has_omit_list)
+		{
+			for (; value < value_end && omit_set.Has(*value); ++value);
+			for (; value_end > value && omit_set.Has(value_end[-1]); --value_end);
 		}
 
 		// See comments in PerformLoop() for details about this section.
-		g.mLoopField = field;
+		g.mLoopField = value;
+		g.mLoopFieldLength = value_end - value;
 		result = mNextLine->ExecUntil(ONLY_ONE_LINE, apReturnValue, &jump_to_line);
 		++g.mLoopIteration;
 
 		if (result == LOOP_BREAK || result == EARLY_RETURN || result == EARLY_EXIT || result == FAIL)
 		{
+			free(unescaped);
 			FREE_PARSE_MEMORY;
 			return result;
 		}
@@ -10378,11 +10840,11 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 			break;
 		}
 
-		if (!saved_char) // The last item in the list has just been processed, so the loop is done.
+		if (!*field_end) // The last item in the list has just been processed, so the loop is done.
 			break;
-		if (saved_char == ',') // Set "field" to be the position of the next field.
+		if (*field_end == ',') // Set "field" to be the position of the next field.
 			field = field_end + 1;
-		else // saved_char must be a double-quote char.
+		else // *field_end must be the closing double-quote.
 		{
 			field = field_end + 1;
 			if (!*field) // No more fields occur after this one.
@@ -10395,6 +10857,7 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 			++field;
 		}
 	}
+	free(unescaped);
 	FREE_PARSE_MEMORY;
 	return OK;
 }
@@ -10404,23 +10867,21 @@ ResultType Line::PerformLoopParseCSV(char **apReturnValue, bool &aContinueMainLo
 ResultType Line::PerformLoopReadFile(char **apReturnValue, bool &aContinueMainLoop, Line *&aJumpToLine, FILE *aReadFile, char *aWriteFileName)
 {
 	LoopReadFileStruct loop_info(aReadFile, aWriteFileName);
-	size_t line_length;
 	ResultType result;
 	Line *jump_to_line;
 
-	for (; fgets(loop_info.mCurrentLine, sizeof(loop_info.mCurrentLine), loop_info.mReadFile);)
+	if (g_LoopReadChunked)
+		loop_info.BeginChunks(); // If this fails (such as for an empty file or a device), the file is read with fgets() instead.
+
+	for (; loop_info.ReadLine();)
 	{
-		line_length = strlen(loop_info.mCurrentLine);
-		if (line_length && loop_info.mCurrentLine[line_length - 1] == '\n') // Remove newlines like FileReadLine does.
-			loop_info.mCurrentLine[--line_length] = '\0';
 		// See comments in PerformLoop() for details about this section.
 		g.mLoopReadFile = &loop_info;
 		result = mNextLine->ExecUntil(ONLY_ONE_LINE, apReturnValue, &jump_to_line);
 		++g.mLoopIteration;
 		if (result == LOOP_BREAK || result == EARLY_RETURN || result == EARLY_EXIT || result == FAIL)
 		{
-			if (loop_info.mWriteFile)
-				fclose(loop_info.mWriteFile);
+			loop_info.Close();
 			return result;
 		}
 		if (jump_to_line) // See comments in PerformLoop() about this section.
@@ -10433,8 +10894,7 @@ ResultType Line::PerformLoopReadFile(char **apReturnValue, bool &aContinueMainLo
 		}
 	}
 
-	if (loop_info.mWriteFile)
-		fclose(loop_info.mWriteFile);
+	loop_info.Close();
 
 	// Don't return result because we want to always return OK unless it was one of the values
 	// already explicitly checked and returned above.  In other words, there might be values other
@@ -10444,6 +10904,161 @@ ResultType Line::PerformLoopReadFile(char **apReturnValue, bool &aContinueMainLo
 
 
 
+bool LoopReadFileStruct::BeginChunks()
+// Prepares to read the file in large chunks rather than with fgets(), which avoids copying each line into
+// a buffer of its own (A_LoopReadLine then points directly into the chunk) and has no limit on the length
+// of a line.  The file is copied into memory rather than mapped because a mapped view faults if another
+// process truncates the file (or its network share goes away) while it's being read, whereas a read
+// simply comes up short.  Returns false, leaving the struct in fgets() mode, if the file can't be read
+// this way (e.g. it's empty or isn't a disk file).
+{
+	mFile = (HANDLE)_get_osfhandle(_fileno(mReadFile));
+	if (mFile == INVALID_HANDLE_VALUE || GetFileType(mFile) != FILE_TYPE_DISK)
+		return false;
+	if (   !(mChunk = (char *)malloc(LOOP_READ_CHUNK_SIZE))   )
+		return false;
+	mNextLine = 0;
+	if (!ReadChunk(0) || !mChunkSize) // Read error or empty file, which fgets() handles just as well.
+	{
+		free(mChunk);
+		mChunk = NULL;
+		return false;
+	}
+	return true;
+}
+
+
+
+bool LoopReadFileStruct::ReadChunk(__int64 aOffset)
+// Replaces the contents of the chunk with the part of the file that starts at aOffset.
+{
+	LONG offset_high = (LONG)(aOffset >> 32);
+	if (SetFilePointer(mFile, (LONG)aOffset, &offset_high, FILE_BEGIN) == 0xFFFFFFFF // INVALID_SET_FILE_POINTER, which might also be a valid low part.
+		&& GetLastError() != NO_ERROR)
+		return false;
+	DWORD bytes_read;
+	if (!ReadFile(mFile, mChunk, LOOP_READ_CHUNK_SIZE, &bytes_read, NULL))
+		return false;
+	mChunkOffset = aOffset;
+	mChunkSize = bytes_read;
+	mEndOfFile = (bytes_read < LOOP_READ_CHUNK_SIZE); // This also covers a file that was truncated while being read.
+	return true;
+}
+
+
+
+bool LoopReadFileStruct::ReadLine()
+// Sets mCurrentLine and mCurrentLineLength to the next line, minus its newline.  Returns false when there
+// are no more lines (or upon a read error, which like fgets() is treated the same as end-of-file).
+{
+	if (!mChunk)
+	{
+		if (!fgets(mLineBuf, sizeof(mLineBuf), mReadFile))
+			return false;
+		size_t line_length = strlen(mLineBuf);
+		if (line_length && mLineBuf[line_length - 1] == '\n') // Remove newlines like FileReadLine does.
+			mLineBuf[--line_length] = '\0';
+		mCurrentLine = mLineBuf;
+		mCurrentLineLength = line_length;
+		return true;
+	}
+
+	if (mEndOfFile && mNextLine >= mChunkOffset + mChunkSize)
+		return false;
+
+	char *start, *end, *newline;
+	bool is_long_line = false;
+	for (;;)
+	{
+		start = mChunk + (size_t)(mNextLine - mChunkOffset);
+		end = mChunk + mChunkSize;
+		// memchr() is used because the C library implements it with word-at-a-time or SIMD scanning,
+		// which is several times faster than checking one char at a time for long lines.
+		if (newline = (char *)memchr(start, '\n', end - start))
+			break;
+		if (mEndOfFile)
+		{
+			if (start == end && !is_long_line) // The previous line ended exactly at the end of the file.
+				return false;
+			break; // The file's last line lacks a newline.
+		}
+		// Otherwise, the line continues beyond the end of the chunk.
+		if (!is_long_line && mNextLine > mChunkOffset)
+		{
+			// Read the next chunk starting at this line, then search again.
+			if (!ReadChunk(mNextLine))
+				return false;
+			continue;
+		}
+		// The line is longer than a whole chunk, so it must be assembled piece by piece in mLongLine.
+		if (!is_long_line)
+		{
+			is_long_line = true;
+			mLongLineLength = 0;
+		}
+		if (!AppendToLongLine(start, end - start))
+			return false;
+		mNextLine = mChunkOffset + mChunkSize;
+		if (!ReadChunk(mNextLine))
+			return false;
+	}
+
+	if (!newline)
+		newline = end; // Point it to where the final line ends.
+	mNextLine += newline - start + 1; // +1 to skip over the newline (or go beyond the end of the file if there isn't one).
+	if (is_long_line)
+	{
+		if (!AppendToLongLine(start, newline - start))
+			return false;
+		mCurrentLine = mLongLine;
+		mCurrentLineLength = mLongLineLength;
+	}
+	else
+	{
+		mCurrentLine = start;
+		mCurrentLineLength = newline - start;
+	}
+	// Remove the CR of a CRLF pair since fgets() in text mode would have translated CRLF to LF:
+	if (newline != end && mCurrentLineLength && mCurrentLine[mCurrentLineLength - 1] == '\r')
+		--mCurrentLineLength;
+	return true;
+}
+
+
+
+bool LoopReadFileStruct::AppendToLongLine(char *aBuf, size_t aLength)
+{
+	if (mLongLineLength + aLength > mLongLineCapacity)
+	{
+		size_t new_capacity = mLongLineCapacity ? mLongLineCapacity : LOOP_READ_CHUNK_SIZE;
+		while (new_capacity < mLongLineLength + aLength)
+			new_capacity *= 2; // Geometric growth keeps the total amount of copying linear in the line's length.
+		char *new_buf;
+		if (   !(new_buf = (char *)realloc(mLongLine, new_capacity))   )
+			return false;
+		mLongLine = new_buf;
+		mLongLineCapacity = new_capacity;
+	}
+	memcpy(mLongLine + mLongLineLength, aBuf, aLength);
+	mLongLineLength += aLength;
+	return true;
+}
+
+
+
+void LoopReadFileStruct::Close()
+// Closes the output file and frees the chunk (the input file itself belongs to the caller).
+{
+	if (mWriteFile)
+		fclose(mWriteFile); // Also flushes the batched writes.
+	if (mChunk)
+		free(mChunk);
+	if (mLongLine)
+		free(mLongLine);
+}
+
+
+
 __forceinline ResultType Line::Perform() // __forceinline() currently boosts performance a bit, though it's probably more due to the butterly effect and cache hits/misses.
 // Performs only this line's action.
 // Returns OK or FAIL.
@@ -10474,6 +11089,9 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 	// are taken out or added to the param list:
 	//if (nArgs < g_act[mActionType].MinParams) ...
 
+	if (mActionType >= ACT_FILEAPPEND && mActionType <= ACT_FILECREATESHORTCUT)
+		IniFlushAll(); // So that the file commands see (and act upon) any changes the script has made to INI files.
+
 	switch (mActionType)
 	{
 	case ACT_ASSIGN:
@@ -10527,7 +11145,7 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 		#undef DETERMINE_NUMERIC_TYPES
 		#define DETERMINE_NUMERIC_TYPES \
 			value_is_pure_numeric = IsPureNumeric(ARG2, true, false, true, true);\
-			var_is_pure_numeric = IsPureNumeric(output_var->Contents(), true, false, true, true);
+			var_is_pure_numeric = output_var->IsNumeric(true);
 
 		// Some performance can be gained by relying on the fact that short-circuit boolean
 		// can skip the "var_is_pure_numeric" check whenever value_is_pure_numeric == PURE_FLOAT.
@@ -10590,9 +11208,9 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 		else // ARG3 is absent or invalid, so do normal math (not date-time).
 		{
 			IF_EITHER_IS_FLOAT
-				return output_var->Assign(ATOF(output_var->Contents()) + ATOF(ARG2));  // Overload: Assigns a double.
+				return output_var->Assign(output_var->ToDouble() + ATOF(ARG2));  // Overload: Assigns a double.
 			else // Non-numeric variables or values are considered to be zero for the purpose of the calculation.
-				return output_var->Assign(ATOI64(output_var->Contents()) + ATOI64(ARG2));  // Overload: Assigns an int.
+				return output_var->Assign(output_var->ToInt64() + ATOI64(ARG2));  // Overload: Assigns an int.
 		}
 		return OK;  // Never executed.
 
@@ -10621,18 +11239,18 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 		{
 			DETERMINE_NUMERIC_TYPES
 			IF_EITHER_IS_FLOAT
-				return output_var->Assign(ATOF(output_var->Contents()) - ATOF(ARG2));  // Overload: Assigns a double.
+				return output_var->Assign(output_var->ToDouble() - ATOF(ARG2));  // Overload: Assigns a double.
 			else // Non-numeric variables or values are considered to be zero for the purpose of the calculation.
-				return output_var->Assign(ATOI64(output_var->Contents()) - ATOI64(ARG2));  // Overload: Assigns an INT.
+				return output_var->Assign(output_var->ToInt64() - ATOI64(ARG2));  // Overload: Assigns an INT.
 		}
 		// All paths above return.
 
 	case ACT_MULT:
 		DETERMINE_NUMERIC_TYPES
 		IF_EITHER_IS_FLOAT
-			return output_var->Assign(ATOF(output_var->Contents()) * ATOF(ARG2));  // Overload: Assigns a double.
+			return output_var->Assign(output_var->ToDouble() * ATOF(ARG2));  // Overload: Assigns a double.
 		else // Non-numeric variables or values are considered to be zero for the purpose of the calculation.
-			return output_var->Assign(ATOI64(output_var->Contents()) * ATOI64(ARG2));  // Overload: Assigns an INT.
+			return output_var->Assign(output_var->ToInt64() * ATOI64(ARG2));  // Overload: Assigns an INT.
 
 	case ACT_DIV:
 		DETERMINE_NUMERIC_TYPES
@@ -10641,14 +11259,14 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 			double ARG2_as_float = ATOF(ARG2);  // Since ATOF() returns double, at least on MSVC++ 7.x
 			if (!ARG2_as_float)              // v1.0.46: Make behavior more consistent with expressions by
 				return output_var->Assign(); // avoiding a runtime error dialog; just make the output variable blank.
-			return output_var->Assign(ATOF(output_var->Contents()) / ARG2_as_float);  // Overload: Assigns a double.
+			return output_var->Assign(output_var->ToDouble() / ARG2_as_float);  // Overload: Assigns a double.
 		}
 		else // Non-numeric variables or values are considered to be zero for the purpose of the calculation.
 		{
 			__int64 ARG2_as_int = ATOI64(ARG2);
 			if (!ARG2_as_int)                // v1.0.46: Make behavior more consistent with expressions by
 				return output_var->Assign(); // avoiding a runtime error dialog; just make the output variable blank.
-			return output_var->Assign(ATOI64(output_var->Contents()) / ARG2_as_int);  // Overload: Assigns an INT.
+			return output_var->Assign(output_var->ToInt64() / ARG2_as_int);  // Overload: Assigns an INT.
 		}
 
 	case ACT_STRINGLEFT:
@@ -10753,8 +11371,11 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 			// Copy the input variable's text directly into the output variable:
 			strcpy(contents, ARG2);
 		}
-		//else input and output are the same, normal variable; so nothing needs to be copied over.  Just leave
-		// contents at the default set earlier, then convert its case.
+		else // Input and output are the same, normal variable; so nothing needs to be copied over.  Just convert its case in place.
+		{
+			output_var->ResolveAlias()->DetachIfPinned(); // Don't let it alter the text a parsing loop is reading.
+			contents = output_var->Contents(); // Do this only after the above might have changed the contents mem address.
+		}
 		if (*ARG3 && toupper(*ARG3) == 'T' && !*(ARG3 + 1)) // Convert to title case.
 			StrToTitleCase(contents);
 		else if (mActionType == ACT_STRINGLOWER)
@@ -11625,7 +12246,7 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 	case ACT_SETFORMAT:
 		// For now, it doesn't seem necessary to have runtime validation of the first parameter.
 		// Just ignore the command if it's not valid:
-		if (!stricmp(ARG1, "Float"))
+		if (!stricmp(ARG1, "Float") || !stricmp(ARG1, "FloatFast"))
 		{
 			// -2 to allow room for the letter 'f' and the '%' that will be added:
 			if (ArgLength(2) >= sizeof(g.FormatFloat) - 2) // A variable that resolved to something too long.
@@ -11640,9 +12261,11 @@ __forceinline ResultType Line::Perform() // __forceinline() currently boosts per
 			sprintf(g.FormatFloat, "%%%s%s%s", ARG2
 				, dot_pos ? "" : "." // Add a dot if none was specified so that "0" is the same as "0.", which seems like the most user-friendly approach; it's also easier to document in the help file.
 				, IsPureNumeric(ARG2, true, true, true) ? "f" : ""); // If it's not pure numeric, assume the user already included the desired letter (e.g. SetFormat, Float, 0.6e).
+			g.FormatFloatFast = (ARG1[5] != '\0'); // FloatFast vs. Float.  See Var::Assign(double).
 		}
-		else if (!stricmp(ARG1, "Integer"))
+		else if (!stricmp(ARG1, "Integer") || !stricmp(ARG1, "IntegerFast"))
 		{
+			g.FormatIntegerFast = (ARG1[7] != '\0'); // IntegerFast vs. Integer.  See Var::Assign(__int64).
 			switch(*ARG2)
 			{
 			case 'd':
@@ -12134,6 +12757,365 @@ char *Line::VicinityToText(char *aBuf, int aBufSize) // aBufSize should be an in
 
 
 
+static ProfileItem sProfileDummy; // Absorbs the statistics that can't be stored due to lack of memory.
+#define PROFILE_HASH(key, size) ((UINT)(((size_t)(key) >> 2) * 2654435761U) & ((size) - 1))
+
+static ProfileItem *ProfileFind(ProfileItem *&aTable, UINT &aCount, UINT &aSize, void *aKey)
+// Returns the item for aKey in the given hash table (open addressing, linear probing), adding it if necessary.
+{
+	UINT i, j;
+	if (aCount >= aSize / 2) // Keep the table no more than half full so that probes stay short.
+	{
+		UINT new_size = aSize ? aSize * 2 : 256;
+		ProfileItem *new_table = (ProfileItem *)calloc(new_size, sizeof(ProfileItem));
+		if (!new_table)
+			return &sProfileDummy;
+		for (j = 0; j < aSize; ++j)
+			if (aTable[j].key)
+			{
+				for (i = PROFILE_HASH(aTable[j].key, new_size); new_table[i].key; i = (i + 1) & (new_size - 1));
+				new_table[i] = aTable[j];
+			}
+		free(aTable);
+		aTable = new_table;
+		aSize = new_size;
+	}
+	for (i = PROFILE_HASH(aKey, aSize); aTable[i].key; i = (i + 1) & (aSize - 1))
+		if (aTable[i].key == aKey)
+			return aTable + i;
+	aTable[i].key = aKey;
+	++aCount;
+	return aTable + i;
+}
+
+
+
+static UINT ProfileChild(UINT aParent, Func *aFunc, Line *aLine)
+// Returns the index of the call tree node beneath aParent for aFunc (or if it's NULL, the thread that
+// began with aLine), adding it if necessary.  Returns 0 if there's insufficient memory.
+{
+	ProfileNode *node = Line::sProfileNode;
+	UINT i;
+	if (node)
+		for (i = node[aParent].first_child; i; i = node[i].next_sibling)
+			if (node[i].func == aFunc && node[i].line == aLine)
+				return i;
+	if (Line::sProfileNodeCount >= Line::sProfileNodeSize)
+	{
+		UINT new_size = Line::sProfileNodeSize ? Line::sProfileNodeSize * 2 : 256;
+		if (   !(node = (ProfileNode *)realloc(node, new_size * sizeof(ProfileNode)))   )
+			return 0;
+		Line::sProfileNode = node;
+		Line::sProfileNodeSize = new_size;
+		if (!Line::sProfileNodeCount) // Create the root.
+		{
+			ZeroMemory(node, sizeof(ProfileNode));
+			Line::sProfileNodeCount = 1;
+		}
+	}
+	i = Line::sProfileNodeCount++;
+	node[i].func = aFunc;
+	node[i].line = aLine;
+	node[i].parent = aParent;
+	node[i].first_child = 0;
+	node[i].next_sibling = node[aParent].first_child;
+	node[aParent].first_child = i;
+	node[i].self = 0;
+	return i;
+}
+
+
+
+static inline __int64 ProfileNow()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+
+
+static void ProfileCharge(__int64 aNow)
+// Charges the time elapsed since the previous event to the line and call tree node of the innermost frame.
+{
+	__int64 elapsed = aNow - Line::sProfileTick;
+	ProfileFrame &frame = Line::sProfileFrame[Line::sProfileDepth];
+	if (frame.line)
+	{
+		ProfileItem &item = *ProfileFind(Line::sProfileLine, Line::sProfileLineCount, Line::sProfileLineSize, frame.line);
+		item.self += elapsed;
+		item.total += elapsed;
+	}
+	if (frame.node)
+		Line::sProfileNode[frame.node].self += elapsed;
+	Line::sProfileTick = aNow;
+}
+
+
+
+void Line::ProfileStart()
+{
+	if (sProfiling)
+		return;
+	++sProfileSession; // Invalidates the tokens of any frames left over from before (see ProfileLeave).
+	sProfileDepth = 0;
+	ProfileFrame &frame = sProfileFrame[0]; // This represents the thread that turned on the profiler.
+	frame.func = NULL;
+	frame.line = NULL;
+	frame.node = 0;
+	frame.child = 0;
+	frame.start = sProfileTick = ProfileNow();
+	sProfiling = true;
+}
+
+
+
+void Line::ProfileStop()
+{
+	if (!sProfiling)
+		return;
+	ProfileCharge(ProfileNow());
+	sProfiling = false;
+}
+
+
+
+void Line::ProfileReset()
+// Discards all statistics.  This must also be done before any lines or functions they refer to are freed.
+{
+	bool was_profiling = sProfiling;
+	sProfiling = false;
+	free(sProfileLine);
+	free(sProfileFunc);
+	free(sProfileNode);
+	sProfileLine = sProfileFunc = NULL;
+	sProfileNode = NULL;
+	sProfileLineCount = sProfileLineSize = sProfileFuncCount = sProfileFuncSize = 0;
+	sProfileNodeCount = sProfileNodeSize = 0;
+	if (was_profiling)
+		ProfileStart(); // Start a new session since the current frames refer to nodes that no longer exist.
+}
+
+
+
+void Line::ProfileLine(Line *aLine)
+// Called by ExecUntil() just before it executes each line, but only while the profiler is on.
+{
+	ProfileCharge(ProfileNow());
+	ProfileFrame &frame = sProfileFrame[sProfileDepth];
+	frame.line = aLine;
+	++ProfileFind(sProfileLine, sProfileLineCount, sProfileLineSize, aLine)->count;
+	if (!frame.node) // This is the first line of a thread, which is what identifies the thread in the call tree.
+		frame.node = ProfileChild(sProfileDepth ? sProfileFrame[sProfileDepth - 1].node : 0, NULL, aLine);
+}
+
+
+
+__int64 Line::ProfileEnter(Func *aFunc)
+// Called while the profiler is on when a function is called, or when a thread is launched (aFunc==NULL).
+// Returns the token to be passed to ProfileLeave() when it finishes, or 0 if it's too deep to be tracked.
+// The token identifies the session as well as the depth, so that a frame left over from before a reset
+// can't be mistaken for one of the current session's; being 64-bit, it can't wrap around in practice.
+{
+	if (sProfileDepth >= PROFILE_MAX_DEPTH - 1)
+		return 0;
+	__int64 now = ProfileNow();
+	ProfileCharge(now);
+	UINT parent_node = sProfileFrame[sProfileDepth].node;
+	ProfileFrame &frame = sProfileFrame[++sProfileDepth];
+	frame.func = aFunc;
+	frame.line = NULL;
+	frame.node = aFunc ? ProfileChild(parent_node, aFunc, NULL) : 0;
+	frame.start = now;
+	frame.child = 0;
+	return sProfileSession * PROFILE_MAX_DEPTH + sProfileDepth;
+}
+
+
+
+void Line::ProfileLeave(__int64 aToken)
+// Ends the frame identified by aToken along with any frames above it, which can exist only if they
+// were abandoned (e.g. by a thread that was launched from inside a function and then did Exit).
+{
+	if (aToken / PROFILE_MAX_DEPTH != sProfileSession) // The profiler has been reset or restarted since then.
+		return;
+	int depth = (int)(aToken % PROFILE_MAX_DEPTH), i;
+	if (!sProfiling) // Just discard the frames.
+	{
+		if (sProfileDepth >= depth)
+			sProfileDepth = depth - 1;
+		return;
+	}
+	__int64 now = ProfileNow(), total;
+	ProfileCharge(now);
+	for (; sProfileDepth >= depth; --sProfileDepth)
+	{
+		ProfileFrame &frame = sProfileFrame[sProfileDepth];
+		ProfileFrame &caller = sProfileFrame[sProfileDepth - 1];
+		total = now - frame.start;
+		caller.child += total;
+		if (!frame.func) // A thread, whose time isn't counted as part of the line it interrupted.
+			continue;
+		ProfileItem &item = *ProfileFind(sProfileFunc, sProfileFuncCount, sProfileFuncSize, frame.func);
+		++item.count;
+		item.self += total - frame.child;
+		// Count only the outermost of a set of recursive calls, since the inner ones are already included:
+		for (i = sProfileDepth - 1; i > 0 && sProfileFrame[i].func != frame.func; --i);
+		if (!i)
+			item.total += total;
+		if (caller.line)
+			ProfileFind(sProfileLine, sProfileLineCount, sProfileLineSize, caller.line)->total += total;
+	}
+}
+
+
+
+struct ProfileSortItem
+{
+	ProfileItem *item;
+	__int64 key;
+};
+
+static int ProfileSortDescending(const void *a1, const void *a2)
+{
+	__int64 key1 = ((ProfileSortItem *)a1)->key, key2 = ((ProfileSortItem *)a2)->key;
+	return key1 < key2 ? 1 : (key1 > key2 ? -1 : 0);
+}
+
+static ProfileSortItem *ProfileSort(ProfileItem *aTable, UINT aCount, UINT aSize, char aSortBy)
+// Returns a malloc'd array of the items in aTable, highest first (see Line::ProfileReport for aSortBy).
+{
+	ProfileSortItem *sorted = (ProfileSortItem *)malloc((aCount + 1) * sizeof(ProfileSortItem)); // +1 to avoid malloc(0).
+	if (!sorted)
+		return NULL;
+	for (UINT i = 0, j = 0; i < aSize; ++i)
+		if (aTable[i].key)
+		{
+			sorted[j].item = aTable + i;
+			sorted[j++].key = aSortBy == 'C' ? aTable[i].count : (aSortBy == 'T' ? aTable[i].total : aTable[i].self);
+		}
+	qsort(sorted, aCount, sizeof(ProfileSortItem), ProfileSortDescending);
+	return sorted;
+}
+
+
+
+char *Line::ProfileReport(char aSortBy, size_t &aLength)
+// Returns a malloc'd report of the statistics gathered so far, in which the functions and lines are
+// sorted by aSortBy: 'T' for total time, 'C' for count, and anything else for self time.  Returns NULL
+// if there's insufficient memory.  The caller is responsible for freeing the report.
+{
+	ProfileSortItem *func = ProfileSort(sProfileFunc, sProfileFuncCount, sProfileFuncSize, aSortBy);
+	ProfileSortItem *line = ProfileSort(sProfileLine, sProfileLineCount, sProfileLineSize, aSortBy);
+	size_t buf_size = 1024 + sProfileFuncCount * (40 + MAX_VAR_NAME_LENGTH) + sProfileLineCount * (40 + 200);
+	char *buf = (func && line) ? (char *)malloc(buf_size) : NULL;
+	if (!buf)
+	{
+		free(func);
+		free(line);
+		return NULL;
+	}
+	LARGE_INTEGER frequency;
+	double ms_per_tick = QueryPerformanceFrequency(&frequency) && frequency.QuadPart ? 1000.0 / frequency.QuadPart : 0.0;
+	char *aBuf = buf, *aBuf_orig = buf; // For use with BUF_SPACE_REMAINING.
+	int aBufSize = (int)buf_size;
+	UINT i;
+
+	aBuf += snprintf(aBuf, BUF_SPACE_REMAINING, "Functions: the number of calls, then the time (in milliseconds) spent"
+		" in the function itself and in total, including the functions it called.\r\n\r\n");
+	for (i = 0; i < sProfileFuncCount; ++i)
+		aBuf += snprintf(aBuf, BUF_SPACE_REMAINING, "%10u %12.3f %12.3f  %s\r\n", func[i].item->count
+			, func[i].item->self * ms_per_tick, func[i].item->total * ms_per_tick, ((Func *)func[i].item->key)->mName);
+	aBuf += snprintf(aBuf, BUF_SPACE_REMAINING, "\r\nLines: the number of times executed, then the time (in milliseconds)"
+		" spent in the line itself and in total, including the functions it called.\r\n\r\n");
+	for (i = 0; i < sProfileLineCount; ++i)
+	{
+		aBuf += snprintf(aBuf, BUF_SPACE_REMAINING, "%10u %12.3f %12.3f  ", line[i].item->count
+			, line[i].item->self * ms_per_tick, line[i].item->total * ms_per_tick);
+		// Truncate really huge lines the same way as LogToText():
+		aBuf = ((Line *)line[i].item->key)->ToText(aBuf, BUF_SPACE_REMAINING < 200 ? BUF_SPACE_REMAINING : 200, true);
+	}
+	free(func);
+	free(line);
+	aLength = aBuf - buf;
+	return buf;
+}
+
+
+
+char *Line::ProfileCollapsed(size_t &aLength)
+// Returns a malloc'd copy of the call tree in the "collapsed stack" format used by flame graph tools:
+// one line per distinct stack, consisting of its frames separated by semicolons, then a space and the
+// time (in microseconds) spent in the innermost frame itself.  Threads are named after the label at
+// which they began, or if there's none, the line number of their first line.  Returns NULL if there's
+// insufficient memory.  The caller is responsible for freeing the result.
+{
+	UINT node_count = sProfileNodeCount, i, n;
+	char **name = (char **)malloc((node_count + 1) * sizeof(char *)); // +1 to avoid malloc(0).
+	char (*line_name)[16] = (char (*)[16])malloc((node_count + 1) * 16);
+	size_t *path_length = (size_t *)malloc((node_count + 1) * sizeof(size_t));
+	size_t buf_size = 1, length;
+	char *buf = NULL, *cp;
+	LARGE_INTEGER frequency;
+	double us_per_tick = QueryPerformanceFrequency(&frequency) && frequency.QuadPart ? 1000000.0 / frequency.QuadPart : 0.0;
+	if (!name || !line_name || !path_length)
+		goto end;
+
+	// Find out each node's name and the length of the stack that leads to it.  A node's parent always
+	// precedes it in the array, so the parent's path is already known:
+	for (path_length[0] = 0, i = 1; i < node_count; ++i)
+	{
+		ProfileNode &node = sProfileNode[i];
+		if (node.func)
+			name[i] = node.func->mName;
+		else
+		{
+			Label *label;
+			for (label = g_script.mFirstLabel; label && label->mJumpToLine != node.line; label = label->mNextLabel);
+			if (label)
+				name[i] = label->mName;
+			else
+			{
+				sprintf(line_name[i], "line %u", node.line->mLineNumber);
+				name[i] = line_name[i];
+			}
+		}
+		path_length[i] = (node.parent ? path_length[node.parent] + 1 : 0) + strlen(name[i]); // +1 for the semicolon.
+		if (node.self)
+			buf_size += path_length[i] + 24; // Enough for the time and line break.
+	}
+	if (   !(buf = (char *)malloc(buf_size))   )
+		goto end;
+
+	for (cp = buf, i = 1; i < node_count; ++i)
+	{
+		if (!sProfileNode[i].self)
+			continue;
+		// Write the names from the innermost frame outward, starting at the end of this stack's text:
+		for (n = i, length = path_length[i]; ; )
+		{
+			size_t name_length = strlen(name[n]);
+			memcpy(cp + length - name_length, name[n], name_length);
+			length -= name_length;
+			if (   !(n = sProfileNode[n].parent)   )
+				break;
+			cp[--length] = ';';
+		}
+		cp += path_length[i];
+		cp += sprintf(cp, " %.0f\r\n", sProfileNode[i].self * us_per_tick);
+	}
+	*cp = '\0';
+	aLength = cp - buf;
+
+end:
+	free(name);
+	free(line_name);
+	free(path_length);
+	return buf;
+}
+
+
+
 char *Line::ToText(char *aBuf, int aBufSize, bool aCRLF, DWORD aElapsed, bool aLineWasResumed) // aBufSize should be an int to preserve negatives from caller (caller relies on this).
 // aBufSize is an int so that any negative values passed in from caller are not lost.
 // Caller has ensured that aBuf isn't NULL.
@@ -12435,6 +13417,25 @@ ResultType Script::ScriptError(char *aErrorText, char *aExtraInfo) //, ResultTyp
 
 
 
+int SortVarsByName(const void *a1, const void *a2)
+{
+	return stricmp((*(Var **)a1)->mName, (*(Var **)a2)->mName); // lstrcmpi() is not used: 1) avoids breaking exisitng scripts; 2) provides consistent behavior across multiple locales; 3) performance.
+}
+
+void Script::SortVars(Var **aVar, int aVarCount, bool &aVarIsSorted)
+// Puts a list of variables into alphabetical order for ListVars.  Since lookups are done through a hash
+// index, variables are stored in order of creation and the sorting is deferred until it's actually needed.
+// Sorting the list in place is safe because nothing else depends on its order (e.g. the backup of a
+// function's variables records each Var's address rather than its position).
+{
+	if (aVarIsSorted)
+		return;
+	qsort(aVar, aVarCount, sizeof(Var *), SortVarsByName);
+	aVarIsSorted = true;
+}
+
+
+
 char *Script::ListVars(char *aBuf, int aBufSize) // aBufSize should be an int to preserve negatives from caller (caller relies on this).
 // aBufSize is an int so that any negative values passed in from caller are not lost.
 // Translates this script's list of variables into text equivalent, putting the result
@@ -12448,16 +13449,14 @@ char *Script::ListVars(char *aBuf, int aBufSize) // aBufSize should be an int to
 		// Start at the oldest and continue up through the newest:
 		aBuf += snprintf(aBuf, BUF_SPACE_REMAINING, "Local Variables for %s()%s", g.CurrentFunc->mName, LIST_VARS_UNDERLINE);
 		Func &func = *g.CurrentFunc; // For performance.
+		SortVars(func.mVar, func.mVarCount, func.mVarIsSorted);
 		for (int i = 0; i < func.mVarCount; ++i)
 			if (func.mVar[i]->Type() == VAR_NORMAL) // Don't bother showing clipboard and other built-in vars.
 				aBuf = func.mVar[i]->ToText(aBuf, BUF_SPACE_REMAINING, true);
 	}
-	// v1.0.31: The description "alphabetical" is kept even though it isn't quite true
-	// when the lazy variable list exists, since those haven't yet been sorted into the main list.
-	// However, 99.9% of scripts do not use the lazy list, so it seems too rare to worry about other
-	// than document it in the ListVars command in the help file:
 	aBuf += snprintf(aBuf, BUF_SPACE_REMAINING, "%sGlobal Variables (alphabetical)%s"
 		, g.CurrentFunc ? "\r\n\r\n" : "", LIST_VARS_UNDERLINE);
+	SortVars(mVar, mVarCount, mVarIsSorted);
 	// Start at the oldest and continue up through the newest:
 	for (int i = 0; i < mVarCount; ++i)
 		if (mVar[i]->Type() == VAR_NORMAL) // Don't bother showing clipboard and other built-in vars.
@@ -12548,6 +13547,8 @@ ResultType Script::ActionExec(char *aAction, char *aParams, char *aWorkingDir, b
 	// Launching nothing is always a success:
 	if (!aAction || !*aAction) return OK;
 
+	IniFlushAll(); // So that the program sees any changes the script has made to INI files.
+
 	size_t aAction_length = strlen(aAction);
 	if (aAction_length >= LINE_SIZE) // Max length supported by CreateProcess() is 32 KB. But there hasn't been any demand to go above 16 KB, so seems little need to support it (plus it reduces risk of stack overflow).
 	{
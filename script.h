@@ -333,7 +333,9 @@ struct ArgStruct
 	WORD length; // Keep adjacent to above so that it uses no extra memory. This member was added in v1.0.44.14 to improve runtime performance.  It relies on the fact that an arg's literal text can't be longer than LINE_SIZE.
 	char *text;
 	DerefType *deref;  // Will hold a NULL-terminated array of var-deref locations within <text>.
+	ExprTokenType *postfix; // For expressions: the postfix program built by the first evaluation (terminated by SYM_INVALID), so that later evaluations can skip tokenizing. NULL until then. See CachePostfix().
 };
+#define ARG_POSTFIX_UNCACHEABLE ((ExprTokenType *)1) // ArgStruct::postfix holds this if the expression must be re-tokenized on every evaluation.
 
 
 // Some of these lengths and such are based on the MSDN example at
@@ -378,15 +380,36 @@ struct LoopReadFileStruct
 {
 	FILE *mReadFile, *mWriteFile;
 	char mWriteFileName[MAX_PATH];
+	// A_LoopReadLine is the mCurrentLineLength chars at mCurrentLine.  They aren't necessarily zero-terminated
+	// because when the file is read in chunks, mCurrentLine points directly into the chunk (see ReadLine()).
+	char *mCurrentLine;
+	size_t mCurrentLineLength;
+	// Members for reading the file in large chunks (see #LoopReadChunked):
+	#define LOOP_READ_CHUNK_SIZE (4 * 1024 * 1024)
+	#define LOOP_READ_WRITE_BUFFER_SIZE (256 * 1024) // Stdio buffer for the output file, so that FileAppend's many small writes are batched.
+	HANDLE mFile;
+	char *mChunk;      // malloc'd copy of mChunkSize bytes of the file starting at offset mChunkOffset, or NULL when the file is being read with fgets() instead.
+	DWORD mChunkSize;
+	__int64 mChunkOffset;
+	bool mEndOfFile;   // The chunk reaches the end of the file.
+	__int64 mNextLine; // File offset of the start of the line that ReadLine() will return next.
+	char *mLongLine;   // malloc'd buffer for a line that doesn't fit in one chunk (the only case where a line is copied).
+	size_t mLongLineLength, mLongLineCapacity;
 	#define READ_FILE_LINE_SIZE (64 * 1024)  // This is also used by FileReadLine().
-	char mCurrentLine[READ_FILE_LINE_SIZE];
+	char mLineBuf[READ_FILE_LINE_SIZE]; // Used only when the file isn't mapped.
 	LoopReadFileStruct(FILE *aReadFile, char *aWriteFileName)
 		: mReadFile(aReadFile), mWriteFile(NULL) // mWriteFile is opened by FileAppend() only upon first use.
+		, mCurrentLine(""), mCurrentLineLength(0)
+		, mChunk(NULL), mLongLine(NULL), mLongLineLength(0), mLongLineCapacity(0)
 	{
 		// Use our own buffer because caller's is volatile due to possibly being in the deref buffer:
 		strlcpy(mWriteFileName, aWriteFileName, sizeof(mWriteFileName));
-		*mCurrentLine = '\0';
 	}
+	bool BeginChunks();
+	bool ReadChunk(__int64 aOffset);
+	bool ReadLine();
+	bool AppendToLongLine(char *aBuf, size_t aLength);
+	void Close();
 };
 
 
@@ -512,6 +535,30 @@ enum WinSetAttributes {WINSET_INVALID, WINSET_TRANSPARENT, WINSET_TRANSCOLOR, WI
 	, WINSET_REGION};
 
 
+class Line; // Forward declaration for use below.
+// The profiler's statistics (see Line::ProfileLine).  All times are in QueryPerformanceCounter() ticks.
+struct ProfileItem
+{
+	void *key; // The Line or Func these statistics belong to, or NULL if this slot of the table is unused.
+	UINT count; // How many times the line was executed or the function was called.
+	__int64 self, total; // Exclusive and inclusive time.  A line's total includes the functions it called.
+};
+struct ProfileNode // A node of the call tree, which is what the collapsed stacks are made from.
+{
+	Func *func; // The function that was called, or NULL if this is a thread, in which case...
+	Line *line; // ...this is the first line the thread executed.
+	UINT parent, first_child, next_sibling; // Node indices, where 0 is the root of the tree (which is neither).
+	__int64 self;
+};
+struct ProfileFrame // A function call or thread that hasn't yet returned.
+{
+	Func *func; // NULL for the frame of a thread.
+	Line *line; // The line this frame is currently executing.
+	UINT node; // 0 until a thread frame executes its first line.
+	__int64 start, child; // When the frame began, and the total time of the frames it called.
+};
+#define PROFILE_MAX_DEPTH 1024 // Deeper calls are treated as part of the line that made them.
+
 class Label; // Forward declaration so that each can use the other.
 class Line
 {
@@ -519,14 +566,20 @@ private:
 	#define SET_S_DEREF_BUF(ptr, size) sDerefBuf = ptr, sDerefBufSize = size
 	#define NULLIFY_S_DEREF_BUF \
 	{\
+		DisownDerefBuf(sDerefBufSize);\
 		SET_S_DEREF_BUF(NULL, 0);\
-		if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)\
-			--sLargeDerefBufs;\
 	}
 	static char *sDerefBuf;  // Buffer to hold the values of any args that need to be dereferenced.
 	static size_t sDerefBufSize;
 	static int sLargeDerefBufs;
 
+	// Deref buffers come from and return to a pool (see AcquireDerefBuf) rather than being malloc'd and
+	// free'd by each ExpandArgs() layer that needs one:
+	static char *AcquireDerefBuf(size_t aSizeNeeded, size_t &aBufSize);
+	static void ReleaseDerefBuf(char *aBuf, size_t aBufSize, bool aKeepInPool = true);
+	static void DisownDerefBuf(size_t aBufSize);
+	static void TrimDerefBufPool();
+
 	// Static because only one line can be Expanded at a time (not to mention the fact that we
 	// wouldn't want the size of each line to be expanded by this size):
 	static char *sArgDeref[MAX_ARGS];
@@ -786,6 +839,31 @@ public:
 	static DWORD sLogTick[LINE_LOG_SIZE];
 	static int sLogNext;
 
+	// The deref of the call to the built-in function that ExpandExpression() is currently calling, or NULL
+	// if it isn't calling one.  This identifies the call site to functions that cache things per site (see
+	// BIF_DllCall()), so such a function must read it before doing anything that could run script code.
+	static DerefType *sBIFCallSite;
+
+	// The profiler, which keeps per-line and per-function statistics while it's turned on by
+	// Profile("On").  Turning it off leaves only the check of sProfiling in ExecUntil() and Func::Call().
+	static bool sProfiling;
+	static __int64 sProfileSession; // 64-bit so that the tokens made from it (see ProfileEnter) never wrap.
+	static int sProfileDepth;
+	static __int64 sProfileTick;
+	static ProfileFrame sProfileFrame[PROFILE_MAX_DEPTH];
+	static ProfileItem *sProfileLine, *sProfileFunc;
+	static UINT sProfileLineCount, sProfileLineSize, sProfileFuncCount, sProfileFuncSize;
+	static ProfileNode *sProfileNode;
+	static UINT sProfileNodeCount, sProfileNodeSize;
+	static void ProfileStart();
+	static void ProfileStop();
+	static void ProfileReset();
+	static void ProfileLine(Line *aLine);
+	static __int64 ProfileEnter(Func *aFunc);
+	static void ProfileLeave(__int64 aToken);
+	static char *ProfileReport(char aSortBy, size_t &aLength);
+	static char *ProfileCollapsed(size_t &aLength);
+
 #ifdef AUTOHOTKEYSC  // Reduces code size to omit things that are unused, and helps catch bugs at compile-time.
 	static char *sSourceFile[1]; // Only need to be able to hold the main script since compiled scripts don't support dynamic including.
 #else
@@ -795,6 +873,7 @@ public:
 	static int sSourceFileCount; // Number of items in the above array.
 
 	static void FreeDerefBufIfLarge();
+	static __int64 GetDerefBufStat(char *aItem, char *aWhich);
 
 	ResultType ExecUntil(ExecUntilMode aMode, char **apReturnValue = NULL, Line **apJumpToLine = NULL);
 
@@ -856,6 +935,8 @@ public:
 	char *ExpandArg(char *aBuf, int aArgIndex, Var *aArgVar = NULL);
 	char *ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget, char *&aDerefBuf
 		, size_t &aDerefBufSize, char *aArgDeref[], size_t aExtraSize);
+	static ExprTokenType *CachePostfix(ExprTokenType *aPostfix[], int aPostfixCount, char *aTextStart, char *aTextEnd);
+	static void ConvertNumericLiteral(ExprTokenType &aToken, bool aIntegersOnly);
 
 	ResultType Deref(Var *aOutputVar, char *aBuf);
 
@@ -1801,6 +1882,8 @@ public:
 
 
 enum FuncParamDefaults {PARAM_DEFAULT_NONE, PARAM_DEFAULT_STR, PARAM_DEFAULT_INT, PARAM_DEFAULT_FLOAT};
+void RegExScanFree(RegExScan *aScan); // For Func::Call() below.
+
 struct FuncParam
 {
 	Var *var;
@@ -1819,8 +1902,9 @@ public:
 	FuncParam *mParam;  // Will hold an array of FuncParams.
 	int mParamCount; // The number of items in the above array.  This is also the function's maximum number of params.
 	int mMinParams;  // The number of mandatory parameters (populated for both UDFs and built-in's).
-	Var **mVar, **mLazyVar; // Array of pointers-to-variable, allocated upon first use and later expanded as needed.
-	int mVarCount, mVarCountMax, mLazyVarCount; // Count of items in the above array as well as the maximum capacity.
+	Var **mVar; // Array of pointers-to-variable in order of creation, allocated upon first use and later expanded as needed.
+	int mVarCount, mVarCountMax; // Count of items in the above array as well as the maximum capacity.
+	NameHashTable mVarIndex; // Used by FindVar() to look up the above variables by name.
 	int mInstances; // How many instances currently exist on the call stack (due to recursion or thread interruption).  Future use: Might be used to limit how deep recursion can go to help prevent stack overflow.
 	Func *mNextFunc; // Next item in linked list.
 
@@ -1830,6 +1914,7 @@ public:
 	// Keep small members adjacent to each other to save space and improve perf. due to byte alignment:
 	UCHAR mDefaultVarType;
 	bool mIsBuiltIn; // Determines contents of union. Keep this member adjacent/contiguous with the above.
+	bool mVarIsSorted; // Whether mVar is known to be in alphabetical order (it's sorted on demand by ListVars).
 	// Note that it's possible for a built-in function such as WinExist() to become a normal/UDF via
 	// override in the script.  So mIsBuiltIn should always be used to determine whether the function
 	// is truly built-in, not its name.
@@ -1866,7 +1951,16 @@ public:
 		// for a command that references A_Index in two of its args such as the following:
 		// ToolTip, O, ((cos(A_Index) * 500) + 500), A_Index
 		++mInstances;
+		__int64 profile_token = Line::sProfiling ? Line::ProfileEnter(this) : 0;
+		// Each call has RegExMatchNext() scans of its own, so that recursion can't disturb the caller's:
+		RegExScan *prev_scans = g.RegExScans;
+		g.RegExScans = NULL;
 		ResultType result = mJumpToLine->ExecUntil(UNTIL_BLOCK_END, &aReturnValue);
+		if (g.RegExScans) // A scan was abandoned before it reached the last match.
+			RegExScanFree(g.RegExScans);
+		g.RegExScans = prev_scans;
+		if (profile_token)
+			Line::ProfileLeave(profile_token);
 		--mInstances;
 		// Restore the original value in case this function is called from inside another function.
 		// Due to the synchronous nature of recursion and recursion-collapse, this should keep
@@ -1879,10 +1973,10 @@ public:
 		: mName(aFuncName) // Caller gave us a pointer to dynamic memory for this.
 		, mBIF(NULL)
 		, mParam(NULL), mParamCount(0), mMinParams(0)
-		, mVar(NULL), mVarCount(0), mVarCountMax(0), mLazyVar(NULL), mLazyVarCount(0)
+		, mVar(NULL), mVarCount(0), mVarCountMax(0)
 		, mInstances(0), mNextFunc(NULL)
 		, mDefaultVarType(VAR_ASSUME_NONE)
-		, mIsBuiltIn(aIsBuiltIn)
+		, mIsBuiltIn(aIsBuiltIn), mVarIsSorted(true)
 	{}
 	void *operator new(size_t aBytes) {return SimpleHeap::Malloc(aBytes);}
 	void *operator new[](size_t aBytes) {return SimpleHeap::Malloc(aBytes);}
@@ -1903,12 +1997,31 @@ public:
 	bool mEnabled;
 	bool mRunOnlyOnce;
 	ScriptTimer *mNextTimer;  // Next items in linked list
+	// The members below support the scheduler's min-heap (see Script::TimerHeapInsert).  mDue is kept
+	// in 64-bit (wrap-extended) ticks so that the heap's ordering remains valid across the 49.7-day
+	// rollover of GetTickCount().  mHeapIndex is -1 whenever the timer is not in the heap, which is
+	// exactly when it's disabled.
+	__int64 mDue;
+	int mHeapIndex;
+	// Statistics about how late the timer's subroutine was launched relative to its due time.
+	// See TimerStat() for how these are reported:
+	UINT mRunCount;
+	DWORD mLastLateness, mMaxLateness;
+	__int64 mTotalLateness, mTotalJitter;
 	void Disable();
+	void UpdateDue(__int64 aNow)
+	// Recalculates mDue from mTimeLastRun, which is only 32-bit, by measuring the elapsed time
+	// in unsigned DWORD math (as CheckScriptTimers() has always done) and anchoring it to aNow.
+	{
+		mDue = aNow - (DWORD)((DWORD)aNow - mTimeLastRun) + mPeriod;
+	}
 	ScriptTimer(Label *aLabel)
 		#define DEFAULT_TIMER_PERIOD 250
 		: mLabel(aLabel), mPeriod(DEFAULT_TIMER_PERIOD), mPriority(0) // Default is always 0.
 		, mExistingThreads(0), mTimeLastRun(0)
 		, mEnabled(false), mRunOnlyOnce(false), mNextTimer(NULL)  // Note that mEnabled must default to false for the counts to be right.
+		, mDue(0), mHeapIndex(-1)
+		, mRunCount(0), mLastLateness(0), mMaxLateness(0), mTotalLateness(0), mTotalJitter(0)
 	{}
 	void *operator new(size_t aBytes) {return SimpleHeap::Malloc(aBytes);}
 	void *operator new[](size_t aBytes) {return SimpleHeap::Malloc(aBytes);}
@@ -1918,6 +2031,14 @@ public:
 
 
 
+// A timer sorts before another if it's due sooner or, when both are due at the same tick, if it has
+// the higher priority.  This lets CheckScriptTimers() find out whether anything is due by looking only
+// at mTimerHeap[0], rather than walking every timer on every call as it did when the linked list was
+// the only structure:
+#define TIMER_BEFORE(a, b) ((a)->mDue < (b)->mDue || ((a)->mDue == (b)->mDue && (a)->mPriority > (b)->mPriority))
+
+
+
 struct MsgMonitorStruct
 {
 	UINT msg;
@@ -2316,6 +2437,91 @@ public:
 	static DWORD ControlGetListViewMode(HWND aWnd);
 };
 
+
+
+// A script image caches the result of the first stage of loading a script: the logical lines of every
+// file the script consists of, as produced by LoadIncludedFile() after it has read each physical line,
+// removed comments, joined continuation sections and continuation lines, and expanded #Include.  When a
+// script that has the #ScriptImage directive in its main file is loaded, the image is written next to it (with the
+// extension below).  The next time it's loaded (e.g. by Reload), if every file recorded in the image
+// still has the same content, LoadIncludedFile() gets its lines directly from the image rather than
+// from the files.  The image is keyed by a hash of each file's contents rather than timestamps so that
+// tools which restore files with old timestamps (e.g. version control) can't cause a stale image to be
+// used.  The absence of each optional include (#Include *i) that was missing is recorded too, since
+// creating such a file must invalidate the image.
+// Only the reading stage is cached, not the resulting lines, labels, functions and hotkeys, because
+// those are created by parsing code that has many side-effects (hotkeys, directives that change global
+// settings, etc.) which all run the same way regardless of where the lines came from.
+// Known limitation: library files that were auto-included (stdlib/userlib) are validated by content like
+// any other file, but creating a new library file that would now take precedence over one of them (e.g.
+// in the user library, shadowing one in the standard library) doesn't make the image stale.
+#define SCRIPT_IMAGE_EXT ".cache"
+#define SCRIPT_IMAGE_MAGIC "AHKIMG1"
+#define SCRIPT_IMAGE_FILE_ABSENT 0xFFFFFFFF // ScriptImageFile::size of a file that must not exist.
+#define SCRIPT_IMAGE_END_OF_PHASE 0xFFFFFFFF // ScriptImageLine::length of the record that ends a phase (see LoadFromFile).
+#define SCRIPT_IMAGE_END_OF_FILE 0xFFFFFFFE  // ScriptImageLine::length of the record that ends each file.
+
+struct ScriptImageHeader
+{
+	char magic[8];
+	char version[24]; // The version of the program that wrote the image, since the rules for building lines may change.
+	UINT file_count;
+	UINT files_size, lines_size; // Sizes in bytes of the file table and line records that follow the header.
+};
+
+struct ScriptImageFile // Followed by the file's zero-terminated path, then padding to a multiple of 4 bytes.
+{
+	DWORD size;
+	unsigned __int64 hash;
+	UINT path_length;
+};
+
+struct ScriptImageLine // Followed by the line's zero-terminated text, then padding to a multiple of 4 bytes.
+{
+	int file_index;
+	LineNumberType line_number;
+	UINT length;
+};
+
+class ScriptImage
+{
+private:
+	// Replaying: The whole image is mapped into a single view.  Since it consists of offsets and inline
+	// text rather than pointers, it needs no relocation and lines are copied straight out of the view.
+	char *mView, *mNextLine;
+	// Recording:
+	char *mFiles, *mLines;
+	UINT mFileCount, mFilesSize, mFilesCapacity, mLinesSize, mLinesCapacity;
+
+	static void BuildPath(char *aBuf, char *aScriptFileSpec);
+	static bool HashFile(char *aFileSpec, DWORD &aSize, unsigned __int64 &aHash);
+	static bool HasDirective(char *aScriptFileSpec);
+	static bool MayReplace(char *aImagePath);
+	bool Append(char *&aBuf, UINT &aSize, UINT &aCapacity, void *aData, UINT aDataSize, UINT aPadTo = 1);
+	bool Open(char *aScriptFileSpec);
+public:
+	bool mReplaying;        // Lines are being supplied by the image.
+	bool mReplayInProgress; // Inside the LoadIncludedFile() call that's replaying a phase.
+	bool mRecording;        // The load is being recorded so that an image can be written afterward.
+	bool mWanted;           // The script has the #ScriptImage directive.
+
+	bool Begin(char *aScriptFileSpec);
+	UINT NextLine(char *aBuf, int &aFileIndex, LineNumberType &aLineNumber);
+	void AddFile(char *aFileSpec, bool aIsAbsent = false);
+	void AddLine(int aFileIndex, LineNumberType aLineNumber, char *aText, UINT aLength);
+	void EndFile(int aFileIndex, LineNumberType aLineNumber) {AddLine(aFileIndex, aLineNumber, NULL, SCRIPT_IMAGE_END_OF_FILE);}
+	void EndPhase(int aFileIndex, LineNumberType aLineNumber) {AddLine(aFileIndex, aLineNumber, NULL, SCRIPT_IMAGE_END_OF_PHASE);}
+	void Finish(char *aScriptFileSpec);
+
+	ScriptImage() : mView(NULL), mNextLine(NULL), mFiles(NULL), mLines(NULL)
+		, mFileCount(0), mFilesSize(0), mFilesCapacity(0), mLinesSize(0), mLinesCapacity(0)
+		, mReplaying(false), mReplayInProgress(false), mRecording(false), mWanted(false)
+	{}
+	~ScriptImage();
+};
+
+
+
 typedef int (* ahkx_int_str)(char *ahkx_str); // ahkx N11
 typedef int (* ahkx_int_str_str)(char *ahkx_str, char *ahkx_str2); // ahkx N11
 
@@ -2329,14 +2535,16 @@ public:  // Naveen made bunch of stuff public
 	UINT mLineCount;                  // The number of lines.
 	Label *mFirstLabel, *mLastLabel;  // The first and last labels in the linked list.
 	Func *mFirstFunc, *mLastFunc;     // The first and last functions in the linked list.
+	NameHashTable mLabelIndex, mFuncIndex; // Hash indexes of the above lists, used by FindLabel() and FindFunc().
 	Line *mTempLine; // for use with dll Execute # Naveen N9
 	Label *mTempLabel; // for use with dll Execute # Naveen N9
-	Func *mTempFunc; // for use with dll Execute # Naveen N9
     ahkx_int_str xifwinactive ; // ahkx N11
     ahkx_int_str xwingetid ;
     ahkx_int_str_str xsend ;
-	Var **mVar, **mLazyVar; // Array of pointers-to-variable, allocated upon first use and later expanded as needed.
-	int mVarCount, mVarCountMax, mLazyVarCount; // Count of items in the above array as well as the maximum capacity.
+	Var **mVar; // Array of pointers-to-variable in order of creation, allocated upon first use and later expanded as needed.
+	int mVarCount, mVarCountMax; // Count of items in the above array as well as the maximum capacity.
+	NameHashTable mVarIndex; // Used by FindVar() to look up the above variables by name.
+	bool mVarIsSorted; // Whether mVar is known to be in alphabetical order (it's sorted on demand by ListVars).
 	WinGroup *mFirstGroup, *mLastGroup;  // The first and last variables in the linked list.
 	int mOpenBlockCount; // How many blocks are currently open.
 	bool mNextLineIsFunctionBody; // Whether the very next line to be added will be the first one of the body.
@@ -2397,6 +2605,15 @@ public:  // Naveen made bunch of stuff public
 
 	ScriptTimer *mFirstTimer, *mLastTimer;  // The first and last script timers in the linked list.
 	UINT mTimerCount, mTimerEnabledCount;
+	// Binary min-heap of the enabled timers, ordered by due time (and by priority among timers
+	// that are due at the same tick).  mTimerHeap[0] is therefore always the next timer to run:
+	ScriptTimer **mTimerHeap;
+	UINT mTimerHeapCount, mTimerHeapSize;
+	ResultType TimerHeapInsert(ScriptTimer *aTimer);
+	void TimerHeapRemove(ScriptTimer *aTimer);
+	void TimerHeapUpdate(ScriptTimer *aTimer);
+	void TimerHeapSiftUp(int aIndex);
+	void TimerHeapSiftDown(int aIndex);
 
 	UserMenu *mFirstMenu, *mLastMenu;
 	UINT mMenuCount;
@@ -2420,6 +2637,8 @@ public:  // Naveen made bunch of stuff public
 #else
 	FILE *mIncludeLibraryFunctionsThenExit;
 #endif
+	NameHashTable mIncludeIndex; // The lowercase full path of each file loaded so far, used to detect duplicate includes.
+	ScriptImage *mImage; // Non-NULL only while the script is being loaded by LoadFromFile(), and never for compiled scripts.
 	__int64 mLinesExecutedThisCycle; // Use 64-bit to match the type of g.LinesPerCycle
 	int mUninterruptedLineCountMax; // 32-bit for performance (since huge values seem unnecessary here).
 	int mUninterruptibleTime;
@@ -2453,6 +2672,7 @@ public:  // Naveen made bunch of stuff public
 	LineNumberType LoadFromFile(bool aScriptWasNotspecified);
 #endif
 	ResultType LoadIncludedFile(char *aFileSpec, bool aAllowDuplicateInclude, bool aIgnoreLoadFailure);
+	void FreeImage() {delete mImage; mImage = NULL;} // Done by LoadFromFile() whether or not the load succeeds.
 	ResultType UpdateOrCreateTimer(Label *aLabel, char *aPeriod, char *aPriority, bool aEnable
 		, bool aUpdatePriorityOnly);
 
@@ -2469,10 +2689,11 @@ public:  // Naveen made bunch of stuff public
 	#define ALWAYS_PREFER_LOCAL 3
 	Var *FindOrAddVar(char *aVarName, size_t aVarNameLength = 0, int aAlwaysUse = ALWAYS_USE_DEFAULT
 		, bool *apIsException = NULL);
-	Var *FindVar(char *aVarName, size_t aVarNameLength = 0, int *apInsertPos = NULL
+	Var *FindVar(char *aVarName, size_t aVarNameLength = 0
 		, int aAlwaysUse = ALWAYS_USE_DEFAULT, bool *apIsException = NULL
 		, bool *apIsLocal = NULL);
-	Var *AddVar(char *aVarName, size_t aVarNameLength, int aInsertPos, int aIsLocal);
+	Var *AddVar(char *aVarName, size_t aVarNameLength, int aIsLocal);
+	static void SortVars(Var **aVar, int aVarCount, bool &aVarIsSorted);
 	static void *GetVarType(char *aVarName);
 
 	WinGroup *FindGroup(char *aGroupName, bool aCreateIfNotFound = false);
@@ -2632,6 +2853,8 @@ void BIF_StrLen(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParam
 void BIF_SubStr(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
 void BIF_InStr(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
 void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
+void BIF_EngineStats(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
+void BIF_Profile(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
 void BIF_Asc(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
 void BIF_Chr(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
 void BIF_NumGet(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount);
@@ -2679,6 +2902,11 @@ char *ExprTokenToString(ExprTokenType &aToken, char *aBuf);
 ResultType ExprTokenToDoubleOrInt(ExprTokenType &aToken);
 
 char *RegExMatch(char *aHaystack, char *aNeedleRegEx);
+void DllCallSiteReset();
+void RegExSiteReset();
+void FuncLibraryIndexReset();
+void IniFlushAll();
+void IniFlushIfDue(DWORD aTickNow);
 void SetWorkingDir(char *aNewDir);
 int ConvertJoy(char *aBuf, int *aJoystickID = NULL, bool aAllowOnlyButtons = false);
 bool ScriptGetKeyState(vk_type aVK, KeyStateTypes aKeyStateType);
@@ -24,7 +24,7 @@ GNU General Public License for more details.
 #include "resources/resource.h"  // For InputBox.
 
 #define PCRE_STATIC             // For RegEx. PCRE_STATIC tells PCRE to declare its functions for normal, static
-// #include "lib_pcre/pcre/pcre.h" // linkage rather than as functions inside an external DLL.
+#include "lib_pcre/pcre/pcre.h"   // linkage rather than as functions inside an external DLL.
 
 #define DATE_YEARMONTH 8
 
@@ -1540,6 +1540,13 @@ ResultType Line::Input()
 			break;
 		}
 	}
+	// Now that the options are known, compile the match list so that the hook can check each keystroke
+	// without comparing the buffer to every phrase (which can take too long in the hook when there are
+	// hundreds of phrases):
+	if (g_input.MatchCount && !g_input.Matcher.BuildFrom(g_input.match, g_input.MatchCount
+		, g_input.CaseSensitive, g_input.FindAnywhere))
+		return LineError(ERR_OUTOFMEM);  // Short msg. since so rare.
+
 	// Point the global addresses to our memory areas on the stack:
 	g_input.EndVK = end_vk;
 	g_input.EndSC = end_sc;
@@ -5346,8 +5353,8 @@ LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT iMsg, WPARAM wParam, LPARAM lPar
 		g_script.mTempLabel = (Label *)wParam ;
 		g_script.mTempLabel->Execute();
 		return 0;
-	case AHK_EXECUTE_FUNCTION:
-		callFunc(wParam, lParam);
+	case AHK_EXECUTE_FUNCTION: // Posted by the DLL exports when they add calls to the queue.
+		DrainCallQueue();
 		return 0;
 	case AHK_SENDKEYS:
 		SendKeys((char *)wParam, false, SM_EVENT, 0, 1);
@@ -6669,6 +6676,9 @@ ResultType Line::PerformAssign()
 
 	if (source_is_being_appended_to_target)
 	{
+		// The text is about to be appended in place, which mustn't alter the text a parsing loop is reading.
+		// This is done prior to checking the capacity because giving the var new memory can change it:
+		output_var.DetachIfPinned();
 		if (space_needed > output_var.Capacity())
 		{
 			// Since expanding the size of output_var while preserving its existing contents would
@@ -7058,81 +7068,44 @@ ResultType Line::SplitPath(char *aFileSpec)
 
 
 
-int SortWithOptions(const void *a1, const void *a2)
-// Decided to just have one sort function since there are so many permutations.  The performance
-// will be a little bit worse, but it seems simpler to implement and maintain.
-// This function's input parameters are pointers to the elements of the array.  Snce those elements
-// are themselves pointers, the input parameters are therefore pointers to pointers (handles).
+struct SortItem
 {
-	char *sort_item1 = *(char **)a1;
-	char *sort_item2 = *(char **)a2;
-	if (g_SortColumnOffset > 0)
-	{
-		// Adjust each string (even for numerical sort) to be the right column position,
-		// or the position of its zero terminator if the column offset goes beyond its length:
-		size_t length = strlen(sort_item1);
-		sort_item1 += (size_t)g_SortColumnOffset > length ? length : g_SortColumnOffset;
-		length = strlen(sort_item2);
-		sort_item2 += (size_t)g_SortColumnOffset > length ? length : g_SortColumnOffset;
-	}
-	if (g_SortNumeric) // Takes precedence over g_SortCaseSensitive
+	char *item; // The item itself, which is what gets copied into the output.
+	char *key;  // The part of the item by which it's sorted (differs from item only for the P and \ options).
+	union
 	{
-		// For now, assume both are numbers.  If one of them isn't, it will be sorted as a zero.
-		// Thus, all non-numeric items should wind up in a sequential, unsorted group.
-		// Resolve only once since parts of the ATOF() macro are inline:
-		double item1_minus_2 = ATOF(sort_item1) - ATOF(sort_item2);
-		if (!item1_minus_2) // Exactly equal.
-			return 0;
-		// Otherwise, it's either greater or less than zero:
-		int result = (item1_minus_2 > 0.0) ? 1 : -1;
-		return g_SortReverse ? -result : result;
-	}
-	// Otherwise, it's a non-numeric sort.
-	// v1.0.43.03: Added support the new locale-insensitive mode.
-	int result = strcmp2(sort_item1, sort_item2, g_SortCaseSensitive); // Resolve large macro only once for code size reduction.
-	return g_SortReverse ? -result : result;
-}
-
-
+		// For the N option, the key's numeric value, converted so that comparing it as an unsigned integer
+		// yields the same order as comparing the original doubles.  For the Random option, a random number.
+		unsigned __int64 bits;
+		double number;
+	};
+};
 
-int SortByNakedFilename(const void *a1, const void *a2)
-// See comments in prior function for details.
+struct SortContext
+// Everything the sorting functions need is passed to them rather than kept in globals, so that a thread which
+// interrupts a sort (such as during a call to the F option's function) can safely perform a sort of its own.
 {
-	char *sort_item1 = *(char **)a1;
-	char *sort_item2 = *(char **)a2;
-	char *cp;
-	if (cp = strrchr(sort_item1, '\\'))  // Assign
-		sort_item1 = cp + 1;
-	if (cp = strrchr(sort_item2, '\\'))  // Assign
-		sort_item2 = cp + 1;
-	// v1.0.43.03: Added support the new locale-insensitive mode.
-	int result = strcmp2(sort_item1, sort_item2, g_SortCaseSensitive); // Resolve large macro only once for code size reduction.
-	return g_SortReverse ? -result : result;
-}
+	Func *func;            // The F option's function, or NULL if none.
+	UCHAR case_sensitive;  // SCS_INSENSITIVE, SCS_SENSITIVE, or SCS_INSENSITIVE_LOCALE.
+	UCHAR char_map[256];   // For SortMultikey(): maps each char to its sort weight (e.g. 'A' to 'a' when case-insensitive).
+};
 
+typedef int (*SortCompareType)(SortItem &aItem1, SortItem &aItem2, SortContext &aContext);
 
 
-struct sort_rand_type
-{
-	char *cp; // This must be the first member of the struct, otherwise the array trickery in PerformSort will fail.
-	union
-	{
-		// This must be the same size in bytes as the above, which is why it's maintained as a union with
-		// a char* rather than a plain int (though currently they would be the same size anyway).
-		char *unused;
-		int rand;
-	};
-};
 
-int SortRandom(const void *a1, const void *a2)
-// See comments in prior functions for details.
+int SortLocale(SortItem &aItem1, SortItem &aItem2, SortContext &aContext)
+// v1.0.43.03: Added support the new locale-insensitive mode, which can't be done a character at a time
+// like the other modes because lstrcmpi() weighs whole strings (e.g. it ignores hyphens in some cases).
 {
-	return ((sort_rand_type *)a1)->rand - ((sort_rand_type *)a2)->rand;
+	return lstrcmpi(aItem1.key, aItem2.key);
 }
 
-int SortUDF(const void *a1, const void *a2)
-// See comments in prior function for details.
+
+
+int SortUDF(SortItem &aItem1, SortItem &aItem2, SortContext &aContext)
 {
+	Func &func = *aContext.func;
 	// Need to check if backup of function's variables is needed in case:
 	// 1) The UDF is assigned to more than one callback, in which case the UDF could be running more than one
 	//    simultantously.
@@ -7142,8 +7115,8 @@ int SortUDF(const void *a1, const void *a2)
 	// See ExpandExpression() for detailed comments about the following section.
 	VarBkp *var_backup = NULL;  // If needed, it will hold an array of VarBkp objects.
 	int var_backup_count; // The number of items in the above array.
-	if (g_SortFunc->mInstances > 0) // Backup is needed.
-		if (!Var::BackupFunctionVars(*g_SortFunc, var_backup, var_backup_count)) // Out of memory.
+	if (func.mInstances > 0) // Backup is needed.
+		if (!Var::BackupFunctionVars(func, var_backup, var_backup_count)) // Out of memory.
 			return 0; // Since out-of-memory is so rare, it seems justifiable not to have any error reporting and instead just say "these items are equal".
 
 	// The following isn't necessary because by definition, the current thread isn't paused because it's the
@@ -7151,11 +7124,11 @@ int SortUDF(const void *a1, const void *a2)
 	//g_script.UpdateTrayIcon();
 
 	char *return_value;
-	g_SortFunc->mParam[0].var->Assign(*(char **)a1); // For simplicity and due to extreme rarity, parameters beyond
-	g_SortFunc->mParam[1].var->Assign(*(char **)a2); // the first 2 aren't populated even if they have default values.
-	if (g_SortFunc->mParamCount > 2)
-		g_SortFunc->mParam[2].var->Assign((__int64)(*(char **)a2 - *(char **)a1)); // __int64 to allow for a list greater than 2 GB, though that is currently impossible.
-	g_SortFunc->Call(return_value); // Call the UDF.
+	func.mParam[0].var->Assign(aItem1.item); // For simplicity and due to extreme rarity, parameters beyond
+	func.mParam[1].var->Assign(aItem2.item); // the first 2 aren't populated even if they have default values.
+	if (func.mParamCount > 2)
+		func.mParam[2].var->Assign((__int64)(aItem2.item - aItem1.item)); // __int64 to allow for a list greater than 2 GB, though that is currently impossible.
+	func.Call(return_value); // Call the UDF.
 
 	// MUST handle return_value BEFORE calling FreeAndRestoreFunctionVars() because return_value might be
 	// the contents of one of the function's local variables (which are about to be free'd).
@@ -7178,12 +7151,200 @@ int SortUDF(const void *a1, const void *a2)
 	else
 		returned_int = 0;
 
-	Var::FreeAndRestoreFunctionVars(*g_SortFunc, var_backup, var_backup_count);
+	Var::FreeAndRestoreFunctionVars(func, var_backup, var_backup_count);
 	return returned_int;
 }
 
 
 
+void SortMerge(SortItem *aItem, SortItem *aTemp, size_t aCount, SortCompareType aCompare, SortContext &aContext)
+// Sorts via a comparison function, which is necessary for the F option and the locale-insensitive mode.
+// A merge sort is used rather than qsort() because it can pass aContext to the comparison function, and
+// because it never strays outside the array even if a script's function contradicts itself (e.g. by
+// returning random results).  aTemp must have room for at least aCount/2 items.
+{
+	size_t i, j, k;
+	if (aCount < 8) // Insertion sort is faster for tiny runs.
+	{
+		SortItem this_item;
+		for (i = 1; i < aCount; ++i)
+		{
+			this_item = aItem[i];
+			for (j = i; j && aCompare(aItem[j - 1], this_item, aContext) > 0; --j)
+				aItem[j] = aItem[j - 1];
+			aItem[j] = this_item;
+		}
+		return;
+	}
+	size_t half = aCount / 2;
+	SortMerge(aItem, aTemp, half, aCompare, aContext);
+	SortMerge(aItem + half, aTemp, aCount - half, aCompare, aContext);
+	if (aCompare(aItem[half - 1], aItem[half], aContext) <= 0) // Already in order (common for partly-sorted lists).
+		return;
+	// Move the first half aside, then merge it with the second half back into aItem.  The destination
+	// never overtakes the unmerged part of the second half, so nothing is overwritten before it's used:
+	memcpy(aTemp, aItem, half * sizeof(SortItem));
+	for (i = 0, j = half, k = 0; i < half && j < aCount;)
+		aItem[k++] = (aCompare(aItem[j], aTemp[i], aContext) < 0) ? aItem[j++] : aTemp[i++]; // Taking from the first half when equal keeps the sort stable.
+	while (i < half)
+		aItem[k++] = aTemp[i++];
+}
+
+
+
+void SortRadix(SortItem *aItem, SortItem *aTemp, size_t aCount)
+// Sorts by the "bits" member in ascending order.  This is a least-significant-byte-first radix sort, which
+// takes linear time.  Passes for bytes that are the same in every item are skipped, which avoids most of
+// the work for typical lists of numbers (e.g. small integers differ only in two or three of their bytes).
+{
+	size_t count[8][256], i, sum, n, *this_count;
+	int pass, shift;
+	if (aCount < 2)
+		return;
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < aCount; ++i)
+		for (pass = 0, shift = 0; pass < 8; ++pass, shift += 8)
+			++count[pass][(UCHAR)(aItem[i].bits >> shift)];
+	SortItem *source = aItem, *dest = aTemp, *swap;
+	for (pass = 0, shift = 0; pass < 8; ++pass, shift += 8)
+	{
+		this_count = count[pass];
+		if (this_count[(UCHAR)(aItem->bits >> shift)] == aCount) // Every item has the same byte here.
+			continue;
+		for (sum = 0, i = 0; i < 256; ++i) // Convert counts into starting positions.
+		{
+			n = this_count[i];
+			this_count[i] = sum;
+			sum += n;
+		}
+		for (i = 0; i < aCount; ++i)
+			dest[this_count[(UCHAR)(source[i].bits >> shift)]++] = source[i];
+		swap = source;
+		source = dest;
+		dest = swap;
+	}
+	if (source != aItem)
+		memcpy(aItem, source, aCount * sizeof(SortItem));
+}
+
+
+
+inline int SortCompareFrom(char *aKey1, char *aKey2, UCHAR *aMap)
+// Compares two keys like strcmp()/stricmp() except that each char is weighed via aMap.
+{
+	UCHAR c1, c2;
+	for (;; ++aKey1, ++aKey2)
+	{
+		c1 = aMap[(UCHAR)*aKey1];
+		c2 = aMap[(UCHAR)*aKey2];
+		if (c1 != c2 || !c1)
+			return (int)c1 - (int)c2;
+	}
+}
+
+
+
+void SortMultikey(SortItem *aItem, size_t aCount, size_t aDepth, UCHAR *aMap)
+// Sorts by the "key" member in ascending order for the case-sensitive and case-insensitive modes.  All keys
+// in aItem are known to be identical up to aDepth.  This is a multikey quicksort (Bentley & Sedgewick), which
+// partitions the items by a single char at a time and only moves on to the next char for the items that
+// share it.  Unlike a comparison sort, it never re-examines the common prefixes of keys, which is where
+// most of the time goes when sorting things like file paths.
+{
+	ptrdiff_t count, a, b, c, d, n, less, equal, greater, i;
+	int pivot, r;
+	SortItem swap;
+	#define SORT_CHAR(x) aMap[(UCHAR)aItem[x].key[aDepth]]
+	#define SORT_SWAP(x, y) (swap = aItem[x], aItem[x] = aItem[y], aItem[y] = swap)
+	while (aCount > 1)
+	{
+		count = (ptrdiff_t)aCount;
+		if (count < 16) // Insertion sort is faster for tiny partitions.
+		{
+			SortItem this_item;
+			for (a = 1; a < count; ++a)
+			{
+				this_item = aItem[a];
+				for (b = a; b && SortCompareFrom(aItem[b - 1].key + aDepth, this_item.key + aDepth, aMap) > 0; --b)
+					aItem[b] = aItem[b - 1];
+				aItem[b] = this_item;
+			}
+			break;
+		}
+		// Use the median of the first, middle and last chars as the pivot, then move it to the front:
+		a = 0, b = count / 2, c = count - 1;
+		int ca = SORT_CHAR(a), cb = SORT_CHAR(b), cc = SORT_CHAR(c);
+		i = ca < cb ? (cb < cc ? b : (ca < cc ? c : a)) : (cb > cc ? b : (ca < cc ? a : c));
+		SORT_SWAP(0, i);
+		pivot = SORT_CHAR(0);
+		// Split-end partitioning: items equal to the pivot collect at both ends, then get swapped to the middle.
+		a = b = 1;
+		c = d = count - 1;
+		for (;;)
+		{
+			for (; b <= c && (r = SORT_CHAR(b) - pivot) <= 0; ++b)
+				if (!r)
+				{
+					SORT_SWAP(a, b);
+					++a;
+				}
+			for (; b <= c && (r = SORT_CHAR(c) - pivot) >= 0; --c)
+				if (!r)
+				{
+					SORT_SWAP(c, d);
+					--d;
+				}
+			if (b > c)
+				break;
+			SORT_SWAP(b, c);
+			++b;
+			--c;
+		}
+		n = a < b - a ? a : b - a;
+		for (i = 0; i < n; ++i)
+			SORT_SWAP(i, b - n + i);
+		n = d - c < count - 1 - d ? d - c : count - 1 - d;
+		for (i = 0; i < n; ++i)
+			SORT_SWAP(b + i, count - n + i);
+		less = b - a;
+		greater = d - c;
+		equal = count - less - greater;
+		SortItem *equal_part = aItem + less, *greater_part = aItem + count - greater;
+		if (!pivot) // These keys end here, so they're all identical and there's nothing left to sort among them.
+			equal = 0;
+		// To keep the recursion shallow even for long keys or unlucky pivots, recurse into the two smaller
+		// partitions and loop on the largest:
+		if (equal >= less && equal >= greater)
+		{
+			SortMultikey(aItem, less, aDepth, aMap);
+			SortMultikey(greater_part, greater, aDepth, aMap);
+			aItem = equal_part;
+			aCount = equal;
+			++aDepth;
+		}
+		else
+		{
+			if (equal)
+				SortMultikey(equal_part, equal, aDepth + 1, aMap);
+			if (less >= greater)
+			{
+				SortMultikey(greater_part, greater, aDepth, aMap);
+				aCount = less;
+			}
+			else
+			{
+				SortMultikey(aItem, less, aDepth, aMap);
+				aItem = greater_part;
+				aCount = greater;
+			}
+		}
+	}
+	#undef SORT_CHAR
+	#undef SORT_SWAP
+}
+
+
+
 ResultType Line::PerformSort(char *aContents, char *aOptions)
 // Caller must ensure that aContents is modifiable (ArgMustBeDereferenced() currently ensures this) because
 // not only does this function modify it, it also needs to store its result back into output_var in a way
@@ -7200,17 +7361,17 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 {
 	// Set defaults in case of early goto:
 	char *mem_to_free = NULL;
-	Func *sort_func_orig = g_SortFunc; // Because UDFs can be interrupted by other threads -- and because UDFs can themselves call Sort with some other UDF (unlikely to be sure) -- backup & restore original g_SortFunc so that the "collapsing in reverse order" behavior will automatically ensure proper operation.
-	g_SortFunc = NULL; // Now that original has been saved above, reset to detect whether THIS sort uses a UDF.
+	SortItem *item = NULL;
+	SortContext context; // Kept on the stack rather than in globals because UDFs can be interrupted by other threads, and because UDFs can themselves call Sort with some other UDF.
+	context.func = NULL; // Detects whether THIS sort uses a UDF.
 	ResultType result_to_return = OK;
 	DWORD ErrorLevel = -1; // Use -1 to mean "don't change/set ErrorLevel".
 
 	// Resolve options.  First set defaults for options:
 	char delimiter = '\n';
-	g_SortCaseSensitive = SCS_INSENSITIVE;
-	g_SortNumeric = false;
-	g_SortReverse = false;
-	g_SortColumnOffset = 0;
+	context.case_sensitive = SCS_INSENSITIVE;
+	bool sort_numeric = false, sort_reverse = false;
+	int column_offset = 0;
 	bool trailing_delimiter_indicates_trailing_blank_item = false, terminate_last_item_with_delimiter = false
 		, trailing_crlf_added_temporarily = false, sort_by_naked_filename = false, sort_random = false
 		, omit_dupes = false;
@@ -7224,10 +7385,10 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 			if (toupper(cp[1]) == 'L') // v1.0.43.03: Locale-insensitive mode, which probably performs considerably worse.
 			{
 				++cp;
-				g_SortCaseSensitive = SCS_INSENSITIVE_LOCALE;
+				context.case_sensitive = SCS_INSENSITIVE_LOCALE;
 			}
 			else
-				g_SortCaseSensitive = SCS_SENSITIVE;
+				context.case_sensitive = SCS_SENSITIVE;
 			break;
 		case 'D':
 			if (!cp[1]) // Avoids out-of-bounds when the loop's own ++cp is done.
@@ -7243,14 +7404,14 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 			cp = omit_leading_whitespace(cp + 1); // Point it to the function's name.
 			if (   !(cp_end = StrChrAny(cp, " \t"))   ) // Find space or tab, if any.
 				cp_end = cp + strlen(cp); // Point it to the terminator instead.
-			if (   !(g_SortFunc = g_script.FindFunc(cp, cp_end - cp))   )
+			if (   !(context.func = g_script.FindFunc(cp, cp_end - cp))   )
 				goto end; // For simplicity, just abort the sort.
 			// To improve callback performance, ensure there are no ByRef parameters (for simplicity:
 			// not even ones that have default values) among the first two parameters.  This avoids the
 			// need to ensure formal parameters are non-aliases each time the callback is called.
-			if (g_SortFunc->mIsBuiltIn || g_SortFunc->mParamCount < 2 // This validation is relied upon at a later stage.
-				|| g_SortFunc->mParamCount > 3  // Reserve 4-or-more parameters for possible future use (to avoid breaking existing scripts if such features are ever added).
-				|| g_SortFunc->mParam[0].is_byref || g_SortFunc->mParam[1].is_byref) // Relies on short-circuit boolean order.
+			if (context.func->mIsBuiltIn || context.func->mParamCount < 2 // This validation is relied upon at a later stage.
+				|| context.func->mParamCount > 3  // Reserve 4-or-more parameters for possible future use (to avoid breaking existing scripts if such features are ever added).
+				|| context.func->mParam[0].is_byref || context.func->mParam[1].is_byref) // Relies on short-circuit boolean order.
 				goto end; // For simplicity, just abort the sort.
 			// Otherwise, the function meets the minimum contraints (though for simplicity, optional parameters
 			// (default values), if any, aren't populated).
@@ -7259,15 +7420,15 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 			cp = cp_end - 1; // In the next interation (which also does a ++cp), resume looking for options after the function's name.
 			break;
 		case 'N':
-			g_SortNumeric = true;
+			sort_numeric = true;
 			break;
 		case 'P':
 			// Use atoi() vs. ATOI() to avoid interpreting something like 0x01C as hex
 			// when in fact the C was meant to be an option letter:
-			g_SortColumnOffset = atoi(cp + 1);
-			if (g_SortColumnOffset < 1)
-				g_SortColumnOffset = 1;
-			--g_SortColumnOffset;  // Convert to zero-based.
+			column_offset = atoi(cp + 1);
+			if (column_offset < 1)
+				column_offset = 1;
+			--column_offset;  // Convert to zero-based.
 			break;
 		case 'R':
 			if (!strnicmp(cp, "Random", 6))
@@ -7276,7 +7437,7 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 				cp += 5; // Point it to the last char so that the loop's ++cp will point to the character after it.
 			}
 			else
-				g_SortReverse = true;
+				sort_reverse = true;
 			break;
 		case 'U':  // Unique.
 			omit_dupes = true;
@@ -7368,9 +7529,9 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 	// v1.0.47.05: It simplifies the code a lot to allocate and/or improves understandability to allocate
 	// memory for trailing_crlf_added_temporarily even though technically it's done only to make room to
 	// append the extra CRLF at the end.
-	if (g_SortFunc || trailing_crlf_added_temporarily) // Do this here rather than earlier with the options parsing in case the function-option is present twice (unlikely, but it would be a memory leak due to strdup below).  Doing it here also avoids allocating if it isn't necessary.
+	if (context.func || trailing_crlf_added_temporarily) // Do this here rather than earlier with the options parsing in case the function-option is present twice (unlikely, but it would be a memory leak due to strdup below).  Doing it here also avoids allocating if it isn't necessary.
 	{
-		// When g_SortFunc!=NULL, the copy of the string is needed because an earlier stage has ensured that
+		// When context.func!=NULL, the copy of the string is needed because an earlier stage has ensured that
 		// aContents is in the deref buffer, but that deref buffer is about to be overwritten by the
 		// execution of the script's UDF body.
 		if (   !(mem_to_free = (char *)malloc(aContents_length + 3))   ) // +1 for terminator and +2 in case of trailing_crlf_added_temporarily.
@@ -7389,82 +7550,112 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 		}
 	}
 
-	// Create the array of pointers that points into aContents to each delimited item.
-	// Use item_count + 1 to allow space for the last (blank) item in case
-	// trailing_delimiter_indicates_trailing_blank_item is false:
-	int unit_size = sort_random ? 2 : 1;
-	size_t item_size = unit_size * sizeof(char *);
-	char **item = (char **)malloc((item_count + 1) * item_size);
-	if (!item)
+	// Decide how to sort.  In order of precedence: the F option, Random, the \ option (which ignores N),
+	// then N, then the string modes.  Numeric keys are sorted by the bit patterns of their values, which
+	// allows a radix sort:
+	bool sort_by_bits = sort_numeric && !sort_by_naked_filename && !sort_random && !context.func;
+	bool sort_by_compare = context.func || (!sort_random && !sort_by_bits && context.case_sensitive == SCS_INSENSITIVE_LOCALE);
+
+	// Create the array of items, each of which points into aContents.  Use item_count + 1 to allow space for
+	// the last (blank) item in case trailing_delimiter_indicates_trailing_blank_item is false.  SortRadix()
+	// and SortMerge() also need scratch space, which is put at the end of the same block:
+	if (   !(item = (SortItem *)malloc((item_count + 1 + (sort_by_bits || sort_by_compare ? item_count : 0)) * sizeof(SortItem)))   )
 	{
 		result_to_return = LineError(ERR_OUTOFMEM);  // Short msg. since so rare.
 		goto end;
 	}
 
-	// If sort_random is in effect, the above has created an array twice the normal size.
-	// This allows the random numbers to be interleaved inside the array as though it
-	// were an array consisting of sort_rand_type (which it actually is when viewed that way).
-	// Because of this, the array should be accessed through pointer addition rather than
-	// indexing via [].
-
 	// Scan aContents and do the following:
 	// 1) Replace each delimiter with a terminator so that the individual items can be seen
-	//    as real strings by the SortWithOptions() and when copying the sorted results back
+	//    as real strings by the sort and when copying the sorted results back
 	//    into output_vav.  It is safe to change aContents in this way because
 	//    ArgMustBeDereferenced() has ensured that those contents are in the deref buffer.
 	// 2) Store a marker/pointer to each item (string) in aContents so that we know where
 	//    each item begins for sorting and recopying purposes.
-	char **item_curr = item; // i.e. Don't use [] indexing for the reason in the paragraph previous to above.
-	for (item_count = 0, cp = *item_curr = aContents; *cp; ++cp)
+	SortItem *item_curr = item, *item_end, swap_item;
+	for (item_count = 0, item_curr->item = cp = aContents; *cp; ++cp)
 	{
 		if (*cp == delimiter)  // Each delimiter char becomes the terminator of the previous key phrase.
 		{
 			*cp = '\0';  // Terminate the item that appears before this delimiter.
 			++item_count;
-			if (sort_random)
-				*(item_curr + 1) = (char *)(size_t)genrand_int31(); // i.e. the randoms are in the odd fields, the pointers in the even.
-				// For the above:
-				// I don't know the exact reasons, but using genrand_int31() is much more random than
-				// using genrand_int32() in this case.  Perhaps it is some kind of statistical/cyclical
-				// anomaly in the random number generator.  Or perhaps it's something to do with integer
-				// underflow/overflow in SortRandom().  In any case, the problem can be proven via the
-				// following script, which shows a sharply non-random distribution when genrand_int32()
-				// is used:
-				//count = 0
-				//Loop 10000
-				//{
-				//	var = 1`n2`n3`n4`n5`n
-				//	Sort, Var, Random
-				//	StringLeft, Var1, Var, 1
-				//	if Var1 = 5  ; Change this value to 1 to see the opposite problem.
-				//		count += 1
-				//}
-				//Msgbox %count%
-				//
-				// I e-mailed the author about this sometime around/prior to 12/1/04 but never got a response.
-			item_curr += unit_size; // i.e. Don't use [] indexing for the reason described above.
-			*item_curr = cp + 1; // Make a pointer to the next item's place in aContents.
+			(++item_curr)->item = cp + 1; // Make a pointer to the next item's place in aContents.
 		}
 	}
 	// The above reset the count to 0 and recounted it.  So now re-add the last item to the count unless it was
 	// disqualified earlier. Verified correct:
 	if (!terminate_last_item_with_delimiter) // i.e. either trailing_delimiter_indicates_trailing_blank_item==true OR the final character isn't a delimiter. Either way the final item needs to be added.
-	{
 		++item_count;
-		if (sort_random) // Provide a random number for the last item.
-			*(item_curr + 1) = (char *)(size_t)genrand_int31(); // i.e. the randoms are in the odd fields, the pointers in the even.
-	}
-	else // Since the final item is not included in the count, point item_curr to the one before the last, for use below.
-		item_curr -= unit_size;
+	item_end = item + item_count;
 
-	// Now aContents has been divided up based on delimiter.  Sort the array of pointers
-	// so that they indicate the correct ordering to copy aContents into output_var:
-	if (g_SortFunc) // Takes precedence other sorting methods.
-		qsort((void *)item, item_count, item_size, SortUDF);
+	// Now aContents has been divided up based on delimiter.  Sort the array so that it indicates the correct
+	// ordering to copy aContents into output_var:
+	if (context.func) // Takes precedence other sorting methods.
+		SortMerge(item, item_end, item_count, SortUDF, context);
 	else if (sort_random) // Takes precedence over all remaining options.
-		qsort((void *)item, item_count, item_size, SortRandom);
+	{
+		// Shuffle the items, which unlike sorting them by random numbers takes linear time and gives
+		// every ordering the same chance.  genrand_int31() is used because genrand_int32() was once found
+		// to give a sharply non-random distribution when sorting by random numbers.
+		for (item_curr = item_end - 1; item_curr > item; --item_curr)
+		{
+			SortItem &other_item = item[genrand_int31() % (item_curr - item + 1)];
+			swap_item = *item_curr;
+			*item_curr = other_item;
+			other_item = swap_item;
+		}
+	}
 	else
-		qsort((void *)item, item_count, item_size, sort_by_naked_filename ? SortByNakedFilename : SortWithOptions);
+	{
+		// Find each item's key only once rather than in every comparison:
+		for (item_curr = item; item_curr < item_end; ++item_curr)
+		{
+			if (sort_by_naked_filename)
+				item_curr->key = (cp = strrchr(item_curr->item, '\\')) ? cp + 1 : item_curr->item;
+			else if (column_offset > 0)
+			{
+				// Adjust each string (even for numerical sort) to be the right column position,
+				// or the position of its zero terminator if the column offset goes beyond its length:
+				size_t length = strlen(item_curr->item);
+				item_curr->key = item_curr->item + ((size_t)column_offset > length ? length : column_offset);
+			}
+			else
+				item_curr->key = item_curr->item;
+			if (sort_by_bits)
+			{
+				// For now, assume all are numbers.  If one of them isn't, it will be sorted as a zero.
+				// Thus, all non-numeric items should wind up in a sequential, unsorted group.
+				item_curr->number = ATOF(item_curr->key);
+				if (!item_curr->number) // Convert -0.0 to 0.0 so that the two are treated as equal.
+					item_curr->number = 0.0;
+				// Set the sign bit of positives and invert all bits of negatives, which makes the unsigned
+				// order of the bits the same as the numeric order:
+				item_curr->bits = (item_curr->bits & 0x8000000000000000ULL) ? ~item_curr->bits
+					: item_curr->bits | 0x8000000000000000ULL;
+			}
+		}
+		if (sort_by_bits)
+			SortRadix(item, item_end, item_count);
+		else if (sort_by_compare) // Locale-insensitive mode.
+			SortMerge(item, item_end, item_count, SortLocale, context);
+		else
+		{
+			int c;
+			for (c = 0; c < 256; ++c)
+				context.char_map[c] = (UCHAR)c;
+			if (context.case_sensitive == SCS_INSENSITIVE) // Same as stricmp(), which folds only A-Z.
+				for (c = 'A'; c <= 'Z'; ++c)
+					context.char_map[c] = (UCHAR)(c + ('a' - 'A'));
+			SortMultikey(item, item_count, 0, context.char_map);
+		}
+		if (sort_reverse) // Each of the above sorts in ascending order.
+			for (item_curr = item, item_end = item + item_count - 1; item_curr < item_end; ++item_curr, --item_end)
+			{
+				swap_item = *item_curr;
+				*item_curr = *item_end;
+				*item_end = swap_item;
+			}
+	}
 
 	// Copy the sorted pointers back into output_var, which might not already be sized correctly
 	// if it's the clipboard or it was an environment variable when it came in as the input.
@@ -7480,24 +7671,23 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 	DWORD omit_dupe_count = 0;
 	bool keep_this_item;
 	char *source, *dest;
-	char *item_prev = NULL;
+	SortItem *item_prev = NULL;
 
 	// Copy the sorted result back into output_var.  Do all except the last item, since the last
 	// item gets special treatment depending on the options that were specified.  The call to
 	// output_var->Contents() below should never fail due to the above having prepped it:
-	item_curr = item; // i.e. Don't use [] indexing for the reason described higher above (same applies to item += unit_size below).
-	for (dest = output_var.Contents(), i = 0; i < item_count; ++i, item_curr += unit_size)
+	for (dest = output_var.Contents(), item_curr = item, i = 0; i < item_count; ++i, ++item_curr)
 	{
 		keep_this_item = true;  // Set default.
 		if (omit_dupes && item_prev)
 		{
 			// Update to the comment below: Exact dupes will still be removed when sort_by_naked_filename
-			// or g_SortColumnOffset is in effect because duplicate lines would still be adjacent to
+			// or column_offset is in effect because duplicate lines would still be adjacent to
 			// each other even in these modes.  There doesn't appear to be any exceptions, even if
 			// some items in the list are sorted as blanks due to being shorter than the specified
-			// g_SortColumnOffset.
+			// column_offset.
 			// As documented, special dupe-checking modes are not offered when sort_by_naked_filename
-			// is in effect, or g_SortColumnOffset is greater than 1.  That's because the need for such
+			// is in effect, or column_offset is greater than 1.  That's because the need for such
 			// a thing seems too rare (and the result too strange) to justify the extra code size.
 			// However, adjacent dupes are still removed when any of the above modes are in effect,
 			// or when the "random" mode is in effect.  This might have some usefulness; for example,
@@ -7505,13 +7695,15 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 			// the dupe-removal feature would remove duplicate songs if they happen to be sorted
 			// to lie adjacent to each other, which would be useful to prevent the same song from
 			// playing twice in a row.
-			if (g_SortNumeric && !g_SortColumnOffset)
-				// if g_SortColumnOffset is zero, fall back to the normal dupe checking in case its
+			if (sort_numeric && !column_offset)
+				// if column_offset is zero, fall back to the normal dupe checking in case its
 				// ever useful to anyone.  This is done because numbers in an offset column are not supported
 				// since the extra code size doensn't seem justified given the rarity of the need.
-				keep_this_item = (ATOF(*item_curr) != ATOF(item_prev)); // ATOF() ignores any trailing \r in CRLF mode, so no extra logic is needed for that.
+				keep_this_item = sort_by_bits // The key is the whole item, so compare the numbers already extracted for the sort.
+					? item_curr->bits != item_prev->bits
+					: ATOF(item_curr->item) != ATOF(item_prev->item); // ATOF() ignores any trailing \r in CRLF mode, so no extra logic is needed for that.
 			else
-				keep_this_item = strcmp2(*item_curr, item_prev, g_SortCaseSensitive); // v1.0.43.03: Added support for locale-insensitive mode.
+				keep_this_item = strcmp2(item_curr->item, item_prev->item, context.case_sensitive); // v1.0.43.03: Added support for locale-insensitive mode.
 				// Permutations of sorting case sensitive vs. eliminating duplicates based on case sensitivity:
 				// 1) Sort is not case sens, but dupes are: Won't work because sort didn't necessarily put
 				//    same-case dupes adjacent to each other.
@@ -7520,19 +7712,19 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 				// 3) Both are case sensitive: seems okay
 				// 4) Both are not case sensitive: seems okay
 				//
-				// In light of the above, using the g_SortCaseSensitive flag to control the behavior of
+				// In light of the above, using the case_sensitive option to control the behavior of
 				// both sorting and dupe-removal seems best.
 		}
 		if (keep_this_item)
 		{
-			for (source = *item_curr; *source;)
+			for (source = item_curr->item; *source;)
 				*dest++ = *source++;
 			// If we're at the last item and the original list's last item had a terminating delimiter
 			// and the specified options said to treat it not as a delimiter but as a final char of sorts,
 			// include it after the item that is now last so that the overall layout is the same:
 			if (i < item_count_minus_1 || terminate_last_item_with_delimiter)
 				*dest++ = delimiter;  // Put each item's delimiter back in so that format is the same as the original.
-			item_prev = *item_curr; // Since the item just processed above isn't a dupe, save this item to compare against the next item.
+			item_prev = item_curr; // Since the item just processed above isn't a dupe, save this item to compare against the next item.
 		}
 		else // This item is a duplicate of the previous item.
 		{
@@ -7544,7 +7736,6 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 				--dest; // Remove the previous item's trailing delimiter there's nothing for it to delimit due to omission of this duplicate.
 		}
 	} // for()
-	free(item); // Free the index/pointer list used for the sort.
 
 	// Terminate the variable's contents.
 	if (trailing_crlf_added_temporarily) // Remove the CRLF only after its presence was used above to simplify the code by reducing the number of types/cases.
@@ -7571,9 +7762,10 @@ ResultType Line::PerformSort(char *aContents, char *aOptions)
 end:
 	if (ErrorLevel != -1) // A change to ErrorLevel is desired.  Compare directly to -1 due to unsigned.
 		g_ErrorLevel->Assign(ErrorLevel); // ErrorLevel is set only when dupe-mode is in effect.
+	if (item)
+		free(item); // Free the index/pointer list used for the sort.
 	if (mem_to_free)
 		free(mem_to_free);
-	g_SortFunc = sort_func_orig;
 	return result_to_return;
 }
 
@@ -9010,7 +9202,12 @@ ResultType Line::FileAppend(char *aFilespec, char *aBuf, LoopReadFileStruct *aCu
 		if (   !(fp = fopen(aFilespec, open_as_binary ? "ab" : "a"))   )
 			return g_ErrorLevel->Assign(ERRORLEVEL_ERROR);
 		if (aCurrentReadFile)
+		{
+			// The file stays open for the whole loop, so give it a large buffer to batch the many
+			// small writes (typically one per line) into a few big ones:
+			setvbuf(fp, NULL, _IOFBF, LOOP_READ_WRITE_BUFFER_SIZE);
 			aCurrentReadFile->mWriteFile = fp;
+		}
 	}
 
 	// Write to the file:
@@ -11213,18 +11410,37 @@ VarSizeType BIV_LoopRegTimeModified(char *aBuf, char *aVarName)
 
 VarSizeType BIV_LoopReadLine(char *aBuf, char *aVarName)
 {
-	char *str = const_cast<char*>(g.mLoopReadFile ? g.mLoopReadFile->mCurrentLine : "");
+	if (!g.mLoopReadFile)
+	{
+		if (aBuf)
+			*aBuf = '\0';
+		return 0;
+	}
+	// The line isn't necessarily zero-terminated (see LoopReadFileStruct), so its length is used instead.
+	size_t length = g.mLoopReadFile->mCurrentLineLength;
 	if (aBuf)
-		strcpy(aBuf, str);
-	return (VarSizeType)strlen(str);
+	{
+		memcpy(aBuf, g.mLoopReadFile->mCurrentLine, length);
+		aBuf[length] = '\0';
+	}
+	return (VarSizeType)length;
 }
 
 VarSizeType BIV_LoopField(char *aBuf, char *aVarName)
 {
-	char *str = const_cast<char*>(g.mLoopField ? g.mLoopField : "");
+	// The field isn't terminated because it points directly into the text being parsed.
+	if (!g.mLoopField)
+	{
+		if (aBuf)
+			*aBuf = '\0';
+		return 0;
+	}
 	if (aBuf)
-		strcpy(aBuf, str);
-	return (VarSizeType)strlen(str);
+	{
+		memcpy(aBuf, g.mLoopField, g.mLoopFieldLength);
+		aBuf[g.mLoopFieldLength] = '\0';
+	}
+	return (VarSizeType)g.mLoopFieldLength;
 }
 
 VarSizeType BIV_LoopIndex(char *aBuf, char *aVarName)
@@ -11663,6 +11879,151 @@ typedef DYNARESULT (* DYNAFUNC)(int, void *, DYNAPARM [], int, DWORD &
 	, void *, int, char [32]);
 char errorlevel [32] = {0}; // Naveen dynacall
 
+
+
+// DllCall() keeps what it learns at each call site (the deref of a particular DllCall in a particular
+// expression) so that later calls from the same site can skip parsing the types and resolving the function.
+// Since the types can come from variables and the function name from an expression, each call compares the
+// current type strings and function name against the cached copies, and redoes the work only if they differ.
+struct DllCallSiteType
+{
+	char *text; // The type string from which "attrib" was determined.
+	Var *var;   // The variable that contained it (whose name is the fallback type), or NULL if none.
+	DYNAPARM attrib; // Only type, passed_by_address and is_unsigned are used.
+};
+
+struct DllCallSite
+{
+	DerefType *deref;          // The call site, or NULL if this item is unused.
+	int param_count;           // The number of parameters, including the return type (if any).
+	int dll_call_mode;
+	DllCallSiteType *type;     // One for each odd-numbered parameter: the arg types, then the return type (if any).
+	char *function_name;       // The first parameter, for which "function" was resolved.  NULL if none yet.
+	void *function;
+};
+
+#define DLLCALL_SITE_CACHE_SIZE 256 // Must be a power of 2.  Sites that collide simply replace each other.
+static DllCallSite sDllCallSite[DLLCALL_SITE_CACHE_SIZE];
+
+// The modules DllCall() has had to load or has cached the address of a function within.  Each has been given
+// a reference of DllCall()'s own that is never released, so that no cached address can become invalid by the
+// script (or another DllCall) unloading its module.  There are usually only a few.
+static HMODULE *sDllCallModule = NULL;
+static int sDllCallModuleCount = 0, sDllCallModuleSize = 0;
+
+
+
+bool DllCallSiteMatches(DllCallSite &aSite, ExprTokenType *aParam[], int aParamCount)
+// Returns true if aSite's types were determined from the same type strings as the ones in aParam.
+{
+	DllCallSiteType *type = aSite.type;
+	for (int i = 1; i < aParamCount; i += 2, ++type) // Each odd-numbered parameter is a type (see DllCallSite).
+	{
+		ExprTokenType &token = *aParam[i];
+		if (token.symbol == SYM_VAR)
+		{
+			if (token.var != type->var || strcmp(token.var->Contents(), type->text))
+				return false;
+		}
+		else if (IS_NUMERIC(token.symbol) || type->var || strcmp(token.marker, type->text))
+			return false;
+	}
+	return true;
+}
+
+
+
+void DllCallSiteStore(DllCallSite &aSite, DerefType *aDeref, ExprTokenType *aParam[], int aParamCount
+	, DYNAPARM aDynaParam[], DYNAPARM &aReturnAttrib, int aDllCallMode)
+// Caches the types that DllCall() has just determined from aParam, replacing whatever aSite held before.
+// Caller has ensured that all the types are valid.
+{
+	int i, type_count = aParamCount / 2; // The number of odd-numbered parameters.
+	size_t space_needed = type_count * sizeof(DllCallSiteType);
+	for (i = 1; i < aParamCount; i += 2)
+		space_needed += strlen(aParam[i]->symbol == SYM_VAR ? aParam[i]->var->Contents() : aParam[i]->marker) + 1;
+	if (aSite.deref != aDeref) // A different site is taking over this item, so its function is of no use.
+	{
+		free(aSite.function_name);
+		aSite.function_name = NULL;
+		aSite.function = NULL;
+	}
+	free(aSite.type);
+	if (   !(aSite.type = (DllCallSiteType *)malloc(space_needed))   )
+	{
+		aSite.deref = NULL; // Just don't cache this site.
+		return;
+	}
+	aSite.deref = aDeref;
+	aSite.param_count = aParamCount;
+	aSite.dll_call_mode = aDllCallMode;
+	char *text = (char *)(aSite.type + type_count);
+	for (i = 1; i < aParamCount; i += 2)
+	{
+		ExprTokenType &token = *aParam[i];
+		DllCallSiteType &type = aSite.type[i / 2];
+		type.var = (token.symbol == SYM_VAR) ? token.var : NULL;
+		type.text = text;
+		text += strlen(strcpy(text, type.var ? type.var->Contents() : token.marker)) + 1;
+		type.attrib = (i == aParamCount - 1 && !(aParamCount % 2)) ? aReturnAttrib : aDynaParam[i / 2];
+	}
+}
+
+
+
+void DllCallSiteReset()
+// Forgets every call site, for use when the lines they're in are about to be freed (see FreeFragments()).
+// The modules in sDllCallModule stay referenced since the script might still use them.
+{
+	for (int i = 0; i < DLLCALL_SITE_CACHE_SIZE; ++i)
+	{
+		DllCallSite &site = sDllCallSite[i];
+		free(site.type);
+		free(site.function_name);
+		site.type = NULL;
+		site.function_name = NULL;
+		site.function = NULL;
+		site.deref = NULL;
+	}
+}
+
+
+
+bool DllCallKeepModule(HMODULE aModule, char *aDllName, bool aAlreadyReferenced)
+// Ensures aModule stays loaded for the rest of the script's life (see sDllCallModule).  aAlreadyReferenced
+// should be true if the caller has just loaded aModule via LoadLibrary() and is handing that reference over.
+// Returns false if the module couldn't be kept, in which case the caller shouldn't cache anything from it.
+{
+	for (int i = 0; i < sDllCallModuleCount; ++i)
+		if (sDllCallModule[i] == aModule)
+		{
+			if (aAlreadyReferenced) // Another reference isn't needed.
+				FreeLibrary(aModule);
+			return true;
+		}
+	if (sDllCallModuleCount == sDllCallModuleSize)
+	{
+		int new_size = sDllCallModuleSize ? sDllCallModuleSize * 2 : 16;
+		HMODULE *new_module = (HMODULE *)realloc(sDllCallModule, new_size * sizeof(HMODULE));
+		if (!new_module)
+			return false;
+		sDllCallModule = new_module;
+		sDllCallModuleSize = new_size;
+	}
+	if (!aAlreadyReferenced) // Take a reference.  The module is already loaded, so this is quick.
+	{
+		HMODULE hmodule = LoadLibrary(aDllName);
+		if (hmodule != aModule) // Should be impossible, but if it happens, don't rely on the module staying loaded.
+		{
+			if (hmodule)
+				FreeLibrary(hmodule);
+			return false;
+		}
+	}
+	sDllCallModule[sDllCallModuleCount++] = aModule;
+	return true;
+}
+
 void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount)
 // Stores a number or a SYM_STRING result in aResultToken.
 // Sets ErrorLevel to the error code appropriate to any problem that occurred.
@@ -11675,6 +12036,14 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 	aResultToken.marker = "";
 	HMODULE hmodule_to_free = NULL; // Set default in case of early goto; mostly for maintainability.
 
+	// Find what's cached for this call site, if anything.  This must be done before anything below that
+	// might run script code (such as a callback), since that would change Line::sBIFCallSite.
+	DerefType *call_site = Line::sBIFCallSite; // NULL if DllCall() was called some other way than by an expression.
+	DllCallSite *site = call_site ? sDllCallSite + ((size_t)call_site / sizeof(DerefType) & (DLLCALL_SITE_CACHE_SIZE - 1)) : NULL;
+	bool site_types_match = site && site->deref == call_site && site->param_count == aParamCount
+		&& DllCallSiteMatches(*site, aParam, aParamCount);
+	int param_count_with_return_type = aParamCount; // Saved for DllCallSiteStore().
+
 	// Check that the mandatory first parameter (DLL+Function) is valid.
 	// (load-time validation has ensured at least one parameter is present).
 	void *function; // Will hold the address of the function to be called.
@@ -11728,6 +12097,12 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 	int dll_call_mode = DC_CALL_STD; // Set default.  Can be overridden to DC_CALL_CDECL and flags can be OR'd into it.
 	if (aParamCount % 2) // Odd number of parameters indicates the return type has been omitted, so assume BOOL/INT.
 		return_attrib.type = DLL_ARG_INT;
+	else if (site_types_match) // The return type was already determined by a previous call from this site.
+	{
+		return_attrib = site->type[aParamCount / 2 - 1].attrib;
+		dll_call_mode = site->dll_call_mode;
+		--aParamCount;  // Remove the last parameter from further consideration.
+	}
 	else
 	{
 		// Check validity of this arg's return type:
@@ -11803,7 +12178,9 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 			return;
 		}
 		// Otherwise, this arg's type is a string as it should be, so retrieve it:
-		if (aParam[i]->symbol == SYM_VAR) // SYM_VAR's Type() is always VAR_NORMAL.
+		if (site_types_match) // The type strings aren't needed because the site's cached types are used below.
+			arg_type_string[0] = arg_type_string[1] = NULL;
+		else if (aParam[i]->symbol == SYM_VAR) // SYM_VAR's Type() is always VAR_NORMAL.
 		{
 			arg_type_string[0] = aParam[i]->var->Contents();
 			arg_type_string[1] = aParam[i]->var->mName;
@@ -11831,6 +12208,7 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 		{
 			if (this_param.symbol == SYM_VAR) // SYM_VAR's Type() is always VAR_NORMAL.
 			{
+				this_param.var->DetachIfPinned(); // The function might write into it, so don't let it alter the text a parsing loop is reading.
 				arg_as_string = this_param.var->Contents(); // See below.
 				// UPDATE: The v1.0.44.14 item below doesn't work in release mode, only debug mode (turning off
 				// "string pooling" doesn't help either).  So it's commented out until a way is found
@@ -11862,7 +12240,15 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 		}
 
 		// Store the each arg into a dyna_param struct, using its arg type to determine how.
-		ConvertDllArgType(arg_type_string, this_dyna_param);
+		if (site_types_match)
+		{
+			DYNAPARM &cached_attrib = site->type[arg_count].attrib;
+			this_dyna_param.type = cached_attrib.type;
+			this_dyna_param.passed_by_address = cached_attrib.passed_by_address;
+			this_dyna_param.is_unsigned = cached_attrib.is_unsigned;
+		}
+		else
+			ConvertDllArgType(arg_type_string, this_dyna_param);
 		switch (this_dyna_param.type)
 		{
 		case DLL_ARG_STR:
@@ -11939,9 +12325,19 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 		} // switch (this_dyna_param.type)
 	} // for() each arg.
 
+	// Since all the types are valid (otherwise the above would have returned), remember them for next time:
+	if (site && !site_types_match)
+		DllCallSiteStore(*site, call_site, aParam, param_count_with_return_type, dyna_param, return_attrib, dll_call_mode);
+
+	char *param1; // The first parameter if it's a function name.
+	if (!function && site && site->deref == call_site && site->function // i.e. DllCallSiteStore() above didn't fail.
+		&& !strcmp(site->function_name, param1 = (aParam[0]->symbol == SYM_VAR ? aParam[0]->var->Contents() : aParam[0]->marker)))
+		function = site->function; // Same function as the last call from this site, which is still loaded (see sDllCallModule).
+
 	if (!function) // The function's address hasn't yet been determined.
 	{
 		char param1_buf[MAX_PATH*2], *function_name, *dll_name; // Must use MAX_PATH*2 because the function name is INSIDE the Dll file, and thus MAX_PATH can be exceeded.
+		HMODULE hmodule = NULL; // The module that contains the function, if a DLL name was specified.
 		// Define the standard libraries here. If they reside in %SYSTEMROOT%\system32 it is not
 		// necessary to specify the full path (it wouldn't make sense anyway).
 		static HMODULE sStdModule[] = {GetModuleHandle("user32"), GetModuleHandle("kernel32")
@@ -11980,7 +12376,6 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 			// Get module handle. This will work when DLL is already loaded and might improve performance if
 			// LoadLibrary is a high-overhead call even when the library already being loaded.  If
 			// GetModuleHandle() fails, fall back to LoadLibrary().
-			HMODULE hmodule;
 			if (   !(hmodule = GetModuleHandle(dll_name))    )
 				if (   !(hmodule = hmodule_to_free = LoadLibrary(dll_name))   )
 				{
@@ -12005,6 +12400,18 @@ void BIF_DllCall(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPara
 			g_ErrorLevel->Assign("-4"); // Stage 4 error: Function could not be found in the DLL(s).
 			goto end;
 		}
+
+		// Cache the function for the next call from this site.  Its module must stay loaded for that, so
+		// DllCall() keeps it loaded from now on rather than freeing it after the call.  Functions found in
+		// the standard modules need no such care since those modules are never unloaded.
+		if (site && site->deref == call_site
+			&& (!dll_name || DllCallKeepModule(hmodule, dll_name, hmodule_to_free != NULL)))
+		{
+			hmodule_to_free = NULL; // Either DllCallKeepModule() now owns that reference, or there wasn't one.
+			param1 = aParam[0]->symbol == SYM_VAR ? aParam[0]->var->Contents() : aParam[0]->marker;
+			free(site->function_name);
+			site->function = (site->function_name = _strdup(param1)) ? function : NULL;
+		}
 	}
 
 	////////////////////////
@@ -12342,8 +12749,370 @@ void BIF_InStr(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 }
 
 
-typedef  int pcre; // ahkgcc remove pcre
-typedef  int pcre_extra; // ahkgcc remove pcre
+// REGEX CACHE
+// Compiled RegEx's are cached in a fixed array of #RegExCacheSize entries, which is indexed by a chained hash
+// table whose key is the entire RegEx string including its options (see RegExCacheEntry::re_raw for why the
+// options are part of the key).  The array is allocated on first use, which is always after the directive
+// has been processed.
+// Hits don't take g_CriticalRegExCache: only inserts do (the hook thread can enter get_compiled_regex() via
+// #IfWin & SetTitleMatchMode RegEx, and so can other DLL threads).  To make that safe, each entry has a
+// sequence number which is odd while the entry is being rewritten; a reader that sees an odd or changed
+// number simply treats it as a miss and takes the locked path, which searches again before compiling.
+// Readers walking a chain that is being changed might also wander into another chain or miss an entry,
+// but the walk is bounded by the cache size and a false miss is always rechecked under the lock.
+// Eviction uses the "clock" approximation of LRU: each hit sets the entry's referenced flag (a plain store,
+// so hits don't have to write anything shared other than that) and the eviction hand skips and clears
+// referenced entries until it finds one that hasn't been used since the hand last passed it.
+struct RegExCacheEntry
+{
+	// For simplicity (and thus performance), the entire RegEx pattern including its options is cached
+	// is stored in re_raw and that entire string becomes the RegEx's unique identifier for the purpose
+	// of finding an entry in the cache.  Technically, this isn't optimal because some options like Study
+	// and aGetPositionsNotSubstrings don't alter the nature of the compiled RegEx.  However, the CPU time
+	// required to strip off some options prior to doing a cache search seems likely to offset much of the
+	// cache's benefit.  So for this reason, as well as rarity and code size issues, this policy seems best.
+	char * volatile re_raw;          // The RegEx's literal string pattern such as "abc.*123".
+	pcre * volatile re_compiled;     // The RegEx in compiled form.
+	pcre_extra * volatile extra;     // NULL unless a study() was done (and NULL even then if study() didn't find anything).
+	volatile UINT hash;              // Hash of re_raw, which rules out most non-matching entries without a strcmp().
+	volatile LONG next;              // Index of the next entry in the same bucket, or -1 if none.
+	volatile LONG sequence;          // Odd while the entry is being rewritten by RegExCacheInsert().
+	volatile bool referenced;        // Set by each hit and cleared by the eviction hand.
+	volatile bool get_positions_not_substrings;
+	// The previous occupant of this entry is kept until the entry is evicted again.  This ensures that a reader
+	// which was part way through comparing or returning the previous occupant never touches freed memory.
+	char *retired_raw;
+	pcre *retired_compiled;
+	pcre_extra *retired_extra;
+};
+
+static RegExCacheEntry *sRegExCache = NULL;
+static volatile LONG * volatile sRegExBucket = NULL; // NULL until RegExCacheInit() has been called.
+static int sRegExBucketMask, sRegExCacheSize, sRegExCacheCount, sRegExClockHand;
+static volatile LONG sRegExCacheHits = 0, sRegExCacheMisses = 0, sRegExCacheEvictions = 0; // Reported by EngineStats().
+
+
+
+static UINT RegExCacheHash(char *aRegEx)
+// Unlike NameHashTable's hash, this one is case sensitive because a RegEx's case always matters.
+{
+	UINT hash = 2166136261U; // FNV-1a.
+	for (UCHAR *cp = (UCHAR *)aRegEx; *cp; ++cp)
+		hash = (hash ^ *cp) * 16777619U;
+	return hash;
+}
+
+
+
+static bool RegExCacheInit()
+// Caller must own g_CriticalRegExCache.  Returns false if out of memory.
+{
+	if (sRegExBucket) // Already done.
+		return true;
+	int bucket_count;
+	for (bucket_count = 16; bucket_count < 2 * g_RegExCacheSize; bucket_count <<= 1); // Keep the chains short.
+	if (   !(sRegExCache = (RegExCacheEntry *)calloc(g_RegExCacheSize, sizeof(RegExCacheEntry)))   )
+		return false;
+	LONG *bucket;
+	if (   !(bucket = (LONG *)malloc(bucket_count * sizeof(LONG)))   )
+	{
+		free(sRegExCache);
+		sRegExCache = NULL;
+		return false;
+	}
+	memset(bucket, 0xFF, bucket_count * sizeof(LONG)); // Set every bucket to -1 (empty).
+	sRegExCacheSize = g_RegExCacheSize;
+	sRegExBucketMask = bucket_count - 1;
+	sRegExBucket = bucket; // Done last so that lock-free readers never see a half-initialized cache.
+	return true;
+}
+
+
+
+static pcre *RegExCacheFind(char *aRegEx, UINT aHash, bool &aGetPositionsNotSubstrings, pcre_extra *&aExtra)
+// Returns the cached, compiled form of aRegEx, or NULL if it isn't in the cache (or it couldn't be found
+// safely without the lock; see comments at RegExCacheEntry).  Caller need not own g_CriticalRegExCache.
+{
+	volatile LONG *bucket = sRegExBucket;
+	if (!bucket) // Cache hasn't been used yet.
+		return NULL;
+	LONG i, sequence;
+	int steps;
+	for (i = bucket[aHash & sRegExBucketMask], steps = 0; i != -1 && steps < sRegExCacheSize; i = sRegExCache[i].next, ++steps)
+	{
+		RegExCacheEntry &entry = sRegExCache[i];
+		sequence = entry.sequence;
+		if (sequence & 1) // A writer is changing this entry right now, so let the caller search under the lock.
+			return NULL;
+		if (entry.hash != aHash || strcmp(entry.re_raw, aRegEx)) // No match (case sensitive).
+			continue;
+		pcre *re_compiled = entry.re_compiled;
+		aExtra = entry.extra;
+		aGetPositionsNotSubstrings = entry.get_positions_not_substrings;
+		if (entry.sequence != sequence) // Entry was replaced while the above was being fetched.
+			return NULL;
+		entry.referenced = true;
+		InterlockedIncrement((LPLONG)&sRegExCacheHits);
+		return re_compiled;
+	}
+	return NULL;
+}
+
+
+
+static void RegExCacheFree(pcre *aCompiled, pcre_extra *aExtra)
+{
+	if (aExtra)
+		pcre_free(aExtra);
+	pcre_free(aCompiled);
+}
+
+
+
+static bool RegExCacheInsert(char *aRegEx, UINT aHash, pcre *aCompiled, pcre_extra *aExtra
+	, bool aGetPositionsNotSubstrings)
+// Caller must own g_CriticalRegExCache, must have called RegExCacheInit(), and must have verified
+// (while owning the lock) that aRegEx isn't already in the cache.  Returns false if out of memory.
+{
+	char *re_raw;
+	if (   !(re_raw = _strdup(aRegEx))   ) // _strdup() is very tiny and basically just calls strlen+malloc+strcpy.
+		return false;
+
+	LONG i;
+	if (sRegExCacheCount < sRegExCacheSize) // Most scripts never fill the cache.
+		i = sRegExCacheCount++;
+	else
+	{
+		// Advance the hand until it finds an entry that hasn't been hit since the hand last passed it.
+		// This finishes within two sweeps of the cache because each step clears the flag it skips.
+		for (;;)
+		{
+			i = sRegExClockHand;
+			if (++sRegExClockHand == sRegExCacheSize)
+				sRegExClockHand = 0;
+			if (!sRegExCache[i].referenced)
+				break;
+			sRegExCache[i].referenced = false;
+		}
+		// Unlink the victim from its chain.  Readers already on it will still find its old next-index.
+		volatile LONG *link;
+		for (link = &sRegExBucket[sRegExCache[i].hash & sRegExBucketMask]; *link != i; link = &sRegExCache[*link].next);
+		*link = sRegExCache[i].next;
+		++sRegExCacheEvictions;
+	}
+
+	RegExCacheEntry &entry = sRegExCache[i]; // For performance and convenience.
+	InterlockedIncrement((LPLONG)&entry.sequence); // Now odd: readers that look at this entry will search again under the lock.
+	if (entry.retired_raw) // Free the attributes of the occupant before last, which no reader can still be using.
+	{
+		free(entry.retired_raw);
+		RegExCacheFree(entry.retired_compiled, entry.retired_extra);
+	}
+	entry.retired_raw = entry.re_raw; // These are NULL if the entry was never used before.
+	entry.retired_compiled = entry.re_compiled;
+	entry.retired_extra = entry.extra;
+	entry.re_raw = re_raw;
+	entry.re_compiled = aCompiled;
+	entry.extra = aExtra;
+	entry.get_positions_not_substrings = aGetPositionsNotSubstrings;
+	entry.hash = aHash;
+	entry.referenced = true; // Give the new entry one full sweep of the hand before it can be evicted.
+	InterlockedIncrement((LPLONG)&entry.sequence); // Even again: the entry is consistent.
+	// Link it at the head of its chain only after it's complete, so that readers never find a half-built entry.
+	volatile LONG *bucket = &sRegExBucket[aHash & sRegExBucketMask];
+	entry.next = *bucket;
+	InterlockedExchange((LPLONG)bucket, i);
+	return true;
+}
+
+
+
+static __int64 RegExCacheStat(char *aItem, char *aWhich)
+// Shows whether #RegExCacheSize suits the script.
+{
+	if (!stricmp(aItem, "Hits")) return sRegExCacheHits;
+	if (!stricmp(aItem, "Misses")) return sRegExCacheMisses;
+	if (!stricmp(aItem, "Evictions")) return sRegExCacheEvictions;
+	if (!stricmp(aItem, "Count")) return sRegExCacheCount; // Number of RegEx's in the cache.
+	if (!stricmp(aItem, "Size")) return sRegExBucket ? sRegExCacheSize : g_RegExCacheSize;
+	return -1;
+}
+
+
+
+static __int64 TimerStat(char *aItem, char *aWhich)
+// Shows how punctually the timer whose label is aWhich is being run.  All times are in milliseconds.
+{
+	Label *label = g_script.FindLabel(aWhich);
+	ScriptTimer *timer = NULL;
+	if (label)
+		for (timer = g_script.mFirstTimer; timer; timer = timer->mNextTimer)
+			if (timer->mLabel == label)
+				break;
+	if (!timer)
+		return -1;
+	if (!stricmp(aItem, "Runs")) return timer->mRunCount;
+	if (!stricmp(aItem, "Lateness")) return timer->mLastLateness; // Of the most recent run.
+	if (!stricmp(aItem, "MaxLateness")) return timer->mMaxLateness;
+	if (!stricmp(aItem, "AverageLateness"))
+		return timer->mRunCount ? timer->mTotalLateness / timer->mRunCount : 0;
+	if (!stricmp(aItem, "AverageJitter")) // The average change in lateness from one run to the next.
+		return timer->mRunCount > 1 ? timer->mTotalJitter / (timer->mRunCount - 1) : 0;
+	return -1;
+}
+
+
+
+static __int64 MsgMonitorStat(char *aItem, char *aWhich)
+// Shows how much of the message traffic reaching the script is actually monitored by OnMessage (which helps
+// when diagnosing message-heavy GUIs).  Messages are counted only while at least one is being monitored.
+{
+	if (!stricmp(aItem, "Monitored")) return g_MsgMonitorHits;
+	if (!stricmp(aItem, "Unmonitored")) return g_MsgMonitorMisses;
+	if (!stricmp(aItem, "Count")) return g_MsgMonitorCount; // Number of message numbers being monitored.
+	if (!stricmp(aItem, "Reset")) // Resets the counters (e.g. before measuring a particular GUI operation).
+	{
+		__int64 total = g_MsgMonitorHits + g_MsgMonitorMisses; // Yield the total prior to the reset.
+		g_MsgMonitorHits = g_MsgMonitorMisses = 0;
+		return total;
+	}
+	return -1;
+}
+
+
+
+static __int64 HotCriterionStat(char *aItem, char *aWhich)
+// Shows how often hotkey and hotstring #IfWin criteria were checked and how many of those checks actually
+// had to search for a window rather than reuse an earlier result.
+{
+	if (!stricmp(aItem, "Calls")) return g_HotCriterionCalls;
+	if (!stricmp(aItem, "Evaluations")) return g_HotCriterionEvaluations;
+	if (!stricmp(aItem, "Time")) return g_HotCriterionTime; // Microseconds.
+	if (!stricmp(aItem, "Reset")) // Resets the counters (e.g. before measuring a particular set of keystrokes).
+	{
+		__int64 calls = g_HotCriterionCalls; // Yield the total prior to the reset.
+		g_HotCriterionCalls = g_HotCriterionEvaluations = g_HotCriterionTime = 0;
+		return calls;
+	}
+	return -1;
+}
+
+
+
+static __int64 HeapStat(char *aItem, char *aWhich)
+// Shows how much memory the script and each fragment loaded by addFile() occupy.  aWhich is the SimpleHeap
+// arena's zero-based index in order of creation, where 0 (the default) is the main arena.
+{
+	if (!stricmp(aItem, "Count")) // Number of arenas, which doesn't need aWhich.
+	{
+		int count;
+		for (count = 0; SimpleHeap::GetArena(count); ++count);
+		return count;
+	}
+	SimpleHeap *heap;
+	if (   !(heap = SimpleHeap::GetArena(ATOI(aWhich)))   )
+		return -1;
+	if (!stricmp(aItem, "Used")) return heap->GetBytesUsed();
+	if (!stricmp(aItem, "Wasted")) return heap->GetBytesWasted();
+	if (!stricmp(aItem, "Blocks")) return heap->GetBlockCount();
+	return -1;
+}
+
+
+
+void BIF_EngineStats(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount)
+// EngineStats(Subsystem, Item [, Which]): Returns one of the counters kept by the program's caches and
+// schedulers, so that a script can tell how well they suit it.  Each subsystem's items are listed by its
+// function in sEngineStats.  Which selects among several instances of a subsystem, for those that have them.
+// A single function is used for all of them to keep their names from colliding with those of
+// script functions.  Returns "" if the subsystem or item is unknown.
+// Caller has set aResultToken.symbol to a default of SYM_INTEGER.
+{
+	static struct
+	{
+		char *subsystem;
+		__int64 (*stat)(char *aItem, char *aWhich); // Returns -1 if aItem or aWhich is unknown.
+	} sEngineStats[] =
+	{
+		{"RegExCache", RegExCacheStat}
+		, {"DerefBuf", Line::GetDerefBufStat}
+		, {"Timer", TimerStat}
+		, {"MsgMonitor", MsgMonitorStat}
+		, {"Heap", HeapStat}
+		, {"HotCriterion", HotCriterionStat}
+	};
+	// Separate buffers since all the params might need one:
+	char subsystem_buf[MAX_NUMBER_SIZE], which_buf[MAX_NUMBER_SIZE];
+	char *subsystem = ExprTokenToString(*aParam[0], subsystem_buf);
+	char *item = ExprTokenToString(*aParam[1], aResultToken.buf);
+	char *which = aParamCount > 2 ? ExprTokenToString(*aParam[2], which_buf) : "";
+	for (int i = 0; i < sizeof(sEngineStats) / sizeof(sEngineStats[0]); ++i)
+		if (!stricmp(subsystem, sEngineStats[i].subsystem))
+		{
+			if ((aResultToken.value_int64 = sEngineStats[i].stat(item, which)) != -1)
+				return;
+			break;
+		}
+	aResultToken.symbol = SYM_STRING;
+	aResultToken.marker = "";
+}
+
+
+
+void BIF_Profile(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount)
+// Profile(Command [, SortBy]) controls the profiler, which measures how often each line and function
+// is executed and how long it takes:
+// "On" or "Off": Turns the profiler on or off.  Yields 1 if it was on beforehand, otherwise 0.
+// "Reset": Discards the statistics gathered so far.  Yields the same as the above.
+// "Report": Yields the statistics in the style of ListLines, sorted by SortBy: "Self" (the default),
+//    "Total" or "Count".
+// "Collapsed": Yields the call stacks in the format used by flame graph tools.
+// Caller has set aResultToken.symbol to a default of SYM_INTEGER.
+{
+	char *command = ExprTokenToString(*aParam[0], aResultToken.buf);
+	char *result = NULL;
+	size_t length;
+	switch (toupper(*command))
+	{
+	case 'O': // On or Off.
+		aResultToken.value_int64 = Line::sProfiling;
+		if (toupper(command[1]) == 'N')
+			Line::ProfileStart();
+		else
+			Line::ProfileStop();
+		return;
+	case 'R':
+		if (toupper(command[2]) == 'S') // Reset.
+		{
+			aResultToken.value_int64 = Line::sProfiling;
+			Line::ProfileReset();
+			return;
+		}
+		else // Report.
+		{
+			char sort_by_buf[MAX_NUMBER_SIZE]; // Separate from aResultToken.buf since both params might need a buffer.
+			result = Line::ProfileReport(aParamCount > 1 ? toupper(*ExprTokenToString(*aParam[1], sort_by_buf)) : 'S', length);
+		}
+		break;
+	case 'C': // Collapsed.
+		result = Line::ProfileCollapsed(length);
+		break;
+	}
+	aResultToken.symbol = SYM_STRING;
+	if (!result) // Unknown command or out of memory.
+	{
+		aResultToken.marker = "";
+		return;
+	}
+	// Caller has provided a NULL circuit_token as a means of passing back memory we allocate here.
+	// So by changing it to be non-NULL, the caller will take over responsibility for freeing that memory.
+	aResultToken.circuit_token = (ExprTokenType *)result;
+	aResultToken.marker = result;
+	aResultToken.buf = (char *)length; // MANDATORY FOR USERS OF CIRCUIT_TOKEN: "buf" is being overloaded to store the length for our caller.
+}
+
+
+
 pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_extra *&aExtra
 	, ExprTokenType *aResultToken)
 // Returns the compiled RegEx, or NULL on failure.
@@ -12355,101 +13124,34 @@ pcre *get_compiled_regex(char *aRegEx, bool &aGetPositionsNotSubstrings, pcre_ex
 //    aGetPositionsNotSubstrings
 //    aExtra
 //    (but it doesn't change ErrorLevel on success, not even if aResultToken!=NULL)
-{
-/*
-	// While reading from or writing to the cache, don't allow another thread entry.  This is because
-	// that thread (or this one) might write to the cache while the other one is reading/writing, which
-	// could cause loss of data integrity (the hook thread can enter here via #IfWin & SetTitleMatchMode RegEx).
-	// Together, Enter/LeaveCriticalSection reduce performance by only 1.4% in the tightest possible script
-	// loop that hits the first cache entry every time.  So that's the worst case except when there's an actual
-	// collision, in which case performance suffers more because internally, EnterCriticalSection() does a
-	// wait/semaphore operation, which is more costly.
-	// Finally, the code size of all critical-section features together is less than 512 bytes (uncompressed),
-	// so like performance, that's not a concern either.
-	EnterCriticalSection(&g_CriticalRegExCache); // Request ownership of the critical section. If another thread already owns it, this thread will block until the other thread finishes.
-
-	// SET UP THE CACHE.
-	// This is a very crude cache for linear search. Of course, hashing would be better in the sense that it
-	// would allow the cache to get much larger while still being fast (I believe PHP caches up to 4096 items).
-	// Binary search might not be such a good idea in this case due to the time required to find the right spot
-	// to insert a new cache item (however, items aren't inserted often, so it might perform quite well until
-	// the cache contained thousands of RegEx's, which is unlikely to ever happen in most scripts).
-	struct pcre_cache_entry
-	{
-		// For simplicity (and thus performance), the entire RegEx pattern including its options is cached
-		// is stored in re_raw and that entire string becomes the RegEx's unique identifier for the purpose
-		// of finding an entry in the cache.  Technically, this isn't optimal because some options like Study
-		// and aGetPositionsNotSubstrings don't alter the nature of the compiled RegEx.  However, the CPU time
-		// required to strip off some options prior to doing a cache search seems likely to offset much of the
-		// cache's benefit.  So for this reason, as well as rarity and code size issues, this policy seems best.
-		char *re_raw;      // The RegEx's literal string pattern such as "abc.*123".
-		pcre *re_compiled; // The RegEx in compiled form.
-		pcre_extra *extra; // NULL unless a study() was done (and NULL even then if study() didn't find anything).
-		// int pcre_options; // Not currently needed in the cache since options are implicitly inside re_compiled.
-		bool get_positions_not_substrings;
-	};
-
-	#define PCRE_CACHE_SIZE 100 // Going too high would be counterproductive due to the slowness of linear search (and also the memory utilization of so many compiled RegEx's).
-	static pcre_cache_entry sCache[PCRE_CACHE_SIZE] = {{0}};
-	static int sLastInsert, sLastFound = -1; // -1 indicates "cache empty".
-	int insert_pos; // v1.0.45.03: This is used to avoid updating sLastInsert until an insert actually occurs (it might not occur if a compile error occurs in the regex, or something else stops it early).
 {
 	// CHECK IF THIS REGEX IS ALREADY IN THE CACHE.
-	if (sLastFound == -1) // Cache is empty, so insert this RegEx at the first position.
-		insert_pos = 0;  // A section further below will change sLastFound to be 0.
-	else
-	{
-		// Search the cache to see if it contains the caller-specified RegEx in compiled form.
-		// First check if the last-found item is a match, since often it will be (such as cases
-		// where a script-loop executes only one RegEx, and also for SetTitleMatchMode RegEx).
-		if (!strcmp(aRegEx, sCache[sLastFound].re_raw)) // Match found (case sensitive).
-			goto match_found; // And no need to update sLastFound because it's already set right.
-
-		// Since above didn't find a match, search outward in both directions from the last-found match.
-		// A bidirectional search is done because consecutively-called regex's tend to be adjacent to each other
-		// in the array, so performance is improved on average (since most of the time when repeating a previously
-		// executed regex, that regex will already be in the cache -- so optimizing the finding behavior is
-		// more important than optimizing the never-found-because-not-cached behavior).
-		bool go_right;
-		int i, item_to_check, left, right;
-		int last_populated_item = (sCache[PCRE_CACHE_SIZE-1].re_compiled) // When the array is full...
-			? PCRE_CACHE_SIZE - 1  // ...all items must be checked except the one already done earlier.
-			: sLastInsert;         // ...else only the items actually populated need to be checked.
-
-		for (go_right = true, left = sLastFound, right = sLastFound, i = 0
-			; i < last_populated_item  // This limits it to exactly the number of items remaining to be checked.
-			; ++i, go_right = !go_right)
-		{
-			if (go_right) // Proceed rightward in the array.
-			{
-				right = (right == last_populated_item) ? 0 : right + 1; // Increment or wrap around back to the left side.
-				item_to_check = right;
-			}
-			else // Proceed leftward.
-			{
-				left = (left == 0) ? last_populated_item : left - 1; // Decrement or wrap around back to the right side.
-				item_to_check = left;
-			}
-			if (!strcmp(aRegEx, sCache[item_to_check].re_raw)) // Match found (case sensitive).
-			{
-				sLastFound = item_to_check;
-				goto match_found;
-			}
-		}
+	// This is done without the lock because hits are by far the most common case (such as a script-loop
+	// that executes the same few RegEx's, and also SetTitleMatchMode RegEx).
+	UINT hash = RegExCacheHash(aRegEx);
+	pcre *re_compiled;
+	if (re_compiled = RegExCacheFind(aRegEx, hash, aGetPositionsNotSubstrings, aExtra))
+		return re_compiled;
 
-		// Since above didn't goto, no match was found nor is one possible.  So just indicate the insert position
-		// for where this RegEx will be put into the cache.
-		// The following formula is for both cache-full and cache-partially-full.  When the cache is full,
-		// it might not be the best possible formula; but it seems pretty good because it takes a round-robin
-		// approach to overwriting/discarding old cache entries.  A discarded entry might have just been
-		// used -- or even be sLastFound itself -- but on average, this approach seems pretty good because a
-		// script loop that uses 50 unique RegEx's will quickly stabilize in the cache so that all 50 of them
-		// stay compiled/cached until the loop ends.
-		insert_pos = (sLastInsert == PCRE_CACHE_SIZE-1) ? 0 : sLastInsert + 1; // Formula works for both full and partially-full array.
+	// While compiling and inserting, don't allow another thread entry.  This is because that thread (or this one)
+	// might write to the cache at the same time as the other one (the hook thread can enter here via #IfWin &
+	// SetTitleMatchMode RegEx).  Compiling while owning the lock also ensures that two threads never compile and
+	// insert the same RegEx.
+	EnterCriticalSection(&g_CriticalRegExCache); // Request ownership of the critical section. If another thread already owns it, this thread will block until the other thread finishes.
+	if (!RegExCacheInit())
+	{
+		if (aResultToken) // Only when this is non-NULL does caller want ErrorLevel changed.
+			g_ErrorLevel->Assign(ERR_OUTOFMEM);
+		goto error;
 	}
-	// Since the above didn't goto:
-	// - This RegEx isn't yet in the cache.  So compile it and put it in the cache, then return it to caller.
-	// - Above is responsible for having set insert_pos to the cache position where the new RegEx will be stored.
+	// Search again now that no writer can be active, since the lock-free search above can miss an entry that
+	// was being rewritten, or one that another thread added while this one was waiting for the lock.
+	if (re_compiled = RegExCacheFind(aRegEx, hash, aGetPositionsNotSubstrings, aExtra))
+	{
+		LeaveCriticalSection(&g_CriticalRegExCache);
+		return re_compiled;
+	}
+	++sRegExCacheMisses;
 
 	// The following macro is for maintainability, to enforce the definition of "default" in multiple places.
 	// PCRE_NEWLINE_CRLF is the default in AutoHotkey rather than PCRE_NEWLINE_LF because *multiline* haystacks
@@ -12546,7 +13248,6 @@ break_both:
 	const char *error_msg;
 	char error_buf[ERRORLEVEL_SAVED_SIZE];
 	int error_code, error_offset;
-	pcre *re_compiled;
 
 	// COMPILE THE REGEX.
 	if (   !(re_compiled = pcre_compile2(pat, pcre_options, &error_code, &error_msg, &error_offset, NULL))   )
@@ -12591,37 +13292,17 @@ break_both:
 		aExtra = NULL; // aExtra is an output parameter for caller.
 
 	// ADD THE NEWLY-COMPILED REGEX TO THE CACHE.
-	// An earlier stage has set insert_pos to be the desired insert-position in the cache.
-	pcre_cache_entry &this_entry = sCache[insert_pos]; // For performance and convenience.
-	if (this_entry.re_compiled) // An existing cache item is being overwritten, so free it's attributes.
-	{
-		// Free the old cache entry's attributes in preparation for overwriting them with the new one's.
-		free(this_entry.re_raw);           // Free the uncompiled pattern.
-		pcre_free(this_entry.re_compiled); // Free the compiled pattern.
-	}
-	//else the insert-position is an empty slot, which is usually the case because most scripts contain fewer than
-	// PCRE_CACHE_SIZE unique regex's.  Nothing extra needs to be done.
-	this_entry.re_raw = _strdup(aRegEx); // _strdup() is very tiny and basically just calls strlen+malloc+strcpy.
-	this_entry.re_compiled = re_compiled;
-	this_entry.extra = aExtra;
-	this_entry.get_positions_not_substrings = aGetPositionsNotSubstrings;
-	// "this_entry.pcre_options" doesn't exist because it isn't currently needed in the cache.  This is
-	// because the RE's options are implicitly stored inside re_compiled.
-
-	sLastInsert = insert_pos; // v1.0.45.03: Must be done only *after* the insert succeeded because some things rely on sLastInsert being synonymous with the last populated item in the cache (when the cache isn't yet full).
-	sLastFound = sLastInsert; // Relied upon in the case where sLastFound==-1. But it also sets things up to start the search at this item next time, because it's a bit more likely to be found here such as tight loops containing only one RegEx.
-	// Remember that although sLastFound==sLastInsert in this case, it isn't always so -- namely when a previous
-	// call found an existing match in the cache without having to compile and insert the item.
+	if (!RegExCacheInsert(aRegEx, hash, re_compiled, aExtra, aGetPositionsNotSubstrings))
+	{
+		RegExCacheFree(re_compiled, aExtra);
+		if (aResultToken)
+			g_ErrorLevel->Assign(ERR_OUTOFMEM);
+		goto error;
+	}
+	// The RE's options needn't be cached because they're implicitly stored inside re_compiled.
 
 	LeaveCriticalSection(&g_CriticalRegExCache);
 	return re_compiled; // Indicate success.
-}
-match_found: // RegEx was found in the cache at position sLastFound, so return the cached info back to the caller.
-	aGetPositionsNotSubstrings = sCache[sLastFound].get_positions_not_substrings;
-	aExtra = sCache[sLastFound].extra;
-
-	LeaveCriticalSection(&g_CriticalRegExCache);
-	return sCache[sLastFound].re_compiled; // Indicate success.
 
 error: // Since NULL is returned here, caller should ignore the contents of the output parameters.
 	if (aResultToken)
@@ -12632,7 +13313,6 @@ error: // Since NULL is returned here, caller should ignore the contents of the
 
 	LeaveCriticalSection(&g_CriticalRegExCache);
 	return NULL; // Indicate failure.
-*/
 }
 
 
@@ -12640,7 +13320,6 @@ error: // Since NULL is returned here, caller should ignore the contents of the
 char *RegExMatch(char *aHaystack, char *aNeedleRegEx)
 // Returns NULL if no match.  Otherwise, returns the address where the pattern was found in aHaystack.
 {
-    /*
 	bool get_positions_not_substrings; // Currently ignored.
 	pcre_extra *extra;
 	pcre *re;
@@ -12662,7 +13341,6 @@ char *RegExMatch(char *aHaystack, char *aNeedleRegEx)
 
 	// Otherwise, captured_pattern_count>=0 (it's 0 when offset[] was too small; but that's harmless in this case).
 	return aHaystack + offset[0]; // Return the position of the entire-pattern match.
-*/
 }
 
 
@@ -12671,7 +13349,6 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 	, pcre *aRE, pcre_extra *aExtra, char *aHaystack, int aHaystackLength, int aStartingOffset
 	, int aOffset[], int aNumberOfIntsInOffset)
 {
-    /*
 	// Set default return value in case of early return.
 	aResultToken.symbol = SYM_STRING;
 	aResultToken.marker = aHaystack; // v1.0.46.06: aHaystack vs. "" is the new default because it seems a much safer and more convenient to return aHaystack when an unexpected PCRE-exec error occurs (such an error might otherwise cause loss of data in scripts that don't meticulously check ErrorLevel after each RegExReplace()).
@@ -12690,7 +13367,7 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 
 	// In PCRE, lengths and such are confined to ints, so there's little reason for using unsigned for anything.
 	int captured_pattern_count, empty_string_is_not_a_match, match_length, ref_num
-		, result_size, new_result_length, haystack_portion_length, second_iteration, substring_name_length
+		, result_size, new_result_size, new_result_length, haystack_portion_length, second_iteration, substring_name_length
 		, extra_offset, pcre_options;
 	char *haystack_pos, *match_pos, *src, *src_orig, *dest, *closing_brace, char_after_dollar
 		, *substring_name_pos, substring_name[33] // In PCRE, "Names consist of up to 32 alphanumeric characters and underscores."
@@ -12836,9 +13513,14 @@ void RegExReplace(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPar
 					//    new_result_length - haystack_portion_length - (aOffset[1] - aOffset[0])
 					// Above is the length difference between the current replacement text and what it's
 					// replacing (it's negative when replacement is smaller than what it replaces).
-					REGEX_REALLOC(PredictReplacementSize((new_result_length - aOffset[1]) / replacement_count // See above.
-						, replacement_count, limit, aHaystackLength, new_result_length+2, aOffset[1])); // +2 in case of empty_string_is_not_a_match (which needs room for up to two extra characters).  The function will also do another +1 to convert length to size (for terminator).
-					// The above will return if an alloc error occurs.
+					new_result_size = PredictReplacementSize((new_result_length - aOffset[1]) / replacement_count // See above.
+						, replacement_count, limit, aHaystackLength, new_result_length+2, aOffset[1]); // +2 in case of empty_string_is_not_a_match (which needs room for up to two extra characters).  The function will also do another +1 to convert length to size (for terminator).
+					// Grow by at least half each time so that a series of low predictions (e.g. when most of the
+					// matches are near the end of haystack, or the replacements vary in length) can't make the
+					// number of reallocs proportional to the number of matches.  See StrReplace() for the same.
+					if (new_result_size < result_size + result_size / 2)
+						new_result_size = result_size + result_size / 2;
+					REGEX_REALLOC(new_result_size); // This will return if an alloc error occurs.
 				}
 				//else result_size is not only large enough, but also non-zero.  Other sections rely on it always
 				// being non-zero when replacement_count>0.
@@ -13038,17 +13720,110 @@ out_of_mem:
 set_count_and_return:
 	if (output_var_count)
 		output_var_count->Assign(replacement_count); // v1.0.47.05: Must be done last in case output_var_count shares the same memory with haystack, needle, or replacement.
-*/
+}
+
+
+
+// RegExMatch() and RegExMatchNext() keep what they learn at each call site (the deref of a particular call in
+// a particular expression; see Line::sBIFCallSite) so that a loop which matches the same RegEx many times
+// needn't do everything from scratch each time: the variables of the output pseudo-array, so that they
+// needn't be looked up (or created) by name for every match.  Since variables are never deleted and a call
+// site belongs to only one function, the same output var and RegEx always resolve to the same array variables.
+struct RegExSite
+{
+	DerefType *deref;     // The call site, or NULL if this item is unused.
+	char *needle;         // The RegEx (including its options) for which the members below were determined.
+	Var *output_var;      // The output var whose array is in "item", or NULL if none yet.
+	Var **item;           // For each subpattern: its var; or in position mode, its Pos var followed by its Len var.
+};
+
+// For RegExMatchNext(), where in the haystack the previous match from a call site ended, so that each call
+// resumes there without the script having to pass (and the function having to re-validate) a StartingPos.
+// Unlike a RegExSite, this belongs to the function call or thread that is doing the scan (g.RegExScans)
+// rather than to the call site alone, since a recursive call or an interrupting thread can scan another
+// haystack from the same site in the meantime.  Func::Call() and ResumeUnderlyingThread() free any scans
+// left over when the call or thread ends.  The haystack is recognized as the one being scanned by being the
+// same variable, with the same contents address and length, and not having been written to since the previous
+// match (since new contents of the same length might have been written over the old in place).
+struct RegExScan
+{
+	DerefType *deref;     // The call site.
+	Var *haystack_var;
+	char *haystack;
+	int haystack_length;
+	UINT haystack_write_count; // The target variable's mWriteCount as of the previous match.
+	int next_offset;      // Where the next search begins (the end of the previous match).
+	int exec_options;     // Non-zero if the previous match was the empty string (see RegExReplace()).
+	RegExScan *next;      // The next scan in progress in the same function call or thread.
+	char needle[1];       // The RegEx (including its options) being used for the scan.  Allocated to fit.
+};
+
+#define REGEX_SITE_CACHE_SIZE 64 // Must be a power of 2.  Sites that collide simply replace each other.
+static RegExSite sRegExSite[REGEX_SITE_CACHE_SIZE];
+
+
+
+RegExSite *RegExSiteFind(DerefType *aDeref, char *aNeedle)
+// Returns the item for aDeref, after making it forget anything it knew about other call sites or RegEx's.
+// Returns NULL if aDeref is NULL (i.e. called some other way than by an expression) or out of memory.
+{
+	if (!aDeref)
+		return NULL;
+	RegExSite &site = sRegExSite[(size_t)aDeref / sizeof(DerefType) & (REGEX_SITE_CACHE_SIZE - 1)];
+	if (site.deref == aDeref && !strcmp(site.needle, aNeedle)) // Relies on short-circuit boolean order.
+		return &site;
+	// Otherwise, this site or RegEx is taking over the item, so nothing in it is of any use.
+	free(site.needle);
+	free(site.item);
+	site.item = NULL;
+	site.output_var = NULL;
+	if (   !(site.needle = _strdup(aNeedle))   )
+	{
+		site.deref = NULL; // Just don't cache this site.
+		return NULL;
+	}
+	site.deref = aDeref;
+	return &site;
+}
+
+
+
+void RegExSiteReset()
+// Forgets every call site, for use when the lines they're in are about to be freed (see FreeFragments()).
+{
+	for (int i = 0; i < REGEX_SITE_CACHE_SIZE; ++i)
+	{
+		RegExSite &site = sRegExSite[i];
+		free(site.needle);
+		free(site.item);
+		site.needle = NULL;
+		site.item = NULL;
+		site.output_var = NULL;
+		site.deref = NULL;
+	}
+}
+
+
+
+void RegExScanFree(RegExScan *aScan)
+// Frees aScan and every scan after it in its list.
+{
+	for (RegExScan *next; aScan; aScan = next)
+	{
+		next = aScan->next;
+		free(aScan);
+	}
 }
 
 
 
 void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamCount)
-// This function is the initial entry point for both RegExMatch() and RegExReplace().
+// This function is the initial entry point for RegExMatch(), RegExMatchNext() and RegExReplace().
 // Caller has set aResultToken.symbol to a default of SYM_INTEGER.
 {
-    /*
 	bool mode_is_replace = toupper(aResultToken.marker[5]) == 'R'; // Union's marker initially contains the function name; e.g. RegEx[R]eplace.
+	bool mode_is_iterator = !mode_is_replace && aResultToken.marker[10]; // i.e. RegExMatch[N]ext().
+	DerefType *call_site = Line::sBIFCallSite; // Fetched early for maintainability, in case anything below ever runs script code.
 	char *needle = ExprTokenToString(*aParam[1], aResultToken.buf); // Load-time validation has already ensured that at least two actual parameters are present.
 
 	bool get_positions_not_substrings;
@@ -13100,9 +13875,85 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 		return;
 	}
 
-	// OTHERWISE, THIS IS RegExMatch() not RegExReplace().
+	// OTHERWISE, THIS IS RegExMatch() or RegExMatchNext(), not RegExReplace().
+	RegExSite *site = RegExSiteFind(call_site, needle); // NULL if this call can't be cached.
+	RegExScan *scan = NULL, **scan_link = NULL; // The current function call's or thread's scan from this site (if any), and what points to it.
+	int exec_options = 0;
+	if (mode_is_iterator && call_site)
+	{
+		for (scan_link = &g.RegExScans; *scan_link && (*scan_link)->deref != call_site; scan_link = &(*scan_link)->next);
+		if (   (scan = *scan_link) && aParam[0]->symbol == SYM_VAR // Relies on short-circuit boolean order.
+			&& scan->haystack_var == aParam[0]->var && scan->haystack == haystack && scan->haystack_length == haystack_length
+			&& scan->haystack_write_count == aParam[0]->var->ResolveAlias()->mWriteCount
+			&& !strcmp(scan->needle, needle)   )
+		{
+			// A scan of this haystack is in progress, so resume it where the previous match ended.  The haystack is
+			// searched in place, so nothing about it needs to be copied or re-validated.  StartingPos is ignored in
+			// this case because it applies only to where a new scan begins.
+			starting_offset = scan->next_offset;
+			exec_options = scan->exec_options;
+		}
+		else if (scan) // A different haystack or RegEx, so the scan this site had in progress is being abandoned.
+		{
+			*scan_link = scan->next;
+			free(scan);
+			scan = NULL;
+		}
+	}
+
 	// EXECUTE THE REGEX.
-	int captured_pattern_count = pcre_exec(re, extra, haystack, haystack_length, starting_offset, 0, offset, number_of_ints_in_offset);
+	int captured_pattern_count, pcre_options;
+	for (;;)
+	{
+		captured_pattern_count = pcre_exec(re, extra, haystack, haystack_length, starting_offset, exec_options, offset, number_of_ints_in_offset);
+		if (captured_pattern_count != PCRE_ERROR_NOMATCH || !exec_options || starting_offset >= haystack_length)
+			break;
+		// Otherwise, the previous match was the empty string and there's no non-empty match at the same position,
+		// so resume normal searching at the next character.  See the similar section in RegExReplace() for
+		// comments, including why the LF of a CRLF is skipped along with its CR in `a mode.
+		exec_options = 0;
+		if (haystack[starting_offset++] == '\r' && haystack[starting_offset] == '\n'
+			&& !pcre_fullinfo(re, extra, PCRE_INFO_OPTIONS, &pcre_options) && (pcre_options & PCRE_NEWLINE_ANY))
+			++starting_offset;
+	}
+
+	if (scan_link) // i.e. mode_is_iterator && call_site.
+	{
+		if (captured_pattern_count < 0 || aParam[0]->symbol != SYM_VAR)
+		{
+			// There are no more matches (or an error), so the next call will begin a new scan.  The same is true
+			// when the haystack isn't a variable, since anything else (such as the result of a sub-expression)
+			// resides in temporary memory and thus can't be recognized as the same haystack next time.
+			if (scan)
+			{
+				*scan_link = scan->next;
+				free(scan);
+			}
+		}
+		else
+		{
+			if (!scan) // Begin a new scan.
+			{
+				if (scan = (RegExScan *)malloc(sizeof(RegExScan) + strlen(needle)))
+				{
+					scan->deref = call_site;
+					scan->haystack_var = aParam[0]->var;
+					scan->haystack = haystack;
+					scan->haystack_length = haystack_length;
+					strcpy(scan->needle, needle);
+					scan->next = g.RegExScans;
+					g.RegExScans = scan;
+				}
+				// Otherwise, out of memory: just let the next call begin a new scan.
+			}
+			if (scan)
+			{
+				scan->haystack_write_count = aParam[0]->var->ResolveAlias()->mWriteCount; // Updated each time in case the haystack was converted to text by this call.
+				scan->next_offset = offset[1];
+				scan->exec_options = (offset[0] == offset[1]) ? PCRE_NOTEMPTY | PCRE_ANCHORED : 0; // For an empty match, the next call must look for a non-empty one at the same position first.
+			}
+		}
+	}
 
 	// SET THE RETURN VALUE AND ERRORLEVEL BASED ON THE RESULTS OF EXECUTING THE EXPRESSION.
 	if (captured_pattern_count == PCRE_ERROR_NOMATCH)
@@ -13130,6 +13981,7 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 	// OTHERWISE, THE CALLER PROVIDED AN OUTPUT VAR/ARRAY: Store the substrings that matched the patterns.
 	Var &output_var = *aParam[2]->var; // SYM_VAR's Type() is always VAR_NORMAL.
 	char *mem_to_free = NULL; // Set default.
+	Var **site_item = NULL; // The array's variables, if they're being recorded for the next call from this site.
 
 	if (get_positions_not_substrings) // In this mode, it's done this way to avoid creating an array if there are no subpatterns; i.e. the return value is the starting position and the array name will contain the length of what was found.
 		output_var.Assign(captured_pattern_count < 0 ? 0 : offset[1] - offset[0]); // Seems better to store length of zero rather than something non-length like -1 (after all, the return value is blank in this case, which should be used as the error indicator).
@@ -13158,6 +14010,38 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 	if (pattern_count < 2) // There are no subpatterns (only the main pattern), so nothing more to do.
 		goto free_and_return;
 
+	if (site && site->output_var == &output_var) // This call site has already resolved the array's variables.
+	{
+		// This does the same as the loops further below (see them for comments), except that it needn't build
+		// the name of each variable or look it up.
+		Var **item = site->item, *array_item;
+		int *this_offset = offset + 2;
+		for (int p = 1; p < pattern_count; ++p, this_offset += 2)
+		{
+			bool subpat_not_matched = (p >= captured_pattern_count || this_offset[0] < 0);
+			if (get_positions_not_substrings)
+			{
+				if (array_item = *item++)
+					array_item->Assign(subpat_not_matched ? 0 : this_offset[0] + 1);
+				if (array_item = *item++)
+					array_item->Assign(subpat_not_matched ? 0 : this_offset[1] - this_offset[0]);
+			}
+			else if (array_item = *item++)
+			{
+				if (subpat_not_matched)
+					array_item->Assign();
+				else
+				{
+					if (p < pattern_count-1 && haystack == array_item->Contents())
+						if (mem_to_free = _strdup(haystack))
+							haystack = mem_to_free;
+					array_item->Assign(haystack + this_offset[0], this_offset[1] - this_offset[0]);
+				}
+			}
+		}
+		goto free_and_return;
+	}
+
 	// OTHERWISE, CONTINUE ON TO STORE THE SUBSTRINGS THAT MATCHED THE SUBPATTERNS (EVEN IF PCRE_ERROR_NOMATCH).
 	// For lookup performance, create a table of subpattern names indexed by subpattern number.
 	char **subpat_name = NULL; // Set default as "no subpattern names present or available".
@@ -13191,6 +14075,12 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 	//else one of the pcre_fullinfo() calls may have failed.  The PCRE docs indicate that this realistically never
 	// happens unless bad inputs were given.  So due to rarity, just leave subpat_name==NULL; i.e. "no named subpatterns".
 
+	// Record each of the array's variables as it's found below, for use by the next call from this site.  This
+	// isn't done when duplicate names are allowed because which subpatterns are skipped then depends on the match.
+	if (site && !allow_dupe_subpat_names)
+		site_item = (Var **)malloc((pattern_count - 1) * (get_positions_not_substrings ? 2 : 1) * sizeof(Var *)); // NULL if out of memory, in which case nothing is recorded.
+	Var **record = site_item;
+
 	// Make var_name longer than Max so that FindOrAddVar() will be able to spot and report var names
 	// that are too long, either because the base-name is too long, or the name becomes too long
 	// as a result of appending the array index number:
@@ -13227,9 +14117,13 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 					suffix_length = sprintf(var_name_suffix, "Pos%s", subpat_name[p]); // Append the subpattern to the array's base name.
 					if (array_item = g_script.FindOrAddVar(var_name, prefix_length + suffix_length, always_use))
 						array_item->Assign(subpat_pos);
+					if (record)
+						*record++ = array_item;
 					suffix_length = sprintf(var_name_suffix, "Len%s", subpat_name[p]); // Append the subpattern name to the array's base name.
 					if (array_item = g_script.FindOrAddVar(var_name, prefix_length + suffix_length, always_use))
 						array_item->Assign(subpat_len);
+					if (record)
+						*record++ = array_item;
 					// Fix for v1.0.45.01: Section below added.  See similar section further below for comments.
 					if (!subpat_not_matched && allow_dupe_subpat_names) // Explicitly check subpat_not_matched not pos/len so that behavior is consistent with the default mode (non-position).
 						for (n = p + 1; n < pattern_count; ++n) // Search to the right of this subpat to find others with the same name.
@@ -13245,9 +14139,13 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 				if (array_item = g_script.FindOrAddVar(var_name, prefix_length + suffix_length, always_use))
 					array_item->Assign(subpat_pos);
 				//else var couldn't be created: no error reporting currently, since it basically should never happen.
+				if (record)
+					*record++ = array_item;
 				suffix_length = sprintf(var_name_suffix, "Len%d", p); // Append the element number to the array's base name.
 				if (array_item = g_script.FindOrAddVar(var_name, prefix_length + suffix_length, always_use))
 					array_item->Assign(subpat_len);
+				if (record)
+					*record++ = array_item;
 			}
 		}
 		goto free_and_return;
@@ -13273,7 +14171,10 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 			{
 				// This section is similar to the one in the "else" below, so see it for more comments.
 				strcpy(var_name_suffix, subpat_name[p]); // Append the subpat name to the array's base name.  strcpy() seems safe because PCRE almost certainly enforces the 32-char limit on subpattern names.
-				if (array_item = g_script.FindOrAddVar(var_name, 0, always_use))
+				array_item = g_script.FindOrAddVar(var_name, 0, always_use);
+				if (record)
+					*record++ = array_item;
+				if (array_item)
 				{
 					if (subpat_not_matched)
 						array_item->Assign(); // Omit all parameters to make the var empty without freeing its memory (for performance, in case this RegEx is being used many times in a loop).
@@ -13306,7 +14207,10 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 			// to start the search.  Use the base array name rather than the preceding element because,
 			// for example, Array19 is alphabetially less than Array2, so we can't rely on the
 			// numerical ordering:
-			if (array_item = g_script.FindOrAddVar(var_name, 0, always_use))
+			array_item = g_script.FindOrAddVar(var_name, 0, always_use);
+			if (record)
+				*record++ = array_item;
+			if (array_item)
 			{
 				if (subpat_not_matched)
 					array_item->Assign(); // Omit all parameters to make the var empty without freeing its memory (for performance, in case this RegEx is being used many times in a loop).
@@ -13324,9 +14228,14 @@ void BIF_RegEx(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParamC
 	} // for() each subpattern.
 }
 free_and_return:
+	if (site_item) // The array's variables were recorded above, so keep them for the next call from this site.
+	{
+		free(site->item);
+		site->item = site_item;
+		site->output_var = &output_var;
+	}
 	if (mem_to_free)
 		free(mem_to_free);
-*/
 }
 
 
@@ -13466,6 +14375,7 @@ void BIF_NumPut(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aParam
 	ExprTokenType &target_token = *aParam[1];
 	if (target_token.symbol == SYM_VAR) // SYM_VAR's Type() is always VAR_NORMAL.
 	{
+		target_token.var->DetachIfPinned(); // See DllCall for comments.
 		target = (size_t)target_token.var->Contents();
 		right_side_bound = target + target_token.var->Capacity(); // This is first illegal address to the right of target.
 	}
@@ -13988,7 +14898,6 @@ void BIF_OnMessage(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPa
 // 2: Name of the function that will monitor the message.
 // 3: (FUTURE): A flex-list of space-delimited option words/letters.
 {
-    /*
 	char *buf = aResultToken.buf; // Must be saved early since below overwrites the union (better maintainability too).
 	// Set default result in case of early return; a blank value:
 	aResultToken.symbol = SYM_STRING;
@@ -14026,11 +14935,10 @@ void BIF_OnMessage(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPa
 		return; // Yield the default return value set earlier.
 
 	// Check if this message already exists in the array:
-	int msg_index;
-	for (msg_index = 0; msg_index < g_MsgMonitorCount; ++msg_index)
-		if (g_MsgMonitor[msg_index].msg == specified_msg)
-			break;
-	bool item_already_exists = (msg_index < g_MsgMonitorCount);
+	int msg_index = FindMsgMonitor(specified_msg);
+	bool item_already_exists = (msg_index > -1);
+	if (!item_already_exists)
+		msg_index = g_MsgMonitorCount; // The position a new item would occupy.
 	MsgMonitorStruct &monitor = g_MsgMonitor[msg_index == MAX_MSG_MONITORS ? 0 : msg_index]; // The 0th item is just a placeholder.
 
 	if (item_already_exists)
@@ -14053,6 +14961,7 @@ void BIF_OnMessage(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPa
 			--g_MsgMonitorCount;  // Must be done prior to the below.
 			if (msg_index < g_MsgMonitorCount) // An element other than the last is being removed. Shift the array to cover/delete it.
 				MoveMemory(g_MsgMonitor+msg_index, g_MsgMonitor+msg_index+1, sizeof(MsgMonitorStruct)*(g_MsgMonitorCount-msg_index));
+			RebuildMsgMonitorHash(); // Must be done after the above since the indices of the items after it have changed.
 			return;
 		}
 		if (aParamCount < 2) // Single-parameter mode: Report existing item's function name.
@@ -14081,12 +14990,13 @@ void BIF_OnMessage(ExprTokenType &aResultToken, ExprTokenType *aParam[], int aPa
 	// Update those struct attributes that get the same treatment regardless of whether this is an update or creation.
 	monitor.msg = specified_msg;
 	monitor.func = func;
+	if (!item_already_exists)
+		AddMsgMonitorToHash(msg_index); // Must be done after setting monitor.msg above.
 	if (aParamCount > 2)
 		monitor.max_instances = (short)ExprTokenToInt64(*aParam[2]); // No validation because it seems harmless if it's negative or some huge number.
 	else // Unspecified, so if this item is being newly created fall back to the default.
 		if (!item_already_exists)
 			monitor.max_instances = 1;
-*/
 }
 
 
@@ -15810,7 +16720,7 @@ __int64 ExprTokenToInt64(ExprTokenType &aToken)
 	{
 		case SYM_INTEGER: return aToken.value_int64; // Fixed in v1.0.45 not to cast to int.
 		case SYM_FLOAT: return (int)aToken.value_double;
-		case SYM_VAR: return ATOI64(aToken.var->Contents()); // Fixed in v1.0.45 to use ATOI64 vs. ATOI().
+		case SYM_VAR: return aToken.var->ToInt64(); // Same as ATOI64(Contents()), but uses the var's cached number if it has one.
 		default: // SYM_STRING or SYM_OPERAND
 			return ATOI64(aToken.marker); // Fixed in v1.0.45 to use ATOI64 vs. ATOI().
 	}
@@ -15825,7 +16735,7 @@ double ExprTokenToDouble(ExprTokenType &aToken)
 	{
 		case SYM_INTEGER: return (double)aToken.value_int64;
 		case SYM_FLOAT: return aToken.value_double;
-		case SYM_VAR: return ATOF(aToken.var->Contents());
+		case SYM_VAR: return aToken.var->ToDouble(); // Same as ATOF(Contents()), but uses the var's cached number if it has one.
 		default: // SYM_STRING or SYM_OPERAND
 			return ATOF(aToken.marker);
 	}
@@ -15869,8 +16779,19 @@ ResultType ExprTokenToDoubleOrInt(ExprTokenType &aToken)
 		case SYM_FLOAT:
 			return OK;
 		case SYM_VAR:
-			str = aToken.var->Contents();
-			break;
+		{
+			Var &var = *aToken.var; // Must be resolved before the union is overwritten below.
+			if (aToken.symbol = var.IsNumeric()) // Uses the var's cached number (if any) rather than parsing its contents.
+			{
+				if (aToken.symbol == PURE_INTEGER)
+					aToken.value_int64 = var.ToInt64();
+				else
+					aToken.value_double = var.ToDouble();
+				return OK;
+			}
+			aToken.marker = ""; // Same as for other non-numeric strings further below.
+			return FAIL;
+		}
 		case SYM_STRING:   // v1.0.40.06: Fixed to be listed explicitly so that "default" case can return failure.
 		case SYM_OPERAND:
 			str = aToken.marker;
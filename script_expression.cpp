@@ -178,6 +178,24 @@ char *Line::ExpandExpression(int aArgIndex, ResultType &aResult, char *&aTarget,
 	int derefs_in_this_double;
 	int cp1; // int vs. char benchmarks slightly faster, and is slightly smaller in code size.
 
+	// If a previous evaluation of this arg already built its postfix program, use a fresh copy of it
+	// rather than tokenizing the text again.  A copy is needed because the evaluation phase below
+	// overwrites its tokens (e.g. SYM_DYNAMIC becomes SYM_VAR, operators become their results).
+	// The copy is put into the infix array because that array isn't otherwise needed in this case.
+	ExprTokenType *cached_postfix = mArg[aArgIndex].postfix;
+	if (cached_postfix > ARG_POSTFIX_UNCACHEABLE) // i.e. neither NULL nor ARG_POSTFIX_UNCACHEABLE.
+	{
+		for (; cached_postfix[postfix_count].symbol != SYM_INVALID; ++postfix_count)
+		{
+			ExprTokenType &this_copy = infix[postfix_count];
+			this_copy = cached_postfix[postfix_count]; // Struct copy.
+			if (this_copy.circuit_token) // Point it to the corresponding token in the copy rather than the original.
+				this_copy.circuit_token = infix + (this_copy.circuit_token - cached_postfix);
+			postfix[postfix_count] = &this_copy;
+		}
+		goto evaluate_postfix;
+	}
+
 	for (cp = mArg[aArgIndex].text, deref = mArg[aArgIndex].deref // Start at the begining of this arg's text and look for the next deref.
 		;; ++deref, ++infix_count) // FOR EACH DEREF IN AN ARG:
 	{
@@ -672,8 +690,12 @@ numeric_literal:
 					infix[infix_count++].symbol = SYM_CONCAT;
 				}
 				if (this_deref->var->Type() == VAR_NORMAL // VAR_ALIAS is taken into account (and resolved) by Type().
-					&& (g_NoEnv || this_deref->var->Length())) // v1.0.43.08: Added g_NoEnv.  Relies on short-circuit boolean order.
+					&& g_NoEnv) // v1.0.43.08: Added g_NoEnv.
 					// "!this_deref->var->Get()" isn't checked here.  See comments in SYM_DYNAMIC evaluation.
+					// The var's Length() is no longer checked here because the result of this section is cached
+					// by CachePostfix() for use by future evaluations, so it must not depend on the var's current
+					// contents.  A non-blank normal var made SYM_DYNAMIC is turned into SYM_VAR by the evaluation
+					// phase anyway (as is a blank one that isn't also an environment variable).
 				{
 					// DllCall() and possibly others rely on this having been done to support changing the
 					// value of a parameter (similar to by-ref).
@@ -758,6 +780,12 @@ double_deref: // Caller has set cp to be start and op_end to be the character af
 	////////////////////////////
 	#define STACK_PUSH(token_ptr) stack[stack_count++] = token_ptr
 	#define STACK_POP stack[--stack_count]  // To be used as the r-value for an assignment.
+	// For an operand already known to be an integer (or a float, for the second macro), these get its value.
+	// A variable's own cached number is used, since its text might not even exist yet (see Var::IsNumeric()).
+	#define OPERAND_TO_INT64(token, contents) ((token).symbol == SYM_INTEGER ? (token).value_int64 \
+		: (token).symbol == SYM_VAR ? (token).var->ToInt64() : ATOI64(contents))
+	#define OPERAND_TO_DOUBLE(token, contents) ((token).symbol == SYM_FLOAT ? (token).value_double \
+		: (token).symbol == SYM_VAR ? (token).var->ToDouble() : atof(contents)) // atof() vs. ATOF() since PURE_FLOAT is never hex.
 	// SYM_BEGIN is the first item to go on the stack.  It's a flag to indicate that conversion to postfix has begun:
 	ExprTokenType token_begin;
 	token_begin.symbol = SYM_BEGIN;
@@ -1030,6 +1058,13 @@ standard_pop_into_postfix: // Use of a goto slightly reduces code size.
 	} // End of loop that builds postfix array from the infix array.
 end_of_infix_to_postfix:
 
+	// Keep the postfix program for use by future evaluations of this arg.  This must be done prior to
+	// evaluating it because evaluation alters the tokens.
+	if (!mArg[aArgIndex].postfix)
+		mArg[aArgIndex].postfix = CachePostfix(postfix, postfix_count, aTarget, target);
+
+evaluate_postfix:
+
 	///////////////////////////////////////////////////
 	// EVALUATE POSTFIX EXPRESSION (constructed above).
 	///////////////////////////////////////////////////
@@ -1238,6 +1273,7 @@ end_of_infix_to_postfix:
 				goto abnormal_end;
 			if (func.mIsBuiltIn)
 			{
+				sBIFCallSite = this_token.deref; // Must be done before the union is overwritten below.
 				// Adjust the stack early to simplify.  Above already confirmed that this won't underflow.
 				// Pop the actual number of params involved in this function-call off the stack.  Load-time
 				// validation has ensured that this number is always less than or equal to the number of
@@ -1266,6 +1302,7 @@ end_of_infix_to_postfix:
 
 				// CALL THE FUNCTION:
 				func.mBIF(this_token, stack + stack_count, actual_param_count);
+				sBIFCallSite = NULL; // So that nothing which calls a built-in function directly mistakes this site for its own.
 
 				// RESTORE THE CIRCUIT TOKEN (after handling what came back inside it):
 				#define EXPR_IS_DONE (!stack_count && i == postfix_count-1) // True if we've used up the last of the operators & operands.
@@ -1694,15 +1731,16 @@ end_of_infix_to_postfix:
 			{
 				// Free the memory of all the just-completed function's local variables.  This is done in
 				// both of the following cases:
-				// 1) There are other instances of this function beneath us on the call-stack: Must free
-				//    the memory to prevent a memory leak for any variable that existed prior to the call
-				//    we just did.  Although any local variables newly created as a result of our call
-				//    technically don't need to be freed, they are freed for simplicity of code and also
-				//    because not doing so might result in side-effects for instances of this function that
-				//    lie beneath ours that would expect such nonexistent variables to have blank contents
-				//    when *they* create it.
-				// 2) No other instances of this function exist on the call stack: The memory is freed and
-				//    the contents made blank for these reasons:
+				// 1) There are other instances of this function beneath us on the call-stack: The memory
+				//    of each variable that existed prior to the call we just did must be freed (or kept in
+				//    the frame stack for the next call at this depth) to prevent a memory leak before its
+				//    backup is restored.  Any local variables newly created as a result of our call have
+				//    no backup, but they are made blank because not doing so might result in side-effects
+				//    for instances of this function that lie beneath ours that would expect such
+				//    nonexistent variables to have blank contents when *they* create it.
+				// 2) No other instances of this function exist on the call stack: The contents are made
+				//    blank and any large memory is freed (small memory is kept for reuse by the next call,
+				//    just as case #1 leaves it in the frame stack for the next call at its depth) because:
 				//    a) Prevents locals from all being static in duration, and users coming to rely on that,
 				//       since in the future local variables might be implemented using a non-persistent method
 				//       such as hashing (rather than maintaining a permanent list of Var*'s for each function).
@@ -1777,9 +1815,11 @@ end_of_infix_to_postfix:
 			// If the operand is still generic/undetermined, find out whether it is a string, integer, or float:
 			switch(right.symbol)
 			{
-			case SYM_VAR:
-				right_contents = right.var->Contents(); // Can be the clipboard in this case, but it works even then.
-				right_is_number = IsPureNumeric(right_contents, true, false, true);
+			case SYM_VAR: // Can be the clipboard in this case, but it works even then.
+				// A number's text isn't fetched here because the operator usually doesn't need it, and a var
+				// that was assigned a number hasn't formatted it yet.  Operators that need it call Contents().
+				right_is_number = right.var->IsNumeric();
+				right_contents = right_is_number ? NULL : right.var->Contents();
 				break;
 			case SYM_OPERAND:
 				right_contents = right.marker;
@@ -1803,9 +1843,9 @@ end_of_infix_to_postfix:
 		case SYM_AND: // These are now unary operators because short-circuit has made them so.  If the AND/OR
 		case SYM_OR:  // had short-circuited, we would never be here, so this is the right branch of a non-short-circuit AND/OR.
 			if (right_is_number == PURE_INTEGER)
-				this_token.value_int64 = (right.symbol == SYM_INTEGER ? right.value_int64 : ATOI64(right_contents)) != 0;
+				this_token.value_int64 = OPERAND_TO_INT64(right, right_contents) != 0;
 			else if (right_is_number == PURE_FLOAT)
-				this_token.value_int64 = (right.symbol == SYM_FLOAT ? right.value_double : atof(right_contents)) != 0.0;
+				this_token.value_int64 = OPERAND_TO_DOUBLE(right, right_contents) != 0.0;
 			else // This is either a non-numeric string or a numeric raw literal string such as "123".
 				// All non-numeric strings are considered TRUE here.  In addition, any raw literal string,
 				// even "0", is considered to be TRUE.  This relies on the fact that right.symbol will be
@@ -1819,10 +1859,10 @@ end_of_infix_to_postfix:
 
 		case SYM_NEGATIVE:  // Unary-minus.
 			if (right_is_number == PURE_INTEGER)
-				this_token.value_int64 = -(right.symbol == SYM_INTEGER ? right.value_int64 : ATOI64(right_contents));
+				this_token.value_int64 = -OPERAND_TO_INT64(right, right_contents);
 			else if (right_is_number == PURE_FLOAT)
 				// Overwrite this_token's union with a float. No need to have the overhead of ATOF() since PURE_FLOAT is never hex.
-				this_token.value_double = -(right.symbol == SYM_FLOAT ? right.value_double : atof(right_contents));
+				this_token.value_double = -OPERAND_TO_DOUBLE(right, right_contents);
 			else // String.
 			{
 				// Seems best to consider the application of unary minus to a string, even a quoted string
@@ -1844,10 +1884,10 @@ end_of_infix_to_postfix:
 		case SYM_LOWNOT:  // The operator-word "not".
 		case SYM_HIGHNOT: // The symbol !
 			if (right_is_number == PURE_INTEGER)
-				this_token.value_int64 = !(right.symbol == SYM_INTEGER ? right.value_int64 : ATOI64(right_contents));
+				this_token.value_int64 = !OPERAND_TO_INT64(right, right_contents);
 			else if (right_is_number == PURE_FLOAT) // Convert to float, not int, so that a number between 0.0001 and 0.9999 is considered "true".
 				// Using ! vs. comparing explicitly to 0.0 might generate faster code, and K&R implies it's okay:
-				this_token.value_int64 = !(right.symbol == SYM_FLOAT ? right.value_double : atof(right_contents));
+				this_token.value_int64 = !OPERAND_TO_DOUBLE(right, right_contents);
 			else // This is either a non-numeric string or a numeric raw literal string such as "123".
 				// All non-numeric strings are considered TRUE here.  In addition, any raw literal string,
 				// even "0", is considered to be TRUE.  This relies on the fact that right.symbol will be
@@ -1919,13 +1959,13 @@ end_of_infix_to_postfix:
 			delta = (this_token.symbol == SYM_POST_INCREMENT || this_token.symbol == SYM_PRE_INCREMENT) ? 1 : -1;
 			if (right_is_number == PURE_INTEGER)
 			{
-				this_token.value_int64 = (right.symbol == SYM_INTEGER) ? right.value_int64 : ATOI64(right_contents);
+				this_token.value_int64 = OPERAND_TO_INT64(right, right_contents);
 				right.var->Assign(this_token.value_int64 + delta);
 			}
 			else // right_is_number must be PURE_FLOAT because it's the only remaining alternative.
 			{
 				// Uses atof() because no need to have the overhead of ATOF() since PURE_FLOAT is never hex.
-				this_token.value_double = (right.symbol == SYM_FLOAT) ? right.value_double : atof(right_contents);
+				this_token.value_double = OPERAND_TO_DOUBLE(right, right_contents);
 				right.var->Assign(this_token.value_double + delta);
 			}
 			if (is_pre_op)
@@ -1956,8 +1996,9 @@ end_of_infix_to_postfix:
 		case SYM_ADDRESS: // Take the address of a variable.
 			if (right.symbol == SYM_VAR) // At this stage, SYM_VAR is always a normal variable, never a built-in one, so taking its address should be safe.
 			{
+				right.var->DisableCache(); // Something might write to the address, which would make the var's cached number wrong without its knowledge.
 				this_token.symbol = SYM_INTEGER;
-				this_token.value_int64 = (__int64)right_contents;
+				this_token.value_int64 = (__int64)right.var->Contents();
 			}
 			else // Invalid, so make it a localized blank value.
 			{
@@ -1969,10 +2010,11 @@ end_of_infix_to_postfix:
 		case SYM_DEREF:   // Dereference an address to retrieve a single byte.
 		case SYM_BITNOT:           // The tilde (~) operator.
 			if (right_is_number == PURE_INTEGER) // But in this case, it can be hex, so use ATOI64().
-				right_int64 = right.symbol == SYM_INTEGER ? right.value_int64 : ATOI64(right_contents);
+				right_int64 = OPERAND_TO_INT64(right, right_contents);
 			else if (right_is_number == PURE_FLOAT)
 				// No need to have the overhead of ATOI64() since PURE_FLOAT can't be hex:
-				right_int64 = right.symbol == SYM_FLOAT ? (__int64)right.value_double : _atoi64(right_contents);
+				right_int64 = right.symbol == SYM_FLOAT ? (__int64)right.value_double
+					: right.symbol == SYM_VAR ? right.var->ToInt64() : _atoi64(right_contents);
 			else // String.  Seems best to consider the application of unary minus to a string, even a quoted string literal such as "15", to be a failure.
 			{
 				this_token.marker = "";
@@ -2072,9 +2114,9 @@ end_of_infix_to_postfix:
 			// If the operand is still generic/undetermined, find out whether it is a string, integer, or float:
 			switch(left.symbol)
 			{
-			case SYM_VAR:
-				left_contents = left.var->Contents();
-				left_is_number = IsPureNumeric(left_contents, true, false, true);
+			case SYM_VAR: // See the "right" section higher above for comments.
+				left_is_number = left.var->IsNumeric();
+				left_contents = left_is_number ? NULL : left.var->Contents();
 				break;
 			case SYM_OPERAND:
 				left_contents = left.marker;
@@ -2098,7 +2140,8 @@ end_of_infix_to_postfix:
 				// Seems best to obey SetFormat for these two, though it's debatable:
 				case SYM_INTEGER: right_string = ITOA64(right.value_int64, right_buf); break;
 				case SYM_FLOAT: snprintf(right_buf, sizeof(right_buf), g.FormatFloat, right.value_double); right_string = right_buf; break;
-				default: right_string = right_contents; // SYM_STRING/SYM_OPERAND/SYM_VAR, which is already in the right format.
+				case SYM_VAR: right_string = right.var->Contents(); break; // Even if it's a number, its own text is used (e.g. "007" rather than 7).
+				default: right_string = right_contents; // SYM_STRING/SYM_OPERAND, which is already in the right format.
 				}
 
 				switch (left.symbol)
@@ -2106,7 +2149,8 @@ end_of_infix_to_postfix:
 				// Seems best to obey SetFormat for these two, though it's debatable:
 				case SYM_INTEGER: left_string = ITOA64(left.value_int64, left_buf); break;
 				case SYM_FLOAT: snprintf(left_buf, sizeof(left_buf), g.FormatFloat, left.value_double); left_string = left_buf; break;
-				default: left_string = left_contents; // SYM_STRING/SYM_OPERAND/SYM_VAR, which is already in the right format.
+				case SYM_VAR: left_string = left.var->Contents(); break;
+				default: left_string = left_contents; // SYM_STRING/SYM_OPERAND, which is already in the right format.
 				}
 
 				result_symbol = SYM_INTEGER; // Set default.  Boolean results are treated as integers.
@@ -2131,7 +2175,7 @@ end_of_infix_to_postfix:
 					// simplify the code).
 					right_length = (right.symbol == SYM_VAR) ? right.var->LengthIgnoreBinaryClip() : strlen(right_string);
 					if (sym_assign_var // Since "right" is being appended onto a variable ("left"), an optimization is possible.
-						&& sym_assign_var->AppendIfRoom(right_string, (VarSizeType)right_length)) // But only if the target variable has enough remaining capacity.
+						&& sym_assign_var->AppendIfRoom(right_string, (VarSizeType)right_length)) // Append in place, growing the target's capacity geometrically if needed (so a loop of x .= y is linear rather than quadratic).
 					{
 						// AppendIfRoom() always fails for VAR_CLIPBOARD, so below won't execute for it (which is
 						// good because don't want clipboard to stay as SYM_VAR after the assignment. This is
@@ -2140,6 +2184,38 @@ end_of_infix_to_postfix:
 						this_token.symbol = SYM_VAR;     // address can be taken, and it can be passed ByRef. e.g. &(x+=1)
 						goto push_this_token; // Skip over all other sections such as subsequent checks of sym_assign_var because it was all taken care of here.
 					}
+					// Something like x := x . y . z is simplified to x .= y followed by x := x . z (which the
+					// section further below turns into x .= z), so that building a string that way in a loop is
+					// linear like x .= y rather than quadratic.  This is done only when everything from here to
+					// the assignment is a chain of simple operands each followed by a concat, and none of those
+					// operands is the target itself, since it would otherwise see the partially built result.
+					if (left.symbol == SYM_VAR && i < postfix_count - 2)
+					{
+						for (j = i + 1; j < postfix_count - 1 && postfix[j+1]->symbol == SYM_CONCAT; j += 2)
+						{
+							ExprTokenType &chain_token = *postfix[j]; // For performance and convenience.
+							if (   !(chain_token.symbol == SYM_STRING || chain_token.symbol == SYM_OPERAND
+								|| chain_token.symbol == SYM_INTEGER || chain_token.symbol == SYM_FLOAT
+								|| (chain_token.symbol == SYM_VAR // For SYM_DYNAMIC, double-derefs might resolve to the target.
+									|| chain_token.symbol == SYM_DYNAMIC && !SYM_DYNAMIC_IS_DOUBLE_DEREF(chain_token))
+									&& chain_token.var->ResolveAlias() != left.var->ResolveAlias())   )
+								break;
+						}
+						if (j == postfix_count) // The chain ends the expression, so its result goes to output_var, if any.
+							temp_var = stack_count ? NULL : output_var;
+						else if (postfix[j]->symbol == SYM_ASSIGN // The chain ends at a ":=" (anything else means the loop above found an unsuitable item).
+							&& stack_count && stack[stack_count-1]->symbol == SYM_VAR)
+							temp_var = stack[stack_count-1]->var;
+						else
+							temp_var = NULL;
+						if (j > i + 1 && temp_var && temp_var->ResolveAlias() == left.var->ResolveAlias()
+							&& left.var->AppendIfRoom(right_string, (VarSizeType)right_length)) // Fails for VAR_CLIPBOARD, which is relied upon since SYM_VAR results must be VAR_NORMAL.
+						{
+							this_token.var = left.var; // The next concat in the chain will see that its left side is the target.
+							this_token.symbol = SYM_VAR;
+							goto push_this_token;
+						}
+					}
 					// Otherwise, fall back to the other concat methods:
 					left_length = (left.symbol == SYM_VAR) ? left.var->LengthIgnoreBinaryClip() : strlen(left_string);
 					result_size = right_length + left_length + 1;
@@ -2274,7 +2350,8 @@ end_of_infix_to_postfix:
 				{
 				case SYM_INTEGER: right_int64 = right.value_int64; break;
 				case SYM_FLOAT: right_int64 = (__int64)right.value_double; break;
-				default: right_int64 = ATOI64(right_contents); // SYM_OPERAND or SYM_VAR
+				case SYM_VAR: right_int64 = right.var->ToInt64(); break;
+				default: right_int64 = ATOI64(right_contents); // SYM_OPERAND
 				// It can't be SYM_STRING because in here, both right and left are known to be numbers
 				// (otherwise an earlier "else if" would have executed instead of this one).
 				}
@@ -2283,7 +2360,8 @@ end_of_infix_to_postfix:
 				{
 				case SYM_INTEGER: left_int64 = left.value_int64; break;
 				case SYM_FLOAT: left_int64 = (__int64)left.value_double; break;
-				default: left_int64 = ATOI64(left_contents); // SYM_OPERAND or SYM_VAR
+				case SYM_VAR: left_int64 = left.var->ToInt64(); break;
+				default: left_int64 = ATOI64(left_contents); // SYM_OPERAND
 				// It can't be SYM_STRING because in here, both right and left are known to be numbers
 				// (otherwise an earlier "else if" would have executed instead of this one).
 				}
@@ -2356,7 +2434,8 @@ end_of_infix_to_postfix:
 				{
 				case SYM_INTEGER: right_double = (double)right.value_int64; break;
 				case SYM_FLOAT: right_double = right.value_double; break;
-				default: right_double = ATOF(right_contents); // SYM_OPERAND or SYM_VAR
+				case SYM_VAR: right_double = right.var->ToDouble(); break;
+				default: right_double = ATOF(right_contents); // SYM_OPERAND
 				// It can't be SYM_STRING because in here, both right and left are known to be numbers.
 				}
 
@@ -2364,7 +2443,8 @@ end_of_infix_to_postfix:
 				{
 				case SYM_INTEGER: left_double = (double)left.value_int64; break;
 				case SYM_FLOAT: left_double = left.value_double; break;
-				default: left_double = ATOF(left_contents); // SYM_OPERAND or SYM_VAR
+				case SYM_VAR: left_double = left.var->ToDouble(); break;
+				default: left_double = ATOF(left_contents); // SYM_OPERAND
 				// It can't be SYM_STRING because in here, both right and left are known to be numbers.
 				}
 
@@ -2455,8 +2535,8 @@ non_null_circuit_token:
 				// "right" vs. "left" is used even though this is technically the left branch because
 				// right is used more often (for unary operators) and sometimes the compiler generates
 				// faster code for the most frequently accessed variables.
-				right_contents = this_token.var->Contents();
-				right_is_number = IsPureNumeric(right_contents, true, false, true);
+				right_is_number = this_token.var->IsNumeric();
+				right_contents = right_is_number ? NULL : this_token.var->Contents();
 				break;
 			case SYM_OPERAND:
 				right_contents = this_token.marker;
@@ -2474,12 +2554,10 @@ non_null_circuit_token:
 			{
 			case PURE_INTEGER: // Probably the most common, e.g. both sides of "if (x>3 and x<6)" are the number 1/0.
 				// Force it to be purely 1 or 0 if it isn't already.
-				left_branch_is_true = (this_token.symbol == SYM_INTEGER ? this_token.value_int64
-					: ATOI64(right_contents)) != 0;
+				left_branch_is_true = OPERAND_TO_INT64(this_token, right_contents) != 0;
 				break;
 			case PURE_FLOAT: // Convert to float, not int, so that a number between 0.0001 and 0.9999 is is considered "true".
-				left_branch_is_true = (this_token.symbol == SYM_FLOAT ? this_token.value_double
-					: atof(right_contents)) != 0.0;
+				left_branch_is_true = OPERAND_TO_DOUBLE(this_token, right_contents) != 0.0;
 				break;
 			default:  // string.
 				// Since "if x" evaluates to false when x is blank, it seems best to also have blank
@@ -2661,13 +2739,11 @@ non_null_circuit_token:
 			// none of the contents needs to be copied (realloc's ability to do an in-place resize might
 			// be unlikely for anything other than small blocks; see compiler's realloc.c):
 			char *new_buf;
-			if (   !(new_buf = (char *)malloc(new_buf_size))   )
+			if (   !(new_buf = AcquireDerefBuf(new_buf_size, new_buf_size))   ) // This also rounds new_buf_size up to its size class.
 			{
 				LineError(ERR_OUTOFMEM ERR_ABORT);
 				goto abort;
 			}
-			if (new_buf_size > LARGE_DEREF_BUF_SIZE)
-				++sLargeDerefBufs; // And if the old deref buf was larger too, this value is decremented later below.
 
 			// Copy only that portion of the old buffer that is in front of our portion of the buffer
 			// because we no longer need our portion (except for result.marker if it happens to be
@@ -2683,9 +2759,7 @@ non_null_circuit_token:
 			// done prior to free(), but memcpy() vs. memmove() is safe in any case:
 			memcpy(aTarget, result, result_size); // Copy from old location to the newly allocated one.
 
-			free(aDerefBuf); // Free our original buffer since it's contents are no longer needed.
-			if (aDerefBufSize > LARGE_DEREF_BUF_SIZE)
-				--sLargeDerefBufs;
+			ReleaseDerefBuf(aDerefBuf, aDerefBufSize); // Release our original buffer since it's contents are no longer needed.
 
 			// Now that the buffer has been enlarged, need to adjust any other pointers that pointed into
 			// the old buffer:
@@ -2733,6 +2807,184 @@ normal_end_skip_output_var:
 
 
 
+ExprTokenType *Line::CachePostfix(ExprTokenType *aPostfix[], int aPostfixCount, char *aTextStart, char *aTextEnd)
+// Called by ExpandExpression() right after it builds an arg's postfix array for the first time.
+// Returns a persistent, self-contained copy of that postfix program (terminated by a SYM_INVALID token)
+// for use by future evaluations of the same arg, or ARG_POSTFIX_UNCACHEABLE if it can't be reused.
+// aTextStart and aTextEnd enclose the area of the deref buffer into which the tokenizing phase copied
+// the expression's literal strings, numbers and double-deref names; they're copied too since the deref
+// buffer is volatile.
+// Numeric literals are converted to SYM_INTEGER/SYM_FLOAT here when the only thing that will ever
+// consume them is a math operator, which saves the IsPureNumeric()+ATOI64()/ATOF() of each evaluation.
+// They're left as SYM_OPERAND everywhere else because the literal's original formatting is visible
+// to the script in those cases (e.g. x := 0x10, "abc" . 1.0, fn(007)).
+{
+	int i, k, stack_count = 0, deref_count = 0;
+	int stack[MAX_TOKENS]; // For each pending operand: the index of the literal that produced it, or -1.
+	DerefType *deref;
+
+	// Validate and measure.
+	for (i = 0; i < aPostfixCount; ++i)
+	{
+		ExprTokenType &this_token = *aPostfix[i];
+		if (this_token.circuit_token)
+		{
+			// Short-circuit targets must be found in the postfix array itself so that they can be expressed
+			// as a position within the copy.  This should always be true except for malformed expressions.
+			for (k = 0; k < aPostfixCount && aPostfix[k] != this_token.circuit_token; ++k);
+			if (k == aPostfixCount)
+				return ARG_POSTFIX_UNCACHEABLE;
+		}
+		if (this_token.symbol == SYM_DYNAMIC && SYM_DYNAMIC_IS_DOUBLE_DEREF(this_token))
+		{
+			for (deref = (DerefType *)this_token.var; deref->marker; ++deref, ++deref_count);
+			// A dynamic function call such as %fn%() stores the function it resolves to in the terminator
+			// of its deref list during each evaluation.  Since another evaluation of this same arg (by
+			// recursion) can happen before that function is called, the list can't be shared:
+			if (deref->is_function)
+				return ARG_POSTFIX_UNCACHEABLE;
+			++deref_count; // For the terminator.
+		}
+	}
+
+	size_t token_size = (aPostfixCount + 1) * sizeof(ExprTokenType); // +1 for the SYM_INVALID terminator.
+	size_t deref_size = deref_count * sizeof(DerefType);
+	size_t text_size = aTextEnd - aTextStart;
+	char *block;
+	if (   !(block = SimpleHeap::Malloc(token_size + deref_size + (text_size ? text_size : 1)))   )
+		return ARG_POSTFIX_UNCACHEABLE; // Too large (or out of memory), so just keep doing it the slow way.
+	ExprTokenType *program = (ExprTokenType *)block;
+	DerefType *deref_copy = (DerefType *)(block + token_size);
+	char *text = block + token_size + deref_size;
+	memcpy(text, aTextStart, text_size);
+	#define RELOCATE_TEXT(ptr) (((ptr) >= aTextStart && (ptr) < aTextEnd) ? text + ((ptr) - aTextStart) : (ptr))
+
+	for (i = 0; i < aPostfixCount; ++i)
+	{
+		ExprTokenType &this_token = program[i];
+		this_token = *aPostfix[i]; // Struct copy.
+		if (this_token.circuit_token)
+		{
+			for (k = 0; aPostfix[k] != this_token.circuit_token; ++k); // Already verified above to be present.
+			this_token.circuit_token = program + k;
+		}
+		switch (this_token.symbol)
+		{
+		case SYM_STRING:
+		case SYM_OPERAND:
+			this_token.marker = RELOCATE_TEXT(this_token.marker);
+			break;
+		case SYM_DYNAMIC:
+			if (SYM_DYNAMIC_IS_DOUBLE_DEREF(this_token))
+			{
+				this_token.buf = RELOCATE_TEXT(this_token.buf);
+				deref = (DerefType *)this_token.var;
+				this_token.var = (Var *)deref_copy;
+				for (;; ++deref, ++deref_copy)
+				{
+					*deref_copy = *deref; // Struct copy.
+					if (!deref->marker) // The terminator has been copied.
+						break;
+					deref_copy->marker = RELOCATE_TEXT(deref->marker);
+				}
+				++deref_copy; // Move on to where the next double-deref's list (if any) will go.
+			}
+			break;
+		}
+	}
+	program[aPostfixCount].symbol = SYM_INVALID;
+	program[aPostfixCount].circuit_token = NULL;
+
+	// Find the numeric literals that are consumed only by a math operator by simulating the operand
+	// stack of the evaluation phase.  Short-circuit doesn't affect this because every operator still
+	// consumes the same operands whenever it's actually evaluated.
+	bool integers_only;
+	for (i = 0; i < aPostfixCount; ++i)
+	{
+		ExprTokenType &this_token = program[i];
+		if (IS_OPERAND(this_token.symbol))
+		{
+			stack[stack_count++] = (this_token.symbol == SYM_OPERAND) ? i : -1;
+			continue;
+		}
+		switch (this_token.symbol)
+		{
+		case SYM_FUNC:
+			if (this_token.deref->param_count > stack_count)
+				return program; // Malformed, so don't attempt any conversions.
+			stack_count -= this_token.deref->param_count;
+			stack[stack_count++] = -1;
+			continue;
+		case SYM_NEGATIVE: case SYM_HIGHNOT: case SYM_LOWNOT: case SYM_BITNOT:
+			if (!stack_count)
+				return program;
+			if (stack[stack_count - 1] > -1) // A literal is the operand.
+				ConvertNumericLiteral(program[stack[stack_count - 1]], this_token.symbol == SYM_BITNOT);
+			stack[stack_count - 1] = -1; // The result replaces the operand.
+			continue;
+		case SYM_ADDRESS: case SYM_DEREF:
+		case SYM_POST_INCREMENT: case SYM_POST_DECREMENT: case SYM_PRE_INCREMENT: case SYM_PRE_DECREMENT:
+			if (!stack_count)
+				return program;
+			stack[stack_count - 1] = -1;
+			continue;
+		}
+		// Since above didn't "continue", it's a binary operator (which includes AND/OR and the two halves
+		// of a ternary, since the left operand of each is consumed by it via short-circuit).
+		if (stack_count < 2)
+			return program;
+		stack_count -= 2;
+		switch (this_token.symbol)
+		{
+		case SYM_BITOR: case SYM_BITXOR: case SYM_BITAND: case SYM_BITSHIFTLEFT: case SYM_BITSHIFTRIGHT:
+		case SYM_ASSIGN_BITOR: case SYM_ASSIGN_BITXOR: case SYM_ASSIGN_BITAND:
+		case SYM_ASSIGN_BITSHIFTLEFT: case SYM_ASSIGN_BITSHIFTRIGHT:
+			integers_only = true; // Bitwise operators truncate a float operand differently than _atoi64() does its text (e.g. 1e3).
+			break;
+		case SYM_ADD: case SYM_SUBTRACT: case SYM_MULTIPLY: case SYM_DIVIDE: case SYM_FLOORDIVIDE: case SYM_POWER:
+		case SYM_ASSIGN_ADD: case SYM_ASSIGN_SUBTRACT: case SYM_ASSIGN_MULTIPLY: case SYM_ASSIGN_DIVIDE:
+		case SYM_ASSIGN_FLOORDIVIDE:
+			integers_only = false;
+			break;
+		default: // Relational operators, concat, :=, comma, AND/OR, ternary: the text of a literal can matter to these.
+			stack[stack_count++] = -1;
+			continue;
+		}
+		// The left operand of an assignment is a variable, so only the right one can be a literal here:
+		if (stack[stack_count] > -1 && !IS_ASSIGNMENT_EXCEPT_POST_AND_PRE(this_token.symbol))
+			ConvertNumericLiteral(program[stack[stack_count]], integers_only);
+		if (stack[stack_count + 1] > -1)
+			ConvertNumericLiteral(program[stack[stack_count + 1]], integers_only);
+		stack[stack_count++] = -1;
+	}
+	return program;
+}
+
+
+
+void Line::ConvertNumericLiteral(ExprTokenType &aToken, bool aIntegersOnly)
+// Helper for CachePostfix(): converts aToken (a SYM_OPERAND literal) into SYM_INTEGER or SYM_FLOAT,
+// but only if it's numeric.  Uses the same functions as the evaluation phase so that the result is
+// identical to what that phase would have produced from the text.
+{
+	switch (IsPureNumeric(aToken.marker, true, false, true))
+	{
+	case PURE_INTEGER:
+		aToken.value_int64 = ATOI64(aToken.marker); // Must be done last because marker and value_int64 overlap in union.
+		aToken.symbol = SYM_INTEGER;
+		break;
+	case PURE_FLOAT:
+		if (aIntegersOnly)
+			break;
+		aToken.value_double = ATOF(aToken.marker); // Must be done last because marker and value_double overlap in union.
+		aToken.symbol = SYM_FLOAT;
+		break;
+	//default: Not numeric, so leave it as SYM_OPERAND.
+	}
+}
+
+
+
 ResultType Line::ExpandArgs(VarSizeType aSpaceNeeded, Var *aArgVar[])
 // Caller should either provide both or omit both of the parameters.  If provided, it means
 // caller already called GetExpandedArgSize for us.
@@ -2787,28 +3039,18 @@ ResultType Line::ExpandArgs(VarSizeType aSpaceNeeded, Var *aArgVar[])
 		// then the old size should be passed to FreeAndRestoreFunctionVars() so that it can restore it.
 		// However, given the rarity of deep recursion, this doesn't seem worth the extra code size and loss of
 		// performance.
-		size_t increments_needed = space_needed / DEREF_BUF_EXPAND_INCREMENT;
-		if (space_needed % DEREF_BUF_EXPAND_INCREMENT)  // Need one more if above division truncated it.
-			++increments_needed;
-		size_t new_buf_size = increments_needed * DEREF_BUF_EXPAND_INCREMENT;
+		// Release and acquire rather than realloc(), which should be far more efficient, especially if
+		// there is a large amount of memory involved here (realloc's ability to do an in-place resize
+		// might be unlikely for anything other than small blocks; see compiler's realloc.c).  The new
+		// buffer's size is rounded up to its pool size class, a multiple of DEREF_BUF_EXPAND_INCREMENT:
 		if (sDerefBuf)
-		{
-			// Do a free() and malloc(), which should be far more efficient than realloc(), especially if
-			// there is a large amount of memory involved here (realloc's ability to do an in-place resize
-			// might be unlikely for anything other than small blocks; see compiler's realloc.c):
-			free(sDerefBuf);
-			if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
-				--sLargeDerefBufs;
-		}
-		if (   !(sDerefBuf = (char *)malloc(new_buf_size))   )
+			ReleaseDerefBuf(sDerefBuf, sDerefBufSize);
+		if (   !(sDerefBuf = AcquireDerefBuf(space_needed, sDerefBufSize))   )
 		{
 			// Error msg was formerly: "Ran out of memory while attempting to dereference this line's parameters."
 			sDerefBufSize = 0;  // Reset so that it can make another attempt, possibly smaller, next time.
 			return LineError(ERR_OUTOFMEM ERR_ABORT); // Short msg since so rare.
 		}
-		sDerefBufSize = new_buf_size;
-		if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
-			++sLargeDerefBufs;
 	}
 
 	// Always init our_buf_marker even if zero iterations, because we want to enforce
@@ -3009,12 +3251,8 @@ end:
 	{
 		// Must always restore the original buffer, not keep the new one, because our caller needs
 		// the arg_deref addresses, which point into the original buffer.
-		if (sDerefBuf)
-		{
-			free(sDerefBuf);
-			if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
-				--sLargeDerefBufs;
-		}
+		if (sDerefBuf) // Put it back in the pool for the next line that needs an extra buffer.
+			ReleaseDerefBuf(sDerefBuf, sDerefBufSize);
 		SET_S_DEREF_BUF(our_deref_buf, our_deref_buf_size);
 	}
 	//else the original buffer is NULL, so keep any new sDerefBuf that might have been created (should
@@ -3044,9 +3282,8 @@ end:
 	// were done and the launch of a script function creates (directly or through thread
 	// interruption, indirectly) a large deref buffer, and that thread is waiting for something
 	// such as WinWait, that large deref buffer would never get freed.
-	#define SET_DEREF_TIMER(aTimeoutValue) g_DerefTimerExists = SetTimer(g_hWnd, TIMER_ID_DEREF, aTimeoutValue, DerefTimeout);
 	if (sDerefBufSize > LARGE_DEREF_BUF_SIZE)
-		SET_DEREF_TIMER(10000) // Reset the timer right before the deref buf is possibly about to become idle.
+		SET_DEREF_TIMER(DEREF_BUF_IDLE_TIME) // Reset the timer right before the deref buf is possibly about to become idle.
 
 	return result_to_return;
 }
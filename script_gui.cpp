@@ -4466,7 +4466,7 @@ ResultType GuiType::ControlParseOptions(char *aOptions, GuiControlOptionsType &a
 					++next_option; // Now it should point to the variable name of the buddy control.
 					// Check if there's an existing *global* variable of this name.  It must be global
 					// because the variable of a control can never be a local variable:
-					Var *var = g_script.FindVar(next_option, 0, NULL, ALWAYS_USE_GLOBAL); // Search globals only.
+					Var *var = g_script.FindVar(next_option, 0, ALWAYS_USE_GLOBAL); // Search globals only.
 					if (var)
 					{
 						var = var->ResolveAlias(); // Update it to its target if it's an alias.
@@ -6670,7 +6670,7 @@ GuiIndexType GuiType::FindControl(char *aControlID)
 	// improved by skipping the first loop entirely when aControlID doesn't exist as a global
 	// variable (GUI controls always have global variables, not locals).
 	Var *var;
-	if (var = g_script.FindVar(aControlID, 0, NULL, ALWAYS_USE_GLOBAL)) // First search globals only because for backward compatibility, a GUI control whose Var* is identical to that of a global should be given precedence over a static that matches some other control.  Furthermore, since most GUI variables are global, doing this check before the static check improves avg-case performance.
+	if (var = g_script.FindVar(aControlID, 0, ALWAYS_USE_GLOBAL)) // First search globals only because for backward compatibility, a GUI control whose Var* is identical to that of a global should be given precedence over a static that matches some other control.  Furthermore, since most GUI variables are global, doing this check before the static check improves avg-case performance.
 	{
 		// No need to do "var = var->ResolveAlias()" because the line above never finds locals, only globals.
 		// Similarly, there's no need to do confirm that var->IsLocal()==false.
@@ -6679,7 +6679,7 @@ GuiIndexType GuiType::FindControl(char *aControlID)
 				return u;  // Match found.
 	}
 	if (g.CurrentFunc // v1.0.46.15: Since above failed to match: if we're in a function (which is checked for performance reasons), search for a static or ByRef-that-points-to-a-global-or-static because both should be supported.
-		&& (var = g_script.FindVar(aControlID, 0, NULL, ALWAYS_USE_LOCAL)))
+		&& (var = g_script.FindVar(aControlID, 0, ALWAYS_USE_LOCAL)))
 	{
 		// No need to do "var = var->ResolveAlias()" because the line above never finds locals, only globals.
 		// Similarly, there's no need to do confirm that var->IsLocal()==false.
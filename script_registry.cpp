@@ -29,54 +29,709 @@
 #include "globaldata.h"
 
 
+// IniRead, IniWrite and IniDelete keep each INI file they use parsed in memory, so that a script which
+// reads many keys doesn't re-open and re-parse the whole file for every one of them as
+// GetPrivateProfileString() does.  The file's lines are kept in order so that writing it back preserves its
+// comments and formatting, and its sections and keys are indexed by hash tables.  The parsing mirrors that
+// of GetPrivateProfileString(): names are case-insensitive and trimmed of spaces and tabs, a value is
+// trimmed too and loses any pair of quotes (single or double) that encloses it, and only the first of any
+// duplicate sections or keys is seen.
+// Before each use, the file's timestamp and size are checked so that changes made by other programs are
+// seen.  The script's own changes are applied to the parsed copy at once, but are written to the file only
+// when the script goes idle, runs a program, uses a file command or exits (see IniFlushAll), or while it's
+// busy, once they're a second old (see IniFlushIfDue, which the periodic message check calls).
+// This lets a series of writes share a single one.  Each is done by writing a temporary file and moving
+// it over the original, so that the file is never seen half-written.  The changes that are pending are
+// also kept as a list of operations, so that if something else changes the file in the meantime, they
+// can be reapplied to the new version of it rather than overwriting that.
+#define INI_CACHE_MAX_FILES 16   // Beyond this many files, the least recently used one is dropped from the cache.
+#define INI_FLUSH_INTERVAL 1000  // The longest a change can remain unwritten while the script is busy (ms).
+
+struct IniLine
+{
+	IniLine *prev, *next;     // In file order.
+	char *text;               // The line without its line break, terminated.
+	size_t length;
+	bool allocated;           // Whether this line was made by the script (see IniFile::NewLine) rather than read from the file.
+	// Section headers and keys are also in one of the indexes, and have name set (to within text):
+	IniLine *next_in_bucket;
+	IniLine *section;         // For a key: the header of its section.  For a header: the last line of its section.
+	char *name, *value;       // Neither is terminated.  value is NULL for a section header.
+	size_t name_length, value_length;
+	UINT hash;
+};
+
+struct IniOp
+// A change the script has made that hasn't been written to the file yet.
+{
+	IniOp *next;
+	char *section, *key, *value; // key is NULL to delete the section, otherwise value is NULL to delete the key.
+};
+
+class IniFile
+{
+private:
+	char *mBuf;              // The file's contents as of the last read, with each line terminated in place.
+	IniLine *mLineBlock;     // The lines of mBuf, which are allocated as one block.
+	IniLine *mFirstLine, *mLastLine;
+	IniLine **mSectionIndex, **mKeyIndex; // Chained hash tables of section headers and keys.
+	UINT mSectionIndexSize, mKeyIndexSize, mSectionCount, mKeyCount;
+	bool mLoaded;            // Whether the members above reflect the file.
+	bool mExists;            // The file's existence, timestamp and size as of the last read or write, by which
+	FILETIME mTime;          // changes made by anything else are detected.
+	ULONGLONG mSize;         //
+	IniOp *mFirstOp, *mLastOp;
+
+	static void ParseLine(IniLine &aLine);
+	static bool IsBlank(IniLine &aLine);
+	static UINT KeyHash(IniLine *aSection, char *aName, size_t aLength);
+	void Unload();
+	bool Load();
+	bool Refresh();
+	bool BuildIndex();
+	bool IndexAdd(IniLine *aLine);
+	IniLine *FindSection(char *aName, size_t aLength);
+	IniLine *FindKey(IniLine *aSection, char *aName, size_t aLength);
+	IniLine *NewLine(char *aPrefix, char *aName, char *aSeparator, char *aValue);
+	void LinkAfter(IniLine *aAfter, IniLine *aLine);
+	void Unlink(IniLine *aLine);
+	bool Apply(char *aSection, char *aKey, char *aValue);
+	bool CreateTempFile(char *aTempPath);
+
+public:
+	IniFile *mNext;          // The cache is a list in most-recently-used order.
+	char mPath[MAX_PATH];    // The full path, by which the cache recognizes the file.
+
+	static IniFile *Open(char *aFilespec);
+	char *Read(char *aSection, char *aKey, size_t &aLength);
+	bool Write(char *aSection, char *aKey, char *aValue);
+	bool Flush();
+
+	IniFile(char *aPath) : mBuf(NULL), mLineBlock(NULL), mFirstLine(NULL), mLastLine(NULL)
+		, mSectionIndex(NULL), mKeyIndex(NULL), mSectionIndexSize(0), mKeyIndexSize(0), mSectionCount(0), mKeyCount(0)
+		, mLoaded(false), mExists(false), mSize(0), mFirstOp(NULL), mLastOp(NULL), mNext(NULL)
+	{
+		strlcpy(mPath, aPath, sizeof(mPath));
+	}
+	~IniFile();
+};
+
+static IniFile *sIniFile = NULL; // The cache of parsed files.
+static int sIniFileCount = 0;
+static bool sIniChangesPending = false; // Whether any file might have changes that haven't been written yet.
+static DWORD sIniChangesTick;           // When the above became true (see IniFlushIfDue).
+
+
+
+void IniFile::ParseLine(IniLine &aLine)
+// Sets the name and value of aLine if it's a section header or a key, or sets name to NULL if it's neither.
+{
+	char *cp = omit_leading_whitespace(aLine.text), *end;
+	aLine.name = NULL;
+	aLine.value = NULL;
+	if (*cp == '[') // Section header.  Anything after the closing bracket is ignored.
+	{
+		cp = omit_leading_whitespace(cp + 1);
+		if (   !(end = strchr(cp, ']'))   )
+			end = aLine.text + aLine.length;
+	}
+	else
+	{
+		if (   !(end = strchr(cp, '='))   ) // Neither a header nor a key.
+			return;
+		char *value = omit_leading_whitespace(end + 1), *value_end = aLine.text + aLine.length;
+		for (; value_end > value && IS_SPACE_OR_TAB(value_end[-1]); --value_end);
+		if (value_end - value > 1 && (*value == '"' || *value == '\'') && value_end[-1] == *value) // Enclosed in quotes.
+		{
+			++value;
+			--value_end;
+		}
+		aLine.value = value;
+		aLine.value_length = value_end - value;
+	}
+	for (; end > cp && IS_SPACE_OR_TAB(end[-1]); --end);
+	if (end == cp && aLine.value) // A key must have a name.
+	{
+		aLine.value = NULL;
+		return;
+	}
+	aLine.name = cp;
+	aLine.name_length = end - cp;
+}
+
+
+
+bool IniFile::IsBlank(IniLine &aLine)
+{
+	return !*omit_leading_whitespace(aLine.text);
+}
+
+
+
+UINT IniFile::KeyHash(IniLine *aSection, char *aName, size_t aLength)
+// Keys of all sections share one index, so the hash of a key's name is combined with that of its section.
+{
+	return NameHashTable::Hash(aName, aLength) ^ (aSection->hash * 31);
+}
+
+
+
+IniFile::~IniFile()
+{
+	Unload();
+	for (IniOp *next; mFirstOp; mFirstOp = next)
+	{
+		next = mFirstOp->next;
+		free(mFirstOp);
+	}
+}
+
+
+
+void IniFile::Unload()
+{
+	for (IniLine *next; mFirstLine; mFirstLine = next)
+	{
+		next = mFirstLine->next;
+		if (mFirstLine->allocated)
+			free(mFirstLine);
+	}
+	mLastLine = NULL;
+	free(mLineBlock);
+	free(mBuf);
+	free(mSectionIndex); // mKeyIndex is part of the same block.
+	mLineBlock = NULL;
+	mBuf = NULL;
+	mSectionIndex = mKeyIndex = NULL;
+	mLoaded = false;
+}
+
+
+
+bool IniFile::Load()
+// Reads and splits up the file, which the caller has verified exists.  Returns false on failure.
+{
+	HANDLE file = CreateFile(mPath, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD size = GetFileSize(file, NULL), bytes_read = 0;
+	bool success = size != INVALID_FILE_SIZE && (mBuf = (char *)malloc(size + 1))
+		&& ReadFile(file, mBuf, size, &bytes_read, NULL);
+	CloseHandle(file);
+	if (!success)
+		return false;
+	char *cp, *end = mBuf + bytes_read, *eol;
+	size_t line_count = 1;
+	for (cp = mBuf; cp = (char *)memchr(cp, '\n', end - cp); ++cp, ++line_count);
+	if (   !(mLineBlock = (IniLine *)malloc(line_count * sizeof(IniLine)))   )
+		return false;
+	IniLine *line = mLineBlock;
+	for (cp = mBuf; cp < end; cp = eol + 1, ++line)
+	{
+		if (   !(eol = (char *)memchr(cp, '\n', end - cp))   )
+			eol = end; // The last line has no line break.  There's room for the terminator at end.
+		*eol = '\0';
+		line->text = cp;
+		if ((line->length = eol - cp) && cp[line->length - 1] == '\r')
+			cp[--line->length] = '\0';
+		line->allocated = false;
+		ParseLine(*line);
+		LinkAfter(mLastLine, line);
+	}
+	return true;
+}
+
+
+
+bool IniFile::Refresh()
+// Makes the parsed copy reflect the file's current contents, plus the script's changes that haven't been
+// written yet.  Returns false upon failure (e.g. the file is locked), in which case the copy is left empty.
+{
+	WIN32_FILE_ATTRIBUTE_DATA attrib;
+	bool exists = GetFileAttributesEx(mPath, GetFileExInfoStandard, &attrib)
+		&& !(attrib.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+	ULONGLONG size = exists ? ((ULONGLONG)attrib.nFileSizeHigh << 32) | attrib.nFileSizeLow : 0;
+	if (mLoaded && exists == mExists
+		&& (!exists || size == mSize && !CompareFileTime(&attrib.ftLastWriteTime, &mTime)))
+		return true; // Unchanged since it was last read or written.
+	Unload();
+	mExists = exists;
+	mSize = size;
+	if (exists)
+		mTime = attrib.ftLastWriteTime;
+	if (exists && !Load() || !BuildIndex())
+	{
+		Unload();
+		return false;
+	}
+	// Reapply the pending changes, since they were made after whatever version of the file this is.
+	for (IniOp *op = mFirstOp; op; op = op->next)
+		if (!Apply(op->section, op->key, op->value))
+		{
+			Unload();
+			return false;
+		}
+	return mLoaded = true;
+}
+
+
+
+bool IniFile::BuildIndex()
+// (Re)builds both indexes from the lines.  Returns false if out of memory.
+{
+	// Count the sections and keys first so that each index can be sized to keep its chains short.
+	UINT section_count = 0, key_count = 0;
+	IniLine *line, *section = NULL, *header = NULL;
+	for (line = mFirstLine; line; line = line->next)
+		if (line->name)
+			++(line->value ? key_count : section_count);
+	UINT section_index_size, key_index_size;
+	for (section_index_size = 16; section_index_size < section_count; section_index_size <<= 1);
+	for (key_index_size = 64; key_index_size < key_count; key_index_size <<= 1);
+	IniLine **index;
+	if (   !(index = (IniLine **)calloc(section_index_size + key_index_size, sizeof(IniLine *)))   )
+		return false;
+	free(mSectionIndex);
+	mSectionIndex = index;
+	mKeyIndex = index + section_index_size;
+	mSectionIndexSize = section_index_size;
+	mKeyIndexSize = key_index_size;
+	mSectionCount = mKeyCount = 0;
+	for (line = mFirstLine; line; line = line->next)
+	{
+		if (line->name && !line->value) // A section header.
+		{
+			header = line;
+			header->section = header; // Its last line so far.
+			// Only the first section of a given name is seen, so a duplicate's keys aren't indexed.
+			section = FindSection(line->name, line->name_length) ? NULL : line;
+			if (section)
+				IndexAdd(section); // Can't fail since the index is already big enough.
+			continue;
+		}
+		if (header)
+			header->section = line; // Its last line so far.
+		if (line->name && section && !FindKey(section, line->name, line->name_length)) // Only the first of duplicate keys is seen.
+		{
+			line->section = section;
+			IndexAdd(line);
+		}
+	}
+	return true;
+}
+
+
+
+bool IniFile::IndexAdd(IniLine *aLine)
+// Adds aLine, which is already linked into the list of lines, to the appropriate index.  For a key, caller
+// must have set aLine->section.  Returns false if out of memory.
+{
+	IniLine **bucket;
+	if (aLine->value)
+	{
+		if (++mKeyCount > mKeyIndexSize * 2) // The chains are getting long, so make the index bigger.
+			return BuildIndex(); // This indexes aLine too.
+		aLine->hash = KeyHash(aLine->section, aLine->name, aLine->name_length);
+		bucket = mKeyIndex + (aLine->hash & (mKeyIndexSize - 1));
+	}
+	else
+	{
+		if (++mSectionCount > mSectionIndexSize * 2)
+			return BuildIndex();
+		aLine->hash = NameHashTable::Hash(aLine->name, aLine->name_length);
+		bucket = mSectionIndex + (aLine->hash & (mSectionIndexSize - 1));
+	}
+	aLine->next_in_bucket = *bucket;
+	*bucket = aLine;
+	return true;
+}
+
+
+
+IniLine *IniFile::FindSection(char *aName, size_t aLength)
+{
+	UINT hash = NameHashTable::Hash(aName, aLength);
+	IniLine *line;
+	for (line = mSectionIndex[hash & (mSectionIndexSize - 1)]; line; line = line->next_in_bucket)
+		if (line->hash == hash && line->name_length == aLength && !strnicmp(line->name, aName, aLength))
+			break;
+	return line;
+}
+
+
+
+IniLine *IniFile::FindKey(IniLine *aSection, char *aName, size_t aLength)
+{
+	UINT hash = KeyHash(aSection, aName, aLength);
+	IniLine *line;
+	for (line = mKeyIndex[hash & (mKeyIndexSize - 1)]; line; line = line->next_in_bucket)
+		if (line->hash == hash && line->section == aSection && line->name_length == aLength
+			&& !strnicmp(line->name, aName, aLength))
+			break;
+	return line;
+}
+
+
+
+IniLine *IniFile::NewLine(char *aPrefix, char *aName, char *aSeparator, char *aValue)
+// Returns a new line consisting of the four strings, or NULL if out of memory.  The caller must link it in.
+{
+	size_t length = strlen(aPrefix) + strlen(aName) + strlen(aSeparator) + strlen(aValue);
+	IniLine *line;
+	if (   !(line = (IniLine *)malloc(sizeof(IniLine) + length + 1))   ) // The text follows the struct.
+		return NULL;
+	line->text = (char *)(line + 1);
+	line->length = sprintf(line->text, "%s%s%s%s", aPrefix, aName, aSeparator, aValue);
+	line->allocated = true;
+	ParseLine(*line);
+	return line;
+}
+
+
+
+void IniFile::LinkAfter(IniLine *aAfter, IniLine *aLine)
+// Links aLine into the list of lines after aAfter, or at the beginning if aAfter is NULL.
+{
+	aLine->prev = aAfter;
+	aLine->next = aAfter ? aAfter->next : mFirstLine;
+	if (aLine->next)
+		aLine->next->prev = aLine;
+	else
+		mLastLine = aLine;
+	if (aAfter)
+		aAfter->next = aLine;
+	else
+		mFirstLine = aLine;
+}
+
+
+
+void IniFile::Unlink(IniLine *aLine)
+// Removes aLine from the list of lines and frees it.  The caller must take care of the indexes.
+{
+	if (aLine->prev)
+		aLine->prev->next = aLine->next;
+	else
+		mFirstLine = aLine->next;
+	if (aLine->next)
+		aLine->next->prev = aLine->prev;
+	else
+		mLastLine = aLine->prev;
+	if (aLine->allocated)
+		free(aLine);
+}
+
+
+
+bool IniFile::Apply(char *aSection, char *aKey, char *aValue)
+// Makes a change to the parsed copy (see IniOp).  Returns false if out of memory.
+{
+	IniLine *section = FindSection(aSection, strlen(aSection)), *line, *new_line, *last;
+	if (!aKey) // Delete the section.
+	{
+		if (!section)
+			return true;
+		for (last = section->section; ; ) // Its lines are those from its header to its last line.
+		{
+			line = last->prev;
+			Unlink(last);
+			if (last == section)
+				break;
+			last = line;
+		}
+		return BuildIndex(); // Rebuild rather than remove because a later section of the same name is now seen.
+	}
+	line = section ? FindKey(section, aKey, strlen(aKey)) : NULL;
+	if (!aValue) // Delete the key.
+	{
+		if (!line)
+			return true;
+		if (section->section == line) // It's the last line of its section.
+			section->section = line->prev;
+		Unlink(line);
+		return BuildIndex(); // Rebuild rather than remove because a later key of the same name is now seen.
+	}
+	if (!section) // Add the section at the end of the file.
+	{
+		if (   !(section = NewLine("[", aSection, "]", ""))   )
+			return false;
+		LinkAfter(mLastLine, section);
+		section->section = section;
+		if (!section->name) // aSection is something like "" that can't be a section name.  Keep the line anyway, like WritePrivateProfileString().
+			return true;
+		if (!IndexAdd(section))
+			return false;
+	}
+	if (   !(new_line = NewLine("", aKey, "=", aValue))   )
+		return false;
+	if (!new_line->name) // aKey is something like "" that can't be a key.  Keep the line anyway (see above).
+		new_line->value = NULL;
+	if (line) // Replace the key's line.
+	{
+		LinkAfter(line, new_line);
+		if (section->section == line)
+			section->section = new_line;
+		// The new line takes the old one's place in its bucket since their names are the same.
+		IniLine **link;
+		for (link = mKeyIndex + (line->hash & (mKeyIndexSize - 1)); *link != line; link = &(*link)->next_in_bucket);
+		*link = new_line;
+		new_line->next_in_bucket = line->next_in_bucket;
+		new_line->section = section;
+		new_line->hash = line->hash;
+		Unlink(line);
+		return true;
+	}
+	// Otherwise, add the key after the last line of the section that isn't blank, like WritePrivateProfileString().
+	for (last = section->section; last != section && IsBlank(*last); last = last->prev);
+	LinkAfter(last, new_line);
+	if (section->section == last)
+		section->section = new_line;
+	if (!new_line->value)
+		return true;
+	new_line->section = section;
+	return IndexAdd(new_line);
+}
+
+
+
+IniFile *IniFile::Open(char *aFilespec)
+// Returns the parsed copy of aFilespec, which needn't exist, or NULL upon failure.
+{
+	// As before (GetPrivateProfileString() needs a full path), the path is resolved against the working dir.
+	// This also lets the cache recognize a file no matter which relative path it's given by.
+	char path[MAX_PATH], *file_part;
+	DWORD length = GetFullPathName(aFilespec, MAX_PATH, path, &file_part);
+	if (!length || length >= MAX_PATH)
+		return NULL;
+	IniFile *file, **link;
+	for (link = &sIniFile; file = *link; link = &file->mNext)
+		if (!stricmp(file->mPath, path))
+		{
+			*link = file->mNext; // Unlink it so that it can be moved to the front below.
+			break;
+		}
+	if (!file)
+	{
+		if (   !(file = new IniFile(path))   )
+			return NULL;
+		++sIniFileCount;
+	}
+	file->mNext = sIniFile;
+	sIniFile = file;
+	if (sIniFileCount > INI_CACHE_MAX_FILES)
+	{
+		for (link = &sIniFile; (*link)->mNext; link = &(*link)->mNext); // Find the least recently used.
+		if ((*link)->Flush()) // Otherwise, keep it so that its changes aren't lost.
+		{
+			delete *link;
+			*link = NULL;
+			--sIniFileCount;
+		}
+	}
+	return file->Refresh() ? file : NULL;
+}
+
+
+
+char *IniFile::Read(char *aSection, char *aKey, size_t &aLength)
+// Returns the value of aKey (which isn't terminated) and sets aLength to its length, or returns NULL if
+// there's no such key.  Caller must have called Open() beforehand.
+{
+	IniLine *section, *key;
+	if (   !(section = FindSection(aSection, strlen(aSection)))
+		|| !(key = FindKey(section, aKey, strlen(aKey)))   )
+		return NULL;
+	aLength = key->value_length;
+	return key->value;
+}
+
+
+
+bool IniFile::Write(char *aSection, char *aKey, char *aValue)
+// Makes a change (see IniOp) and schedules the file to be written.  Returns false if the file can't be
+// written or out of memory, in which case nothing has changed.  Caller must have called Open() beforehand.
+{
+	IniLine *section;
+	if (!aValue && !(   (section = FindSection(aSection, strlen(aSection)))
+		&& (!aKey || FindKey(section, aKey, strlen(aKey)))   ))
+		return true; // There's nothing to delete, so don't touch the file.
+	if (!mFirstOp)
+	{
+		// Since writing is deferred, make sure now that the file can be written so that the failure can be
+		// reported.  This also creates the file if it doesn't exist, just as the deferred write would.
+		HANDLE file = CreateFile(mPath, GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		CloseHandle(file);
+		// Flush() also needs to create a temporary file in the same directory, which can fail even when the
+		// above succeeds (e.g. permission to change the file but not to add files to its directory):
+		char temp_path[MAX_PATH];
+		if (!CreateTempFile(temp_path))
+			return false;
+		DeleteFile(temp_path);
+		if (!Refresh()) // In case the above created the file.
+			return false;
+	}
+	size_t section_size = strlen(aSection) + 1, key_size = aKey ? strlen(aKey) + 1 : 0
+		, value_size = aValue ? strlen(aValue) + 1 : 0;
+	IniOp *op;
+	if (   !(op = (IniOp *)malloc(sizeof(IniOp) + section_size + key_size + value_size))   ) // The strings follow the struct.
+		return false;
+	op->next = NULL;
+	op->section = (char *)memcpy(op + 1, aSection, section_size);
+	op->key = aKey ? (char *)memcpy(op->section + section_size, aKey, key_size) : NULL;
+	op->value = aValue ? (char *)memcpy(op->section + section_size + key_size, aValue, value_size) : NULL;
+	if (!Apply(op->section, op->key, op->value))
+	{
+		free(op);
+		Unload(); // The change might have been partly made, so have the next Refresh() start over.
+		return false;
+	}
+	if (mLastOp)
+		mLastOp->next = op;
+	else
+		mFirstOp = op;
+	mLastOp = op;
+	if (!sIniChangesPending)
+	{
+		sIniChangesPending = true;
+		sIniChangesTick = GetTickCount();
+	}
+	return true;
+}
+
+
+
+bool IniFile::Flush()
+// Writes the script's changes to the file, if there are any.  Returns false upon failure, in which case
+// the changes are kept so that the next flush can try again.
+{
+	if (!mFirstOp)
+		return true;
+	if (!Refresh()) // In case something else has changed the file, apply the changes to its current contents.
+		return false;
+	size_t size = 0;
+	IniLine *line;
+	for (line = mFirstLine; line; line = line->next)
+		size += line->length + 2;
+	char *buf, *cp;
+	if (   !(buf = (char *)malloc(size + 1))   )
+		return false;
+	for (cp = buf, line = mFirstLine; line; line = line->next)
+	{
+		memcpy(cp, line->text, line->length);
+		cp += line->length;
+		*cp++ = '\r';
+		*cp++ = '\n';
+	}
+	// Write a temporary file in the same directory and then move it over the original, so that the file is
+	// never seen half-written nor lost if writing fails part way.
+	char temp_path[MAX_PATH];
+	bool success = CreateTempFile(temp_path);
+	if (success)
+	{
+		HANDLE file = CreateFile(temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		DWORD bytes_written;
+		success = file != INVALID_HANDLE_VALUE && WriteFile(file, buf, (DWORD)(cp - buf), &bytes_written, NULL)
+			&& bytes_written == (DWORD)(cp - buf);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		if (   !(success = success && MoveFileEx(temp_path, mPath, MOVEFILE_REPLACE_EXISTING))   )
+			DeleteFile(temp_path);
+	}
+	free(buf);
+	if (!success)
+		return false;
+	for (IniOp *next; mFirstOp; mFirstOp = next)
+	{
+		next = mFirstOp->next;
+		free(mFirstOp);
+	}
+	mLastOp = NULL;
+	// Remember the new version's timestamp so that Refresh() won't mistake this write for someone else's.
+	WIN32_FILE_ATTRIBUTE_DATA attrib;
+	if (GetFileAttributesEx(mPath, GetFileExInfoStandard, &attrib))
+	{
+		mExists = true;
+		mSize = ((ULONGLONG)attrib.nFileSizeHigh << 32) | attrib.nFileSizeLow;
+		mTime = attrib.ftLastWriteTime;
+	}
+	else
+		mLoaded = false; // Have the next Refresh() read it again.
+	return true;
+}
+
+
+
+bool IniFile::CreateTempFile(char *aTempPath)
+// Creates an empty file in the same directory as this one and stores its path in aTempPath, which must be
+// MAX_PATH in size.  Returns false upon failure.
+{
+	char dir[MAX_PATH], *last_backslash;
+	strcpy(dir, mPath);
+	if (last_backslash = strrchr(dir, '\\')) // Always true since mPath is a full path.
+		last_backslash[1] = '\0'; // Keep the backslash, since "C:" rather than "C:\" would mean the drive's current directory.
+	return GetTempFileName(dir, "ini", 0, aTempPath) != 0;
+}
+
+
+
+void IniFlushAll()
+// Writes the changes the script has made to INI files (see IniFile).  This is called when the script is
+// about to go idle, run a program, use a file command or exit.
+{
+	if (!sIniChangesPending)
+		return;
+	sIniChangesPending = false;
+	for (IniFile *file = sIniFile; file; file = file->mNext)
+		if (!file->Flush())
+		{
+			sIniChangesPending = true; // Try again next time.
+			sIniChangesTick = GetTickCount(); // But not until another interval has passed, for a busy script.
+		}
+}
+
+
+
+void IniFlushIfDue(DWORD aTickNow)
+// Called periodically while the script is busy (see LONG_OPERATION_UPDATE) so that its changes to INI files
+// don't go unwritten for long just because it never goes idle.
+{
+	if (sIniChangesPending && aTickNow - sIniChangesTick >= INI_FLUSH_INTERVAL)
+		IniFlushAll();
+}
+
+
+
 ResultType Line::IniRead(char *aFilespec, char *aSection, char *aKey, char *aDefault)
-{
-    /*
+{
 	if (!aDefault || !*aDefault)
 		aDefault = "ERROR";  // This mirrors what AutoIt2 does for its default value.
-	char	szFileTemp[_MAX_PATH+1];
-	char	*szFilePart;
-	char	szBuffer[65535] = "";					// Max ini file size is 65535 under 95
-	// Get the fullpathname (ini functions need a full path):
-	GetFullPathName(aFilespec, _MAX_PATH, szFileTemp, &szFilePart);
-	GetPrivateProfileString(aSection, aKey, aDefault, szBuffer, sizeof(szBuffer), szFileTemp);
-	// The above function is supposed to set szBuffer to be aDefault if it can't find the
-	// file, section, or key.  In other words, it always changes the contents of szBuffer.
-	return OUTPUT_VAR->Assign(szBuffer); // Avoid using the length the API reported because it might be inaccurate if the data contains any binary zeroes, or if the data is double-terminated, etc.
+	IniFile *file = IniFile::Open(aFilespec);
+	size_t length;
+	char *value = file ? file->Read(aSection, aKey, length) : NULL;
+	return value ? OUTPUT_VAR->Assign(value, (VarSizeType)length) : OUTPUT_VAR->Assign(aDefault);
 	// Note: ErrorLevel is not changed by this command since the aDefault value is returned
 	// whenever there's an error.
-*/
 }
 
 
 
 ResultType Line::IniWrite(char *aValue, char *aFilespec, char *aSection, char *aKey)
-{
-    /*
-	char	szFileTemp[_MAX_PATH+1];
-	char	*szFilePart;
-	// Get the fullpathname (ini functions need a full path)
-	GetFullPathName(aFilespec, _MAX_PATH, szFileTemp, &szFilePart);
-	BOOL result = WritePrivateProfileString(aSection, aKey, aValue, szFileTemp);  // Returns zero on failure.
-	WritePrivateProfileString(NULL, NULL, NULL, szFileTemp);	// Flush
+{
+	IniFile *file = IniFile::Open(aFilespec);
+	bool result = file && file->Write(aSection, aKey, aValue);
 	return g_script.mIsAutoIt2 ? OK : g_ErrorLevel->Assign(result ? ERRORLEVEL_NONE : ERRORLEVEL_ERROR);
-*/
 }
 
 
 
 ResultType Line::IniDelete(char *aFilespec, char *aSection, char *aKey)
 // Note that aKey can be NULL, in which case the entire section will be deleted.
-{
-    /*
-	char	szFileTemp[_MAX_PATH+1];
-	char	*szFilePart;
-	// Get the fullpathname (ini functions need a full path)
-	GetFullPathName(aFilespec, _MAX_PATH, szFileTemp, &szFilePart);
-	BOOL result = WritePrivateProfileString(aSection, aKey, NULL, szFileTemp);  // Returns zero on failure.
-	WritePrivateProfileString(NULL, NULL, NULL, szFileTemp);	// Flush
+{
+	IniFile *file = IniFile::Open(aFilespec);
+	bool result = file && file->Write(aSection, aKey, NULL);
 	return g_script.mIsAutoIt2 ? OK : g_ErrorLevel->Assign(result ? ERRORLEVEL_NONE : ERRORLEVEL_ERROR);
-*/
 }
 
 
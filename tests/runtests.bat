@@ -0,0 +1,19 @@
+@echo off
+rem Runs each test_*.ahk in this directory and reports the ones that fail.  Each test exits with the number
+rem of its checks that failed (see testlib.ahk).  The first parameter overrides the interpreter to use.
+setlocal
+set ahk=%1
+if "%ahk%"=="" set ahk=..\bin\ahkmingw.exe
+set failed=0
+for %%t in (test_*.ahk) do (
+	"%ahk%" /ErrorStdOut %%t
+	if errorlevel 1 (
+		echo FAILED: %%t
+		set /a failed+=1
+	) else echo passed: %%t
+)
+if not %failed%==0 (
+	echo %failed% test^(s^) failed.
+	exit /b 1
+)
+echo All tests passed.
@@ -19,6 +19,9 @@ GNU General Public License for more details.
 #include "msc_headers/GdiPlus.h" // Used by LoadPicture().
 #include "util.h"
 #include "globaldata.h"
+#ifdef __SSE2__
+	#include <emmintrin.h> // For StrSearchFind().
+#endif
 
 
 int GetYDay(int aMon, int aDay, bool aIsLeapYear)
@@ -842,6 +845,107 @@ ret0:
 
 
 
+void StrSearchInit(StrSearch &aSearch, char *aNeedle, size_t aNeedleLength, StringCaseSenseType aStringCaseSense)
+// Prepares aSearch for finding aNeedle (which must not be empty) via StrSearchFind().  Matches are the same
+// as those of strstr(), strcasestr() and lstrcasestr() for the respective modes.
+{
+	static UCHAR sFold[2][256]; // [0] is for SCS_INSENSITIVE and [1] for SCS_INSENSITIVE_LOCALE.
+	static bool sFoldReady[2] = {false, false}; // Each table is built upon first use because the locale one costs 256 calls to CharLower().
+	aSearch.needle = (UCHAR *)aNeedle;
+	aSearch.needle_length = aNeedleLength;
+	UCHAR c1 = aSearch.needle[0], c2 = aNeedleLength > 1 ? aSearch.needle[1] : 0;
+	if (aStringCaseSense == SCS_SENSITIVE)
+	{
+		aSearch.fold = NULL; // Indicates that memchr()/memcmp() can be used.
+		aSearch.first[0] = aSearch.first[1] = c1;
+		aSearch.second[0] = aSearch.second[1] = c2;
+		return;
+	}
+	bool locale = (aStringCaseSense == SCS_INSENSITIVE_LOCALE);
+	UCHAR *fold = sFold[locale];
+	if (!sFoldReady[locale])
+	{
+		for (int c = 0; c < 256; ++c)
+			fold[c] = locale ? (UCHAR)(size_t)ltolower(c) : (UCHAR)tolower(c);
+		sFoldReady[locale] = true;
+	}
+	aSearch.fold = fold;
+	// As in strcasestr() and lstrcasestr(), a haystack char matches one of the needle's first two chars only
+	// if it's that char's lowercase or uppercase form:
+	aSearch.first[0] = fold[c1];
+	aSearch.first[1] = locale ? (UCHAR)(size_t)ltoupper(fold[c1]) : (UCHAR)toupper(fold[c1]);
+	aSearch.second[0] = fold[c2];
+	aSearch.second[1] = locale ? (UCHAR)(size_t)ltoupper(fold[c2]) : (UCHAR)toupper(fold[c2]);
+}
+
+
+
+inline bool StrSearchRestMatches(StrSearch &aSearch, UCHAR *aPos)
+// Returns true if the needle's third and subsequent chars match those at aPos+2.  Caller has ensured that
+// the needle's first two chars match and that the haystack has room for the whole needle at aPos.
+{
+	if (aSearch.needle_length < 3)
+		return true;
+	if (!aSearch.fold)
+		return !memcmp(aPos + 2, aSearch.needle + 2, aSearch.needle_length - 2);
+	UCHAR *fold = aSearch.fold, *needle = aSearch.needle + 2, *needle_end = aSearch.needle + aSearch.needle_length;
+	for (aPos += 2; needle < needle_end; ++needle, ++aPos)
+		if (fold[*aPos] != fold[*needle])
+			return false;
+	return true;
+}
+
+
+
+char *StrSearchFind(StrSearch &aSearch, char *aHaystack, char *aHaystackEnd)
+// Returns the first occurrence of aSearch's needle in aHaystack, or NULL if there isn't one.  aHaystackEnd
+// is the position of aHaystack's terminator.  Knowing it in advance allows the search to examine many
+// positions at once rather than stopping at each char to check for the terminator.
+{
+	if ((size_t)(aHaystackEnd - aHaystack) < aSearch.needle_length)
+		return NULL;
+	UCHAR *cp = (UCHAR *)aHaystack;
+	UCHAR *last = (UCHAR *)aHaystackEnd - aSearch.needle_length; // The last position at which a match could start.
+	UCHAR f0 = aSearch.first[0], f1 = aSearch.first[1], s0 = aSearch.second[0], s1 = aSearch.second[1];
+#ifdef __SSE2__
+	if (aSearch.needle_length > 1)
+	{
+		// Check 16 positions at a time for both of the needle's first two chars, which rules out nearly
+		// every position without looking at it individually.  Each block reads one char beyond its last
+		// position, which is still within the haystack because the needle is at least two chars long.
+		__m128i first0 = _mm_set1_epi8((char)f0), first1 = _mm_set1_epi8((char)f1)
+			, second0 = _mm_set1_epi8((char)s0), second1 = _mm_set1_epi8((char)s1), block1, block2;
+		int mask;
+		for (; last - cp >= 15; cp += 16)
+		{
+			block1 = _mm_loadu_si128((__m128i *)cp);
+			block2 = _mm_loadu_si128((__m128i *)(cp + 1));
+			mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(block1, first0), _mm_cmpeq_epi8(block1, first1))
+				, _mm_or_si128(_mm_cmpeq_epi8(block2, second0), _mm_cmpeq_epi8(block2, second1))));
+			for (; mask; mask &= mask - 1) // For each candidate, lowest position first.
+				if (StrSearchRestMatches(aSearch, cp + __builtin_ctz(mask)))
+					return (char *)cp + __builtin_ctz(mask);
+		}
+	}
+#endif
+	// Check the remaining positions (or all of them if the above wasn't compiled in) one at a time:
+	if (!aSearch.fold) // Case-sensitive, so memchr() can find candidates for the first char.
+	{
+		for (; cp <= last && (cp = (UCHAR *)memchr(cp, f0, last - cp + 1)); ++cp)
+			if (aSearch.needle_length == 1 || cp[1] == s0 && StrSearchRestMatches(aSearch, cp))
+				return (char *)cp;
+		return NULL;
+	}
+	for (; cp <= last; ++cp)
+		if ((*cp == f0 || *cp == f1)
+			&& (aSearch.needle_length == 1 || (cp[1] == s0 || cp[1] == s1) && StrSearchRestMatches(aSearch, cp)))
+			return (char *)cp;
+	return NULL;
+}
+
+
+
 UINT StrReplace(char *aHaystack, char *aOld, char *aNew, StringCaseSenseType aStringCaseSense
 	, UINT aLimit, size_t aSizeLimit, char **aDest, size_t *aHaystackLength)
 // Replaces all (or aLimit) occurrences of aOld with aNew in aHaystack.
@@ -912,6 +1016,9 @@ UINT StrReplace(char *aHaystack, char *aOld, char *aNew, StringCaseSenseType aSt
 	size_t aOld_length = strlen(aOld);
 	size_t aNew_length = strlen(aNew);
 	int length_delta = (int)(aNew_length - aOld_length); // Cast to int to avoid loss of unsigned. A negative delta means the replacment substring is smaller than what it's replacing.
+	StrSearch search; // Prepared once here rather than by each call to strstr2() in the loops below.
+	StrSearchInit(search, aOld, aOld_length, aStringCaseSense);
+	char *haystack_end = aHaystack + haystack_length; // Used only by the extra-memory method because the in-place method changes haystack's length.
 
 	if (aSizeLimit != -1) // Caller provided a size *restriction*, so if necessary reduce aLimit to stay within bounds.  Compare directly to -1 due to unsigned.
 	{
@@ -955,12 +1062,23 @@ UINT StrReplace(char *aHaystack, char *aOld, char *aNew, StringCaseSenseType aSt
 	}
 
 	// Other variables used by the replacement loop:
-	size_t haystack_portion_length, new_result_length;
+	size_t haystack_portion_length, new_result_length, new_result_size;
 	UINT replacement_count;
+	size_t result_size_bound;
+
+	// The size of the result is known in advance when it can't be longer than haystack, or when only a few
+	// replacements are allowed (such as the default of one for StringReplace).  In those cases, allocating
+	// that size upon the first match avoids any further reallocs.  Otherwise it must be predicted:
+	if (length_delta <= 0)
+		result_size_bound = haystack_length + 1;
+	else if (aLimit <= 64)
+		result_size_bound = haystack_length + aLimit * length_delta + 1;
+	else
+		result_size_bound = 0; // Unknown.
 
 	// Perform the replacement:
 	for (replacement_count = 0, src = aHaystack
-		; aLimit && (match_pos = strstr2(src, aOld, aStringCaseSense));) // Relies on short-circuit boolean order.
+		; aLimit && (match_pos = StrSearchFind(search, src, haystack_end));) // Relies on short-circuit boolean order.
 	{
 		++replacement_count;
 		--aLimit;
@@ -969,8 +1087,21 @@ UINT StrReplace(char *aHaystack, char *aOld, char *aNew, StringCaseSenseType aSt
 		// Using the required length calculated below, expand/realloc "result" if necessary.
 		new_result_length = result_length + haystack_portion_length + aNew_length;
 		if (new_result_length >= result_size) // Uses >= to allow room for terminator.
-			STRREPLACE_REALLOC(PredictReplacementSize(length_delta, replacement_count, aLimit, (int)haystack_length
-				, (int)new_result_length, (int)(match_pos - aHaystack))); // This will return if an alloc error occurs.
+		{
+			if (result_size_bound)
+				new_result_size = result_size_bound;
+			else
+			{
+				new_result_size = PredictReplacementSize(length_delta, replacement_count, aLimit, (int)haystack_length
+					, (int)new_result_length, (int)(match_pos - aHaystack));
+				// Grow by at least half each time so that a series of low predictions (e.g. when most of the
+				// matches are near the end of haystack) can't make the number of reallocs proportional to the
+				// number of matches:
+				if (new_result_size < result_size + result_size / 2)
+					new_result_size = result_size + result_size / 2;
+			}
+			STRREPLACE_REALLOC(new_result_size); // This will return if an alloc error occurs.
+		}
 
 		// Now that we know "result" has enough capacity, put the new text into it.  The first step
 		// is to copy over the part of haystack that appears before the match.
@@ -1048,7 +1179,7 @@ in_place_method:
 	//for ( ; ptr = StrReplace(aHaystack, aOld, aNew, aStringCaseSense); ); // Note that this very different from the below.
 
 	for (replacement_count = 0, src = aHaystack
-		; aLimit && (match_pos = strstr2(src, aOld, aStringCaseSense)) // Relies on short-circuit boolean order.
+		; aLimit && (match_pos = StrSearchFind(search, src, aHaystack + haystack_length)) // Relies on short-circuit boolean order.
 		; --aLimit, ++replacement_count)
 	{
 		src = match_pos + aNew_length;  // The next search should start at this position when all is adjusted below.
@@ -1386,6 +1517,24 @@ char *FileAttribToStr(char *aBuf, DWORD aAttr)
 
 
 
+__int64 GetTickCount64Ext()
+// Returns GetTickCount() widened to 64 bits so that tick values can be compared directly (e.g. ordered
+// in the script-timer heap) without worrying about the 49.7-day rollover.  The low 32 bits are always
+// identical to what GetTickCount() returned, so callers may cast the result to DWORD to get that value.
+// This detects a rollover only if it is called at least once every 49.7 days, which is always the case
+// while any script timer is enabled (the only time the result matters).
+{
+	static DWORD sLastTick = 0;
+	static __int64 sHighPart = 0;
+	DWORD tick = GetTickCount();
+	if (tick < sLastTick)
+		sHighPart += (__int64)1 << 32;
+	sLastTick = tick;
+	return sHighPart + tick;
+}
+
+
+
 unsigned __int64 GetFileSize64(HANDLE aFileHandle)
 // Returns ULLONG_MAX on failure.  Otherwise, it returns the actual file size.
 {
@@ -2315,3 +2464,94 @@ bool IsStringInList(char *aStr, char *aList, bool aFindExactMatch)
 
 	return false;  // No match found.
 }
+
+
+
+UINT NameHashTable::Hash(char *aName, size_t aLength)
+// FNV-1a of the name with A-Z folded to lowercase.
+{
+	UINT hash = 2166136261U;
+	for (char *cp = aName, *end = aName + aLength; cp < end; ++cp)
+		hash = (hash ^ (UCHAR)(*cp >= 'A' && *cp <= 'Z' ? *cp + ('a' - 'A') : *cp)) * 16777619U;
+	return hash;
+}
+
+
+
+void *NameHashTable::Find(char *aName, size_t aLength)
+// Returns the item added under aName, or NULL if none.  aName need not be terminated if aLength is
+// specified (it's -1 by default, in which case strlen() is used).
+{
+	if (!mCount)
+		return NULL;
+	if (aLength == -1) // Compare directly to -1 since it's unsigned.
+		aLength = strlen(aName);
+	UINT hash = Hash(aName, aLength);
+	NameHashEntry *entry;
+	for (UINT i = hash & (mSize - 1);; i = (i + 1) & (mSize - 1)) // Always terminates because Expand() keeps at least a quarter of the slots empty.
+	{
+		entry = mEntry + i;
+		if (!entry->name)
+			return NULL;
+		if (entry->hash == hash && !strnicmp(entry->name, aName, aLength) && !entry->name[aLength])
+			return entry->item;
+	}
+}
+
+
+
+bool NameHashTable::Add(char *aName, void *aItem)
+// Returns true on success or false if out of memory.  If aName is already in the table, the table is
+// left unchanged (still returning true) so that Find() always yields the first item added under a given
+// name.  This matches the traditional behavior of searching a linked list from its beginning.
+{
+	if ((mCount + 1) * 4 > mSize * 3 && !Expand()) // Keep the load factor at or below 3/4.
+		return false;
+	size_t length = strlen(aName);
+	UINT hash = Hash(aName, length);
+	NameHashEntry *entry;
+	for (UINT i = hash & (mSize - 1);; i = (i + 1) & (mSize - 1))
+	{
+		entry = mEntry + i;
+		if (!entry->name)
+			break;
+		if (entry->hash == hash && !stricmp(entry->name, aName))
+			return true; // Keep the existing item, as described above.
+	}
+	entry->name = aName;
+	entry->item = aItem;
+	entry->hash = hash;
+	++mCount;
+	return true;
+}
+
+
+
+bool NameHashTable::Expand()
+{
+	UINT new_size = mSize ? mSize * 2 : 64;
+	NameHashEntry *new_entry;
+	if (   !(new_entry = (NameHashEntry *)calloc(new_size, sizeof(NameHashEntry)))   )
+		return false;
+	for (UINT i = 0, j; i < mSize; ++i)
+	{
+		if (!mEntry[i].name)
+			continue;
+		for (j = mEntry[i].hash & (new_size - 1); new_entry[j].name; j = (j + 1) & (new_size - 1));
+		new_entry[j] = mEntry[i]; // Struct copy.
+	}
+	free(mEntry);
+	mEntry = new_entry;
+	mSize = new_size;
+	return true;
+}
+
+
+
+void NameHashTable::RemoveAll()
+{
+	free(mEntry);
+	mEntry = NULL;
+	mSize = 0;
+	mCount = 0;
+}
@@ -90,6 +90,26 @@ inline char *StrChrAny(char *aStr, char *aCharList)
 
 
 
+struct CharSet
+// A 256-bit membership table for a list of chars, for callers such as parsing loops that would otherwise
+// rescan a delimiter or omit list (via StrChrAny() or omit_leading_any()) for every char of a long string.
+// The terminator is never a member, so scanning for members also stops at the end of the string.
+{
+	UINT mBits[8];
+	CharSet(char *aCharList)
+	{
+		ZeroMemory(mBits, sizeof(mBits));
+		for (; *aCharList; ++aCharList)
+			mBits[(UCHAR)*aCharList >> 5] |= 1 << ((UCHAR)*aCharList & 31);
+	}
+	bool Has(char aChar)
+	{
+		return (mBits[(UCHAR)aChar >> 5] & (1 << ((UCHAR)aChar & 31))) != 0;
+	}
+};
+
+
+
 inline char *omit_leading_whitespace(char *aBuf) // 10/17/2006: __forceinline didn't help significantly.
 // While aBuf points to a whitespace, moves to the right and returns the first non-whitespace
 // encountered.
@@ -535,6 +555,7 @@ char *FileTimeToYYYYMMDD(char *aBuf, FILETIME &aTime, bool aConvertToLocalTime =
 char *SystemTimeToYYYYMMDD(char *aBuf, SYSTEMTIME &aTime);
 __int64 YYYYMMDDSecondsUntil(char *aYYYYMMDDStart, char *aYYYYMMDDEnd, bool &aFailed);
 __int64 FileTimeSecondsUntil(FILETIME *pftStart, FILETIME *pftEnd);
+__int64 GetTickCount64Ext();
 
 SymbolType IsPureNumeric(char *aBuf, BOOL aAllowNegative = false // BOOL vs. bool might squeeze a little more performance out of this frequently-called function.
 	, BOOL aAllowAllWhitespace = true, BOOL aAllowFloat = false, BOOL aAllowImpure = false);
@@ -548,6 +569,16 @@ int strlicmp(char *aBuf1, char *aBuf2, UINT aLength1 = UINT_MAX, UINT aLength2 =
 char *strrstr(char *aStr, char *aPattern, StringCaseSenseType aStringCaseSense, int aOccurrence = 1);
 char *lstrcasestr(const char *phaystack, const char *pneedle);
 char *strcasestr (const char *phaystack, const char *pneedle);
+struct StrSearch
+// A needle prepared by StrSearchInit() for repeated searches via StrSearchFind().
+{
+	UCHAR *needle;
+	size_t needle_length;
+	UCHAR *fold;                 // Maps each char to the form in which it's compared, or NULL when case-sensitive.
+	UCHAR first[2], second[2];   // The lowercase and uppercase forms of the needle's first and second chars.
+};
+void StrSearchInit(StrSearch &aSearch, char *aNeedle, size_t aNeedleLength, StringCaseSenseType aStringCaseSense);
+char *StrSearchFind(StrSearch &aSearch, char *aHaystack, char *aHaystackEnd);
 UINT StrReplace(char *aHaystack, char *aOld, char *aNew, StringCaseSenseType aStringCaseSense
 	, UINT aLimit = UINT_MAX, size_t aSizeLimit = -1, char **aDest = NULL, size_t *aHaystackLength = NULL);
 int PredictReplacementSize(int aLengthDelta, int aReplacementCount, int aLimit, int aHaystackLength
@@ -583,4 +614,36 @@ HBITMAP IconToBitmap(HICON ahIcon, bool aDestroyIcon);
 int CALLBACK FontEnumProc(ENUMLOGFONTEX *lpelfe, NEWTEXTMETRICEX *lpntme, DWORD FontType, LPARAM lParam);
 bool IsStringInList(char *aStr, char *aList, bool aFindExactMatch);
 
+
+
+class NameHashTable
+// A case-insensitive index of names such as those of labels and functions, which allows them to be
+// found without a linear search of their linked lists.  It's an open-addressing hash table that uses
+// linear probing.  Case-insensitivity is the same as that of stricmp(), i.e. only A-Z are folded,
+// which keeps it consistent with the linear searches it replaces.
+// The name passed to Add() is not copied, so it must persist for as long as it's in the table
+// (e.g. a name in SimpleHeap memory).
+{
+private:
+	struct NameHashEntry
+	{
+		char *name; // NULL means this slot is empty.
+		void *item;
+		UINT hash;  // Kept to avoid recalculating it when the table is expanded, and to avoid most stricmp() calls.
+	};
+	NameHashEntry *mEntry;
+	UINT mSize;  // Number of slots in mEntry: zero or a power of two.
+	UINT mCount; // Number of slots in use.
+	bool Expand();
+
+public:
+	static UINT Hash(char *aName, size_t aLength);
+	void *Find(char *aName, size_t aLength = -1);
+	bool Add(char *aName, void *aItem);
+	void RemoveAll();
+	UINT Count() {return mCount;}
+	NameHashTable() : mEntry(NULL), mSize(0), mCount(0) {}
+	~NameHashTable() {free(mEntry);}
+};
+
 #endif
@@ -21,6 +21,8 @@ GNU General Public License for more details.
 
 // Init static vars:
 char Var::sEmptyString[] = ""; // For explanation, see its declaration in .h file.
+VarPin *Var::sPins = NULL;
+VarFrameBlock *Var::sFrameBlock = NULL;
 
 
 ResultType Var::AssignHWND(HWND aWnd)
@@ -44,19 +46,14 @@ ResultType Var::AssignHWND(HWND aWnd)
 ResultType Var::Assign(DWORD aValueToAssign) // For some reason, this function is actually faster when not inline.
 // Returns OK or FAIL.
 {
-	char value_string[256];
-	return Assign(UTOA(aValueToAssign, value_string));
+	return Assign((__int64)aValueToAssign); // Formats the same as UTOA() would, but lets the number be cached.
 }
 
 
 
 ResultType Var::Assign(int aValueToAssign) // For some reason, this function is actually faster when not inline.
 {
-	char value_string[256];
-	// ITOA() seems to perform quite a bit better than sprintf() in this case:
-	return Assign(ITOA(aValueToAssign, value_string));
-	//snprintf(value_string, sizeof(value_string), "%d", aValueToAssign);
-	//return Assign(value_string);
+	return Assign((__int64)aValueToAssign); // Formats the same as ITOA() would, but lets the number be cached.
 }
 
 
@@ -64,8 +61,29 @@ ResultType Var::Assign(int aValueToAssign) // For some reason, this function is
 ResultType Var::Assign(__int64 aValueToAssign) // For some reason, this function is actually faster when not inline.
 // Returns OK or FAIL.
 {
-	char value_string[256];
-	return Assign(ITOA64(aValueToAssign, value_string));
+	if (mType == VAR_ALIAS) // For simplicity and reduced code size, just make a recursive call to self.
+		return mAliasFor->Assign(aValueToAssign);
+	if (mType != VAR_NORMAL || (mAttrib & VAR_ATTRIB_CACHE_DISABLED) || g.FormatIntAsHex && !g.FormatIntegerFast)
+	{
+		char value_string[256];
+		if (!Assign(ITOA64(aValueToAssign, value_string)))
+			return FAIL;
+		if (mType == VAR_NORMAL && !(mAttrib & VAR_ATTRIB_CACHE_DISABLED)) // Hex contents still read back as this same number.
+		{
+			mContentsInt64 = aValueToAssign;
+			mAttrib |= VAR_ATTRIB_HAS_VALID_INT64;
+		}
+		return OK;
+	}
+	// Otherwise, store only the number and put off formatting it until something needs the text (if ever).
+	// Without SetFormat IntegerFast, this is done only for decimal so that the text never depends on when
+	// it happens to be needed.  With it, the text is in whichever format is in effect at that time (see
+	// UpdateContents()), just as SetFormat FloatFast does for floats.
+	DetachIfPinned(false); // A parsing loop that is reading the old contents keeps them.
+	mAttrib &= ~VAR_ATTRIB_BINARY_CLIP;
+	mContentsInt64 = aValueToAssign;
+	mAttrib |= VAR_ATTRIB_HAS_VALID_INT64 | VAR_ATTRIB_CONTENTS_OUT_OF_DATE;
+	return OK;
 }
 
 
@@ -88,9 +106,24 @@ ResultType Var::Assign(double aValueToAssign)
 // digits/formatting/precision is consistent throughout the program.
 // Returns OK or FAIL.
 {
-	char value_string[MAX_FORMATTED_NUMBER_LENGTH + 1];
-	return Assign(value_string
-		, snprintf(value_string, sizeof(value_string), g.FormatFloat, aValueToAssign)); // "%0.6f"; %f can handle doubles in MSVC++.);
+	if (mType == VAR_ALIAS) // For simplicity and reduced code size, just make a recursive call to self.
+		return mAliasFor->Assign(aValueToAssign);
+	if (mType != VAR_NORMAL || (mAttrib & VAR_ATTRIB_CACHE_DISABLED) || !g.FormatFloatFast)
+	{
+		// Unlike an integer, the double isn't cached here because the formatted text might not read back as
+		// the same number (or even as a float, e.g. "SetFormat, Float, 0.0").  ExpandExpression() caches
+		// whatever the text does read back as the first time it's used.
+		char value_string[MAX_FORMATTED_NUMBER_LENGTH + 1];
+		return Assign(value_string
+			, snprintf(value_string, sizeof(value_string), g.FormatFloat, aValueToAssign)); // "%0.6f"; %f can handle doubles in MSVC++.);
+	}
+	// Otherwise, SetFormat FloatFast is in effect: keep the full-precision number and format it only when
+	// something needs the text (using the SetFormat in effect at that time).
+	DetachIfPinned(false); // A parsing loop that is reading the old contents keeps them.
+	mAttrib &= ~VAR_ATTRIB_BINARY_CLIP;
+	mContentsDouble = aValueToAssign;
+	mAttrib |= VAR_ATTRIB_HAS_VALID_DOUBLE | VAR_ATTRIB_CONTENTS_OUT_OF_DATE;
+	return OK;
 }
 
 
@@ -110,6 +143,9 @@ ResultType Var::Assign(ExprTokenType &aToken)
 		// Below: Caller has ensured that aToken.var's Type() is always VAR_NORMAL.
 		// Below also relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
 		Var &source_var = *(aToken.var->mType == VAR_ALIAS ? aToken.var->mAliasFor : aToken.var);
+		if (source_var.mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE) // Copy the number rather than formatting it only to copy the text.
+			return (source_var.mAttrib & VAR_ATTRIB_HAS_VALID_INT64)
+				? Assign(source_var.mContentsInt64) : Assign(source_var.mContentsDouble);
 		return (source_var.mAttrib & VAR_ATTRIB_BINARY_CLIP) // Caller has ensured that source_var's Type() is VAR_NORMAL.
 			? AssignBinaryClip(source_var) // Caller wants a variable with binary contents assigned (copied) to another variable (usually VAR_CLIPBOARD).
 			: Assign(source_var.mContents, source_var.mLength); // Pass length to improve performance.
@@ -449,12 +485,16 @@ ResultType Var::Assign(char *aBuf, VarSizeType aLength, bool aExactSize, bool aO
 		return OK;
 	}
 
+	// If a parsing loop is reading the current contents in place, let it keep them and start over with no
+	// memory (aBuf might point into the old contents, but they stay valid until the loop ends):
+	DetachIfPinned(false);
+
 	// The below is done regardless of whether the section that follows it fails and returns early because
 	// it's the correct thing to do in all cases.
 	// For simplicity, this is done unconditionally even though it should be needed only
 	// when do_assign is true. It's the caller's responsibility to turn on the binary-clip
 	// attribute (if appropriate) by calling Var::Close() with the right option.
-	mAttrib &= ~VAR_ATTRIB_BINARY_CLIP;
+	mAttrib &= ~(VAR_ATTRIB_BINARY_CLIP | VAR_ATTRIB_CACHE);
 	// HOWEVER, other things like making mLength 0 and mContents blank are not done here for performance
 	// reasons (it seems too rare that early return/failure will occur below, since it's only due to
 	// out-of-memory... and even if it does happen, there a probably no consequences to leaving the variable
@@ -522,6 +562,11 @@ ResultType Var::Assign(char *aBuf, VarSizeType aLength, bool aExactSize, bool aO
 					new_size = (size_t)(new_size * 1.01);
 				else  // 6400 KB or more: Cap the extra margin at some reasonable compromise of speed vs. mem usage: 64 KB
 					new_size += (64 * 1024);
+				// A var that is being built up by concatenation (e.g. x := y . x, which can't append in place)
+				// would otherwise be reallocated and copied every few iterations, which is
+				// quadratic.  So double its capacity instead:
+				if ((mAttrib & VAR_ATTRIB_APPEND_HOT) && new_size < (size_t)mCapacity * 2)
+					new_size = (size_t)mCapacity * 2;
 				if (new_size > g_MaxVarCapacity && aObeyMaxMem) // v1.0.43.03: aObeyMaxMem was added since some callers aren't supposed to obey it.
 					new_size = g_MaxVarCapacity;  // which has already been verified to be enough.
 			}
@@ -612,6 +657,8 @@ VarSizeType Var::Get(char *aBuf)
 	switch(mType)
 	{
 	case VAR_NORMAL: // Listed first for performance.
+		if (mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)
+			UpdateContents();
 		if (!g_NoEnv && !mLength) // If auto-env retrival is on and the var is empty, check to see if it's really an env. var.
 		{
 			// Regardless of whether aBuf is NULL or not, we don't know at this stage
@@ -770,7 +817,9 @@ void Var::Free(int aWhenToFree, bool aExcludeAliases)
 	if (aWhenToFree == VAR_ALWAYS_FREE_BUT_EXCLUDE_STATIC && (mAttrib & VAR_ATTRIB_STATIC))
 		return; // This is the only case in which the variable ISN'T made blank.
 
+	DetachIfPinned(false); // The contents are about to be blanked or freed, so there's no need to copy them.
 	mLength = 0; // Writing to union is safe because above already ensured that "this" isn't an alias.
+	mAttrib &= ~VAR_ATTRIB_APPEND_HOT; // Whatever is assigned next starts over at normal growth.  VarSetCapacity(Var, 0) relies on this to give back the memory of a var that grew geometrically.
 	mAttrib &= ~VAR_ATTRIB_BINARY_CLIP; // Even if it isn't free'd, variable will be made blank. So it seems proper to always remove the binary_clip attribute (since it can't be used that way after it's been made blank).
 
 	switch (mHowAllocated)
@@ -847,10 +896,12 @@ void Var::Free(int aWhenToFree, bool aExcludeAliases)
 
 
 ResultType Var::AppendIfRoom(char *aStr, VarSizeType aLength)
-// Returns OK if there's room enough to append aStr and it succeeds.
-// Returns FAIL otherwise (also returns FAIL for VAR_CLIPBOARD).
+// Returns OK if aStr was appended, growing the variable's memory if necessary (see GrowForAppend).
+// Returns FAIL otherwise (also returns FAIL for VAR_CLIPBOARD), in which case the caller should fall back
+// to a normal concatenation, which reports any error.
 // Environment variables aren't supported here; instead, aStr is appended directly onto the actual/internal
-// contents of the "this" variable.
+// contents of the "this" variable.  For that reason, an empty variable isn't grown (in case it's the name
+// of an environment variable).
 {
 	// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()):
 	Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
@@ -861,14 +912,74 @@ ResultType Var::AppendIfRoom(char *aStr, VarSizeType aLength)
 	VarSizeType var_length = LengthIgnoreBinaryClip(); // Get the apparent length because one caller is a concat that wants consistent behavior of the .= operator regardless of whether this shortcut succeeds or not.
 	VarSizeType new_length = var_length + aLength;
 	if (new_length >= var.mCapacity) // Not enough room.
-		return FAIL;
+	{
+		if (!var_length)
+			return FAIL;
+		// aStr might point into the old contents (e.g. x .= x), which might be moved below.
+		bool str_is_in_var = aStr >= var.mContents && aStr < var.mContents + var.mCapacity;
+		size_t str_offset = aStr - var.mContents;
+		char *old_contents = var.mContents;
+		if (!var.GrowForAppend(var_length, new_length + 1))
+			return FAIL;
+		if (str_is_in_var && var.mContents != old_contents)
+			aStr = var.mContents + str_offset;
+	}
+	else
+	{
+		var.DetachIfPinned(); // aStr might point into the old contents, which remain valid.
+		if (new_length >= var.mCapacity) // Above ran out of memory.
+			return FAIL;
+	}
 	memmove(var.mContents + var_length, aStr, aLength);  // memmove() vs. memcpy() in case there's any overlap between source and dest.
 	var.mContents[new_length] = '\0'; // Terminate it as a separate step in case caller passed a length shorter than the apparent length of aStr.
 	var.mLength = new_length;
 	// If this is a binary-clip variable, appending has probably "corrupted" it; so don't allow it to ever be
 	// put back onto the clipboard as binary data (the routine that does that is designed to detect corruption,
 	// but it might not be perfect since corruption is so rare).
-	var.mAttrib &= ~VAR_ATTRIB_BINARY_CLIP;
+	var.mAttrib &= ~(VAR_ATTRIB_BINARY_CLIP | VAR_ATTRIB_CACHE);
+	return OK;
+}
+
+
+
+ResultType Var::GrowForAppend(VarSizeType aLength, VarSizeType aSpaceNeeded)
+// Caller must ensure that "this" is a non-alias VAR_NORMAL variable whose first aLength chars are to be
+// kept.  Enlarges its capacity to at least aSpaceNeeded.  Since this is called only when something is
+// being appended, the capacity is doubled so that building a large string one piece at a time takes
+// a number of reallocations proportional to the log of its final size rather than to the number of pieces.
+// The var is also marked as "append-hot" so that Assign() grows it geometrically too.  Returns FAIL
+// without reporting an error (leaving the variable unchanged) if there isn't enough memory.
+{
+	if (aSpaceNeeded > g_MaxVarCapacity) // Let the caller's fallback method report this.
+		return FAIL;
+	size_t new_size = (size_t)mCapacity * 2;
+	if (new_size < aSpaceNeeded)
+		new_size = aSpaceNeeded;
+	if (new_size < MAX_PATH) // See Assign() for why there's a minimum size.
+		new_size = MAX_PATH;
+	if (new_size > g_MaxVarCapacity)
+		new_size = g_MaxVarCapacity; // Which has already been verified above to be enough.
+	char *new_mem;
+	if (mHowAllocated == ALLOC_MALLOC && mCapacity && !(mAttrib & VAR_ATTRIB_PINNED))
+	{
+		// realloc() is used here (unlike in Assign()) because the contents must be kept, and because it can
+		// often grow a large block in place, which avoids copying it at all.
+		if (   !(new_mem = (char *)realloc(mContents, new_size))   )
+			return FAIL;
+	}
+	else // The old memory is on SimpleHeap, or a parsing loop is reading it, so it must be left where it is.
+	{
+		if (   !(new_mem = (char *)malloc(new_size))   )
+			return FAIL;
+		memcpy(new_mem, mContents, aLength);
+		DetachIfPinned(false); // Hand over the old memory since the above already made a copy.
+		mHowAllocated = ALLOC_MALLOC; // In case it was ALLOC_SIMPLE, in which case the old memory is abandoned (see Assign()).
+	}
+	new_mem[aLength] = '\0';
+	mContents = new_mem;
+	mCapacity = (VarSizeType)new_size;
+	mLength = aLength;
+	mAttrib |= VAR_ATTRIB_APPEND_HOT;
 	return OK;
 }
 
@@ -934,6 +1045,7 @@ void Var::SetLengthFromContents()
 	{
  		contents[capacity - 1] = '\0';  // Caller wants us to ensure it's terminated, to avoid crashing strlen() below.
 		var.mLength = (VarSizeType)strlen(contents);
+		var.mAttrib &= ~VAR_ATTRIB_CACHE; // Something might have written to the contents, which the cache wouldn't reflect.
 	}
 	//else it has no capacity, so do nothing (it could also be a reserved/built-in variable).
 }
@@ -946,36 +1058,238 @@ ResultType Var::BackupFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVarBa
 // If there is nothing to backup, only the aVarBackupCount is changed (to zero).
 // Returns OK or FAIL.
 {
-	if (   !(aVarBackupCount = aFunc.mVarCount + aFunc.mLazyVarCount)   )  // Nothing needs to be backed up.
+	if (   !(aVarBackupCount = aFunc.mVarCount)   )  // Nothing needs to be backed up.
 		return OK; // Leave aVarBackup set to NULL as set by the caller.
 
-	// NOTES ABOUT MALLOC(): Apparently, the implementation of malloc() is quite good, at least for small blocks
-	// needed to back up 50 or less variables.  It nearly as fast as alloca(), at least when the system
-	// isn't under load and has the memory to spare without swapping.  Therefore, the attempt to use alloca to
-	// speed up recursive script-functions didn't result in enough of a speed-up (only 1 to 5%) to be worth the
-	// added complexity.
+	// The backup goes on top of the frame stack rather than into memory of its own.  This avoids a malloc()
+	// and free() per call, but more importantly, lets each call reuse the memory that the previous call at
+	// the same depth left in the frame for its locals (see Backup()), so that a recursive function's locals
+	// don't have to be reallocated every time it recurses.
 	// Since Var is not a POD struct (it contains private members, a custom constructor, etc.), the VarBkp
 	// POD struct is used to hold the backup because it's probably better performance than using Var's
 	// constructor to create each backup array element.
-	if (   !(aVarBackup = (VarBkp *)malloc(aVarBackupCount * sizeof(VarBkp)))   ) // Caller will take care of freeing it.
-		return FAIL;
+	VarFrameBlock *block = sFrameBlock;
+	if (!block || block->mCount + aVarBackupCount > block->mSize) // No room for the worst case (no statics).
+		if (   !(block = AddFrameBlock(aVarBackupCount))   )
+			return FAIL;
+	aVarBackup = block->mItem + block->mCount;
 
 	int i;
-	aVarBackupCount = 0;  // Init only once prior to both loops. aVarBackupCount is being "overloaded" to track the current item in aVarBackup, BUT ALSO its being updated to an actual count in case some statics are omitted from the array.
+	aVarBackupCount = 0;  // Init only once prior to the loop. aVarBackupCount is being "overloaded" to track the current item in aVarBackup, BUT ALSO its being updated to an actual count in case some statics are omitted from the array.
 
 	// Note that Backup() does not make the variable empty after backing it up because that is something
 	// that must be done by our caller at a later stage.
 	for (i = 0; i < aFunc.mVarCount; ++i)
 		if (!(aFunc.mVar[i]->mAttrib & VAR_ATTRIB_STATIC)) // Don't bother backing up statics because they won't need to be restored.
 			aFunc.mVar[i]->Backup(aVarBackup[aVarBackupCount++]);
-	for (i = 0; i < aFunc.mLazyVarCount; ++i)
-		if (!(aFunc.mLazyVar[i]->mAttrib & VAR_ATTRIB_STATIC)) // Don't bother backing up statics because they won't need to be restored.
-			aFunc.mLazyVar[i]->Backup(aVarBackup[aVarBackupCount++]);
+	if (!aVarBackupCount) // All the locals are static, so there's no frame.  An empty frame mustn't be left
+		aVarBackup = NULL; // pointing into a block, because AddFrameBlock() might discard that block as empty.
+	else
+		block->mCount += aVarBackupCount;
 	return OK;
 }
 
 
 
+VarFrameBlock *Var::AddFrameBlock(int aMinSize)
+// Makes the block after the current one the top of the frame stack, creating it if necessary so that it
+// has room for at least aMinSize items.  Returns the new top block, or NULL if out of memory.
+{
+	VarFrameBlock *block = sFrameBlock, *next;
+	if (block && !block->mCount) // The top block is empty yet too small, so it's replaced rather than left unused.
+	{
+		next = block;
+		block = block->mPrev;
+	}
+	else
+		next = block ? block->mNext : NULL;
+	if (next && next->mSize >= aMinSize) // Reuse a block left over from an earlier, deeper recursion.
+		return sFrameBlock = next;
+	if (next) // Too small.  Since it and the blocks after it are empty, discard them.
+	{
+		for (VarFrameBlock *after; next; next = after)
+		{
+			after = next->mNext;
+			for (int i = 0; i < next->mSize; ++i)
+				if (next->mItem[i].mSpareContents)
+					free(next->mItem[i].mSpareContents);
+			free(next->mItem);
+			free(next);
+		}
+		if (block)
+			block->mNext = NULL;
+	}
+	// Each block is at least twice the size of the one before it, so that a deep recursion needs only a
+	// few of them:
+	int size = block ? block->mSize * 2 : 256;
+	if (size < aMinSize)
+		size = aMinSize;
+	if (   !(next = (VarFrameBlock *)malloc(sizeof(VarFrameBlock)))   )
+		return NULL;
+	if (   !(next->mItem = (VarBkp *)calloc(size, sizeof(VarBkp)))   ) // calloc() so that no item has a spare yet.
+	{
+		free(next);
+		return NULL;
+	}
+	next->mCount = 0;
+	next->mSize = size;
+	next->mPrev = block;
+	next->mNext = NULL;
+	if (block)
+		block->mNext = next;
+	return sFrameBlock = next;
+}
+
+
+
+bool Var::Pin(VarPin &aPin)
+// Caller must ensure that "this" isn't an alias.  Returns false without pinning if the contents aren't
+// worth pinning (i.e. they aren't in malloc'd memory, in which case they're small enough to copy cheaply)
+// or can't safely be pinned because the script has taken their address, so they might be changed in place
+// without the var's knowledge (see VAR_ATTRIB_CACHE_DISABLED).
+{
+	if (mType != VAR_NORMAL || mHowAllocated != ALLOC_MALLOC || !mCapacity || (mAttrib & VAR_ATTRIB_CACHE_DISABLED))
+		return false;
+	aPin.mVar = this;
+	aPin.mContents = mContents;
+	aPin.mDetached = false;
+	aPin.mOwnsContents = false;
+	aPin.mNext = sPins;
+	sPins = &aPin;
+	mAttrib |= VAR_ATTRIB_PINNED;
+	return true;
+}
+
+
+
+void Var::Unpin(VarPin &aPin)
+// Caller must have successfully called Pin() for aPin.
+{
+	VarPin **link, *pin;
+	for (link = &sPins; *link != &aPin; link = &(*link)->mNext); // Almost always the first one since pins are nested.
+	*link = aPin.mNext;
+	if (aPin.mOwnsContents)
+		free(aPin.mContents);
+	else if (!aPin.mDetached)
+	{
+		// Remove the attribute unless an enclosing loop is still reading the same contents.
+		for (pin = sPins; pin; pin = pin->mNext)
+			if (pin->mVar == aPin.mVar && pin->mContents == aPin.mContents && !pin->mDetached)
+				break;
+		if (!pin)
+			aPin.mVar->mAttrib &= ~VAR_ATTRIB_PINNED;
+	}
+	aPin.mVar = NULL;
+}
+
+
+
+void Var::DetachFromPins(bool aKeepContents)
+// Caller must ensure that "this" isn't an alias.  Hands the current contents over to the pins that refer to
+// them, then gives the variable new memory (a copy of the old if aKeepContents==true, otherwise none).
+// This is the copy in "copy-on-write": it only happens when a pinned variable is actually changed.
+{
+	mAttrib &= ~VAR_ATTRIB_PINNED;
+	VarPin *pin, *owner = NULL;
+	for (pin = sPins; pin; pin = pin->mNext)
+		if (pin->mVar == this && pin->mContents == mContents && !pin->mDetached)
+		{
+			pin->mDetached = true;
+			owner = pin; // Since the list is newest first, this ends up being the outermost loop, which outlives the others.
+		}
+	if (!owner) // The contents were already detached, such as while they were backed up by a recursive function call.
+		return;
+	owner->mOwnsContents = true;
+	char *new_mem;
+	if (aKeepContents && (new_mem = (char *)malloc(mCapacity)))
+	{
+		memcpy(new_mem, mContents, mCapacity); // The whole capacity in case it's a binary buffer (e.g. for DllCall or NumPut).
+		mContents = new_mem;
+	}
+	else // Caller doesn't need the contents or there's no memory for them.  Either way, the variable becomes blank.
+	{
+		mCapacity = 0;             // Invariant: Anyone setting mCapacity to 0 must also set
+		mContents = sEmptyString;  // mContents to the empty string.
+		mLength = 0;
+	}
+}
+
+
+
+void Var::UpdateContents()
+// Formats the cached number into mContents for a caller that needs the text.  Caller has ensured that this
+// isn't an alias and that VAR_ATTRIB_CONTENTS_OUT_OF_DATE is set.
+{
+	VarAttribType cache_attrib = mAttrib & (VAR_ATTRIB_HAS_VALID_INT64 | VAR_ATTRIB_HAS_VALID_DOUBLE);
+	char value_string[MAX_FORMATTED_NUMBER_LENGTH + 1];
+	ResultType result = (cache_attrib == VAR_ATTRIB_HAS_VALID_INT64)
+		? Assign(g.FormatIntegerFast ? ITOA64(mContentsInt64, value_string) // Obey SetFormat IntegerFast Hex, as documented at Assign(__int64).
+			: _i64toa(mContentsInt64, value_string, 10)) // Not ITOA64() because SetFormat Integer Hex might have come into effect since Assign(__int64).
+		: Assign(value_string, snprintf(value_string, sizeof(value_string), g.FormatFloat, mContentsDouble));
+	// Assign() discarded the cache along with the old contents, but the number still stands for the new
+	// contents.  If Assign() failed (out of memory), the error has been reported and the var is left with
+	// its old text and no cache.
+	if (result)
+		mAttrib |= cache_attrib;
+}
+
+
+
+SymbolType Var::ParseNumber(BOOL aAllowImpure)
+// Called by IsNumeric() when there's no cached number.  Caller has ensured that this isn't an alias.
+// Caches the number the contents turn out to contain, if any.
+{
+	char *contents = Contents(); // Can be the clipboard, but it works even then.
+	SymbolType is_number = IsPureNumeric(contents, true, false, true, aAllowImpure);
+	// An impure number such as "5 apples" isn't cached since IsNumeric() would then report it as pure.
+	if (is_number && !aAllowImpure && mType == VAR_NORMAL && !(mAttrib & VAR_ATTRIB_CACHE_DISABLED))
+	{
+		if (is_number == PURE_INTEGER)
+		{
+			mContentsInt64 = ATOI64(contents);
+			mAttrib |= VAR_ATTRIB_HAS_VALID_INT64;
+		}
+		else
+		{
+			mContentsDouble = ATOF(contents);
+			mAttrib |= VAR_ATTRIB_HAS_VALID_DOUBLE;
+		}
+	}
+	return is_number;
+}
+
+
+
+void Var::DisableCache()
+// Called when the var's address is taken, after which its contents might be changed by something that has
+// no way to discard the cache (e.g. a function called via DllCall that writes to the address later).
+// For the same reason, a parsing loop that is reading the contents in place is given them to keep.
+{
+	// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
+	Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+	if (var.mType != VAR_NORMAL)
+		return;
+	if (var.mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)
+		var.UpdateContents(); // The script is about to use the address of the text.
+	if (var.mAttrib & VAR_ATTRIB_PINNED)
+		var.DetachFromPins(true); // Done only now so that the address the script gets is that of the var's own copy.
+	var.mAttrib = (var.mAttrib & ~VAR_ATTRIB_CACHE) | VAR_ATTRIB_CACHE_DISABLED;
+}
+
+
+
+void Var::DiscardCache(bool aKeepContents)
+// Called by DetachIfPinned().  Caller has ensured that this isn't an alias.
+{
+	if (aKeepContents && (mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE))
+		UpdateContents(); // Must be done while the number is still known.  This might also detach from pins.
+	mAttrib &= ~VAR_ATTRIB_CACHE;
+	if (mAttrib & VAR_ATTRIB_PINNED)
+		DetachFromPins(aKeepContents);
+}
+
+
+
 void Var::Backup(VarBkp &aVarBkp)
 // Caller must not call this function for static variables because it's not equipped to deal with them
 // (they don't need to be backed up or restored anyway).
@@ -990,6 +1304,8 @@ void Var::Backup(VarBkp &aVarBkp)
 	aVarBkp.mCapacity = mCapacity;
 	aVarBkp.mHowAllocated = mHowAllocated; // This might be ALLOC_SIMPLE or ALLOC_NONE if backed up variable was at the lowest layer of the call stack.
 	aVarBkp.mAttrib = mAttrib;
+	aVarBkp.mContentsInt64 = mContentsInt64; // This also backs up mContentsDouble, which shares the union.
+	aVarBkp.mWriteCount = mWriteCount; // So that a RegExMatchNext() scan of the restored contents can resume.
 	aVarBkp.mType = mType; // Fix for v1.0.47.06: Must also back up and restore mType in case an optional ByRef parameter is omitted by one call by specified by another thread that interrupts the first thread's call.
 	// Once the backup is made, Free() is not called because the whole point of the backup is to
 	// preserve the original memory/contents of each variable.  Instead, clear the variable
@@ -1001,12 +1317,24 @@ void Var::Backup(VarBkp &aVarBkp)
 	// when the program exits).
 	// Now reset this variable (caller has ensured it's non-static) to create a "new layer" for it, keeping
 	// its backup intact but allowing this variable (or formal parameter) to be given a new value in the future:
-	mCapacity = 0;             // Invariant: Anyone setting mCapacity to 0 must also set...
-	mContents = sEmptyString;  // ...mContents to the empty string.
+	if (aVarBkp.mSpareContents) // The last call to use this item of the frame stack left some memory behind, so use it.
+	{
+		mContents = aVarBkp.mSpareContents;
+		mCapacity = aVarBkp.mSpareCapacity;
+		*mContents = '\0';
+		aVarBkp.mSpareContents = NULL;
+	}
+	else
+	{
+		mCapacity = 0;             // Invariant: Anyone setting mCapacity to 0 must also set...
+		mContents = sEmptyString;  // ...mContents to the empty string.
+	}
 	if (mType != VAR_ALIAS) // Fix for v1.0.42.07: Don't reset mLength if the other member of the union is in effect.
 		mLength = 0;        // Otherwise, functions that recursively pass ByRef parameters can crash because mType stays as VAR_ALIAS.
 	mHowAllocated = ALLOC_MALLOC; // Never NONE because that would permit SIMPLE. See comments higher above.
-	mAttrib &= ~VAR_ATTRIB_BINARY_CLIP; // But the VAR_ATTRIB_STATIC flag isn't altered.
+	// But the VAR_ATTRIB_STATIC flag isn't altered.  VAR_ATTRIB_PINNED is removed because it refers to the
+	// backed-up contents, and is put back along with them by FreeAndRestoreFunctionVars().
+	mAttrib &= ~(VAR_ATTRIB_BINARY_CLIP | VAR_ATTRIB_PINNED | VAR_ATTRIB_APPEND_HOT | VAR_ATTRIB_CACHE);
 }
 
 
@@ -1014,31 +1342,71 @@ void Var::Backup(VarBkp &aVarBkp)
 void Var::FreeAndRestoreFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVarBackupCount)
 {
 	int i;
-	for (i = 0; i < aFunc.mVarCount; ++i)
-		aFunc.mVar[i]->Free(VAR_ALWAYS_FREE_BUT_EXCLUDE_STATIC, true); // Pass "true" to exclude aliases, since their targets should not be freed (they don't belong to this function).
-	for (i = 0; i < aFunc.mLazyVarCount; ++i)
-		aFunc.mLazyVar[i]->Free(VAR_ALWAYS_FREE_BUT_EXCLUDE_STATIC, true);
-
-	// The freeing (above) MUST be done prior to the restore-from-backup below (otherwise there would be
-	// a memory leak).  Static variables are never backed up and thus do not exist in the aVarBackup array.
-	// This is because by definition, the contents of statics are not freed or altered by the calling procedure
-	// (regardless how how recursive or multi-threaded the function is).
-	if (aVarBackup) // This is the indicator that a backup was made; thus a restore is also needed.
+	if (!aVarBackup) // No other instances of this function are on the call stack, so there's nothing to restore.
+	{
+		// The locals are made blank, but unless their memory is large, it's kept for the next call rather
+		// than freed and reallocated.  Aliases are excluded since their targets don't belong to this function.
+		for (i = 0; i < aFunc.mVarCount; ++i)
+			if (!(aFunc.mVar[i]->mAttrib & VAR_ATTRIB_STATIC))
+				aFunc.mVar[i]->Free(VAR_FREE_IF_LARGE, true);
+		return;
+	}
+
+	// Locals created while the instance that's ending was running (e.g. by a dynamic reference such as
+	// v%i% := x) have no backup, yet the instances beneath it expect them to be blank, as they were before
+	// the call.  Since new vars are inserted into mVar without disturbing the order of the others, they're
+	// found by walking mVar alongside the backup, which was made in the same order.
+	int j;
+	for (i = j = 0; i < aFunc.mVarCount; ++i)
 	{
-		for (i = 0; i < aVarBackupCount; ++i) // Static variables were never backed up so they won't be in this array. See comments above.
+		Var &var = *aFunc.mVar[i];
+		if (j < aVarBackupCount && aVarBackup[j].mVar == &var)
+			++j;
+		else if (!(var.mAttrib & VAR_ATTRIB_STATIC))
+			var.Free(VAR_FREE_IF_LARGE, true);
+	}
+
+	// Static variables were never backed up so they won't be in this array.  This is because by definition,
+	// the contents of statics are not freed or altered by the calling procedure (regardless how how recursive
+	// or multi-threaded the function is).
+	for (i = 0; i < aVarBackupCount; ++i)
+	{
+		VarBkp &bkp = aVarBackup[i]; // Resolve only once for performance.
+		Var &var = *bkp.mVar;        //
+		// Before the backup is restored, the memory of the instance that's ending must be freed or it would
+		// leak.  Unless it's large, it's left in the frame instead, for the next call that reaches this depth
+		// (usually the very next recursion).  This applies even to an alias, since it might have been given
+		// memory by Backup() before it became an alias.
+		if (var.mType != VAR_ALIAS)
+			var.DetachIfPinned(false);
+		if (var.mHowAllocated == ALLOC_MALLOC && var.mCapacity)
 		{
-			VarBkp &bkp = aVarBackup[i]; // Resolve only once for performance.
-			Var &var = *bkp.mVar;        //
-			var.mContents = bkp.mContents;
-			var.mLength = bkp.mLength; // Since it's a union, it might actually be restoring mAliasFor, which is desired.
-			var.mCapacity = bkp.mCapacity;
-			var.mHowAllocated = bkp.mHowAllocated; // This might be ALLOC_SIMPLE or ALLOC_NONE if backed up variable was at the lowest layer of the call stack.
-			var.mAttrib = bkp.mAttrib;
-			var.mType = bkp.mType;
+			if (!bkp.mSpareContents && var.mCapacity <= 4 * 1024) // Same limit as VAR_FREE_IF_LARGE.
+			{
+				bkp.mSpareContents = var.mContents;
+				bkp.mSpareCapacity = var.mCapacity;
+			}
+			else
+				free(var.mContents);
 		}
-		free(aVarBackup);
-		aVarBackup = NULL; // Some callers want this reset; it's an indicator of whether the next function call in this expression (if any) will have a backup.
+		var.mContents = bkp.mContents;
+		var.mLength = bkp.mLength; // Since it's a union, it might actually be restoring mAliasFor, which is desired.
+		var.mCapacity = bkp.mCapacity;
+		var.mHowAllocated = bkp.mHowAllocated; // This might be ALLOC_SIMPLE or ALLOC_NONE if backed up variable was at the lowest layer of the call stack.
+		var.mAttrib = bkp.mAttrib;
+		var.mContentsInt64 = bkp.mContentsInt64;
+		var.mWriteCount = bkp.mWriteCount;
+		var.mType = bkp.mType;
 	}
+
+	// Pop the frame.  Since the frames of any calls that were abandoned without restoring their backups
+	// lie above this one, they're discarded along with it.
+	VarFrameBlock *block;
+	for (block = sFrameBlock; aVarBackup < block->mItem || aVarBackup >= block->mItem + block->mSize; block = block->mPrev)
+		block->mCount = 0;
+	block->mCount = (int)(aVarBackup - block->mItem);
+	sFrameBlock = block;
+	aVarBackup = NULL; // Some callers want this reset; it's an indicator of whether the next function call in this expression (if any) will have a backup.
 }
 
 
@@ -68,9 +68,43 @@ struct VarBkp // This should be kept in sync with any changes to the Var class.
 	AllocMethodType mHowAllocated;
 	VarAttribType mAttrib;
 	VarTypeType mType;
+	UINT mWriteCount;
+	union
+	{
+		__int64 mContentsInt64;
+		double mContentsDouble;
+	};
 	// Not needed in the backup:
 	//bool mIsLocal;
 	//char *mName;
+	// Not part of the backup: memory left behind by the last call that occupied this slot of the frame
+	// stack, which is given to the next one rather than freed (see Var::FreeAndRestoreFunctionVars()).
+	char *mSpareContents; // NULL if none.
+	VarSizeType mSpareCapacity;
+};
+
+struct VarFrameBlock
+// The frame stack that holds VarBkp's is a chain of these blocks rather than one array so that growing it
+// never moves the frames already on it.  Blocks are kept after they empty out, so once the stack has reached
+// a given depth, calls up to that depth don't allocate anything.
+{
+	VarBkp *mItem;
+	int mCount; // How many items are in use (the rest are free, but might hold spares).
+	int mSize;
+	VarFrameBlock *mPrev, *mNext;
+};
+
+struct VarPin
+// Lets a parsing loop read a variable's contents in place rather than copying them.  While pinned, anything
+// that would change or free those contents first moves the variable to new memory (see DetachFromPins()),
+// handing the original to the pin so that it stays intact until the loop calls Var::Unpin().
+{
+	Var *mVar;          // The (non-alias) pinned variable, or NULL if nothing is pinned.
+	char *mContents;    // The contents being read; valid until Unpin() even if mVar has since changed.
+	bool mDetached;     // mVar has moved on to new memory, so mContents is no longer its contents.
+	bool mOwnsContents; // mContents was handed over by mVar and must be freed by Unpin().
+	VarPin *mNext;      // The next older pin (see Var::sPins).
+	VarPin() : mVar(NULL) {}
 };
 
 typedef VarSizeType (* BuiltInVarType)(char *aBuf, char *aVarName);
@@ -91,8 +125,14 @@ public: // Naveen
 	};
 	AllocMethodType mHowAllocated; // Keep adjacent/contiguous with the below to save memory.
 	#define VAR_ATTRIB_BINARY_CLIP  0x01
-	#define VAR_ATTRIB_PARAM        0x02 // Currently unused.
-	#define VAR_ATTRIB_STATIC       0x04 // Next in series would be 0x08, 0x10, etc.
+	#define VAR_ATTRIB_CONTENTS_OUT_OF_DATE 0x02 // mContents hasn't yet been updated to reflect the cached number (see UpdateContents()).
+	#define VAR_ATTRIB_STATIC       0x04
+	#define VAR_ATTRIB_PINNED       0x08 // A VarPin refers to mContents.
+	#define VAR_ATTRIB_APPEND_HOT   0x10 // Var has outgrown its capacity by being appended to, so it grows geometrically.
+	#define VAR_ATTRIB_HAS_VALID_INT64  0x20 // mContentsInt64 is the var's value as a number.  Mutually exclusive with the below.
+	#define VAR_ATTRIB_HAS_VALID_DOUBLE 0x40 // mContentsDouble is the var's value as a number.
+	#define VAR_ATTRIB_CACHE_DISABLED   0x80 // The var's address was taken, so its contents might change without its knowledge (e.g. via DllCall).
+	#define VAR_ATTRIB_CACHE (VAR_ATTRIB_HAS_VALID_INT64 | VAR_ATTRIB_HAS_VALID_DOUBLE | VAR_ATTRIB_CONTENTS_OUT_OF_DATE) // All the things that a change to the contents invalidates.
 	VarAttribType mAttrib;  // Bitwise combination of the above flags.
 	bool mIsLocal;
 	VarTypeType mType; // Keep adjacent/contiguous with the above due to struct alignment, to save memory.
@@ -104,6 +144,20 @@ public: // Naveen
 	// Testing shows that due to data alignment, keeping mType adjacent to the other less-than-4-size member
 	// above it reduces size of each object by 4 bytes.
 	char *mName;    // The name of the var.
+	// Counts the changes made to mContents (see DetachIfPinned()), so that something that keeps a position in
+	// the contents between calls (such as a RegExMatchNext() scan) can tell whether they're still the same.
+	// Due to the alignment of the union below, this doesn't make each object any bigger.
+	UINT mWriteCount;
+
+	// A var that holds a number also keeps it in binary form here, so that expressions needn't reparse its
+	// contents every time they use it.  Assigning a number (e.g. x := x + 1) stores only this and leaves
+	// mContents out of date until something needs the text, so a var that's only ever used for math never
+	// has its numbers formatted at all.  Anything that changes mContents discards the cache.
+	union
+	{
+		__int64 mContentsInt64;
+		double mContentsDouble;
+	};
 
 	// sEmptyString is a special *writable* memory area for empty variables (those with zero capacity).
 	// Although making it writable does make buffer overflows difficult to detect and analyze (since they
@@ -118,6 +172,11 @@ public: // Naveen
 	// sEmptyString in DllCall(), which forces an exception to occur immediately, which is caught by the
 	// exception handler there.
 	static char sEmptyString[1]; // See above.
+	static VarPin *sPins; // Newest first.  There are usually none, or one per nested parsing loop.
+	// The top block of the frame stack, which holds the backups of the locals of each function that's been
+	// called while other instances of itself were on the call stack.  A single stack serves all threads
+	// because a thread that interrupts another always finishes before the interrupted one resumes.
+	static VarFrameBlock *sFrameBlock;
 
 	ResultType AssignHWND(HWND aWnd);
 	ResultType Assign(DWORD aValueToAssign);
@@ -143,10 +202,29 @@ public: // Naveen
 	#define VAR_FREE_IF_LARGE                  4
 	void Free(int aWhenToFree = VAR_ALWAYS_FREE, bool aExcludeAliases = false);
 	ResultType AppendIfRoom(char *aStr, VarSizeType aLength);
+	ResultType GrowForAppend(VarSizeType aLength, VarSizeType aSpaceNeeded);
 	void AcceptNewMem(char *aNewMem, VarSizeType aLength);
 	void SetLengthFromContents();
+	void UpdateContents();
+	SymbolType ParseNumber(BOOL aAllowImpure);
+	void DisableCache();
+	void DiscardCache(bool aKeepContents);
+
+	bool Pin(VarPin &aPin);
+	static void Unpin(VarPin &aPin);
+	void DetachFromPins(bool aKeepContents);
+	__forceinline void DetachIfPinned(bool aKeepContents = true)
+	// Must be called for a non-alias variable prior to any change to its memory that isn't done through
+	// Assign(), Free() or AppendIfRoom(), which call it themselves.  For example: writing directly to Contents().
+	// Since such a change would make any cached number wrong, the cache is discarded too.
+	{
+		++mWriteCount;
+		if (mAttrib & (VAR_ATTRIB_PINNED | VAR_ATTRIB_CACHE)) // Checked together so that the usual case is a single test.
+			DiscardCache(aKeepContents);
+	}
 
 	static ResultType BackupFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVarBackupCount);
+	static VarFrameBlock *AddFrameBlock(int aMinSize);
 	void Backup(VarBkp &aVarBkp);
 	static void FreeAndRestoreFunctionVars(Func &aFunc, VarBkp *&aVarBackup, int &aVarBackupCount);
 
@@ -163,6 +241,8 @@ public: // Naveen
 	{
 		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
 		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+		if (var.mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)
+			var.UpdateContents();
 		// v1.0.44.14: Changed it so that ByRef/Aliases report their own name rather than the target's/caller's
 		// (it seems more useful and intuitive).
 		char *aBuf_orig = aBuf;
@@ -236,7 +316,11 @@ public: // Naveen
 		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
 		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
 		if (var.mType == VAR_NORMAL)
+		{
+			if (var.mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)
+				var.UpdateContents();
 			return var.mLength;
+		}
 		// Since the length of the clipboard isn't normally tracked, we just return a
 		// temporary storage area for the caller to use.  Note: This approach is probably
 		// not thread-safe, but currently there's only one thread so it's not an issue.
@@ -253,6 +337,8 @@ public: // Naveen
 	{
 		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
 		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+		if (var.mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)
+			var.UpdateContents();
 		// Return the apparent length of the string (i.e. the position of its first binary zero).
 		return (var.mType == VAR_NORMAL && !(var.mAttrib & VAR_ATTRIB_BINARY_CLIP))
 			? var.mLength : strlen(var.Contents()); // Use Contents() vs. mContents to support VAR_CLIPBOARD.
@@ -263,7 +349,11 @@ public: // Naveen
 		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
 		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
 		if (var.mType == VAR_NORMAL)
+		{
+			if (var.mAttrib & VAR_ATTRIB_CONTENTS_OUT_OF_DATE)
+				var.UpdateContents();
 			return var.mContents;
+		}
 		if (var.mType == VAR_CLIPBOARD)
 			// The returned value will be a writable mem area if clipboard is open for write.
 			// Otherwise, the clipboard will be opened physically, if it isn't already, and
@@ -272,6 +362,44 @@ public: // Naveen
 		return sEmptyString; // For reserved vars (but this method should probably never be called for them).
 	}
 
+	SymbolType IsNumeric(BOOL aAllowImpure = false)
+	// Returns the same as IsPureNumeric(Contents(), true, false, true, aAllowImpure), but without having
+	// to parse the contents if the var has a cached number.
+	{
+		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
+		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+		if (var.mAttrib & VAR_ATTRIB_HAS_VALID_INT64)
+			return PURE_INTEGER;
+		if (var.mAttrib & VAR_ATTRIB_HAS_VALID_DOUBLE)
+			return PURE_FLOAT;
+		return var.ParseNumber(aAllowImpure);
+	}
+
+	__int64 ToInt64()
+	// Returns the same as ATOI64(Contents()), but uses the cached number if there is one.
+	{
+		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
+		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+		if (var.mAttrib & VAR_ATTRIB_HAS_VALID_INT64)
+			return var.mContentsInt64;
+		// Otherwise, it's a double or there's no cache, so use the text, since the formatted text of a
+		// double can differ from a truncation of it (e.g. 2.9999999 is "3.000000" under the default format).
+		// For a double from SetFormat FloatFast, Contents() formats the text now.
+		return ATOI64(var.Contents());
+	}
+
+	double ToDouble()
+	// Returns the same as ATOF(Contents()), but uses the cached number if there is one.
+	{
+		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
+		Var &var = *(mType == VAR_ALIAS ? mAliasFor : this);
+		if (var.mAttrib & VAR_ATTRIB_HAS_VALID_DOUBLE)
+			return var.mContentsDouble;
+		if (var.mAttrib & VAR_ATTRIB_HAS_VALID_INT64)
+			return (double)var.mContentsInt64;
+		return ATOF(var.Contents());
+	}
+
 	__forceinline Var *ResolveAlias()
 	{
 		// Relies on the fact that aliases can't point to other aliases (enforced by UpdateAlias()).
@@ -330,6 +458,7 @@ public: // Naveen
 			var.mAttrib |= VAR_ATTRIB_BINARY_CLIP;
 		else
 			var.mAttrib &= ~VAR_ATTRIB_BINARY_CLIP;
+		var.mAttrib &= ~VAR_ATTRIB_CACHE; // The caller has written new contents, which the cache doesn't reflect.
 		return OK; // In all other cases.
 	}
 
@@ -341,6 +470,7 @@ public: // Naveen
 		, mHowAllocated(ALLOC_NONE)
 		, mAttrib(0), mIsLocal(aIsLocal)
 		, mName(aVarName) // Caller gave us a pointer to dynamic memory for this (or static in the case of ResolveVarOfArg()).
+		, mWriteCount(0)
 	{
 		if (aType > (void *)VAR_LAST_TYPE) // Relies on the fact that numbers less than VAR_LAST_TYPE can never realistically match the address of any function.
 		{
@@ -355,8 +485,10 @@ public: // Naveen
 	}
 	void *operator new(size_t aBytes) {return SimpleHeap::Malloc(aBytes);}
 	void *operator new[](size_t aBytes) {return SimpleHeap::Malloc(aBytes);}
+	void *operator new(size_t aBytes, SimpleHeap *aHeap) {return aHeap->Alloc(aBytes);} // For a specific arena.
 	void operator delete(void *aPtr) {}
 	void operator delete[](void *aPtr) {}
+	void operator delete(void *aPtr, SimpleHeap *aHeap) {}
 };
 
 #endif
@@ -1908,3 +1908,368 @@ bool DialogPrep()
 	return thread_was_critical; // Caller is responsible for using this to later restore g.ThreadIsCritical.
 */
 }
+
+
+
+ResultType ParseWindowCriteria(WindowCriteria &aCriteria, char *aTitle, char *aText)
+// Parses aTitle in the same way as WindowSearch::SetCriteria() so that a WindowSnapshot can match it.
+// Criteria that a snapshot can't answer cause mNeedsSearch to be set, in which case the caller should
+// fall back to WinActive() or WinExist().  These are: WinText (which requires the window's controls);
+// ahk_group (whose members have criteria of their own); ahk_id (which can be a child window); and "A".
+// The strings are allocated from SimpleHeap because the caller's criterion lasts as long as the script.
+// Returns FAIL if memory couldn't be allocated, or OK otherwise.
+{
+	aCriteria.mCriteria = 0;
+	aCriteria.mTitle = aCriteria.mClass = "";
+	aCriteria.mTitleLength = 0;
+	aCriteria.mPID = 0;
+	aCriteria.mNeedsSearch = *aText || USE_FOREGROUND_WINDOW(aTitle, aText, "", "");
+	if (aCriteria.mNeedsSearch)
+		return OK;
+
+	char *ahk_flag, *cp, *title_end = NULL;
+	int criteria_count;
+	for (ahk_flag = aTitle, criteria_count = 0;; ++criteria_count, ahk_flag += 4) // +4 only since an "ahk_" string that isn't qualified may have been found.
+	{
+		if (   !(ahk_flag = strcasestr(ahk_flag, "ahk_"))   ) // No other special strings are present.
+		{
+			if (!criteria_count) // Since no special "ahk_" criteria were present, it is CRITERION_TITLE by default.
+				title_end = aTitle + strlen(aTitle);
+			break;
+		}
+		// As in SetCriteria(), any "ahk_" criteria beyond the first must be preceded by a space or tab:
+		if (criteria_count && !IS_SPACE_OR_TAB(ahk_flag[-1]))
+		{
+			--criteria_count; // Compensate for the loop's increment.
+			continue;
+		}
+		cp = ahk_flag + 4;
+		if (!strnicmp(cp, "id", 2) || !strnicmp(cp, "group", 5))
+		{
+			aCriteria.mNeedsSearch = true;
+			return OK;
+		}
+		else if (!strnicmp(cp, "pid", 3))
+		{
+			aCriteria.mCriteria |= CRITERION_PID;
+			aCriteria.mPID = ATOU(cp + 3);
+		}
+		else if (!strnicmp(cp, "class", 5))
+		{
+			aCriteria.mCriteria |= CRITERION_CLASS;
+			cp = omit_leading_whitespace(cp + 5);
+			// Exclude any criteria that come after the class name (see SetCriteria() for details):
+			char *class_end;
+			for (class_end = cp; class_end = strcasestr(class_end, "ahk_"); class_end += 4)
+				if (class_end == cp || IS_SPACE_OR_TAB(class_end[-1]))
+				{
+					if (class_end > cp)
+						--class_end; // Omit the space or tab that delimits the next criterion.
+					break;
+				}
+			if (   !(aCriteria.mClass = SimpleHeap::Malloc(cp, class_end ? class_end - cp : -1))   )
+				return FAIL;
+		}
+		else // It doesn't qualify as a special criteria name even though it starts with "ahk_".
+		{
+			--criteria_count;
+			continue;
+		}
+		// Any text to the left of the first criterion is the title (see SetCriteria() for details).
+		if (!criteria_count && ahk_flag > omit_leading_whitespace(aTitle))
+			title_end = ahk_flag - 1; // Omit exactly one space or tab: the one that delimits the "ahk_" string.
+	}
+	if (title_end && title_end > aTitle)
+	{
+		aCriteria.mCriteria |= CRITERION_TITLE;
+		aCriteria.mTitleLength = title_end - aTitle;
+		if (aCriteria.mTitleLength > SEARCH_PHRASE_SIZE - 1) // Same limit as SetCriteria().
+			aCriteria.mTitleLength = SEARCH_PHRASE_SIZE - 1;
+		if (   !(aCriteria.mTitle = SimpleHeap::Malloc(aTitle, aCriteria.mTitleLength))   )
+			return FAIL;
+	}
+	return OK;
+}
+
+
+
+volatile LONG WindowSnapshot::sID = 1;
+WindowSnapshot *WindowSnapshot::sCurrent = NULL;
+CRITICAL_SECTION WindowSnapshot::sCritical;
+HWINEVENTHOOK WindowSnapshot::sEventHook[WINDOW_SNAPSHOT_HOOK_COUNT] = {NULL};
+
+
+
+void WindowSnapshot::StartWatching()
+// Must be called by the main thread, since that's the thread whose message loop receives the events.
+{
+	if (*sEventHook) // Already watching.
+		return;
+	sEventHook[0] = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL, EventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+	sEventHook[1] = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_HIDE, NULL, EventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+	sEventHook[2] = SetWinEventHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, NULL, EventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+	// If any of the above failed (e.g. the OS doesn't support WinEvents), snapshots still expire
+	// after WINDOW_SNAPSHOT_MAX_AGE.
+}
+
+
+
+void WindowSnapshot::StopWatching()
+{
+	for (int i = 0; i < WINDOW_SNAPSHOT_HOOK_COUNT; ++i)
+		if (sEventHook[i])
+		{
+			UnhookWinEvent(sEventHook[i]);
+			sEventHook[i] = NULL;
+		}
+}
+
+
+
+void CALLBACK WindowSnapshot::EventProc(HWINEVENTHOOK aHook, DWORD aEvent, HWND aWnd, LONG aObject, LONG aChild
+	, DWORD aEventThread, DWORD aEventTime)
+{
+	if (aObject != OBJID_WINDOW || aChild != CHILDID_SELF)
+		return; // It's about something other than a window, such as the caret or a menu item.
+	// Controls are ignored since snapshots have only top-level windows.  GetWindowLong() yields 0 for
+	// a window that has already been destroyed, which is correctly treated as top-level in case it was.
+	if (aEvent != EVENT_SYSTEM_FOREGROUND && (GetWindowLong(aWnd, GWL_STYLE) & WS_CHILD))
+		return;
+	Invalidate();
+}
+
+
+
+DWORD WindowSnapshot::GetID(bool aAllWindows, bool aCheckForeground)
+// Ensures that the current snapshot is up-to-date and returns its ID, which callers can use to tell
+// whether something they've cached from an earlier snapshot is still valid.
+// If aAllWindows is false, the snapshot might include only the foreground window.
+// aCheckForeground should be true for callers that depend on which window is active.  Since that can
+// change well before the event that reports it arrives (e.g. while the main thread is busy), the
+// snapshot's foreground window is then compared to the actual one.
+{
+	WindowSnapshot *snapshot, *old_snapshot;
+	DWORD id;
+	HWND foreground = aCheckForeground ? GetForegroundWindow() : NULL; // Fetched outside the lock for the reason given at the class definition.
+	EnterCriticalSection(&sCritical);
+	if (   (snapshot = sCurrent) && snapshot->mID == (DWORD)sID
+		&& (snapshot->mHasAllWindows || !aAllWindows)   )
+	{
+		if (   GetTickCount() - snapshot->mTick <= WINDOW_SNAPSHOT_MAX_AGE
+			&& (!aCheckForeground || snapshot->mForeground == foreground)   )
+		{
+			LeaveCriticalSection(&sCritical);
+			return snapshot->mID;
+		}
+		// Otherwise, it has expired or another window has become active.  Increment the ID (unless another
+		// thread already has) so that whatever callers cached from it also expires:
+		InterlockedCompareExchange((LPLONG)&sID, (LONG)snapshot->mID + 1, (LONG)snapshot->mID);
+	}
+	LeaveCriticalSection(&sCritical);
+
+	// Take the new snapshot outside the lock (see comments at the class definition):
+	id = (DWORD)sID;
+	if (   !(snapshot = Take(id, aAllWindows))   )
+		return id - 1; // Out of memory.  An ID that's already stale ensures nothing gets cached under it.
+	EnterCriticalSection(&sCritical);
+	old_snapshot = sCurrent;
+	if (   !old_snapshot || (int)(old_snapshot->mID - id) < 0 // The new one is more recent.
+		|| old_snapshot->mID == id && !old_snapshot->mHasAllWindows && aAllWindows   ) // Or it's more complete.
+		sCurrent = snapshot;
+	else // Another thread has already installed one that's at least as good.
+		old_snapshot = snapshot;
+	LeaveCriticalSection(&sCritical);
+	Delete(old_snapshot);
+	return id;
+}
+
+
+
+HWND WindowSnapshot::FindMatch(WindowCriteria &aCriteria, bool aActiveOnly, global_struct &aSettings, DWORD &aSnapshotID)
+// Returns the first window (in Z-order) that matches aCriteria and is detectable according to aSettings,
+// or NULL if there is none.  If aActiveOnly is true, only the foreground window is considered, in which case
+// this is the equivalent of WinActive() rather than WinExist().  Caller must ensure !aCriteria.mNeedsSearch.
+// aSnapshotID receives the ID of the snapshot that was searched (see GetID()).
+{
+	WindowSnapshot *snapshot;
+	HWND found_hwnd;
+	int i;
+	for (i = 0;; ++i)
+	{
+		aSnapshotID = GetID(!aActiveOnly, aActiveOnly);
+		EnterCriticalSection(&sCritical);
+		snapshot = sCurrent;
+		if (snapshot && snapshot->mID == aSnapshotID && (snapshot->mHasAllWindows || aActiveOnly))
+			break;
+		// Otherwise, another thread replaced the snapshot between the two steps above, so try again.
+		// Give up after a few attempts since this can also be caused by insufficient memory.
+		LeaveCriticalSection(&sCritical);
+		if (i == 2)
+			return NULL;
+	}
+	found_hwnd = NULL;
+	for (i = 0; i < snapshot->mItemCount; ++i)
+	{
+		WindowSnapshotItem &item = snapshot->mItem[i];
+		if (aActiveOnly && item.hwnd != snapshot->mForeground)
+			continue;
+		if (   (aSettings.DetectHiddenWindows || item.is_visible) // Skip windows the script isn't supposed to detect.
+			&& (found_hwnd = IsMatch(item, aCriteria, aSettings))
+			|| aActiveOnly   ) // The foreground window was the only candidate.
+			break;
+	}
+	LeaveCriticalSection(&sCritical);
+	return found_hwnd;
+}
+
+
+
+HWND WindowSnapshot::IsMatch(WindowSnapshotItem &aItem, WindowCriteria &aCriteria, global_struct &aSettings)
+// The equivalent of WindowSearch::IsMatch() for the subset of criteria that WindowCriteria supports.
+{
+	if (aCriteria.mCriteria & CRITERION_TITLE)
+	{
+		switch(aSettings.TitleMatchMode)
+		{
+		case FIND_ANYWHERE:
+			if (!strstr(aItem.title, aCriteria.mTitle))
+				return NULL;
+			break;
+		case FIND_IN_LEADING_PART:
+			if (strncmp(aItem.title, aCriteria.mTitle, aCriteria.mTitleLength))
+				return NULL;
+			break;
+		case FIND_REGEX:
+			if (!RegExMatch(aItem.title, aCriteria.mTitle))
+				return NULL;
+			break;
+		default: // Exact match.
+			if (strcmp(aItem.title, aCriteria.mTitle))
+				return NULL;
+		}
+	}
+	if (aCriteria.mCriteria & CRITERION_CLASS)
+	{
+		if (aSettings.TitleMatchMode == FIND_REGEX)
+		{
+			if (!RegExMatch(aItem.class_name, aCriteria.mClass))
+				return NULL;
+		}
+		else // For backward compatibility, all other modes use exact-match for Class.
+			if (strcmp(aItem.class_name, aCriteria.mClass))
+				return NULL;
+	}
+	if ((aCriteria.mCriteria & CRITERION_PID) && aItem.pid != aCriteria.mPID)
+		return NULL;
+	return aItem.hwnd;
+}
+
+
+
+struct WindowSnapshotBuilder // Used by Take() and EnumAdd().
+{
+	WindowSnapshot *snapshot;
+	int item_count_max;
+	size_t text_length, text_size;
+	bool failed;
+};
+
+WindowSnapshot *WindowSnapshot::Take(DWORD aID, bool aAllWindows)
+// Returns a new snapshot, or NULL if there's insufficient memory.
+{
+	WindowSnapshot *snapshot;
+	if (   !(snapshot = (WindowSnapshot *)malloc(sizeof(WindowSnapshot)))   )
+		return NULL;
+	snapshot->mID = aID;
+	snapshot->mTick = GetTickCount();
+	snapshot->mForeground = GetForegroundWindow();
+	snapshot->mHasAllWindows = aAllWindows;
+	snapshot->mItem = NULL;
+	snapshot->mItemCount = 0;
+	snapshot->mText = NULL;
+	WindowSnapshotBuilder builder = {snapshot, 0, 0, 0, false};
+	if (aAllWindows)
+		EnumWindows(EnumAdd, (LPARAM)&builder);
+	else if (snapshot->mForeground)
+		EnumAdd(snapshot->mForeground, (LPARAM)&builder);
+	if (builder.failed)
+	{
+		Delete(snapshot);
+		return NULL;
+	}
+	// Now that mText won't be moved by realloc() any more, convert each item's offsets into pointers:
+	for (int i = 0; i < snapshot->mItemCount; ++i)
+	{
+		WindowSnapshotItem &item = snapshot->mItem[i];
+		item.title = snapshot->mText + (size_t)item.title;
+		item.class_name = snapshot->mText + (size_t)item.class_name;
+	}
+	return snapshot;
+}
+
+
+
+BOOL CALLBACK WindowSnapshot::EnumAdd(HWND aWnd, LPARAM lParam)
+{
+	WindowSnapshotBuilder &builder = *(WindowSnapshotBuilder *)lParam;
+	WindowSnapshot &snapshot = *builder.snapshot;
+	char title[WINDOW_TEXT_SIZE], class_name[WINDOW_CLASS_SIZE];
+	int title_length = GetWindowText(aWnd, title, sizeof(title)); // Failure or blank title is okay.
+	int class_length = GetClassName(aWnd, class_name, sizeof(class_name));
+	if (!title_length)
+		*title = '\0';
+	if (!class_length)
+		*class_name = '\0';
+
+	if (snapshot.mItemCount == builder.item_count_max)
+	{
+		int new_max = builder.item_count_max ? builder.item_count_max * 2 : 256;
+		WindowSnapshotItem *new_item;
+		if (   !(new_item = (WindowSnapshotItem *)realloc(snapshot.mItem, new_max * sizeof(WindowSnapshotItem)))   )
+		{
+			builder.failed = true;
+			return FALSE;
+		}
+		snapshot.mItem = new_item;
+		builder.item_count_max = new_max;
+	}
+	size_t space_needed = title_length + class_length + 2; // +2 for the zero terminators.
+	if (builder.text_length + space_needed > builder.text_size)
+	{
+		size_t new_size = builder.text_size ? builder.text_size * 2 : 16384;
+		if (new_size < builder.text_length + space_needed)
+			new_size = builder.text_length + space_needed;
+		char *new_text;
+		if (   !(new_text = (char *)realloc(snapshot.mText, new_size))   )
+		{
+			builder.failed = true;
+			return FALSE;
+		}
+		snapshot.mText = new_text;
+		builder.text_size = new_size;
+	}
+
+	WindowSnapshotItem &item = snapshot.mItem[snapshot.mItemCount++];
+	item.hwnd = aWnd;
+	GetWindowThreadProcessId(aWnd, &item.pid);
+	item.is_visible = IsWindowVisible(aWnd);
+	// Store offsets rather than pointers since mText might be moved by realloc() (see Take()):
+	item.title = (char *)builder.text_length;
+	memcpy(snapshot.mText + builder.text_length, title, title_length + 1);
+	builder.text_length += title_length + 1;
+	item.class_name = (char *)builder.text_length;
+	memcpy(snapshot.mText + builder.text_length, class_name, class_length + 1);
+	builder.text_length += class_length + 1;
+	return TRUE; // Continue enumerating.
+}
+
+
+
+void WindowSnapshot::Delete(WindowSnapshot *aSnapshot)
+{
+	if (!aSnapshot)
+		return;
+	free(aSnapshot->mItem);
+	free(aSnapshot->mText);
+	free(aSnapshot);
+}
@@ -150,6 +150,75 @@ public:
 
 
 
+struct WindowCriteria
+// A WinTitle and WinText that have been parsed once in advance so that they can be matched against each
+// window in a WindowSnapshot without being parsed again.  Used by hotkey criteria (#IfWin), which are
+// evaluated far more often than they change.
+{
+	DWORD mCriteria;        // Which of CRITERION_TITLE, CRITERION_PID and CRITERION_CLASS are in effect.
+	char *mTitle, *mClass;  // "" when not in effect.
+	size_t mTitleLength;
+	DWORD mPID;
+	bool mNeedsSearch;      // True if the criteria include something a snapshot can't answer (see ParseWindowCriteria).
+};
+
+ResultType ParseWindowCriteria(WindowCriteria &aCriteria, char *aTitle, char *aText);
+
+
+
+struct WindowSnapshotItem
+{
+	HWND hwnd;
+	DWORD pid;
+	bool is_visible;
+	char *title, *class_name;
+};
+
+class WindowSnapshot
+// A copy of the attributes of the top-level windows (title, class, PID and visibility) that is shared by
+// all callers of FindMatch(), which spares each hotkey criterion from querying every window itself.
+// A snapshot is discarded whenever a WinEvent indicates that a window was created, destroyed, shown,
+// hidden, renamed or activated, and also once it's older than WINDOW_SNAPSHOT_MAX_AGE in case an event
+// was missed or isn't reported (for example, while the main thread is too busy to receive events).
+// For #IfWinActive, it's also discarded as soon as the foreground window differs from the snapshot's.
+// Both the hook thread and the main thread use snapshots, so the current one is swapped in and out
+// under a lock.  The lock is never held while windows are queried, since querying a window of our own
+// process sends it a message, which could deadlock if its thread were waiting for the lock.
+{
+private:
+	DWORD mID;          // The value of sID when this snapshot was taken.
+	DWORD mTick;        // When this snapshot was taken.
+	HWND mForeground;
+	bool mHasAllWindows; // False if only the foreground window was fetched.
+	WindowSnapshotItem *mItem; // In Z-order, like EnumWindows().
+	int mItemCount;
+	char *mText;        // Holds the title and class name of every item.
+
+	static volatile LONG sID;
+	static WindowSnapshot *sCurrent;
+	static CRITICAL_SECTION sCritical;
+	#define WINDOW_SNAPSHOT_HOOK_COUNT 3
+	static HWINEVENTHOOK sEventHook[WINDOW_SNAPSHOT_HOOK_COUNT];
+
+	static WindowSnapshot *Take(DWORD aID, bool aAllWindows);
+	static BOOL CALLBACK EnumAdd(HWND aWnd, LPARAM lParam);
+	static void CALLBACK EventProc(HWINEVENTHOOK aHook, DWORD aEvent, HWND aWnd, LONG aObject, LONG aChild
+		, DWORD aEventThread, DWORD aEventTime);
+	static void Delete(WindowSnapshot *aSnapshot);
+	static HWND IsMatch(WindowSnapshotItem &aItem, WindowCriteria &aCriteria, global_struct &aSettings);
+
+public:
+	#define WINDOW_SNAPSHOT_MAX_AGE 250 // Milliseconds.
+	static void Init() {InitializeCriticalSection(&sCritical);}
+	static void StartWatching();
+	static void StopWatching();
+	static void Invalidate() {InterlockedIncrement((LPLONG)&sID);}
+	static DWORD GetID(bool aAllWindows, bool aCheckForeground);
+	static HWND FindMatch(WindowCriteria &aCriteria, bool aActiveOnly, global_struct &aSettings, DWORD &aSnapshotID);
+};
+
+
+
 struct control_list_type
 {
 	// For something this simple, a macro is probably a lot less overhead that making this struct